@@ -1,38 +1,103 @@
 #pragma once
 
 #include "assimp_model_loading.h"
-
-void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+#include "profiler.h"
+#include "mesh_cache.h"
+#include "obj_loader.h"
+#include "gltf_loader.h"
+#include "mesh_optimization.h"
+#include "mesh_simplification.h"
+#include "vertex_compression.h"
+#include "buffer_management.h"
+#include "job_system.h"
+#include "texture_streaming.h"
+#include <assimp/cfileio.h>
+
+// Texture types read from the materials, and the Material members they fill
+static const aiTextureType AssimpTextureTypes[ASSIMP_TEXTURE_SLOT_COUNT] =
+{
+    aiTextureType_DIFFUSE,
+    aiTextureType_EMISSIVE,
+    aiTextureType_SPECULAR,
+    aiTextureType_NORMALS,
+    aiTextureType_HEIGHT,
+};
+
+static u32 Material::* const AssimpTextureSlots[ASSIMP_TEXTURE_SLOT_COUNT] =
+{
+    &Material::albedoTextureIdx,
+    &Material::emissiveTextureIdx,
+    &Material::specularTextureIdx,
+    &Material::normalsTextureIdx,
+    &Material::bumpTextureIdx,
+};
+
+static const TextureUsage AssimpTextureUsages[ASSIMP_TEXTURE_SLOT_COUNT] =
+{
+    TEXTURE_USAGE_COLOR,
+    TEXTURE_USAGE_COLOR,
+    TEXTURE_USAGE_MASK,
+    TEXTURE_USAGE_VECTOR,
+    TEXTURE_USAGE_MASK,
+};
+
+void FillAssimpSubmesh(const aiMesh* mesh, Submesh& submesh)
 {
-    std::vector<float> vertices;
-    std::vector<u32> indices;
+    bool hasTexCoords = mesh->mTextureCoords[0] != nullptr; // does the mesh contain texture coordinates?
+    bool hasTangentSpace = mesh->mTangents != nullptr && mesh->mBitangents != nullptr;
 
-    bool hasTexCoords = false;
-    bool hasTangentSpace = false;
+    // create the vertex format
+    VertexBufferLayout vertexBufferLayout = {};
+    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
+    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) });
+    vertexBufferLayout.stride = 6 * sizeof(float);
+    if (hasTexCoords)
+    {
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, vertexBufferLayout.stride });
+        vertexBufferLayout.stride += 2 * sizeof(float);
+    }
+    if (hasTangentSpace)
+    {
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 3, 3, vertexBufferLayout.stride });
+        vertexBufferLayout.stride += 3 * sizeof(float);
+
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 4, 3, vertexBufferLayout.stride });
+        vertexBufferLayout.stride += 3 * sizeof(float);
+    }
+
+    // size the storage once, so the vertices and indices are written in place
+    // instead of growing the vectors one element at a time
+    submesh.vertexBufferLayout = vertexBufferLayout;
+
+    submesh.vertices.resize((size_t)mesh->mNumVertices * vertexBufferLayout.stride);
+
+    u32 indexCount = 0;
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        indexCount += mesh->mFaces[i].mNumIndices;
+    submesh.indices.resize(indexCount);
 
     // process vertices
+    float* vertices = (float*)submesh.vertices.data();
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
-        vertices.push_back(mesh->mVertices[i].x);
-        vertices.push_back(mesh->mVertices[i].y);
-        vertices.push_back(mesh->mVertices[i].z);
-        vertices.push_back(mesh->mNormals[i].x);
-        vertices.push_back(mesh->mNormals[i].y);
-        vertices.push_back(mesh->mNormals[i].z);
-
-        if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+        *vertices++ = mesh->mVertices[i].x;
+        *vertices++ = mesh->mVertices[i].y;
+        *vertices++ = mesh->mVertices[i].z;
+        *vertices++ = mesh->mNormals[i].x;
+        *vertices++ = mesh->mNormals[i].y;
+        *vertices++ = mesh->mNormals[i].z;
+
+        if (hasTexCoords)
         {
-            hasTexCoords = true;
-            vertices.push_back(mesh->mTextureCoords[0][i].x);
-            vertices.push_back(mesh->mTextureCoords[0][i].y);
+            *vertices++ = mesh->mTextureCoords[0][i].x;
+            *vertices++ = mesh->mTextureCoords[0][i].y;
         }
 
-        if (mesh->mTangents != nullptr && mesh->mBitangents)
+        if (hasTangentSpace)
         {
-            hasTangentSpace = true;
-            vertices.push_back(mesh->mTangents[i].x);
-            vertices.push_back(mesh->mTangents[i].y);
-            vertices.push_back(mesh->mTangents[i].z);
+            *vertices++ = mesh->mTangents[i].x;
+            *vertices++ = mesh->mTangents[i].y;
+            *vertices++ = mesh->mTangents[i].z;
 
             // For some reason ASSIMP gives me the bitangents flipped.
             // Maybe it's my fault, but when I generate my own geometry
@@ -42,53 +107,34 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 bas
             // I think that (even if the documentation says the opposite)
             // it returns a left-handed tangent space matrix.
             // SOLUTION: I invert the components of the bitangent here.
-            vertices.push_back(-mesh->mBitangents[i].x);
-            vertices.push_back(-mesh->mBitangents[i].y);
-            vertices.push_back(-mesh->mBitangents[i].z);
+            *vertices++ = -mesh->mBitangents[i].x;
+            *vertices++ = -mesh->mBitangents[i].y;
+            *vertices++ = -mesh->mBitangents[i].z;
         }
     }
 
     // process indices
+    u32* indices = submesh.indices.data();
     for (unsigned int i = 0; i < mesh->mNumFaces; i++)
     {
-        aiFace face = mesh->mFaces[i];
+        const aiFace& face = mesh->mFaces[i];
         for (unsigned int j = 0; j < face.mNumIndices; j++)
         {
-            indices.push_back(face.mIndices[j]);
+            *indices++ = face.mIndices[j];
         }
     }
+}
+
+void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+{
+    myMesh->submeshes.push_back(Submesh{});
+    FillAssimpSubmesh(mesh, myMesh->submeshes.back());
 
     // store the proper (previously proceessed) material for this mesh
     submeshMaterialIndices.push_back(baseMeshMaterialIndex + mesh->mMaterialIndex);
-
-    // create the vertex format
-    VertexBufferLayout vertexBufferLayout = {};
-    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
-    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) });
-    vertexBufferLayout.stride = 6 * sizeof(float);
-    if (hasTexCoords)
-    {
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, vertexBufferLayout.stride });
-        vertexBufferLayout.stride += 2 * sizeof(float);
-    }
-    if (hasTangentSpace)
-    {
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 3, 3, vertexBufferLayout.stride });
-        vertexBufferLayout.stride += 3 * sizeof(float);
-
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 4, 3, vertexBufferLayout.stride });
-        vertexBufferLayout.stride += 3 * sizeof(float);
-    }
-
-    // add the submesh into the mesh
-    Submesh submesh = {};
-    submesh.vertexBufferLayout = vertexBufferLayout;
-    submesh.vertices.swap(vertices);
-    submesh.indices.swap(indices);
-    myMesh->submeshes.push_back(submesh);
 }
 
-void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory)
+void ReadAssimpMaterial(const aiMaterial* material, Material& myMaterial, std::string* texturePaths, String directory)
 {
     aiString name;
     aiColor3D diffuseColor;
@@ -106,111 +152,244 @@ void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial,
     myMaterial.emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
     myMaterial.smoothness = shininess / 256.0f;
 
+    // texture paths only live until they are copied
+    Arena* scratch = GetThreadArena();
+    TempArenaScope tempScope(scratch);
+
     aiString aiFilename;
-    if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+    for (u32 slot = 0; slot < ASSIMP_TEXTURE_SLOT_COUNT; ++slot)
     {
-        material->GetTexture(aiTextureType_DIFFUSE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.albedoTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
-    {
-        material->GetTexture(aiTextureType_EMISSIVE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.emissiveTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
-    {
-        material->GetTexture(aiTextureType_SPECULAR, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.specularTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
-    {
-        material->GetTexture(aiTextureType_NORMALS, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.normalsTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
-    {
-        material->GetTexture(aiTextureType_HEIGHT, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.bumpTextureIdx = LoadTexture2D(app, filepath.str);
+        if (material->GetTextureCount(AssimpTextureTypes[slot]) > 0)
+        {
+            material->GetTexture(AssimpTextureTypes[slot], 0, &aiFilename);
+            String filename = MakeString(aiFilename.C_Str(), scratch);
+            String filepath = MakePath(directory, filename, scratch);
+            texturePaths[slot] = filepath.str;
+        }
     }
 
     //myMaterial.createNormalFromBump();
 }
 
-void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory)
+{
+    std::string texturePaths[ASSIMP_TEXTURE_SLOT_COUNT];
+    ReadAssimpMaterial(material, myMaterial, texturePaths, directory);
+
+    for (u32 slot = 0; slot < ASSIMP_TEXTURE_SLOT_COUNT; ++slot)
+        if (!texturePaths[slot].empty())
+            myMaterial.*AssimpTextureSlots[slot] = RequestTexture2D(app, texturePaths[slot].c_str(), AssimpTextureUsages[slot]);
+}
+
+// Same order as the recursive walk used to have, the submeshes and their materials come out
+// in the same order
+void CollectAssimpMeshes(const aiScene* scene, const aiNode* node, std::vector<const aiMesh*>& meshes)
 {
     // process all the node's meshes (if any)
     for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        ProcessAssimpMesh(scene, mesh, myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+        meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
 
     // then do the same for each of its children
     for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        ProcessAssimpNode(scene, node->mChildren[i], myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+        CollectAssimpMeshes(scene, node->mChildren[i], meshes);
     }
 }
 
-u32 LoadModel(App* app, const char* filename)
+// Assimp reads the model and the files it references (.mtl, embedded buffers) through these
+// callbacks, which serve the reads from a mapped view of the file instead of stdio. Assimp still
+// copies the contents into its own buffers, but the file is read without buffered I/O syscalls.
+// The paths opened are collected, since they are the dependencies of the cooked mesh.
+struct MappedAssimpFile
+{
+    FileView view;
+    u64      cursor;
+};
+
+size_t MappedAssimpFileRead(aiFile* file, char* buffer, size_t size, size_t count)
 {
-    const aiScene* scene = aiImportFile(filename,
-        aiProcess_Triangulate |
-        aiProcess_GenSmoothNormals |
-        aiProcess_CalcTangentSpace |
-        aiProcess_JoinIdenticalVertices |
-        aiProcess_PreTransformVertices |
-        aiProcess_ImproveCacheLocality |
-        aiProcess_OptimizeMeshes |
-        aiProcess_SortByPType);
+    MappedAssimpFile* mapped = (MappedAssimpFile*)file->UserData;
+    if (size == 0)
+        return 0;
+
+    u64 available = mapped->view.size - mapped->cursor;
+    size_t items = (size_t)std::min<u64>(count, available / size);
+    memcpy(buffer, mapped->view.data + mapped->cursor, items * size);
+    mapped->cursor += items * size;
+    return items;
+}
+
+// Files are opened read-only, nothing is ever written nor flushed
+size_t MappedAssimpFileWrite(aiFile*, const char*, size_t, size_t)
+{
+    return 0;
+}
+
+size_t MappedAssimpFileTell(aiFile* file)
+{
+    return (size_t)((MappedAssimpFile*)file->UserData)->cursor;
+}
+
+size_t MappedAssimpFileSize(aiFile* file)
+{
+    return (size_t)((MappedAssimpFile*)file->UserData)->view.size;
+}
+
+void MappedAssimpFileFlush(aiFile*)
+{
+}
+
+aiReturn MappedAssimpFileSeek(aiFile* file, size_t offset, aiOrigin origin)
+{
+    MappedAssimpFile* mapped = (MappedAssimpFile*)file->UserData;
+
+    u64 position = offset;
+    if (origin == aiOrigin_CUR)
+        position = mapped->cursor + offset;
+    else if (origin == aiOrigin_END)
+        position = mapped->view.size - offset;
+
+    if (position > mapped->view.size)
+        return aiReturn_FAILURE;
+    mapped->cursor = position;
+    return aiReturn_SUCCESS;
+}
+
+aiFile* MappedAssimpFileOpen(aiFileIO* io, const char* filepath, const char* mode)
+{
+    if (strchr(mode, 'w') || strchr(mode, 'a'))
+        return NULL;
+
+    FileView view = MapFile(filepath);
+    if (!view.data)
+        return NULL;
+
+    std::vector<std::string>* openedFiles = (std::vector<std::string>*)io->UserData;
+    if (openedFiles && std::find(openedFiles->begin(), openedFiles->end(), filepath) == openedFiles->end())
+        openedFiles->push_back(filepath);
+
+    MappedAssimpFile* mapped = new MappedAssimpFile{ view, 0 };
+    aiFile* file = new aiFile{};
+    file->ReadProc = MappedAssimpFileRead;
+    file->WriteProc = MappedAssimpFileWrite;
+    file->TellProc = MappedAssimpFileTell;
+    file->FileSizeProc = MappedAssimpFileSize;
+    file->SeekProc = MappedAssimpFileSeek;
+    file->FlushProc = MappedAssimpFileFlush;
+    file->UserData = (aiUserData)mapped;
+    return file;
+}
+
+void MappedAssimpFileClose(aiFileIO*, aiFile* file)
+{
+    MappedAssimpFile* mapped = (MappedAssimpFile*)file->UserData;
+    UnmapFile(mapped->view);
+    delete mapped;
+    delete file;
+}
+
+const aiScene* ImportAssimpScene(const char* filename, std::vector<std::string>* openedFiles)
+{
+    aiFileIO fileIO = { MappedAssimpFileOpen, MappedAssimpFileClose, (aiUserData)openedFiles };
+
+    const aiScene* scene = aiImportFileEx(filename, ASSIMP_IMPORT_FLAGS, &fileIO);
 
     if (!scene)
     {
-        ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
-        return UINT32_MAX;
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_ASSETS, "Error loading mesh %s: %s", filename, aiGetErrorString());
     }
+    return scene;
+}
+
+struct AssimpSubmeshJob
+{
+    const aiMesh* mesh;
+    Submesh*      submesh;
+};
+
+void FillAssimpSubmeshJob(void* data)
+{
+    AssimpSubmeshJob* job = (AssimpSubmeshJob*)data;
+    FillAssimpSubmesh(job->mesh, *job->submesh);
+}
 
-    app->meshes.push_back(Mesh{});
-    Mesh& mesh = app->meshes.back();
-    u32 meshIdx = (u32)app->meshes.size() - 1u;
+struct AssimpMaterialReading
+{
+    const aiScene* scene;
+    Material*      materials;
+    std::string*   texturePaths; // ASSIMP_TEXTURE_SLOT_COUNT per material
+    String         directory;
+};
 
-    app->models.push_back(Model{});
-    Model& model = app->models.back();
-    model.meshIdx = meshIdx;
-    u32 modelIdx = (u32)app->models.size() - 1u;
+void ReadAssimpMaterialRange(void* data, u32 begin, u32 end)
+{
+    AssimpMaterialReading* reading = (AssimpMaterialReading*)data;
+    for (u32 i = begin; i < end; ++i)
+        ReadAssimpMaterial(reading->scene->mMaterials[i], reading->materials[i], reading->texturePaths + i * ASSIMP_TEXTURE_SLOT_COUNT, reading->directory);
+}
 
-    String directory = GetDirectoryPart(MakeString(filename));
+void ProcessAssimpScene(App* app, const aiScene* scene, const char* filename, Mesh* myMesh, std::vector<u32>& submeshMaterialIndices)
+{
+    PROFILE_FUNCTION();
+
+    Arena* scratch = GetThreadArena();
+    TempArenaScope tempScope(scratch);
+    String directory = GetDirectoryPart(MakeString(filename, scratch), scratch);
+
+    // Every mesh of the node tree becomes a submesh. Their storage is allocated up front, so
+    // the workers fill them in place while this thread takes care of the materials.
+    std::vector<const aiMesh*> meshes;
+    CollectAssimpMeshes(scene, scene->mRootNode, meshes);
 
-    // Create a list of materials
     u32 baseMeshMaterialIndex = (u32)app->materials.size();
-    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    u32 firstSubmesh = (u32)myMesh->submeshes.size();
+    myMesh->submeshes.resize(firstSubmesh + meshes.size());
+
+    std::vector<AssimpSubmeshJob> submeshJobs(meshes.size());
+    std::vector<JobDecl> jobs(meshes.size());
+    for (u32 i = 0; i < meshes.size(); ++i)
     {
-        app->materials.push_back(Material{});
-        Material& material = app->materials.back();
-        ProcessAssimpMaterial(app, scene->mMaterials[i], material, directory);
+        submeshJobs[i] = AssimpSubmeshJob{ meshes[i], &myMesh->submeshes[firstSubmesh + i] };
+        jobs[i] = JobDecl{ FillAssimpSubmeshJob, &submeshJobs[i] };
+        submeshMaterialIndices.push_back(baseMeshMaterialIndex + meshes[i]->mMaterialIndex);
     }
 
-    ProcessAssimpNode(scene, scene->mRootNode, &mesh, baseMeshMaterialIndex, model.materialIdx);
+    JobCounter submeshCounter;
+    RunJobs(jobs.data(), (u32)jobs.size(), &submeshCounter);
 
-    aiReleaseImport(scene);
+    // The material properties are read in parallel, and their textures stream in while the
+    // model is drawn with placeholders
+    std::vector<Material> materials(scene->mNumMaterials);
+    std::vector<std::string> texturePaths(scene->mNumMaterials * ASSIMP_TEXTURE_SLOT_COUNT);
+    AssimpMaterialReading reading = { scene, materials.data(), texturePaths.data(), directory };
+    ParallelFor(scene->mNumMaterials, 1, ReadAssimpMaterialRange, &reading);
 
+    for (u32 i = 0; i < scene->mNumMaterials; ++i)
+    {
+        for (u32 slot = 0; slot < ASSIMP_TEXTURE_SLOT_COUNT; ++slot)
+        {
+            u32 texture = i * ASSIMP_TEXTURE_SLOT_COUNT + slot;
+            if (!texturePaths[texture].empty())
+                materials[i].*AssimpTextureSlots[slot] = RequestTexture2D(app, texturePaths[texture].c_str(), AssimpTextureUsages[slot]);
+        }
+        app->materials.push_back(materials[i]);
+    }
+
+    WaitForCounter(&submeshCounter);
+}
+
+void UploadMeshBuffers(Mesh& mesh)
+{
+    // The submeshes start 4 byte aligned, 16-bit index ranges can leave a gap before the next one
     u32 vertexBufferSize = 0;
     u32 indexBufferSize = 0;
 
     for (u32 i = 0; i < mesh.submeshes.size(); ++i)
     {
-        vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-        indexBufferSize += mesh.submeshes[i].indices.size() * sizeof(u32);
+        vertexBufferSize = Align(vertexBufferSize, 4) + (u32)mesh.submeshes[i].vertices.size();
+        indexBufferSize = Align(indexBufferSize, 4) + (u32)mesh.submeshes[i].indices.size() * GetIndexSize(mesh.submeshes[i].indexType);
     }
 
     glGenBuffers(1, &mesh.vertexBufferHandle);
@@ -223,24 +402,124 @@ u32 LoadModel(App* app, const char* filename)
 
     u32 indicesOffset = 0;
     u32 verticesOffset = 0;
+    std::vector<u8> indicesData;
 
     for (u32 i = 0; i < mesh.submeshes.size(); ++i)
     {
-        const void* verticesData = mesh.submeshes[i].vertices.data();
-        const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-        glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-        mesh.submeshes[i].vertexOffset = verticesOffset;
+        Submesh& submesh = mesh.submeshes[i];
+        const u32 verticesSize = (u32)submesh.vertices.size();
+        verticesOffset = Align(verticesOffset, 4);
+        glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, submesh.vertices.data());
+        submesh.vertexOffset = verticesOffset;
         verticesOffset += verticesSize;
 
-        const void* indicesData = mesh.submeshes[i].indices.data();
-        const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-        mesh.submeshes[i].indexOffset = indicesOffset;
+        const u32 indicesSize = (u32)submesh.indices.size() * GetIndexSize(submesh.indexType);
+        indicesData.resize(indicesSize);
+        PackSubmeshIndices(submesh, indicesData.data());
+        indicesOffset = Align(indicesOffset, 4);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData.data());
+        submesh.indexOffset = indicesOffset;
+        submesh.indexCount = submesh.lodCount > 0 ? submesh.lods[0].indexCount : (u32)submesh.indices.size();
         indicesOffset += indicesSize;
     }
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DeleteMeshBuffers(Mesh& mesh)
+{
+    for (Submesh& submesh : mesh.submeshes)
+        for (Vao& vao : submesh.vaos)
+            glDeleteVertexArrays(1, &vao.handle);
+
+    glDeleteBuffers(1, &mesh.vertexBufferHandle);
+    glDeleteBuffers(1, &mesh.indexBufferHandle);
+}
+
+bool ImportModel(App* app, const char* filename, Mesh& mesh, std::vector<u32>& submeshMaterialIndices)
+{
+    // Binary glTF files are uploaded straight from the file, which is as fast as the cooked
+    // mesh, so they are not cooked
+    if (IsGlbFile(filename) && LoadGlbModel(app, filename, mesh, submeshMaterialIndices))
+        return true;
+
+    std::vector<std::string> dependencies;
+    u32 baseMaterialIndex = (u32)app->materials.size();
+
+    // OBJ files go through the native importer, everything else (and the OBJ files it can't
+    // handle) through Assimp
+    bool imported = IsObjFile(filename) && LoadObjModel(app, filename, mesh, submeshMaterialIndices, dependencies);
+    if (!imported)
+    {
+        dependencies.clear();
+        const aiScene* scene = ImportAssimpScene(filename, &dependencies);
+        if (!scene)
+            return false;
+
+        ProcessAssimpScene(app, scene, filename, &mesh, submeshMaterialIndices);
+        aiReleaseImport(scene);
+    }
 
-    return modelIdx;
-}
\ No newline at end of file
+    OptimizeMesh(mesh, filename);
+    ComputeMeshBounds(mesh);
+    GenerateMeshLods(mesh, filename);
+    u64 savedBytes = CompressMeshVertices(mesh);
+    LOG_MESSAGE(LOG_LEVEL_DEBUG, LOG_ASSETS, "Compressed the vertices of %s, %llu bytes saved", filename, savedBytes);
+
+    UploadMeshBuffers(mesh);
+    WriteCookedMesh(app, filename, mesh, submeshMaterialIndices, baseMaterialIndex, (u32)app->materials.size() - baseMaterialIndex, dependencies);
+    return true;
+}
+
+u32 LoadModel(App* app, const char* filename)
+{
+    PROFILE_FUNCTION();
+
+    Mesh mesh = {};
+    Model model = {};
+    model.filepath = MakeString(filename, &GlobalLevelArena).str;
+
+    // The importers only run the first time, or after the model or its materials change
+    if (!LoadCookedMesh(app, filename, mesh, model.materialIdx))
+    {
+        if (!ImportModel(app, filename, mesh, model.materialIdx))
+            return UINT32_MAX;
+    }
+
+    model.meshIdx = (u32)app->meshes.size();
+    app->meshes.push_back(std::move(mesh));
+    app->models.push_back(model);
+
+    return (u32)app->models.size() - 1u;
+}
+
+bool ReloadModel(App* app, u32 modelIdx)
+{
+    PROFILE_FUNCTION();
+    const char* filepath = app->models[modelIdx].filepath;
+
+    // Import everything first, a file that fails to load leaves the previous version in place
+    Mesh newMesh = {};
+    std::vector<u32> newMaterialIdx;
+    if (!ImportModel(app, filepath, newMesh, newMaterialIdx))
+        return false;
+
+    Model& model = app->models[modelIdx];
+    Mesh& mesh = app->meshes[model.meshIdx];
+    DeleteMeshBuffers(mesh);
+    mesh = std::move(newMesh);
+
+    // The materials of the previous version stay in app->materials, since the indices of the
+    // following ones can't change. Models sharing the mesh (stress scene variants) keep their
+    // own materials unless the submeshes changed.
+    for (Model& other : app->models)
+    {
+        if (&other != &model && other.meshIdx == model.meshIdx && other.materialIdx.size() != newMaterialIdx.size())
+            other.materialIdx = newMaterialIdx;
+    }
+    model.materialIdx = std::move(newMaterialIdx);
+
+    LOG_MESSAGE(LOG_LEVEL_INFO, LOG_ASSETS, "Reloaded model %s", filepath);
+    return true;
+}
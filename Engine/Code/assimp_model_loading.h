@@ -5,10 +5,67 @@
 #include <assimp/postprocess.h>
 #include "engine.h"
 
+// Post-processing of every imported model. Cooked meshes store them, so changing these
+// invalidates the cooked files. The triangle order is optimized by OptimizeMesh, for every
+// importer, instead of aiProcess_ImproveCacheLocality.
+#define ASSIMP_IMPORT_FLAGS             \
+    (aiProcess_Triangulate |            \
+     aiProcess_GenSmoothNormals |       \
+     aiProcess_CalcTangentSpace |       \
+     aiProcess_JoinIdenticalVertices |  \
+     aiProcess_PreTransformVertices |   \
+     aiProcess_OptimizeMeshes |         \
+     aiProcess_SortByPType)
+
+// Albedo, emissive, specular, normals and bump
+#define ASSIMP_TEXTURE_SLOT_COUNT 5
+
+/**
+ * Packs the vertices and flattens the indices of a mesh into the submesh. It only reads the
+ * mesh, so several submeshes can be filled at the same time on worker threads.
+ */
+void FillAssimpSubmesh(const aiMesh* mesh, Submesh& submesh);
+
 void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices);
 
+/**
+ * Reads the properties of a material and the paths of its ASSIMP_TEXTURE_SLOT_COUNT textures
+ * (empty when it has none), without loading them. Safe to call from worker threads.
+ */
+void ReadAssimpMaterial(const aiMaterial* material, Material& myMaterial, std::string* texturePaths, String directory);
+
 void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory);
 
-void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices);
+void CollectAssimpMeshes(const aiScene* scene, const aiNode* node, std::vector<const aiMesh*>& meshes);
+
+/**
+ * Imports a model file. The paths of the files read by Assimp (the model and the ones it
+ * references, like .mtl files) are appended to openedFiles when given.
+ */
+const aiScene* ImportAssimpScene(const char* filename, std::vector<std::string>* openedFiles = NULL);
+
+/**
+ * Appends the meshes of the scene as submeshes and its materials to the app. The submeshes
+ * are filled on worker threads while the materials are read, and their textures start
+ * streaming in.
+ */
+void ProcessAssimpScene(App* app, const aiScene* scene, const char* filename, Mesh* myMesh, std::vector<u32>& submeshMaterialIndices);
+
+void UploadMeshBuffers(Mesh& mesh);
+
+void DeleteMeshBuffers(Mesh& mesh);
+
+/**
+ * Imports a model file (with the native glTF or OBJ importers when possible), optimizes its
+ * submeshes, generates their levels of detail, compresses them, uploads its buffers and writes
+ * its cooked version. Returns false if the file could not be imported.
+ */
+bool ImportModel(App* app, const char* filename, Mesh& mesh, std::vector<u32>& submeshMaterialIndices);
 
 u32 LoadModel(App* app, const char* filename);
+
+/**
+ * Imports the model file again and replaces the mesh in place, so the entities using the model
+ * don't change. Returns false (keeping the previous version) if the file could not be imported.
+ */
+bool ReloadModel(App* app, u32 modelIdx);
@@ -0,0 +1,294 @@
+//
+// benchmark.cpp : Command line benchmarks. See benchmark.h for the list of available runs.
+//
+
+#include "benchmark.h"
+#include "job_system.h"
+#include <algorithm>
+#include <thread>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define JOB_BENCHMARK_REPETITIONS 7
+#define JOB_BENCHMARK_BATCH_SIZE  1024
+
+struct TransformBenchmarkData
+{
+    const Transform* transforms;
+    glm::mat4*       worldMatrices;
+    glm::mat4*       worldViewProjections;
+    glm::mat4        viewProjection;
+};
+
+void TransformBenchmarkRange(void* data, u32 begin, u32 end)
+{
+    TransformBenchmarkData* bench = (TransformBenchmarkData*)data;
+    for (u32 i = begin; i < end; ++i)
+    {
+        bench->worldMatrices[i] = TransformConstructor(bench->transforms[i]);
+        bench->worldViewProjections[i] = bench->viewProjection * bench->worldMatrices[i];
+    }
+}
+
+f64 MedianMilliseconds(std::vector<u64>& samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2] / 1000000.0;
+}
+
+void RunJobSystemBenchmark(u32 elementCount)
+{
+    std::vector<Transform> transforms(elementCount);
+    std::vector<glm::mat4> worldMatrices(elementCount);
+    std::vector<glm::mat4> worldViewProjections(elementCount);
+
+    for (u32 i = 0; i < elementCount; ++i)
+    {
+        f32 t = (f32)i;
+        transforms[i] = Transform(vec3(fmodf(t, 100.0f), fmodf(t * 0.37f, 50.0f), fmodf(t * 0.11f, 100.0f)),
+                                  vec3(fmodf(t * 7.0f, 360.0f), fmodf(t * 3.0f, 360.0f), 0.0f),
+                                  vec3(1.0f + fmodf(t, 3.0f)));
+    }
+
+    TransformBenchmarkData data = {};
+    data.transforms = transforms.data();
+    data.worldMatrices = worldMatrices.data();
+    data.worldViewProjections = worldViewProjections.data();
+    data.viewProjection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f) *
+                          glm::lookAt(vec3(0.0f, 10.0f, 50.0f), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
+
+    // 1, 2, 4, 8... threads, always finishing with all the hardware threads
+    u32 hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<u32> threadCounts;
+    for (u32 count = 1; count < hardwareThreads; count *= 2)
+        threadCounts.push_back(count);
+    threadCounts.push_back(hardwareThreads);
+
+    printf("Job system scaling: %u transform updates, batches of %u, median of %u runs\n",
+           elementCount, JOB_BENCHMARK_BATCH_SIZE, JOB_BENCHMARK_REPETITIONS);
+    printf("%8s %12s %10s %12s\n", "threads", "time (ms)", "speedup", "efficiency");
+
+    f64 singleThreadMs = 0.0;
+    for (u32 threadCount : threadCounts)
+    {
+        if (threadCount > 1)
+            InitJobSystem(threadCount - 1);
+
+        // Warm up caches and wake the workers before measuring
+        ParallelFor(elementCount, JOB_BENCHMARK_BATCH_SIZE, TransformBenchmarkRange, &data);
+
+        std::vector<u64> samples;
+        for (u32 rep = 0; rep < JOB_BENCHMARK_REPETITIONS; ++rep)
+        {
+            u64 start = GetTimeNanoseconds();
+            ParallelFor(elementCount, JOB_BENCHMARK_BATCH_SIZE, TransformBenchmarkRange, &data);
+            samples.push_back(GetTimeNanoseconds() - start);
+        }
+
+        if (threadCount > 1)
+            ShutdownJobSystem();
+
+        f64 ms = MedianMilliseconds(samples);
+        if (threadCount == 1)
+            singleThreadMs = ms;
+
+        f64 speedup = singleThreadMs / ms;
+        printf("%8u %12.3f %9.2fx %11.1f%%\n", threadCount, ms, speedup, 100.0 * speedup / threadCount);
+    }
+}
+
+void AddGpuPassTimings(FrameTimings& timings, const std::vector<GpuZoneResult>& passes)
+{
+    for (const GpuZoneResult& pass : passes)
+    {
+        u32 i = 0;
+        while (i < timings.gpuPasses.size() && strcmp(timings.gpuPasses[i].name, pass.name) != 0) ++i;
+        if (i == timings.gpuPasses.size()) timings.gpuPasses.push_back(GpuPassTiming{ pass.name, 0.0, 0 });
+        timings.gpuPasses[i].totalMs += pass.ms;
+        timings.gpuPasses[i].count++;
+    }
+}
+
+TimingStats ComputeTimingStats(const std::vector<f32>& samples)
+{
+    TimingStats stats = {};
+    stats.samples = (u32)samples.size();
+    if (samples.empty())
+        return stats;
+
+    std::vector<f32> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    f64 total = 0.0;
+    for (f32 ms : sorted)
+        total += ms;
+
+    // Nearest rank percentiles: the smallest sample with at least p of them at or below it. The
+    // tolerance keeps exact ranks (0.95 * 600) from being rounded up by the floating point error
+    auto percentile = [&sorted](f64 p)
+    {
+        size_t rank = (size_t)ceil(p * sorted.size() - 1e-9);
+        return (f64)sorted[rank > 0 ? rank - 1 : 0];
+    };
+    stats.avg = total / sorted.size();
+    stats.p50 = percentile(0.50);
+    stats.p95 = percentile(0.95);
+    stats.p99 = percentile(0.99);
+    stats.max = sorted.back();
+    return stats;
+}
+
+void PrintTimingRow(const char* name, const std::vector<f32>& samples)
+{
+    if (samples.empty())
+    {
+        printf("%-22s %9s\n", name, "n/a");
+        return;
+    }
+
+    TimingStats stats = ComputeTimingStats(samples);
+    printf("%-22s %9.3f %9.3f %9.3f %9.3f %9.3f %8u\n", name, stats.avg, stats.p50, stats.p95, stats.p99, stats.max, stats.samples);
+}
+
+void PrintFrameTimings(const FrameTimings& timings, ivec2 resolution)
+{
+    printf("Headless run: %u frames at %dx%d\n", (u32)timings.cpuMs.size(), resolution.x, resolution.y);
+    printf("%-22s %9s %9s %9s %9s %9s %8s\n", "(ms)", "avg", "p50", "p95", "p99", "max", "samples");
+    PrintTimingRow("CPU frame", timings.cpuMs);
+    PrintTimingRow("  Update", timings.updateMs);
+    PrintTimingRow("  Render", timings.renderMs);
+    PrintTimingRow("GPU frame", timings.gpuMs);
+
+    for (const GpuPassTiming& pass : timings.gpuPasses)
+        printf("  %-20s %9.3f\n", pass.name, pass.totalMs / pass.count);
+}
+
+void WriteStatsJson(FILE* file, const char* name, const std::vector<f32>& samples, bool last = false)
+{
+    TimingStats stats = ComputeTimingStats(samples);
+    fprintf(file, "    \"%s\": { \"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"samples\": %u }%s\n",
+            name, stats.avg, stats.p50, stats.p95, stats.p99, stats.max, stats.samples, last ? "" : ",");
+}
+
+bool WriteFrameTimingsJson(const FrameTimings& timings, ivec2 resolution, const char* filepath)
+{
+    FILE* file = fopen(filepath, "w");
+    if (!file)
+    {
+        ELOG("Could not open %s to write the frame timings", filepath);
+        return false;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"resolution\": [%d, %d],\n", resolution.x, resolution.y);
+    fprintf(file, "  \"frames\": %u,\n", (u32)timings.cpuMs.size());
+    fprintf(file, "  \"timings\": {\n");
+    WriteStatsJson(file, "cpu", timings.cpuMs);
+    WriteStatsJson(file, "update", timings.updateMs);
+    WriteStatsJson(file, "render", timings.renderMs);
+    WriteStatsJson(file, "gpu", timings.gpuMs, true);
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"gpuPasses\": {\n");
+    for (u32 i = 0; i < timings.gpuPasses.size(); ++i)
+    {
+        const GpuPassTiming& pass = timings.gpuPasses[i];
+        fprintf(file, "    \"%s\": %.4f%s\n", pass.name, pass.totalMs / pass.count, i + 1 < timings.gpuPasses.size() ? "," : "");
+    }
+    fprintf(file, "  }\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+    return true;
+}
+
+bool WriteFrameTimingsCsv(const FrameTimings& timings, const char* filepath)
+{
+    FILE* file = fopen(filepath, "w");
+    if (!file)
+    {
+        ELOG("Could not open %s to write the frame timings", filepath);
+        return false;
+    }
+
+    const char* names[] = { "cpu", "update", "render", "gpu" };
+    const std::vector<f32>* samples[] = { &timings.cpuMs, &timings.updateMs, &timings.renderMs, &timings.gpuMs };
+
+    fprintf(file, "measurement,avg,p50,p95,p99,max,samples\n");
+    for (u32 i = 0; i < ARRAY_COUNT(names); ++i)
+    {
+        TimingStats stats = ComputeTimingStats(*samples[i]);
+        fprintf(file, "%s,%.4f,%.4f,%.4f,%.4f,%.4f,%u\n", names[i], stats.avg, stats.p50, stats.p95, stats.p99, stats.max, stats.samples);
+    }
+    for (const GpuPassTiming& pass : timings.gpuPasses)
+        fprintf(file, "gpu/%s,%.4f,,,,,%u\n", pass.name, pass.totalMs / pass.count, pass.count);
+
+    fclose(file);
+    return true;
+}
+
+// Reads back one of the "name": { ... } objects written by WriteStatsJson
+bool ReadStatsJson(const char* json, const char* name, TimingStats& stats)
+{
+    std::string key = std::string("\"") + name + "\":";
+    const char* object = strstr(json, key.c_str());
+    if (!object)
+        return false;
+
+    const char* fields[] = { "\"avg\":", "\"p50\":", "\"p95\":", "\"p99\":", "\"max\":" };
+    f64* values[] = { &stats.avg, &stats.p50, &stats.p95, &stats.p99, &stats.max };
+    const char* end = strchr(object, '}');
+    for (u32 i = 0; i < ARRAY_COUNT(fields); ++i)
+    {
+        const char* field = strstr(object, fields[i]);
+        if (!field || (end && field > end))
+            return false;
+        *values[i] = atof(field + strlen(fields[i]));
+    }
+    return true;
+}
+
+bool CompareFrameTimingsWithBaseline(const FrameTimings& timings, const char* baselinePath, f32 thresholdPercent)
+{
+    Arena* scratch = GetThreadArena();
+    TempArenaScope tempScope(scratch);
+    String baseline = ReadTextFile(baselinePath, scratch);
+    if (!baseline.str)
+        return false;
+
+    const char* names[] = { "cpu", "gpu" };
+    const std::vector<f32>* samples[] = { &timings.cpuMs, &timings.gpuMs };
+
+    printf("Comparison with %s (threshold %.1f%%)\n", baselinePath, thresholdPercent);
+    printf("%-10s %9s %9s %9s\n", "(ms)", "baseline", "current", "change");
+
+    bool passed = true;
+    for (u32 i = 0; i < ARRAY_COUNT(names); ++i)
+    {
+        TimingStats base = {};
+        if (!ReadStatsJson(baseline.str, names[i], base))
+        {
+            ELOG("Baseline %s has no %s timings", baselinePath, names[i]);
+            passed = false;
+            continue;
+        }
+
+        // Measurements the current run could not take (e.g. no GPU results) are not compared
+        TimingStats current = ComputeTimingStats(*samples[i]);
+        if (current.samples == 0)
+            continue;
+
+        const char* statNames[] = { "avg", "p50", "p95", "p99" };
+        f64 baseValues[] = { base.avg, base.p50, base.p95, base.p99 };
+        f64 currentValues[] = { current.avg, current.p50, current.p95, current.p99 };
+        for (u32 s = 0; s < ARRAY_COUNT(statNames); ++s)
+        {
+            f64 change = baseValues[s] > 0.0 ? 100.0 * (currentValues[s] - baseValues[s]) / baseValues[s] : 0.0;
+            bool regressed = change > thresholdPercent;
+            printf("%s %-6s %9.3f %9.3f %+8.1f%%%s\n", names[i], statNames[s], baseValues[s], currentValues[s], change,
+                   regressed ? "  REGRESSION" : "");
+            passed = passed && !regressed;
+        }
+    }
+    return passed;
+}
@@ -0,0 +1,69 @@
+//
+// benchmark.h : Performance measurements that run outside the normal editor loop. They are
+// started from the command line and print their results to the standard output.
+//
+
+#pragma once
+
+#include "engine.h"
+#include "gpu_profiler.h"
+
+/**
+ * Measures how the job system scales by running the same batch of transform updates
+ * with 1, 2, 4... worker threads and reporting the speedup against a single thread.
+ */
+void RunJobSystemBenchmark(u32 elementCount);
+
+struct GpuPassTiming
+{
+    const char* name;
+    f64         totalMs;
+    u32         count;
+};
+
+/**
+ * Per frame measurements of a headless run. GPU times arrive a few frames late (see
+ * gpu_profiler.h), so gpuMs may hold fewer samples than the CPU arrays.
+ */
+struct FrameTimings
+{
+    std::vector<f32>            cpuMs;
+    std::vector<f32>            updateMs;
+    std::vector<f32>            renderMs;
+    std::vector<f32>            gpuMs;
+    std::vector<GpuPassTiming>  gpuPasses;
+};
+
+struct TimingStats
+{
+    f64 avg;
+    f64 p50;
+    f64 p95;
+    f64 p99;
+    f64 max;
+    u32 samples;
+};
+
+void AddGpuPassTimings(FrameTimings& timings, const std::vector<GpuZoneResult>& passes);
+
+TimingStats ComputeTimingStats(const std::vector<f32>& samples);
+
+/**
+ * Prints the average, percentiles and maximum of every measurement and the average cost of each pass.
+ */
+void PrintFrameTimings(const FrameTimings& timings, ivec2 resolution);
+
+/**
+ * Writes the same summary as PrintFrameTimings as JSON (the format read back as a baseline)
+ * or as CSV, one row per measurement.
+ */
+bool WriteFrameTimingsJson(const FrameTimings& timings, ivec2 resolution, const char* filepath);
+
+bool WriteFrameTimingsCsv(const FrameTimings& timings, const char* filepath);
+
+/**
+ * Compares the CPU and GPU frame statistics with a JSON file written by a previous run.
+ * Returns false if any average or percentile is slower than the baseline by more than
+ * thresholdPercent, or if the baseline can't be read.
+ */
+bool CompareFrameTimingsWithBaseline(const FrameTimings& timings, const char* baselinePath, f32 thresholdPercent);
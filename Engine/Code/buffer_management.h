@@ -1,17 +1,17 @@
 #pragma once
 #include "engine.h"
 
-bool IsPowerOf2(u32 value)
+inline bool IsPowerOf2(u32 value)
 {
     return value && !(value & (value - 1));
 }
 
-u32 Align(u32 value, u32 alignment)
+inline u32 Align(u32 value, u32 alignment)
 {
     return (value + alignment - 1) & ~(alignment - 1);
 }
 
-Buffer CreateBuffer(u32 size, GLenum type, GLenum usage)
+inline Buffer CreateBuffer(u32 size, GLenum type, GLenum usage)
 {
     Buffer buffer = {};
     buffer.size = size;
@@ -26,34 +26,56 @@ Buffer CreateBuffer(u32 size, GLenum type, GLenum usage)
 }
 
 #define CreateConstantBuffer(size) CreateBuffer(size, GL_UNIFORM_BUFFER, GL_STREAM_DRAW)
+#define CreateStorageBuffer(size) CreateBuffer(size, GL_SHADER_STORAGE_BUFFER, GL_STREAM_DRAW)
 #define CreateStaticVertexBuffer(size) CreateBuffer(size, GL_ARRAY_BUFFER, GL_STATIC_DRAW)
 #define CreateStaticIndexBuffer(size) CreateBuffer(size, GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW)
 
-void BindBuffer(const Buffer& buffer)
+// Grows the buffer (discarding its contents) so it can hold at least the given size
+inline void ReserveBuffer(Buffer& buffer, u32 size, GLenum usage)
+{
+    if (size <= buffer.size)
+        return;
+
+    buffer.size = size + size / 2;
+    glBindBuffer(buffer.type, buffer.handle);
+    glBufferData(buffer.type, buffer.size, NULL, usage);
+    glBindBuffer(buffer.type, 0);
+}
+
+inline void BindBuffer(const Buffer& buffer)
 {
     glBindBuffer(buffer.type, buffer.handle);
 }
 
-void MapBuffer(Buffer& buffer, GLenum access)
+inline void MapBuffer(Buffer& buffer, GLenum access)
 {
     glBindBuffer(buffer.type, buffer.handle);
     buffer.data = (u8*)glMapBuffer(buffer.type, access);
     buffer.head = 0;
 }
 
-void UnmapBuffer(Buffer& buffer)
+// Maps the whole buffer to rewrite it. Its previous storage is orphaned, so this doesn't wait for
+// the draws that still read it
+inline void MapBufferInvalidate(Buffer& buffer)
+{
+    glBindBuffer(buffer.type, buffer.handle);
+    buffer.data = (u8*)glMapBufferRange(buffer.type, 0, buffer.size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    buffer.head = 0;
+}
+
+inline void UnmapBuffer(Buffer& buffer)
 {
     glUnmapBuffer(buffer.type);
     glBindBuffer(buffer.type, 0);
 }
 
-void AlignHead(Buffer& buffer, u32 alignment)
+inline void AlignHead(Buffer& buffer, u32 alignment)
 {
     ASSERT(IsPowerOf2(alignment), "The alignment must be a power of 2");
     buffer.head = Align(buffer.head, alignment);
 }
 
-void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
+inline void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
 {
     ASSERT(buffer.data != NULL, "The buffer must be mapped first");
     AlignHead(buffer, alignment);
@@ -0,0 +1,179 @@
+//
+// camera_path.cpp : Implementation of the scripted camera flythroughs declared in camera_path.h.
+//
+
+#include "camera_path.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+bool LoadCameraPath(CameraPath& path, const char* filepath)
+{
+    path = {};
+
+    Arena* scratch = GetThreadArena();
+    TempArenaScope tempScope(scratch);
+    String text = ReadTextFile(filepath, scratch);
+    if (!text.str)
+        return false;
+
+    u32 lineNumber = 0;
+    char* line = strtok(text.str, "\r\n");
+    while (line)
+    {
+        lineNumber++;
+        while (*line == ' ' || *line == '\t') line++;
+
+        char type[32] = {};
+        char name[64] = {};
+        if (line[0] == '#' || line[0] == '\0')
+        {
+            // Comment or empty line
+        }
+        else if (strncmp(line, "key ", 4) == 0)
+        {
+            CameraKeyframe key = {};
+            if (sscanf(line + 4, "%f %f %f %f %f %f", &key.time, &key.position.x, &key.position.y, &key.position.z,
+                       &key.yaw, &key.pitch) == 6)
+                path.keyframes.push_back(key);
+            else
+                ELOG("%s(%u): expected 'key time x y z yaw pitch'", filepath, lineNumber);
+        }
+        else if (strncmp(line, "light ", 6) == 0 && sscanf(line + 6, "%31s", type) == 1)
+        {
+            Light light;
+            u32 index = (u32)path.lights.size();
+            if (strcmp(type, "point") == 0 &&
+                sscanf(line + 6, "%*s %f %f %f %f %f %f %f %f", &light.position.x, &light.position.y, &light.position.z,
+                       &light.color.r, &light.color.g, &light.color.b, &light.radius, &light.intensity) == 8)
+            {
+                light.type = POINT_LIGHT;
+                light.name = "Point Light " + std::to_string(index);
+                path.lights.push_back(light);
+            }
+            else if (strcmp(type, "directional") == 0 &&
+                     sscanf(line + 6, "%*s %f %f %f %f %f %f %f %f %f %f", &light.position.x, &light.position.y, &light.position.z,
+                            &light.direction.x, &light.direction.y, &light.direction.z,
+                            &light.color.r, &light.color.g, &light.color.b, &light.intensity) == 10)
+            {
+                light.type = DIRECTIONAL_LIGHT;
+                light.name = "Directional Light " + std::to_string(index);
+                path.lights.push_back(light);
+            }
+            else
+                ELOG("%s(%u): invalid light declaration", filepath, lineNumber);
+        }
+        else if (strncmp(line, "entity ", 7) == 0)
+        {
+            Entity entity;
+            Transform& t = entity.transform;
+            f32 scale = 1.0f;
+            if (sscanf(line + 7, "%63s %f %f %f %f %f %f %f", name, &t.position.x, &t.position.y, &t.position.z,
+                       &t.rotation.x, &t.rotation.y, &t.rotation.z, &scale) == 8)
+            {
+                t.scale = vec3(scale);
+                entity.name = std::string(name) + " " + std::to_string(path.entities.size());
+                path.entities.push_back(entity);
+                path.entityModels.push_back(name);
+            }
+            else
+                ELOG("%s(%u): expected 'entity model x y z rx ry rz scale'", filepath, lineNumber);
+        }
+        else
+        {
+            ELOG("%s(%u): unknown declaration", filepath, lineNumber);
+        }
+
+        line = strtok(NULL, "\r\n");
+    }
+
+    if (path.keyframes.empty())
+    {
+        ELOG("Camera path %s has no keyframes", filepath);
+        return false;
+    }
+
+    std::sort(path.keyframes.begin(), path.keyframes.end(),
+              [](const CameraKeyframe& a, const CameraKeyframe& b) { return a.time < b.time; });
+    path.duration = path.keyframes.back().time;
+    return true;
+}
+
+vec3 CatmullRom(const vec3& p0, const vec3& p1, const vec3& p2, const vec3& p3, f32 t)
+{
+    f32 t2 = t * t;
+    f32 t3 = t2 * t;
+    return 0.5f * ((2.0f * p1) + (-p0 + p2) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+                   (-p0 + 3.0f * p1 - 3.0f * p2 + p3) * t3);
+}
+
+void SampleCameraPath(const CameraPath& path, f32 time, Camera& camera)
+{
+    const std::vector<CameraKeyframe>& keys = path.keyframes;
+    ASSERT(!keys.empty(), "Sampling an empty camera path");
+
+    u32 last = (u32)keys.size() - 1;
+    u32 next = 0;
+    while (next < last && keys[next].time <= time) ++next;
+
+    if (time <= keys[0].time || time >= keys[last].time)
+    {
+        const CameraKeyframe& key = time <= keys[0].time ? keys[0] : keys[last];
+        camera.position = key.position;
+        camera.yaw = key.yaw;
+        camera.pitch = key.pitch;
+    }
+    else
+    {
+        u32 prev = next - 1;
+        const CameraKeyframe& a = keys[prev];
+        const CameraKeyframe& b = keys[next];
+        f32 span = b.time - a.time;
+        f32 t = span > 0.0f ? (time - a.time) / span : 0.0f;
+
+        // The end points are repeated so the spline still goes through the first and last keys
+        const vec3& p0 = keys[prev > 0 ? prev - 1 : prev].position;
+        const vec3& p3 = keys[next < last ? next + 1 : next].position;
+        camera.position = CatmullRom(p0, a.position, b.position, p3, t);
+        camera.yaw = a.yaw + (b.yaw - a.yaw) * t;
+        camera.pitch = a.pitch + (b.pitch - a.pitch) * t;
+    }
+
+    ComputeCameraAxisDirection(camera);
+    camera.view = glm::lookAt(camera.position, camera.position + camera.front, camera.up);
+}
+
+void ApplyCameraPathScene(App* app, const CameraPath& path)
+{
+    if (!path.lights.empty())
+        app->lights = path.lights;
+
+    if (path.entities.empty())
+        return;
+
+    // Resolve the model of every entity before replacing the ones of the scene
+    std::vector<Entity> entities;
+    for (u32 i = 0; i < path.entities.size(); ++i)
+    {
+        const std::string& modelName = path.entityModels[i];
+        u32 modelIndex = UINT32_MAX;
+        for (u32 p = 0; p < app->primitiveNames.size() && modelIndex == UINT32_MAX; ++p)
+            if (app->primitiveNames[p] == modelName)
+                modelIndex = app->primitiveIndex[p];
+        for (u32 e = 0; e < app->entities.size() && modelIndex == UINT32_MAX; ++e)
+            if (app->entities[e].name == modelName)
+                modelIndex = app->entities[e].modelIndex;
+
+        if (modelIndex == UINT32_MAX)
+        {
+            ELOG("Camera path entity %s: unknown model %s", path.entities[i].name.c_str(), modelName.c_str());
+            continue;
+        }
+
+        Entity entity = path.entities[i];
+        entity.modelIndex = modelIndex;
+        entity.worldMatrix = TransformConstructor(entity.transform);
+        entities.push_back(entity);
+    }
+    app->entities = entities;
+}
@@ -0,0 +1,56 @@
+//
+// camera_path.h : Scripted camera flythroughs. A path is a list of keyframes over the camera
+// position, yaw and pitch that is sampled at a given time, so runs played back with a fixed
+// timestep always produce the same frames. A path file may also fix the lights and entities of
+// the scene. Example (WorkingDir/flythrough.txt):
+//
+//   # time  position          yaw     pitch
+//   key 0.0   24.4 0.8 45.4   -131.4  12.5
+//   # type         position         color        radius intensity
+//   light point    -4.4 2.1 34.6    1.0 0.4 0.2  10.0   1.0
+//   # type         position         direction        color          intensity
+//   light directional 17.8 27.5 0.0  0.1 0.0 0.2     0.4 0.6 0.7    1.0
+//   # primitive/model  position    rotation (degrees)  scale
+//   entity Cube        0.0 1.0 0.0  0.0 45.0 0.0        2.0
+//   entity Lake        0.0 1.0 0.0  0.0 0.0 0.0         1.0
+//
+
+#pragma once
+
+#include "engine.h"
+
+struct CameraKeyframe
+{
+    f32  time;     // Seconds
+    vec3 position;
+    f32  yaw;      // Degrees, as in Camera
+    f32  pitch;
+};
+
+struct CameraPath
+{
+    std::vector<CameraKeyframe> keyframes;
+    f32                         duration;
+
+    // Scene overrides, applied only when the file declares them
+    std::vector<Light>          lights;
+    std::vector<Entity>         entities;
+    std::vector<std::string>    entityModels; // Primitive or entity name each entity is created from
+};
+
+/**
+ * Parses a path file. Returns false if it can't be read or has no keyframes.
+ */
+bool LoadCameraPath(CameraPath& path, const char* filepath);
+
+/**
+ * Places the camera at the given time of the path. Positions follow a Catmull-Rom spline
+ * through the keyframes while yaw and pitch are interpolated linearly.
+ */
+void SampleCameraPath(const CameraPath& path, f32 time, Camera& camera);
+
+/**
+ * Replaces the lights and entities of the scene with the ones of the path, if it has any.
+ * Entities refer either to a primitive ("Cube", "Sphere"...) or to an entity loaded in Init.
+ */
+void ApplyCameraPathScene(App* app, const CameraPath& path);
@@ -10,11 +10,64 @@
 #include <stb_image.h>
 #include <stb_image_write.h>
 #include <math.h>
+#include <algorithm>
 
 #include "assimp_model_loading.h"
+#include "job_system.h"
+#include "profiler.h"
+#include "gpu_profiler.h"
+#include "stress_scene.h"
+#include "file_watcher.h"
+#include "vertex_compression.h"
+#include "texture_compression.h"
+#include "texture_streaming.h"
+#include "texture_registry.h"
+#include "texture_residency.h"
+#include "texture_pages.h"
 
 #define BINDING(b) b
 
+// Explicit locations of the uniforms that map the quantized positions of a submesh back to
+// model space, in the vertex shaders of shaders.glsl that draw meshes
+#define POSITION_SCALE_LOCATION  20
+#define POSITION_OFFSET_LOCATION 21
+
+// Explicit location of the texture unit of the albedo page of a batch, in the fragment shaders
+// that draw meshes
+#define ALBEDO_PAGE_UNIT_LOCATION 22
+
+// Instanced attribute with the entity and the material of a draw, in the vertex shaders that draw
+// meshes. It reads the binding point of the draw buffer, past the ones of the other attributes
+#define DRAW_ATTRIBUTE_LOCATION 5
+#define DRAW_BUFFER_BINDING     15
+#define DRAW_INITIAL_COUNT      1024
+
+// std430 size of the EntityParams struct in shaders.glsl: world and world-view-projection matrices
+#define ENTITY_STORAGE_STRIDE       (2 * sizeof(glm::mat4))
+#define ENTITY_STORAGE_INITIAL_SIZE (256 * ENTITY_STORAGE_STRIDE)
+#define ENTITY_PARAMS_BATCH_SIZE    256
+
+// Layout of the commands of glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	u32 count;
+	u32 instanceCount;
+	u32 firstIndex;
+	i32 baseVertex;
+	u32 baseInstance;
+};
+
+// std430 size of the Light struct in shaders.glsl
+#define LIGHT_STORAGE_STRIDE       80
+#define LIGHT_STORAGE_INITIAL_SIZE (64 * LIGHT_STORAGE_STRIDE)
+
+// std430 size of the Material struct in shaders.glsl
+#define MATERIAL_STORAGE_STRIDE       80
+#define MATERIAL_STORAGE_INITIAL_SIZE (256 * MATERIAL_STORAGE_STRIDE)
+
+// Entities and lights listed in the inspector, stress scenes have far too many to draw them all
+#define GUI_MAX_LISTED_ITEMS 64
+
 GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 {
 	GLchar  infoLogBuffer[1024] = {};
@@ -60,8 +113,9 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 	if (!success)
 	{
 		glGetShaderInfoLog(vshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-		ELOG("glCompileShader() failed with vertex shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
-		assert(success);
+		LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_RENDER, "glCompileShader() failed with vertex shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+		glDeleteShader(vshader);
+		return 0;
 	}
 
 	GLuint fshader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -71,8 +125,10 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 	if (!success)
 	{
 		glGetShaderInfoLog(fshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-		ELOG("glCompileShader() failed with fragment shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
-		assert(success);
+		LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_RENDER, "glCompileShader() failed with fragment shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+		glDeleteShader(vshader);
+		glDeleteShader(fshader);
+		return 0;
 	}
 
 	GLuint programHandle = glCreateProgram();
@@ -83,8 +139,9 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 	if (!success)
 	{
 		glGetProgramInfoLog(programHandle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-		ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
-		assert(success);
+		LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_RENDER, "glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+		glDeleteProgram(programHandle);
+		programHandle = 0;
 	}
 
 	glUseProgram(0);
@@ -99,32 +156,73 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 
 u32 LoadProgram(App* app, const char* filepath, const char* programName)
 {
-	String programSource = ReadTextFile(filepath);
+	// The source is given to GL with its length, so it is compiled straight from the mapped file
+	FileView source = MapFile(filepath);
+	if (!source.data)
+		LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_RENDER, "Could not read program file %s", filepath);
+	String programSource = { (char*)source.data, (u32)source.size };
 
 	Program program = {};
-	program.handle = CreateProgramFromSource(programSource, programName);
+	program.handle = source.data ? CreateProgramFromSource(programSource, programName) : 0;
+	UnmapFile(source);
 	program.filepath = filepath;
 	program.programName = programName;
 	program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
 	app->programs.push_back(program);
+	assert(program.handle != 0);
 
 	return app->programs.size() - 1;
 }
 
-Image LoadImage(const char* filename)
+bool ReloadProgram(App* app, u32 programIdx)
 {
-	Image img = {};
-	stbi_set_flip_vertically_on_load(true);
-	img.pixels = stbi_load(filename, &img.size.x, &img.size.y, &img.nchannels, 0);
-	if (img.pixels)
+	PROFILE_FUNCTION();
+	Program& program = app->programs[programIdx];
+
+	// Editors may notify several times for a single save
+	u64 timestamp = GetFileLastWriteTimestamp(program.filepath.c_str());
+	if (timestamp == program.lastWriteTimestamp)
+		return false;
+
+	FileView source = MapFile(program.filepath.c_str());
+	String programSource = { (char*)source.data, (u32)source.size };
+	GLuint handle = source.data ? CreateProgramFromSource(programSource, program.programName.c_str()) : 0;
+	UnmapFile(source);
+	if (handle == 0)
 	{
-		img.stride = img.size.x * img.nchannels;
+		// Keep rendering with the previous version until the errors are fixed
+		LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_RENDER, "Could not reload program %s, keeping the previous one", program.programName);
+		return false;
 	}
-	else
+
+	// The VAOs are keyed by program handle, and a deleted handle can be given to the next program
+	for (Mesh& mesh : app->meshes)
 	{
-		ELOG("Could not open file %s", filename);
+		for (Submesh& submesh : mesh.submeshes)
+		{
+			for (u32 i = 0; i < (u32)submesh.vaos.size();)
+			{
+				if (submesh.vaos[i].programHandle == program.handle)
+				{
+					glDeleteVertexArrays(1, &submesh.vaos[i].handle);
+					submesh.vaos.erase(submesh.vaos.begin() + i);
+				}
+				else
+				{
+					++i;
+				}
+			}
+		}
 	}
-	return img;
+
+	glDeleteProgram(program.handle);
+	program.handle = handle;
+	program.lastWriteTimestamp = timestamp;
+	program.vertexInputLayout.attributes.clear();
+	LoadShader(app, programIdx);
+
+	LOG_MESSAGE(LOG_LEVEL_INFO, LOG_RENDER, "Reloaded program %s", program.programName);
+	return true;
 }
 
 void FreeImage(Image image)
@@ -132,60 +230,72 @@ void FreeImage(Image image)
 	stbi_image_free(image.pixels);
 }
 
-GLuint CreateTexture2DFromImage(Image image)
+u32 LoadTexture2D(App* app, const char* filepath, TextureUsage usage)
 {
-	GLenum internalFormat = GL_RGB8;
-	GLenum dataFormat = GL_RGB;
-	GLenum dataType = GL_UNSIGNED_BYTE;
-
-	switch (image.nchannels)
-	{
-	case 3: dataFormat = GL_RGB; internalFormat = GL_RGB8; break;
-	case 4: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; break;
-	default: ELOG("LoadTexture2D() - Unsupported number of channels");
-	}
-
-	GLuint texHandle;
-	glGenTextures(1, &texHandle);
-	glBindTexture(GL_TEXTURE_2D, texHandle);
-	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	return texHandle;
+	u32 texIdx;
+	LoadTexture2DBatch(app, &filepath, &usage, 1, &texIdx);
+	return texIdx;
 }
 
-u32 LoadTexture2D(App* app, const char* filepath)
+void LoadTexture2DBatch(App* app, const char* const* filepaths, const TextureUsage* usages, u32 count, u32* texIndices)
 {
-	for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
-		if (app->textures[texIdx].filepath == filepath)
-			return texIdx;
-
-	Image image = LoadImage(filepath);
+	PROFILE_FUNCTION();
 
-	if (image.pixels)
+	std::vector<const char*> pendingPaths;
+	std::vector<TextureUsage> pendingUsages;
+	for (u32 i = 0; i < count; ++i)
 	{
-		Texture tex = {};
-		tex.handle = CreateTexture2DFromImage(image);
-		tex.filepath = filepath;
+		texIndices[i] = FindTexture(app, filepaths[i]);
+		if (texIndices[i] == UINT32_MAX)
+		{
+			pendingPaths.push_back(filepaths[i]);
+			pendingUsages.push_back(usages[i]);
+		}
+	}
 
-		u32 texIdx = app->textures.size();
-		app->textures.push_back(tex);
+	// The workers map the cooked files, or decode the images and cook them, and the textures are
+	// created on this thread, which owns the GL context
+	std::vector<TextureMips> mips(pendingPaths.size());
+	PrepareTextureMipsBatch(mips.data(), pendingPaths.data(), pendingUsages.data(), (u32)pendingPaths.size());
 
-		FreeImage(image);
-		return texIdx;
-	}
-	else
+	for (u32 i = 0, pending = 0; i < count; ++i)
 	{
-		return UINT32_MAX;
+		if (texIndices[i] != UINT32_MAX)
+			continue;
+
+		TextureMips& textureMips = mips[pending++];
+		texIndices[i] = FindTexture(app, filepaths[i]); // Paths listed twice are created once
+		if (texIndices[i] != UINT32_MAX)
+		{
+			ReleaseTextureMips(textureMips);
+			continue;
+		}
+		if (textureMips.levelCount == 0)
+		{
+			LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_ASSETS, "Could not open file %s", filepaths[i]);
+			continue;
+		}
+
+		Texture tex = {};
+		tex.handle = CreateTexture2DFromMips(textureMips);
+		tex.filepath = MakeString(filepaths[i], &GlobalLevelArena).str;
+		tex.usage = usages[i];
+		tex.state = TEXTURE_STATE_RESIDENT;
+		tex.memorySize = GetTextureMemorySize(textureMips);
+		texIndices[i] = AddTexture(app, tex);
+		ReleaseTextureMips(textureMips);
 	}
 }
 
+GLuint GetTextureHandle(const App* app, u32 texIdx)
+{
+	const Texture& tex = app->textures[app->textures[texIdx].storageTexIdx];
+	if (tex.handle != 0)
+		return tex.handle;
+	u32 placeholderIdx = tex.state == TEXTURE_STATE_MISSING ? app->magentaTexIdx : app->whiteTexIdx;
+	return app->textures[placeholderIdx].handle;
+}
+
 void InicializeResources(App* app)
 {
 	// Initialize the resources
@@ -217,11 +327,16 @@ void InicializeResources(App* app)
 
 void LoadTextures(App* app)
 {
-	app->whiteTexIdx = LoadTexture2D(app, "color_white.png");
-	app->blackTexIdx = LoadTexture2D(app, "color_black.png");
-	app->normalTexIdx = LoadTexture2D(app, "color_normal.png");
-	app->magentaTexIdx = LoadTexture2D(app, "color_magenta.png");
-	app->dudvTex = app->textures[LoadTexture2D(app, "Water/dudvmap.png")].handle;
+	const char* filepaths[] = { "color_white.png", "color_black.png", "color_normal.png", "color_magenta.png", "Water/dudvmap.png" };
+	const TextureUsage usages[] = { TEXTURE_USAGE_COLOR, TEXTURE_USAGE_COLOR, TEXTURE_USAGE_VECTOR, TEXTURE_USAGE_COLOR, TEXTURE_USAGE_VECTOR };
+	u32 texIndices[ARRAY_COUNT(filepaths)];
+	LoadTexture2DBatch(app, filepaths, usages, ARRAY_COUNT(filepaths), texIndices);
+
+	app->whiteTexIdx = texIndices[0];
+	app->blackTexIdx = texIndices[1];
+	app->normalTexIdx = texIndices[2];
+	app->magentaTexIdx = texIndices[3];
+	app->dudvTexIdx = texIndices[4];
 }
 
 void InicializeGLInfo(App* app)
@@ -446,32 +561,27 @@ void CheckFrameBufferStatus()
 
 GLuint LoadCubemap(App* app)
 {
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-	int width, height, nrComponents;
-	std::vector<std::string> faces = {"Skybox/right.jpg", "Skybox/left.jpg", "Skybox/bottom.jpg", "Skybox/top.jpg", "Skybox/front.jpg", "Skybox/back.jpg"};
-	for (unsigned int i = 0; i < faces.size(); i++)
+	PROFILE_FUNCTION();
+
+	// The faces are cooked and compressed like any other color map, all at once on the workers
+	TextureMips faces[6] = {};
+	const char* facePaths[6] = {"Skybox/right.jpg", "Skybox/left.jpg", "Skybox/bottom.jpg", "Skybox/top.jpg", "Skybox/front.jpg", "Skybox/back.jpg"};
+	const TextureUsage faceUsages[6] = {TEXTURE_USAGE_COLOR, TEXTURE_USAGE_COLOR, TEXTURE_USAGE_COLOR, TEXTURE_USAGE_COLOR, TEXTURE_USAGE_COLOR, TEXTURE_USAGE_COLOR};
+	PrepareTextureMipsBatch(faces, facePaths, faceUsages, ARRAY_COUNT(faces));
+	for (u32 i = 0; i < ARRAY_COUNT(faces); i++)
 	{
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
-		if (data)
-		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
-		else
+		if (faces[i].levelCount == 0)
 		{
-			ELOG("Cubemap tex failed to load at path: %s", faces[i]);
-			stbi_image_free(data);
+			LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_ASSETS, "Cubemap tex failed to load at path: %s", facePaths[i]);
+			for (TextureMips& face : faces)
+				ReleaseTextureMips(face);
+			return 0;
 		}
 	}
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	GLuint textureID = CreateCubemapFromMips(faces);
+	for (TextureMips& face : faces)
+		ReleaseTextureMips(face);
 
 	return textureID;
 }
@@ -538,9 +648,13 @@ void GenerateSkyboxVAO(App* app)
 
 void Init(App* app)
 {
+	PROFILE_FUNCTION();
 	InicializeResources(app);
-	LoadTextures(app);
 	InicializeGLInfo(app);
+	InitGpuProfiler(app->glInfo);
+	InitTextureCompression(app->glInfo);
+	InitTextureStreaming();
+	LoadTextures(app);
 
 	//////////////////////////////////
 
@@ -617,30 +731,40 @@ void Init(App* app)
 	// Load programs
 	app->texturedDeferredGeometryProgramIdx = LoadProgram(app, "shaders.glsl", "SHOW_GEOMETRY_PASS");
 	LoadShader(app, app->texturedDeferredGeometryProgramIdx);
-	app->programDeferredUniformTexture = glGetUniformLocation(app->programs[app->texturedDeferredGeometryProgramIdx].handle, "uTexture");
 
 	app->texturedLightingProgramIdx = LoadProgram(app, "shaders.glsl", "SHOW_LIGHTING_PASS");
 	LoadShader(app, app->texturedLightingProgramIdx);
-	app->uGAlbedo = glGetUniformLocation(app->programs[app->texturedLightingProgramIdx].handle, "uGAlbedo");
-	app->uGPosition = glGetUniformLocation(app->programs[app->texturedLightingProgramIdx].handle, "uGPosition");
-	app->uGNormal = glGetUniformLocation(app->programs[app->texturedLightingProgramIdx].handle, "uGNormal");
 
 	app->debugLightsProgramIdx = LoadProgram(app, "shaders.glsl", "SHOW_LIGHT_DEBUG");
 	LoadShader(app, app->debugLightsProgramIdx);
-	app->uWorldViewProjection = glGetUniformLocation(app->programs[app->debugLightsProgramIdx].handle, "worldViewProjection");
-	app->uDebugLightColor = glGetUniformLocation(app->programs[app->debugLightsProgramIdx].handle, "uLightColor");
 
 	app->texturedForwardGeometryProgramIdx = LoadProgram(app, "shaders.glsl", "SHOW_FORWARD");
 	LoadShader(app, app->texturedForwardGeometryProgramIdx);
-	app->programForwardUniformTexture = glGetUniformLocation(app->programs[app->texturedForwardGeometryProgramIdx].handle, "uTexture");
 
 	app->cubemapProgramIdx = LoadProgram(app, "shaders.glsl", "SHOW_CUBE_MAP");
 	LoadShader(app, app->cubemapProgramIdx);
-	app->cubemapuWorldViewProjection = glGetUniformLocation(app->programs[app->cubemapProgramIdx].handle, "worldViewProjection");
-	app->cubemapTexture = glGetUniformLocation(app->programs[app->cubemapProgramIdx].handle, "skybox");
 
 	app->waterProgramIdx = LoadProgram(app, "shaders.glsl", "SHOW_WATER");
 	LoadShader(app, app->waterProgramIdx);
+
+	GetProgramUniformLocations(app);
+
+	app->mode = FORWARD;
+	app->currentMode = "Forward";
+}
+
+void GetProgramUniformLocations(App* app)
+{
+	app->uGAlbedo = glGetUniformLocation(app->programs[app->texturedLightingProgramIdx].handle, "uGAlbedo");
+	app->uGPosition = glGetUniformLocation(app->programs[app->texturedLightingProgramIdx].handle, "uGPosition");
+	app->uGNormal = glGetUniformLocation(app->programs[app->texturedLightingProgramIdx].handle, "uGNormal");
+
+	app->uWorldViewProjection = glGetUniformLocation(app->programs[app->debugLightsProgramIdx].handle, "worldViewProjection");
+	app->uDebugLightColor = glGetUniformLocation(app->programs[app->debugLightsProgramIdx].handle, "uLightColor");
+
+	app->cubemapuWorldViewProjection = glGetUniformLocation(app->programs[app->cubemapProgramIdx].handle, "worldViewProjection");
+	app->cubemapTexture = glGetUniformLocation(app->programs[app->cubemapProgramIdx].handle, "skybox");
+
 	app->wateruProjectionMatrix = glGetUniformLocation(app->programs[app->waterProgramIdx].handle, "projectionMatrix");
 	app->wateruWorldViewMatrix = glGetUniformLocation(app->programs[app->waterProgramIdx].handle, "worldViewMatrix");
 	app->wateruWorldMatrix = glGetUniformLocation(app->programs[app->waterProgramIdx].handle, "uWorldMatrix");
@@ -649,9 +773,6 @@ void Init(App* app)
 	app->wateruRefractionMap = glGetUniformLocation(app->programs[app->waterProgramIdx].handle, "refractionMap");
 	app->wateruDudvMap = glGetUniformLocation(app->programs[app->waterProgramIdx].handle, "dudvMap");
 	app->wateruMoveFactor = glGetUniformLocation(app->programs[app->waterProgramIdx].handle, "moveFactor");
-
-	app->mode = FORWARD;
-	app->currentMode = "Forward";
 }
 
 void LoadShader(App* app, u32 index)
@@ -712,6 +833,11 @@ void CreateUniformBuffers(App* app)
 
 	// For each buffer you need to create
 	app->uniformBuffer = CreateConstantBuffer(maxUniformBufferSize);
+	app->entityStorageBuffer = CreateStorageBuffer(ENTITY_STORAGE_INITIAL_SIZE);
+	app->drawBuffer = CreateBuffer(DRAW_INITIAL_COUNT * sizeof(uvec2), GL_ARRAY_BUFFER, GL_STREAM_DRAW);
+	app->drawCommandBuffer = CreateBuffer(DRAW_INITIAL_COUNT * sizeof(DrawElementsIndirectCommand), GL_DRAW_INDIRECT_BUFFER, GL_STREAM_DRAW);
+	app->lightStorageBuffer = CreateStorageBuffer(LIGHT_STORAGE_INITIAL_SIZE);
+	app->materialStorageBuffer = CreateStorageBuffer(MATERIAL_STORAGE_INITIAL_SIZE);
 }
 
 void CreateDocking()
@@ -739,12 +865,27 @@ void CreateDocking()
 
 void Gui(App* app)
 {
+	PROFILE_FUNCTION();
 	// Docking
 	CreateDocking();
 
 	// Info
 	ImGui::Begin("Info");
 	ImGui::Text("FPS: %f", 1.0f / app->deltaTime);
+	ImGui::Text("Triangles: %u", app->drawnTriangles);
+	ImGui::Text("Draws: %u submeshes in %u batches", app->drawnSubmeshes, app->drawBatches);
+	if (ImGui::CollapsingHeader("GPU Passes"))
+		GuiGpuProfiler();
+	if (ImGui::CollapsingHeader("Texture Streaming"))
+		GuiTextureStreaming();
+	if (ImGui::CollapsingHeader("Texture Registry"))
+		GuiTextureRegistry(app);
+	if (ImGui::CollapsingHeader("Texture Residency"))
+		GuiTextureResidency(app);
+	if (ImGui::CollapsingHeader("Texture Pages"))
+		GuiTexturePages();
+	if (ImGui::CollapsingHeader("Memory Arenas"))
+		ForEachArena(GuiArenaStats, NULL);
 	ImGui::End();
 
 	// Inspector Transform
@@ -816,6 +957,17 @@ void Gui(App* app)
 		ImGui::DragFloat3("##Scale", &waterScale[0], 0.01f, 0.00001f, 10000.0f);
 	}
 
+	// Bias of the levels of detail, the water passes add theirs to the global one
+	if (ImGui::CollapsingHeader("Levels of Detail"))
+	{
+		ImGui::Text("LOD Bias: ");
+		ImGui::DragFloat("##LOD Bias", &app->lodBias, 0.05f, -4.0f, 8.0f);
+		ImGui::Text("Water LOD Bias: ");
+		ImGui::DragFloat("##Water LOD Bias", &app->waterLodBias, 0.05f, -4.0f, 8.0f);
+	}
+
+	GuiStressScene(app);
+
 	// Transform components of primitives and lights
 	GuiEntities(app);
 	GuiLights(app);
@@ -835,6 +987,9 @@ void Gui(App* app)
 	}
 	ImGui::End();
 
+	// CPU timeline
+	GuiProfiler();
+
 	//ShowOpenGlInfo(app);
 }
 
@@ -887,7 +1042,11 @@ void GuiLightsInstance(App* app)
 
 void GuiEntities(App* app)
 {
-	for (int i = 0; i < app->entities.size(); ++i)
+	int listedCount = app->entities.size() < GUI_MAX_LISTED_ITEMS ? (int)app->entities.size() : GUI_MAX_LISTED_ITEMS;
+	if (listedCount < app->entities.size())
+		ImGui::TextDisabled("Showing %d of %u entities", listedCount, (u32)app->entities.size());
+
+	for (int i = 0; i < listedCount; ++i)
 	{
 		if (app->entities[i].name == "")
 			break;
@@ -923,7 +1082,11 @@ void GuiEntities(App* app)
 
 void GuiLights(App* app)
 {
-	for (int i = 0; i < app->lights.size(); i++)
+	int listedCount = app->lights.size() < GUI_MAX_LISTED_ITEMS ? (int)app->lights.size() : GUI_MAX_LISTED_ITEMS;
+	if (listedCount < app->lights.size())
+		ImGui::TextDisabled("Showing %d of %u lights", listedCount, (u32)app->lights.size());
+
+	for (int i = 0; i < listedCount; i++)
 	{
 		ImGui::PushID(app->lights[i].name.c_str());
 
@@ -989,6 +1152,16 @@ void ShowOpenGlInfo(App* app)
 	ImGui::CloseCurrentPopup();
 }
 
+void GuiArenaStats(const Arena* arena, void* userData)
+{
+	const f32 toMB = 1.0f / MB(1);
+	ImGui::Text("%s: %.2f / %.2f MB (peak %.2f MB, %u allocations)", arena->name,
+		arena->head * toMB, arena->size * toMB, arena->highWatermark * toMB, (u32)arena->allocationCount);
+	if (arena->overflowCount > 0)
+		ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "  %u overflows (%.2f MB served by the heap)",
+			(u32)arena->overflowCount, arena->overflowBytes * toMB);
+}
+
 std::string GetNewEntityName(App* app, std::string& name)
 {
 	int nameRepeat = 0;
@@ -1015,6 +1188,8 @@ std::string GetNewLightName(App* app, std::string& name)
 
 void Update(App* app)
 {
+	PROFILE_FUNCTION();
+	app->frame++;
 	app->timeGame += app->deltaTime;
 	app->moveFactor += app->waveSpeed * app->deltaTime;
 	app->moveFactor = fmod(app->moveFactor, 1);
@@ -1027,6 +1202,52 @@ void Update(App* app)
 
 	ZoomCamera(app);
 	MoveCamera(app);
+
+	HotReloadAssets(app);
+	UpdateTextureStreaming(app);
+	UpdateTextureResidency(app);
+}
+
+std::string GetPathDirectory(const std::string& path)
+{
+	size_t separator = path.find_last_of('/');
+	return separator == std::string::npos ? std::string() : path.substr(0, separator);
+}
+
+void HotReloadAssets(App* app)
+{
+	std::vector<std::string> changedFiles;
+	PollFileChanges(changedFiles);
+	if (changedFiles.empty())
+		return;
+
+	PROFILE_FUNCTION();
+	bool programsReloaded = false;
+	for (const std::string& path : changedFiles)
+	{
+		for (u32 i = 0; i < (u32)app->programs.size(); ++i)
+			if (NormalizePath(app->programs[i].filepath.c_str()) == path)
+				programsReloaded |= ReloadProgram(app, i);
+
+		for (u32 i = 0; i < (u32)app->textures.size(); ++i)
+			if (NormalizePath(app->textures[i].filepath) == path)
+				RequestTextureReload(app, i);
+
+		// The materials of an OBJ come from the .mtl files next to it
+		bool isMaterialLibrary = path.size() > 4 && path.compare(path.size() - 4, 4, ".mtl") == 0;
+		for (u32 i = 0; i < (u32)app->models.size(); ++i)
+		{
+			std::string modelPath = NormalizePath(app->models[i].filepath);
+			if (modelPath.empty())
+				continue; // Stress scene variants share the mesh of the model they come from
+			if (modelPath == path || (isMaterialLibrary && GetPathDirectory(modelPath) == GetPathDirectory(path)))
+				ReloadModel(app, i);
+		}
+	}
+
+	// The uniform locations may change with the program
+	if (programsReloaded)
+		GetProgramUniformLocations(app);
 }
 
 void MoveCamera(App* app)
@@ -1135,46 +1356,47 @@ void ComputeCameraAxisDirection(Camera& cam)
 	cam.up = glm::normalize(glm::cross(cam.right, cam.front));
 }
 
+struct EntityParamsPacking
+{
+	App*      app;
+	glm::mat4 viewProjection;
+};
+
+void PackEntityParams(void* data, u32 begin, u32 end)
+{
+	EntityParamsPacking* packing = (EntityParamsPacking*)data;
+	App* app = packing->app;
+
+	for (u32 i = begin; i < end; ++i)
+	{
+		const Entity& entity = app->entities[i];
+		glm::mat4 worldViewProjection = packing->viewProjection * entity.worldMatrix;
+
+		u8* block = (u8*)app->entityStorageBuffer.data + i * ENTITY_STORAGE_STRIDE;
+		memcpy(block, glm::value_ptr(entity.worldMatrix), sizeof(glm::mat4));
+		memcpy(block + sizeof(glm::mat4), glm::value_ptr(worldViewProjection), sizeof(glm::mat4));
+	}
+}
+
 void UniformBufferAlignment(App* app, Camera cam, bool reflection)
 {
+	PROFILE_FUNCTION();
+
+	u32 requiredSize = 3 * app->uniformBufferAlignment + sizeof(glm::mat4) + sizeof(vec4);
+	ReserveBuffer(app->uniformBuffer, requiredSize, GL_STREAM_DRAW);
+
 	glBindBuffer(GL_UNIFORM_BUFFER, app->uniformBuffer.handle);
 	app->uniformBuffer.data = (u8*)glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
 	app->uniformBuffer.head = 0;
 
-	// Global params
+	// Global params (the lights are in their own storage buffer, see UploadLights)
 	app->globalParamsOffset = app->uniformBuffer.head;
 
 	PushVec3(app->uniformBuffer, cam.position);
 	PushUInt(app->uniformBuffer, app->lights.size());
 
-	for (u32 i = 0; i < app->lights.size(); ++i)
-	{
-		AlignHead(app->uniformBuffer, sizeof(vec4));
-
-		Light& light = app->lights[i];
-		PushUInt(app->uniformBuffer,  light.type);
-		PushVec3(app->uniformBuffer,  light.color);
-		PushVec3(app->uniformBuffer,  light.direction);
-		PushVec3(app->uniformBuffer,  light.position);
-		PushFloat(app->uniformBuffer, light.radius);
-		PushFloat(app->uniformBuffer, light.intensity);
-	}
 	app->globalParamsSize = app->uniformBuffer.head - app->globalParamsOffset;
 
-	// Local Params
-	for (u32 i = 0; i < app->entities.size(); ++i)
-	{
-		AlignHead(app->uniformBuffer, app->uniformBufferAlignment);
-		Entity& entity = app->entities[i];
-		glm::mat4 world = entity.worldMatrix;
-		glm::mat4 worldViewProjection = cam.projection * cam.view * world;
-
-		entity.localParamsOffset = app->uniformBuffer.head;
-		PushMat4(app->uniformBuffer, world);
-		PushMat4(app->uniformBuffer, worldViewProjection);
-		entity.localParamsSize = app->uniformBuffer.head - entity.localParamsOffset;
-	}
-
 	// Clipping Plane
 	AlignHead(app->uniformBuffer, app->uniformBufferAlignment);
 	app->clippingPlaneOffset = app->uniformBuffer.head;
@@ -1188,14 +1410,92 @@ void UniformBufferAlignment(App* app, Camera cam, bool reflection)
 
 	glUnmapBuffer(GL_UNIFORM_BUFFER);
 	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// Entity Params
+	// Every pass draws with its own camera, the storage of the previous one is orphaned. The
+	// blocks have the same size, so they are filled in parallel
+	if (!app->entities.empty())
+	{
+		ReserveBuffer(app->entityStorageBuffer, (u32)app->entities.size() * ENTITY_STORAGE_STRIDE, GL_STREAM_DRAW);
+		MapBufferInvalidate(app->entityStorageBuffer);
+		EntityParamsPacking packing = {};
+		packing.app = app;
+		packing.viewProjection = cam.projection * cam.view;
+		ParallelFor(app->entities.size(), ENTITY_PARAMS_BATCH_SIZE, PackEntityParams, &packing);
+		UnmapBuffer(app->entityStorageBuffer);
+	}
+}
+
+void UploadLights(App* app)
+{
+	PROFILE_FUNCTION();
+	ReserveBuffer(app->lightStorageBuffer, (u32)app->lights.size() * LIGHT_STORAGE_STRIDE, GL_STREAM_DRAW);
+
+	Buffer& buffer = app->lightStorageBuffer;
+	MapBuffer(buffer, GL_WRITE_ONLY);
+	for (u32 i = 0; i < app->lights.size(); ++i)
+	{
+		AlignHead(buffer, sizeof(vec4));
+
+		Light& light = app->lights[i];
+		PushUInt(buffer,  light.type);
+		PushVec3(buffer,  light.color);
+		PushVec3(buffer,  light.direction);
+		PushVec3(buffer,  light.position);
+		PushFloat(buffer, light.radius);
+		PushFloat(buffer, light.intensity);
+	}
+	UnmapBuffer(buffer);
+}
+
+void UploadMaterials(App* app)
+{
+	PROFILE_FUNCTION();
+	if (app->uploadedMaterialCount == app->materials.size() && !app->materialTexturesChanged)
+		return;
+
+	ReserveBuffer(app->materialStorageBuffer, (u32)app->materials.size() * MATERIAL_STORAGE_STRIDE, GL_STREAM_DRAW);
+
+	Buffer& buffer = app->materialStorageBuffer;
+	MapBufferInvalidate(buffer);
+	for (const Material& material : app->materials)
+	{
+		AlignHead(buffer, sizeof(vec4));
+		PushVec3(buffer,  material.albedo);
+		PushFloat(buffer, material.smoothness);
+		PushVec3(buffer,  material.emissive);
+
+		const u32 textureIndices[] = { material.albedoTextureIdx, material.emissiveTextureIdx, material.specularTextureIdx,
+		                               material.normalsTextureIdx, material.bumpTextureIdx };
+		AlignHead(buffer, 2 * sizeof(u32));
+		for (u32 texIdx : textureIndices)
+		{
+			TextureLayer layer = GetTextureLayer(GetTextureHandle(app, texIdx));
+			PushUInt(buffer, layer.page);
+			PushUInt(buffer, layer.layer);
+		}
+	}
+	UnmapBuffer(buffer);
+
+	app->uploadedMaterialCount = (u32)app->materials.size();
+	app->materialTexturesChanged = false;
 }
 
 void Render(App* app)
 {
+	PROFILE_FUNCTION();
+	UploadLights(app);
+	UploadMaterials(app);
+	app->drawnTriangles = 0;
+	app->drawnSubmeshes = 0;
+	app->drawBatches = 0;
+
 	switch (app->mode)
 	{
 	case TEXTURED_QUAD:
 	{
+		GPU_PROFILE_SCOPE("Textured Quad");
+
 		// Indicate which shader we are going to use
 		Program& programTexturedGeometry = app->programs[app->texturedForwardGeometryProgramIdx];
 		glUseProgram(programTexturedGeometry.handle);
@@ -1204,9 +1504,7 @@ void Render(App* app)
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-		// Use 1i because we pass it 1 int, if we pass it a vector3 of floats we would use glUniform3f
-		glUniform1i(app->programForwardUniformTexture, 0); // ID = 0
-		glActiveTexture(GL_TEXTURE0);				// The last number of GL_TEXTURE must match the above number which is 0
+		glActiveTexture(GL_TEXTURE0);
 		GLuint textureHandle = app->textures[app->whiteTexIdx].handle;
 		glBindTexture(GL_TEXTURE_2D, textureHandle);
 
@@ -1223,13 +1521,25 @@ void Render(App* app)
 		// Fill water render textures 
 		FillRTWater(app);
 		// Render World
-		DrawScene(app, app->texturedForwardGeometryProgramIdx, app->programForwardUniformTexture, app->gBuffer);
+		{
+			GPU_PROFILE_SCOPE("Forward Scene");
+			DrawScene(app, app->texturedForwardGeometryProgramIdx, app->gBuffer, app->lodBias);
+		}
 		// Debug lights
-		RenderDebug(app);
+		{
+			GPU_PROFILE_SCOPE("Debug");
+			RenderDebug(app);
+		}
 		// Cubemap
-		RenderSkybox(app, app->camera);
+		{
+			GPU_PROFILE_SCOPE("Skybox");
+			RenderSkybox(app, app->camera);
+		}
 		// Water
-		RenderWaterShader(app);
+		{
+			GPU_PROFILE_SCOPE("Water");
+			RenderWaterShader(app);
+		}
 
 		// Render on screen again
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -1242,23 +1552,40 @@ void Render(App* app)
 		FillRTWater(app);
 
 		// Render World
-		DrawScene(app, app->texturedDeferredGeometryProgramIdx, app->programDeferredUniformTexture, app->gBuffer);
+		{
+			GPU_PROFILE_SCOPE("GBuffer");
+			DrawScene(app, app->texturedDeferredGeometryProgramIdx, app->gBuffer, app->lodBias);
+		}
 
 		if (app->currentRenderTarget != "Final")
 		{
-			RenderSkybox(app, app->camera);	
+			{
+				GPU_PROFILE_SCOPE("Skybox");
+				RenderSkybox(app, app->camera);
+			}
+			GPU_PROFILE_SCOPE("Water");
 			RenderWaterShader(app);
 		}
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 		///////////////////////////////////////////////// Lighting pass ////////////////////////////////////////
-		RenderDeferredLights(app, app->lightBuffer);
+		{
+			GPU_PROFILE_SCOPE("Lighting");
+			RenderDeferredLights(app, app->lightBuffer);
+		}
 		// Debug lights
-		RenderDebug(app);		
+		{
+			GPU_PROFILE_SCOPE("Debug");
+			RenderDebug(app);
+		}
 		if (app->currentRenderTarget == "Final")
 		{
-			RenderSkybox(app, app->camera);
-			RenderWaterShader(app);			
+			{
+				GPU_PROFILE_SCOPE("Skybox");
+				RenderSkybox(app, app->camera);
+			}
+			GPU_PROFILE_SCOPE("Water");
+			RenderWaterShader(app);
 		}
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -1269,8 +1596,43 @@ void Render(App* app)
 	}
 }
 
-void DrawScene(App* app, u32 programIdx, GLuint uTexture, GLuint fbo)
+u32 SelectSubmeshLod(const Submesh& submesh, f32 projectedRadius, f32 lodBias)
+{
+	f32 maxError = LOD_PIXEL_ERROR * exp2f(lodBias);
+	u32 lod = 0;
+	while (lod + 1 < submesh.lodCount && submesh.lods[lod + 1].error * projectedRadius <= maxError)
+		lod++;
+	return lod;
+}
+
+f32 GetProjectedMeshRadius(const App* app, const Mesh& mesh, const Entity& entity)
+{
+	f32 scale = glm::max(glm::length(vec3(entity.worldMatrix[0])), glm::max(glm::length(vec3(entity.worldMatrix[1])), glm::length(vec3(entity.worldMatrix[2]))));
+	f32 radius = mesh.boundsRadius * scale;
+	vec3 center = vec3(entity.worldMatrix * vec4(mesh.boundsCenter, 1.0f));
+	f32 distance = glm::length(center - app->camera.position);
+	if (distance <= radius)
+		return FLT_MAX;
+
+	// The reflection camera mirrors this one, so the distances are close enough for its pass too
+	return radius / distance * app->camera.projection[1][1] * app->displaySize.y * 0.5f;
+}
+
+// A submesh that DrawScene draws, until its batch is issued
+struct SceneDraw
 {
+	GLuint         vao;
+	u32            albedoPage; // UINT32_MAX for textures that are not in a page
+	const Submesh* submesh;
+	u32            indexCount;
+	u32            firstIndex;
+	u32            entityIdx;
+	u32            materialIdx;
+};
+
+void DrawScene(App* app, u32 programIdx, GLuint fbo, f32 lodBias)
+{
+	PROFILE_FUNCTION();
 	// Clean screen
 	glClearColor(0.1, 0.1, 0.1, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -1288,35 +1650,115 @@ void DrawScene(App* app, u32 programIdx, GLuint uTexture, GLuint fbo)
 	Program& programTexturedGeometry = app->programs[programIdx];
 	glUseProgram(programTexturedGeometry.handle);
 
-	for (Entity entity : app->entities)
+	// The draws find their entity and material in storage buffers, every draw of the pass reads the same ones
+	if (app->mode == FORWARD)
 	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->uniformBuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING(3), app->lightStorageBuffer.handle);
+	}
+	glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(2), app->uniformBuffer.handle, app->clippingPlaneOffset, app->clippingPlaneSize);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING(4), app->materialStorageBuffer.handle);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING(5), app->entityStorageBuffer.handle);
+
+	u32 maxDrawCount = 0;
+	for (const Entity& entity : app->entities)
+		maxDrawCount += (u32)app->meshes[app->models[entity.modelIndex].meshIdx].submeshes.size();
+	if (maxDrawCount == 0)
+	{
+		glUseProgram(0);
+		return;
+	}
+
+	TempArenaScope tempScope(&GlobalFrameArena);
+	SceneDraw* draws = PushArray(&GlobalFrameArena, SceneDraw, maxDrawCount);
+	u32 drawCount = 0;
+	for (u32 entityIdx = 0; entityIdx < app->entities.size(); ++entityIdx)
+	{
+		const Entity& entity = app->entities[entityIdx];
 		Model& model = app->models[entity.modelIndex];
 		Mesh& mesh = app->meshes[model.meshIdx];
-
-		if(app->mode == FORWARD)
-			glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->uniformBuffer.handle, app->globalParamsOffset, app->globalParamsSize);
-		glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->uniformBuffer.handle, entity.localParamsOffset, entity.localParamsSize);
-		glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(2), app->uniformBuffer.handle, app->clippingPlaneOffset, app->clippingPlaneSize);
+		f32 projectedRadius = GetProjectedMeshRadius(app, mesh, entity);
 
 		for (u32 i = 0; i < mesh.submeshes.size(); ++i)
 		{
-			GLuint vao = FindVAO(mesh, i, programTexturedGeometry);
-			glBindVertexArray(vao);
-			u32 submeshMaterialIdx = model.materialIdx[i];
-			Material& submeshMaterial = app->materials[submeshMaterialIdx];
-
-			glActiveTexture(GL_TEXTURE0);
-			GLuint textureHandle = app->textures[submeshMaterial.albedoTextureIdx].handle;
-			glBindTexture(GL_TEXTURE_2D, textureHandle);
-
-			glUniform1i(uTexture, 0);
+			const Submesh& submesh = mesh.submeshes[i];
+			SceneDraw& draw = draws[drawCount++];
+			draw.vao = FindVAO(mesh, i, programTexturedGeometry);
+			draw.submesh = &submesh;
+			draw.entityIdx = entityIdx;
+			draw.materialIdx = model.materialIdx[i];
+
+			// The shaders sample the albedo texture only, the pages of the others may not be bound
+			const Material& material = app->materials[draw.materialIdx];
+			draw.albedoPage = GetTextureLayer(GetTextureHandle(app, material.albedoTextureIdx)).page;
+			MarkTextureUsed(app, material.albedoTextureIdx, projectedRadius);
+
+			u32 indexSize = GetIndexSize(submesh.indexType);
+			draw.indexCount = submesh.indexCount;
+			draw.firstIndex = submesh.indexOffset / indexSize;
+			if (submesh.lodCount > 0)
+			{
+				const SubmeshLod& lod = submesh.lods[SelectSubmeshLod(submesh, projectedRadius, lodBias)];
+				draw.indexCount = lod.indexCount;
+				draw.firstIndex += lod.firstIndex;
+			}
+			app->drawnTriangles += draw.indexCount / 3;
+		}
+	}
+	app->drawnSubmeshes += drawCount;
 
-			Submesh& submesh = mesh.submeshes[i];
-			glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
+	// Batches: the draws of a submesh share its vertex array and dequantization, and the ones with
+	// the same albedo page sample the same texture unit
+	std::sort(draws, draws + drawCount, [](const SceneDraw& a, const SceneDraw& b)
+	{
+		return a.vao != b.vao ? a.vao < b.vao : a.albedoPage < b.albedoPage;
+	});
+
+	// The command of every draw starts its instance at its own record of the draw buffer
+	ReserveBuffer(app->drawBuffer, drawCount * sizeof(uvec2), GL_STREAM_DRAW);
+	ReserveBuffer(app->drawCommandBuffer, drawCount * sizeof(DrawElementsIndirectCommand), GL_STREAM_DRAW);
+	MapBufferInvalidate(app->drawBuffer);
+	uvec2* records = (uvec2*)app->drawBuffer.data;
+	for (u32 i = 0; i < drawCount; ++i)
+		records[i] = uvec2(draws[i].entityIdx, draws[i].materialIdx);
+	UnmapBuffer(app->drawBuffer);
+
+	MapBufferInvalidate(app->drawCommandBuffer);
+	DrawElementsIndirectCommand* commands = (DrawElementsIndirectCommand*)app->drawCommandBuffer.data;
+	for (u32 i = 0; i < drawCount; ++i)
+		commands[i] = DrawElementsIndirectCommand{ draws[i].indexCount, 1, draws[i].firstIndex, 0, i };
+	UnmapBuffer(app->drawCommandBuffer);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, app->drawCommandBuffer.handle);
+	TexturePageUnits pageUnits;
+	ResetTexturePageUnits(pageUnits);
+	GLuint boundVao = 0;
+	for (u32 first = 0; first < drawCount;)
+	{
+		const SceneDraw& draw = draws[first];
+		u32 end = first + 1;
+		while (end < drawCount && draws[end].vao == draw.vao && draws[end].albedoPage == draw.albedoPage)
+			end++;
 
-			glBindVertexArray(0);
+		if (draw.vao != boundVao)
+		{
+			glBindVertexArray(draw.vao);
+			glBindVertexBuffer(DRAW_BUFFER_BINDING, app->drawBuffer.handle, 0, sizeof(uvec2));
+			SetPositionDequantization(*draw.submesh);
+			boundVao = draw.vao;
 		}
+		if (draw.albedoPage != UINT32_MAX)
+			glUniform1ui(ALBEDO_PAGE_UNIT_LOCATION, BindTexturePage(draw.albedoPage, pageUnits));
+
+		glMultiDrawElementsIndirect(GL_TRIANGLES, draw.submesh->indexType, (void*)(first * sizeof(DrawElementsIndirectCommand)),
+			end - first, 0);
+		app->drawBatches++;
+		first = end;
 	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
 	glUseProgram(0);
 }
 
@@ -1340,6 +1782,7 @@ void RenderQuad(App* app)
 
 	// Send Uniforms
 	glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->uniformBuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING(3), app->lightStorageBuffer.handle);
 
 	// Draw
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
@@ -1348,6 +1791,7 @@ void RenderQuad(App* app)
 
 void RenderDeferredLights(App* app, GLuint fbo)
 {
+	PROFILE_FUNCTION();
 	// Render on this framebuffer render target
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 
@@ -1397,8 +1841,9 @@ void RenderDebug(App* app)
 		glBindVertexArray(vao);
 		glUniformMatrix4fv(app->uWorldViewProjection, 1, GL_FALSE, &model[0][0]);
 		glUniform3f(app->uDebugLightColor, it.color.r, it.color.g, it.color.b);
+		SetPositionDequantization(mesh.submeshes[0]);
 
-		glDrawElements(GL_TRIANGLES, mesh.submeshes[0].indices.size(), GL_UNSIGNED_INT, 0);
+		glDrawElements(GL_TRIANGLES, mesh.submeshes[0].indexCount, mesh.submeshes[0].indexType, (void*)(u64)mesh.submeshes[0].indexOffset);
 		glBindVertexArray(0);
 	}
 	// Debug Pivot Target
@@ -1411,8 +1856,9 @@ void RenderDebug(App* app)
 	glBindVertexArray(vao);
 	glUniformMatrix4fv(app->uWorldViewProjection, 1, GL_FALSE, &model[0][0]);
 	glUniform3f(app->uDebugLightColor, 0.8f, 0.8f, 0.8f);
+	SetPositionDequantization(mesh.submeshes[0]);
 
-	glDrawElements(GL_TRIANGLES, mesh.submeshes[0].indices.size(), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, mesh.submeshes[0].indexCount, mesh.submeshes[0].indexType, (void*)(u64)mesh.submeshes[0].indexOffset);
 	glBindVertexArray(0);
 
 	glUseProgram(0);
@@ -1440,6 +1886,7 @@ void RenderSkybox(App* app, Camera cam)
 
 void FillRTWater(App* app)
 {
+	PROFILE_FUNCTION();
 	//////////////////////////////////////////////////// REFLECTION /////////////////////////////////////
 	// Render on this framebuffer render target
 	glBindFramebuffer(GL_FRAMEBUFFER, app->fboReflection);
@@ -1453,7 +1900,10 @@ void FillRTWater(App* app)
 	UniformBufferAlignment(app, reflectionCam, true);
 
 	PassWaterScene(app, app->fboReflection);
-	RenderSkybox(app, reflectionCam);
+	{
+		GPU_PROFILE_SCOPE("Reflection Skybox");
+		RenderSkybox(app, reflectionCam);
+	}
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	//////////////////////////////////////////////////// REFRACTION /////////////////////////////////////
@@ -1472,15 +1922,28 @@ void PassWaterScene(App* app, GLuint fbo)
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CLIP_DISTANCE0);
 
+	// GPU zones can't be nested, so the scene and lighting passes are measured separately
+	bool reflection = fbo == app->fboReflection;
+	f32 lodBias = app->lodBias + app->waterLodBias;
 	if (app->mode == FORWARD)
-		DrawScene(app, app->texturedForwardGeometryProgramIdx, app->programForwardUniformTexture, fbo);
+	{
+		GPU_PROFILE_SCOPE(reflection ? "Reflection Scene" : "Refraction Scene");
+		DrawScene(app, app->texturedForwardGeometryProgramIdx, fbo, lodBias);
+	}
 	else
 	{
-		if(app->currentRenderTarget != "Final")
-			DrawScene(app, app->texturedDeferredGeometryProgramIdx, app->programDeferredUniformTexture, fbo);
+		if (app->currentRenderTarget != "Final")
+		{
+			GPU_PROFILE_SCOPE(reflection ? "Reflection GBuffer" : "Refraction GBuffer");
+			DrawScene(app, app->texturedDeferredGeometryProgramIdx, fbo, lodBias);
+		}
 		else
 		{
-			DrawScene(app, app->texturedDeferredGeometryProgramIdx, app->programDeferredUniformTexture, app->gBuffer);
+			{
+				GPU_PROFILE_SCOPE(reflection ? "Reflection GBuffer" : "Refraction GBuffer");
+				DrawScene(app, app->texturedDeferredGeometryProgramIdx, app->gBuffer, lodBias);
+			}
+			GPU_PROFILE_SCOPE(reflection ? "Reflection Lighting" : "Refraction Lighting");
 			RenderDeferredLights(app, fbo);
 		}
 	}
@@ -1506,6 +1969,7 @@ void RenderWaterShader(App* app)
 	glUniformMatrix4fv(app->wateruWorldViewMatrix, 1, GL_FALSE, &view[0][0]);
 	glUniformMatrix4fv(app->wateruWorldMatrix, 1, GL_FALSE, &model[0][0]);
 	glUniform1f(app->wateruMoveFactor, app->moveFactor); // TODO: Change by app->moveFactor
+	SetPositionDequantization(mesh.submeshes[0]);
 	
 	if(app->mode == Mode::DEFERRED)
 		glUniform1i(app->wateruRTT, ConvertStringToTextureType(app->currentRenderTarget));
@@ -1522,14 +1986,20 @@ void RenderWaterShader(App* app)
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, app->rtRefraction);
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, app->dudvTex);
+	glBindTexture(GL_TEXTURE_2D, app->textures[app->dudvTexIdx].handle);
 
-	glDrawElements(GL_TRIANGLES, mesh.submeshes[0].indices.size(), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, mesh.submeshes[0].indexCount, mesh.submeshes[0].indexType, (void*)(u64)mesh.submeshes[0].indexOffset);
 	glBindVertexArray(0);
 
 	glUseProgram(0);
 }
 
+void SetPositionDequantization(const Submesh& submesh)
+{
+	glUniform3fv(POSITION_SCALE_LOCATION, 1, &submesh.positionScale[0]);
+	glUniform3fv(POSITION_OFFSET_LOCATION, 1, &submesh.positionOffset[0]);
+}
+
 GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
 {
 	Submesh& submesh = mesh.submeshes[submeshIndex];
@@ -1551,17 +2021,28 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
 	// We have to link all vertex inputs attributes to attributrs in the vertex buffer
 	for (u32 i = 0; i < program.vertexInputLayout.attributes.size(); ++i)
 	{
+		// Except the draw attribute, one record of the draw buffer per instance
+		if (program.vertexInputLayout.attributes[i].location == DRAW_ATTRIBUTE_LOCATION)
+		{
+			glVertexAttribIFormat(DRAW_ATTRIBUTE_LOCATION, 2, GL_UNSIGNED_INT, 0);
+			glVertexAttribBinding(DRAW_ATTRIBUTE_LOCATION, DRAW_BUFFER_BINDING);
+			glVertexBindingDivisor(DRAW_BUFFER_BINDING, 1);
+			glEnableVertexAttribArray(DRAW_ATTRIBUTE_LOCATION);
+			continue;
+		}
+
 		bool attributeWasLinked = false;
 		for (u32 j = 0; j < submesh.vertexBufferLayout.attributes.size(); ++j)
 		{
 			if (program.vertexInputLayout.attributes[i].location == submesh.vertexBufferLayout.attributes[j].location)
 			{
-				const u32 index = submesh.vertexBufferLayout.attributes[j].location;
-				const u32 ncomp = submesh.vertexBufferLayout.attributes[j].componentCount;
-				const u32 offset = submesh.vertexBufferLayout.attributes[j].offset + submesh.vertexOffset;
-				const u32 stride = submesh.vertexBufferLayout.stride;
+				const VertexBufferAttribute& attribute = submesh.vertexBufferLayout.attributes[j];
+				const u32 index = attribute.location;
+				const u32 ncomp = attribute.componentCount;
+				const u32 offset = attribute.offset + submesh.vertexOffset;
+				const u32 stride = attribute.stride ? attribute.stride : submesh.vertexBufferLayout.stride;
 
-				glVertexAttribPointer(index, ncomp, GL_FLOAT, GL_FALSE, stride, (void*)(u64)offset);
+				glVertexAttribPointer(index, ncomp, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE, stride, (void*)(u64)offset);
 				glEnableVertexAttribArray(index);
 
 				attributeWasLinked = true;
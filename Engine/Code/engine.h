@@ -5,6 +5,7 @@
 #pragma once
 
 #include "platform.h"
+#include "memory_arena.h"
 #include <glad/glad.h>
 #include <unordered_map>
 
@@ -14,12 +15,16 @@ typedef glm::vec4  vec4;
 typedef glm::ivec2 ivec2;
 typedef glm::ivec3 ivec3;
 typedef glm::ivec4 ivec4;
+typedef glm::uvec2 uvec2;
 
 struct VertexBufferAttribute
 {
-    u8 location;
-    u8 componentCount;
-    u8 offset;
+    u8     location;
+    u8     componentCount;
+    u32    offset;              // From the start of the submesh vertices
+    GLenum type = GL_FLOAT;
+    bool   normalized = false;  // Integer types are read as floats in [0, 1] or [-1, 1]
+    u8     stride = 0;          // 0 when it uses the stride of the layout (interleaved vertices)
 };
 
 struct VertexBufferLayout
@@ -55,10 +60,40 @@ struct Image
     i32   stride;
 };
 
+// What the texture holds, which picks its compressed format when it is cooked
+enum TextureUsage
+{
+    TEXTURE_USAGE_COLOR,  // Albedo and emissive maps: BC1, or BC3/BC7 with alpha
+    TEXTURE_USAGE_MASK,   // Single channel maps, read from red: BC4
+    TEXTURE_USAGE_VECTOR, // Two channel maps, read from red and green (normals reconstruct z): BC5
+};
+
+// Textures of models are streamed in (see texture_streaming.h) and drawn with a placeholder
+// until they are resident
+enum TextureState
+{
+    TEXTURE_STATE_LOADING,  // Drawn with the white texture
+    TEXTURE_STATE_RESIDENT,
+    TEXTURE_STATE_MISSING,  // The image couldn't be read, drawn with the magenta texture
+};
+
 struct Texture
 {
-    GLuint      handle;
-    std::string filepath;
+    GLuint       handle;        // View of its layer of a texture page (see texture_pages.h), 0 until resident and for textures that share another one
+    const char*  filepath;      // In GlobalLevelArena
+    TextureUsage usage;
+    TextureState state;
+    u32          storageTexIdx; // Texture whose handle is bound: itself, or the first one with the same image (see texture_registry.h)
+    u64          memorySize;    // Bytes of its storage, 0 if it has none
+
+    // Mip residency (see texture_residency.h), of the textures streamed from their files
+    GLenum       format;        // Of the storage
+    u32          width;         // Of level 0, even if it is not resident
+    u32          height;
+    u32          levelCount;    // Of the whole chain, 0 for the textures that are always resident
+    u32          residentMip;   // Largest level in the storage, the larger ones were evicted
+    u32          requiredMip;   // Largest level sampled in the last frame that drew it
+    u32          lastUsedFrame;
 };
 
 struct Material
@@ -74,13 +109,37 @@ struct Material
     u32         bumpTextureIdx;
 };
 
+#define MAX_SUBMESH_LODS 4    // Levels of detail of a submesh, including the full detail one
+#define LOD_PIXEL_ERROR  1.0f  // Screen space error of the levels of detail at bias 0, in pixels
+
+#define TEXTURE_BUDGET_DEFAULT_MB 512 // GPU memory for textures, see texture_residency.h
+
+// A simplified version of a submesh, over the same vertices. The levels are stored one after
+// another in its index range, the full detail one first.
+struct SubmeshLod
+{
+    u32 firstIndex; // From indexOffset
+    u32 indexCount;
+    f32 error;      // Of the simplification, relative to the bounding radius of the mesh
+};
+
 struct Submesh
 {
     VertexBufferLayout vertexBufferLayout;
-    std::vector<float> vertices;
-    std::vector<u32>   indices;
+    std::vector<u8>    vertices;   // Interleaved, in the layout of vertexBufferLayout
+    std::vector<u32>   indices;    // Empty for meshes loaded from the cooked cache, which go straight to the GPU
     u32                vertexOffset;
     u32                indexOffset;
+    u32                indexCount;
+    GLenum             indexType = GL_UNSIGNED_INT; // Of the uploaded indices, indices holds them as u32
+
+    // Quantized positions are read in [0, 1] and mapped back to model space with these
+    vec3               positionScale = vec3(1.0f);
+    vec3               positionOffset = vec3(0.0f);
+
+    // Without levels of detail (lodCount 0), the submesh always draws its indexCount indices
+    u32                lodCount = 0;
+    SubmeshLod         lods[MAX_SUBMESH_LODS];
 
     std::vector<Vao>   vaos;
 };
@@ -90,12 +149,17 @@ struct Mesh
     std::vector<Submesh> submeshes;
     GLuint               vertexBufferHandle;
     GLuint               indexBufferHandle;
+
+    // Bounding sphere in model space, to pick the levels of detail
+    vec3                 boundsCenter = vec3(0.0f);
+    f32                  boundsRadius = 0.0f;
 };
 
 struct Model
 {
     u32              meshIdx;
     std::vector<u32> materialIdx;
+    const char*      filepath;    // In GlobalLevelArena, empty for the models that are not loaded from a file
 };
 
 struct Program
@@ -105,7 +169,7 @@ struct Program
     std::string        programName;
     VertexShaderLayout vertexInputLayout;
 
-    u64                lastWriteTimestamp; // What is this for?
+    u64                lastWriteTimestamp; // Of the source file, to skip hot reloads of unchanged files
 };
 
 struct Buffer
@@ -183,8 +247,6 @@ struct Entity
     Transform   transform;
     glm::mat4   worldMatrix;
     u32         modelIndex;
-    u32         localParamsOffset;
-    u32         localParamsSize;
 
     std::string name;
 };
@@ -271,6 +333,13 @@ struct App
     std::vector<Model>    models;
     std::vector<Program>  programs;
 
+    // Texture of every path, see texture_registry.h
+    std::unordered_map<std::string, u32> texturePathIndices;
+
+    // Texture residency, see texture_residency.h
+    u32 frame = 0;                                   // Updates so far, to tell when textures were last drawn
+    u32 textureBudgetMB = TEXTURE_BUDGET_DEFAULT_MB; // Over it the textures lose the levels they don't need
+
     // program indices
     u32 texturedForwardGeometryProgramIdx;
     u32 texturedDeferredGeometryProgramIdx;
@@ -293,9 +362,6 @@ struct App
     GLuint embeddedVertices;
     GLuint embeddedElements;
 
-    // Location of the texture uniform in the textured quad shader
-    GLuint programForwardUniformTexture;
-    GLuint programDeferredUniformTexture;
     GLint uGAlbedo;
     GLint uGPosition;
     GLint uGNormal;
@@ -317,7 +383,7 @@ struct App
     GLint wateruRTT;
 
     // Dudv texture
-    GLuint dudvTex;
+    u32 dudvTexIdx;
 
     // VAO object to link our screen filling quad with our textured quad shader
     GLuint vao;
@@ -326,6 +392,13 @@ struct App
 
     // Buffer handle
     Buffer uniformBuffer;
+    Buffer entityStorageBuffer;   // World and world-view-projection matrices of every entity, for the pass being drawn
+    Buffer drawBuffer;            // Entity and material of every draw of DrawScene, an instanced vertex attribute
+    Buffer drawCommandBuffer;     // Indirect commands of the draws of DrawScene
+    Buffer lightStorageBuffer;
+    Buffer materialStorageBuffer; // Parameters and texture layers of every material, indexed by the draws
+    u32    uploadedMaterialCount = 0; // In materialStorageBuffer
+    bool   materialTexturesChanged = false; // A texture switched storage or state since the last UploadMaterials
 
     // Uniform Block Alignment
     GLint uniformBufferAlignment;
@@ -388,6 +461,14 @@ struct App
     Transform waterTransform;
     float moveFactor = 0.0f;
     float waveSpeed = 0.005f;
+
+    // Levels of detail: every step of bias doubles the screen space error allowed. The water
+    // reflection and refraction passes add their own bias on top of the global one.
+    f32 lodBias = 0.0f;
+    f32 waterLodBias = 1.0f;
+    u32 drawnTriangles = 0; // By DrawScene in the last frame
+    u32 drawnSubmeshes = 0;
+    u32 drawBatches = 0;    // glMultiDrawElementsIndirect calls of DrawScene in the last frame
 };
 
 void Init(App* app);
@@ -402,6 +483,14 @@ void CreateUniformBuffers(App* app);
 
 void LoadShader(App* app, u32 index);
 
+void GetProgramUniformLocations(App* app);
+
+/**
+ * Compiles the program again from its source file. If it fails the previous program is kept,
+ * so a shader with errors can be fixed while the engine keeps running.
+ */
+bool ReloadProgram(App* app, u32 programIdx);
+
 void InitCamera(App* app);
 
 void InicializeGLInfo(App* app);
@@ -424,12 +513,19 @@ void GuiLights(App* app);
 
 void ShowOpenGlInfo(App* app);
 
+void GuiArenaStats(const Arena* arena, void* userData);
+
 std::string GetNewEntityName(App* app, std::string& name);
 
 std::string GetNewLightName(App* app, std::string& name);
 
 void Update(App* app);
 
+/**
+ * Reloads the shaders, textures and models whose files the file watcher reported as modified.
+ */
+void HotReloadAssets(App* app);
+
 void MoveCamera(App* app);
 
 void LookAtCamera(App* app);
@@ -444,9 +540,37 @@ void RecalculateProjection(App* app, glm::vec2 size);
 
 void UniformBufferAlignment(App* app, Camera cam, bool reflection);
 
+void UploadLights(App* app);
+
+/**
+ * Writes the materials to their storage buffer, with the page and layer of each of their
+ * textures (see texture_pages.h), or of its placeholder while it is not resident. Materials
+ * are only ever added, so it does nothing unless there are new ones or a texture they sample
+ * set materialTexturesChanged.
+ */
+void UploadMaterials(App* app);
+
 void Render(App* app);
 
-void DrawScene(App* app, u32 programIdx, GLuint uTexture, GLuint fbo);
+/**
+ * Picks the level of detail of a submesh: the simplest one whose error, projected to the screen,
+ * stays under LOD_PIXEL_ERROR pixels scaled by 2^lodBias. projectedRadius is the bounding radius
+ * of the mesh in pixels.
+ */
+u32 SelectSubmeshLod(const Submesh& submesh, f32 projectedRadius, f32 lodBias);
+
+/**
+ * Radius of the bounding sphere of the mesh of an entity on the screen, in pixels. FLT_MAX when
+ * the camera is inside it.
+ */
+f32 GetProjectedMeshRadius(const App* app, const Mesh& mesh, const Entity& entity);
+
+/**
+ * Draws the entities with a mesh program. The submeshes that share a vertex array and an albedo
+ * page are drawn together with glMultiDrawElementsIndirect, each draw finding its entity and
+ * material through the instanced draw attribute.
+ */
+void DrawScene(App* app, u32 programIdx, GLuint fbo, f32 lodBias);
 
 void RenderQuad(App* app);
 
@@ -462,14 +586,40 @@ void RenderWaterShader(App* app);
 
 void RenderDeferredLights(App* app, GLuint fbo);
 
-u32 LoadTexture2D(App* app, const char* filepath);
+void FreeImage(Image image);
+
+/**
+ * Loads a texture right away, for the placeholders and the other textures of the engine. Models
+ * request theirs with RequestTexture2D, which doesn't block.
+ */
+u32 LoadTexture2D(App* app, const char* filepath, TextureUsage usage = TEXTURE_USAGE_COLOR);
+
+/**
+ * Loads several textures right away, preparing them in parallel on the job system. Writes the
+ * texture index of each path, UINT32_MAX for the files that can't be read.
+ */
+void LoadTexture2DBatch(App* app, const char* const* filepaths, const TextureUsage* usages, u32 count, u32* texIndices);
+
+/**
+ * Handle to bind for a texture, which is a placeholder while it streams in or if it's missing.
+ */
+GLuint GetTextureHandle(const App* app, u32 texIdx);
 
 GLuint LoadCubemap(App* app);
 
 void GenerateSkyboxVAO(App* app);
 
+/**
+ * Vertex array of a submesh for a program, created the first time. The instanced draw attribute
+ * of the mesh programs reads the buffer bound to DRAW_BUFFER_BINDING (see DrawScene).
+ */
 GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program);
 
+/**
+ * Sets the position dequantization of the submesh in the bound program, before drawing it.
+ */
+void SetPositionDequantization(const Submesh& submesh);
+
 glm::mat4 TransformConstructor(const Transform t);
 
 glm::mat4 TransformPosition(glm::mat4 matrix, const vec3& pos);
@@ -0,0 +1,348 @@
+//
+// file_watcher.cpp : Implementation of the file change notifications declared in file_watcher.h.
+//
+
+#ifdef _WIN32
+#define VC_EXTRALEAN
+#define WIN32_LEAN_AND_MEAN
+#define _CRT_SECURE_NO_WARNINGS
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <unordered_map>
+#endif
+
+#include "file_watcher.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <string.h>
+
+#define FILE_WATCHER_BUFFER_SIZE KB(64)
+
+struct PendingFileChange
+{
+    std::string path;
+    u64         lastEventTime;
+};
+
+struct FileWatcher
+{
+    bool                           running = false;
+    std::thread                    thread;
+    std::string                    directory;
+
+    std::mutex                     mutex;
+    std::vector<PendingFileChange> pending;
+    std::atomic<u32>               pendingCount{ 0 };
+
+#ifdef _WIN32
+    HANDLE                         directoryHandle = INVALID_HANDLE_VALUE;
+    HANDLE                         stopEvent = NULL;
+#elif defined(__linux__)
+    int                            inotifyFd = -1;
+    int                            stopPipe[2] = { -1, -1 };
+    std::unordered_map<int, std::string> watchedDirectories; // inotify watch -> path relative to the root
+#endif
+};
+
+static FileWatcher GlobalFileWatcher;
+
+std::string NormalizePath(const char* path)
+{
+    std::string result;
+    result.reserve(strlen(path));
+    for (const char* c = path; *c; ++c)
+    {
+        char ch = *c == '\\' ? '/' : *c;
+        if (ch == '/' && (result.empty() || result.back() == '/'))
+            continue; // Leading or repeated separator
+        if (ch == '.' && (result.empty() || result.back() == '/') && (c[1] == '/' || c[1] == '\\'))
+        {
+            c++; // "./" segment
+            continue;
+        }
+        result.push_back(ch);
+    }
+    return result;
+}
+
+void QueueFileChange(const std::string& path)
+{
+    FileWatcher& watcher = GlobalFileWatcher;
+    std::string normalized = NormalizePath(path.c_str());
+    u64 now = GetTimeNanoseconds();
+
+    std::lock_guard<std::mutex> lock(watcher.mutex);
+    for (PendingFileChange& change : watcher.pending)
+    {
+        if (change.path == normalized)
+        {
+            change.lastEventTime = now;
+            return;
+        }
+    }
+    watcher.pending.push_back(PendingFileChange{ normalized, now });
+    watcher.pendingCount.store((u32)watcher.pending.size(), std::memory_order_release);
+}
+
+void PollFileChanges(std::vector<std::string>& changedFiles)
+{
+    FileWatcher& watcher = GlobalFileWatcher;
+    if (watcher.pendingCount.load(std::memory_order_acquire) == 0)
+        return;
+
+    u64 now = GetTimeNanoseconds();
+    std::lock_guard<std::mutex> lock(watcher.mutex);
+    for (u32 i = 0; i < watcher.pending.size();)
+    {
+        if (now - watcher.pending[i].lastEventTime >= FILE_WATCHER_SETTLE_NS)
+        {
+            changedFiles.push_back(watcher.pending[i].path);
+            watcher.pending.erase(watcher.pending.begin() + i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    watcher.pendingCount.store((u32)watcher.pending.size(), std::memory_order_release);
+}
+
+#ifdef _WIN32
+
+void FileWatcherThread()
+{
+    FileWatcher& watcher = GlobalFileWatcher;
+
+    // DWORD aligned, as ReadDirectoryChangesW requires
+    static DWORD buffer[FILE_WATCHER_BUFFER_SIZE / sizeof(DWORD)];
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    HANDLE events[2] = { overlapped.hEvent, watcher.stopEvent };
+
+    for (;;)
+    {
+        ResetEvent(overlapped.hEvent);
+        DWORD filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME;
+        if (!ReadDirectoryChangesW(watcher.directoryHandle, buffer, sizeof(buffer), TRUE, filter, NULL, &overlapped, NULL))
+        {
+            LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_PLATFORM, "ReadDirectoryChangesW() failed (%u), hot reload disabled", (u32)GetLastError());
+            break;
+        }
+
+        DWORD signaled = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+        if (signaled != WAIT_OBJECT_0)
+        {
+            CancelIo(watcher.directoryHandle);
+            break;
+        }
+
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(watcher.directoryHandle, &overlapped, &bytes, FALSE))
+            continue;
+        if (bytes == 0)
+        {
+            LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_PLATFORM, "Too many file changes at once, some may not be reloaded");
+            continue;
+        }
+
+        const u8* cursor = (const u8*)buffer;
+        for (;;)
+        {
+            const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)cursor;
+            if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED ||
+                info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+            {
+                char path[MAX_PATH * 3];
+                int len = WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR),
+                                              path, sizeof(path) - 1, NULL, NULL);
+                path[len] = '\0';
+                QueueFileChange(path);
+            }
+
+            if (info->NextEntryOffset == 0)
+                break;
+            cursor += info->NextEntryOffset;
+        }
+    }
+
+    CloseHandle(overlapped.hEvent);
+}
+
+bool InitFileWatcher(const char* directory)
+{
+    FileWatcher& watcher = GlobalFileWatcher;
+    if (watcher.running)
+        return true;
+
+    watcher.directoryHandle = CreateFileA(directory, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                          NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (watcher.directoryHandle == INVALID_HANDLE_VALUE)
+    {
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_PLATFORM, "Could not watch the directory %s, hot reload disabled", directory);
+        return false;
+    }
+
+    watcher.stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    watcher.directory = directory;
+    watcher.running = true;
+    watcher.thread = std::thread(FileWatcherThread);
+    return true;
+}
+
+void ShutdownFileWatcher()
+{
+    FileWatcher& watcher = GlobalFileWatcher;
+    if (!watcher.running)
+        return;
+
+    SetEvent(watcher.stopEvent);
+    watcher.thread.join();
+    CloseHandle(watcher.stopEvent);
+    CloseHandle(watcher.directoryHandle);
+    watcher.directoryHandle = INVALID_HANDLE_VALUE;
+    watcher.running = false;
+}
+
+#elif defined(__linux__)
+
+#define FILE_WATCHER_DIRECTORY_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+// inotify is not recursive, every subdirectory gets its own watch
+void WatchDirectoryTree(const std::string& relativePath)
+{
+    FileWatcher& watcher = GlobalFileWatcher;
+    std::string fullPath = relativePath.empty() ? watcher.directory : watcher.directory + "/" + relativePath;
+
+    int wd = inotify_add_watch(watcher.inotifyFd, fullPath.c_str(), FILE_WATCHER_DIRECTORY_EVENTS | IN_ONLYDIR);
+    if (wd < 0)
+    {
+        LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_PLATFORM, "inotify_add_watch() failed for %s", fullPath.c_str());
+        return;
+    }
+    watcher.watchedDirectories[wd] = relativePath;
+
+    DIR* dir = opendir(fullPath.c_str());
+    if (!dir)
+        return;
+    while (dirent* entry = readdir(dir))
+    {
+        if (entry->d_type != DT_DIR || strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        WatchDirectoryTree(relativePath.empty() ? entry->d_name : relativePath + "/" + entry->d_name);
+    }
+    closedir(dir);
+}
+
+void FileWatcherThread()
+{
+    FileWatcher& watcher = GlobalFileWatcher;
+
+    alignas(inotify_event) static char buffer[FILE_WATCHER_BUFFER_SIZE];
+    pollfd fds[2] = { { watcher.inotifyFd, POLLIN, 0 }, { watcher.stopPipe[0], POLLIN, 0 } };
+
+    for (;;)
+    {
+        if (poll(fds, 2, -1) < 0 || (fds[1].revents & POLLIN))
+            break;
+
+        ssize_t bytes = read(watcher.inotifyFd, buffer, sizeof(buffer));
+        if (bytes <= 0)
+            continue;
+
+        for (char* cursor = buffer; cursor < buffer + bytes;)
+        {
+            const inotify_event* event = (const inotify_event*)cursor;
+            cursor += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_PLATFORM, "Too many file changes at once, some may not be reloaded");
+                continue;
+            }
+            if (event->mask & IN_IGNORED)
+            {
+                watcher.watchedDirectories.erase(event->wd);
+                continue;
+            }
+
+            auto it = watcher.watchedDirectories.find(event->wd);
+            if (it == watcher.watchedDirectories.end() || event->len == 0)
+                continue;
+            std::string path = it->second.empty() ? event->name : it->second + "/" + event->name;
+
+            if (event->mask & IN_ISDIR)
+            {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    WatchDirectoryTree(path);
+            }
+            else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+            {
+                // Editors that save through a temporary file end with a rename, the others with a close
+                QueueFileChange(path);
+            }
+        }
+    }
+}
+
+bool InitFileWatcher(const char* directory)
+{
+    FileWatcher& watcher = GlobalFileWatcher;
+    if (watcher.running)
+        return true;
+
+    watcher.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher.inotifyFd < 0 || pipe(watcher.stopPipe) != 0)
+    {
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_PLATFORM, "inotify_init1() failed, hot reload disabled");
+        if (watcher.inotifyFd >= 0)
+            close(watcher.inotifyFd);
+        watcher.inotifyFd = -1;
+        return false;
+    }
+
+    watcher.directory = directory;
+    WatchDirectoryTree("");
+    watcher.running = true;
+    watcher.thread = std::thread(FileWatcherThread);
+    return true;
+}
+
+void ShutdownFileWatcher()
+{
+    FileWatcher& watcher = GlobalFileWatcher;
+    if (!watcher.running)
+        return;
+
+    char stop = 1;
+    if (write(watcher.stopPipe[1], &stop, 1) != 1)
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_PLATFORM, "Could not stop the file watcher thread");
+    watcher.thread.join();
+
+    close(watcher.stopPipe[0]);
+    close(watcher.stopPipe[1]);
+    close(watcher.inotifyFd);
+    watcher.inotifyFd = -1;
+    watcher.watchedDirectories.clear();
+    watcher.running = false;
+}
+
+#else
+
+bool InitFileWatcher(const char* directory)
+{
+    LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_PLATFORM, "File watching is not supported on this platform, hot reload disabled");
+    return false;
+}
+
+void ShutdownFileWatcher()
+{
+}
+
+#endif
@@ -0,0 +1,34 @@
+//
+// file_watcher.h : Notifies the files modified under a directory tree. A background thread
+// blocks on the notifications of the operating system (inotify on Linux, ReadDirectoryChangesW
+// on Windows) and queues the modified paths, so checking for changes every frame only reads
+// an atomic flag. Used by the engine to hot reload shaders, textures and models.
+//
+
+#pragma once
+
+#include "platform.h"
+
+// Changes are reported once the file has not been modified for this long, so editors that
+// write a file in several steps trigger a single reload of the complete file
+#define FILE_WATCHER_SETTLE_NS 100000000ull
+
+/**
+ * Starts watching the directory and all its subdirectories. Returns false if the platform
+ * notifications could not be set up, in which case no change is ever reported.
+ */
+bool InitFileWatcher(const char* directory);
+
+void ShutdownFileWatcher();
+
+/**
+ * Appends the files modified since the last call (each one once) to the list. Paths are
+ * relative to the watched directory and normalized with NormalizePath.
+ */
+void PollFileChanges(std::vector<std::string>& changedFiles);
+
+/**
+ * Uses '/' as separator and removes "./" prefixes and repeated separators, so the paths
+ * given to the loaders can be compared with the ones reported by the watcher.
+ */
+std::string NormalizePath(const char* path);
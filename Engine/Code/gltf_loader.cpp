@@ -0,0 +1,1048 @@
+//
+// gltf_loader.cpp : Implementation of the .glb loader declared in gltf_loader.h, with the small
+// JSON parser it needs for the glTF document.
+//
+// Everything in the file is validated before the first GL call, so a file the loader can't
+// handle leaves no buffers, materials or textures behind. Then the buffer views used as vertex
+// or index data are placed in the mesh buffers and uploaded from the mapping, and each
+// primitive becomes a submesh whose attributes point into its views.
+//
+
+#include "gltf_loader.h"
+#include "profiler.h"
+#include "job_system.h"
+#include "texture_cache.h"
+#include "texture_registry.h"
+#include "texture_pages.h"
+#include "mesh_optimization.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GLB_VIEW_ALIGNMENT 16
+#define GLB_MAX_NODE_DEPTH 64
+#define JSON_MAX_DEPTH     64
+
+///////////////////////////////////////////////////////////////////////
+// JSON
+
+enum JsonType : u8
+{
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+};
+
+struct JsonValue
+{
+    JsonType                 type = JSON_NULL;
+    bool                     boolean = false;
+    f64                      number = 0.0;
+    std::string              string;
+    std::vector<std::string> keys;   // Member names of objects
+    std::vector<JsonValue>   values; // Elements of arrays, member values of objects
+
+    // Missing members and elements are null values, so lookups can be chained
+    const JsonValue& operator[](const char* key) const;
+    const JsonValue& operator[](u32 index) const;
+    u32 Count() const { return type == JSON_ARRAY ? (u32)values.size() : 0; }
+};
+
+static const JsonValue JsonNullValue = JsonValue();
+
+const JsonValue& JsonValue::operator[](const char* key) const
+{
+    for (u32 i = 0; i < keys.size(); ++i)
+        if (keys[i] == key)
+            return values[i];
+    return JsonNullValue;
+}
+
+const JsonValue& JsonValue::operator[](u32 index) const
+{
+    return type == JSON_ARRAY && index < values.size() ? values[index] : JsonNullValue;
+}
+
+f64 GetJsonNumber(const JsonValue& value, f64 defaultValue)
+{
+    return value.type == JSON_NUMBER ? value.number : defaultValue;
+}
+
+// glTF references other objects by their index, UINT32_MAX when missing or invalid
+u32 GetJsonIndex(const JsonValue& value)
+{
+    return value.type == JSON_NUMBER && value.number >= 0.0 && value.number < (f64)UINT32_MAX ? (u32)value.number : UINT32_MAX;
+}
+
+struct JsonParser
+{
+    const char* p;
+    const char* end; // The text is null terminated, for strtod
+};
+
+void SkipJsonSpaces(JsonParser& parser)
+{
+    while (parser.p < parser.end && (*parser.p == ' ' || *parser.p == '\t' || *parser.p == '\n' || *parser.p == '\r'))
+        ++parser.p;
+}
+
+bool ParseJsonHex4(JsonParser& parser, u32& codepoint)
+{
+    if (parser.end - parser.p < 4)
+        return false;
+    codepoint = 0;
+    for (u32 i = 0; i < 4; ++i)
+    {
+        char c = *parser.p++;
+        u32 digit = c >= '0' && c <= '9' ? c - '0' : (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : 16;
+        if (digit > 15)
+            return false;
+        codepoint = codepoint * 16 + digit;
+    }
+    return true;
+}
+
+void AppendUtf8(std::string& string, u32 codepoint)
+{
+    if (codepoint < 0x80)
+    {
+        string.push_back((char)codepoint);
+    }
+    else if (codepoint < 0x800)
+    {
+        string.push_back((char)(0xC0 | (codepoint >> 6)));
+        string.push_back((char)(0x80 | (codepoint & 0x3F)));
+    }
+    else if (codepoint < 0x10000)
+    {
+        string.push_back((char)(0xE0 | (codepoint >> 12)));
+        string.push_back((char)(0x80 | ((codepoint >> 6) & 0x3F)));
+        string.push_back((char)(0x80 | (codepoint & 0x3F)));
+    }
+    else
+    {
+        string.push_back((char)(0xF0 | (codepoint >> 18)));
+        string.push_back((char)(0x80 | ((codepoint >> 12) & 0x3F)));
+        string.push_back((char)(0x80 | ((codepoint >> 6) & 0x3F)));
+        string.push_back((char)(0x80 | (codepoint & 0x3F)));
+    }
+}
+
+bool ParseJsonString(JsonParser& parser, std::string& string)
+{
+    ++parser.p; // Opening quote
+    while (parser.p < parser.end && *parser.p != '"')
+    {
+        char c = *parser.p++;
+        if (c != '\\')
+        {
+            string.push_back(c);
+            continue;
+        }
+
+        if (parser.p == parser.end)
+            return false;
+        char escape = *parser.p++;
+        switch (escape)
+        {
+        case '"': case '\\': case '/': string.push_back(escape); break;
+        case 'b': string.push_back('\b'); break;
+        case 'f': string.push_back('\f'); break;
+        case 'n': string.push_back('\n'); break;
+        case 'r': string.push_back('\r'); break;
+        case 't': string.push_back('\t'); break;
+        case 'u':
+        {
+            u32 codepoint;
+            if (!ParseJsonHex4(parser, codepoint))
+                return false;
+            if (codepoint >= 0xD800 && codepoint < 0xDC00 && parser.end - parser.p >= 2 && parser.p[0] == '\\' && parser.p[1] == 'u')
+            {
+                // Surrogate pair
+                u32 low;
+                parser.p += 2;
+                if (!ParseJsonHex4(parser, low) || low < 0xDC00 || low >= 0xE000)
+                    return false;
+                codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+            }
+            AppendUtf8(string, codepoint);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    if (parser.p == parser.end)
+        return false;
+    ++parser.p; // Closing quote
+    return true;
+}
+
+bool MatchJsonLiteral(JsonParser& parser, const char* literal)
+{
+    size_t len = strlen(literal);
+    if ((size_t)(parser.end - parser.p) < len || memcmp(parser.p, literal, len) != 0)
+        return false;
+    parser.p += len;
+    return true;
+}
+
+bool ParseJsonValue(JsonParser& parser, JsonValue& value, u32 depth)
+{
+    if (depth > JSON_MAX_DEPTH)
+        return false;
+
+    SkipJsonSpaces(parser);
+    if (parser.p == parser.end)
+        return false;
+
+    switch (*parser.p)
+    {
+    case '{':
+    {
+        value.type = JSON_OBJECT;
+        ++parser.p;
+        SkipJsonSpaces(parser);
+        if (parser.p < parser.end && *parser.p == '}')
+        {
+            ++parser.p;
+            return true;
+        }
+        for (;;)
+        {
+            SkipJsonSpaces(parser);
+            if (parser.p == parser.end || *parser.p != '"')
+                return false;
+            value.keys.emplace_back();
+            if (!ParseJsonString(parser, value.keys.back()))
+                return false;
+
+            SkipJsonSpaces(parser);
+            if (parser.p == parser.end || *parser.p != ':')
+                return false;
+            ++parser.p;
+            value.values.emplace_back();
+            if (!ParseJsonValue(parser, value.values.back(), depth + 1))
+                return false;
+
+            SkipJsonSpaces(parser);
+            if (parser.p < parser.end && *parser.p == ',')
+            {
+                ++parser.p;
+                continue;
+            }
+            if (parser.p < parser.end && *parser.p == '}')
+            {
+                ++parser.p;
+                return true;
+            }
+            return false;
+        }
+    }
+    case '[':
+    {
+        value.type = JSON_ARRAY;
+        ++parser.p;
+        SkipJsonSpaces(parser);
+        if (parser.p < parser.end && *parser.p == ']')
+        {
+            ++parser.p;
+            return true;
+        }
+        for (;;)
+        {
+            value.values.emplace_back();
+            if (!ParseJsonValue(parser, value.values.back(), depth + 1))
+                return false;
+
+            SkipJsonSpaces(parser);
+            if (parser.p < parser.end && *parser.p == ',')
+            {
+                ++parser.p;
+                continue;
+            }
+            if (parser.p < parser.end && *parser.p == ']')
+            {
+                ++parser.p;
+                return true;
+            }
+            return false;
+        }
+    }
+    case '"':
+        value.type = JSON_STRING;
+        return ParseJsonString(parser, value.string);
+    case 't':
+        value.type = JSON_BOOL;
+        value.boolean = true;
+        return MatchJsonLiteral(parser, "true");
+    case 'f':
+        value.type = JSON_BOOL;
+        return MatchJsonLiteral(parser, "false");
+    case 'n':
+        return MatchJsonLiteral(parser, "null");
+    default:
+    {
+        char* numberEnd = NULL;
+        value.type = JSON_NUMBER;
+        value.number = strtod(parser.p, &numberEnd);
+        if (numberEnd == parser.p || numberEnd > parser.end)
+            return false;
+        parser.p = numberEnd;
+        return true;
+    }
+    }
+}
+
+bool ParseJson(const std::string& text, JsonValue& value)
+{
+    JsonParser parser = { text.c_str(), text.c_str() + text.size() };
+    if (!ParseJsonValue(parser, value, 0))
+        return false;
+    SkipJsonSpaces(parser);
+    return parser.p == parser.end;
+}
+
+///////////////////////////////////////////////////////////////////////
+// glTF document
+
+enum GlbViewUsage : u8
+{
+    GLB_VIEW_UNUSED,
+    GLB_VIEW_VERTICES,
+    GLB_VIEW_INDICES,
+};
+
+struct GlbBufferView
+{
+    u64          offset;    // In the BIN chunk
+    u64          length;
+    u32          stride;    // 0 for tightly packed elements
+    GlbViewUsage usage;
+    u32          placement; // Offset in the vertex or index buffer of the mesh
+};
+
+struct GlbAccessor
+{
+    bool   valid;           // False for the accessors this loader can't read (sparse, no view...)
+    u32    view;
+    u64    offset;          // In the view
+    u32    count;
+    GLenum componentType;   // glTF uses the GL enums
+    u32    componentCount;
+    bool   normalized;
+};
+
+struct GlbAttribute
+{
+    const char* name;
+    u8          location;
+};
+
+// Same locations as the imported meshes. The tangent keeps its fourth component (the sign of
+// the bitangent), and there is no bitangent attribute, which no shader reads.
+static const GlbAttribute GlbAttributes[] =
+{
+    { "POSITION",   0 },
+    { "NORMAL",     1 },
+    { "TEXCOORD_0", 2 },
+    { "TANGENT",    3 },
+};
+
+#define GLB_ATTRIBUTE_COUNT ARRAY_COUNT(GlbAttributes)
+
+struct GlbPrimitive
+{
+    u32 attributeAccessors[GLB_ATTRIBUTE_COUNT]; // UINT32_MAX when missing
+    u32 indexAccessor;                           // UINT32_MAX for primitives without indices
+    u32 material;                                // UINT32_MAX for the default material
+    u32 vertexCount;
+    u32 generatedIndexPlacement;                 // Primitives without indices get a sequence
+};
+
+struct GlbDocument
+{
+    const char*                filepath;
+    JsonValue                  json;
+    const u8*                  bin;
+    u64                        binSize;
+    std::vector<GlbBufferView> views;
+    std::vector<GlbAccessor>   accessors;
+    std::vector<GlbPrimitive>  primitives;
+    u32                        vertexBufferSize;
+    u32                        indexBufferSize;
+};
+
+struct GlbImage
+{
+    std::string key;      // Texture filepath in the app: "<model>#image<index>"
+    std::string filepath; // External images, empty for the ones in the BIN chunk
+    const u8*   data;
+    u64         size;
+    TextureMips mips;
+};
+
+bool IsGlbFile(const char* filepath)
+{
+    size_t len = strlen(filepath);
+    if (len < 4)
+        return false;
+    const char* extension = filepath + len - 4;
+    return extension[0] == '.' && (extension[1] | 0x20) == 'g' && (extension[2] | 0x20) == 'l' && (extension[3] | 0x20) == 'b';
+}
+
+u32 GetGlbComponentSize(GLenum componentType)
+{
+    switch (componentType)
+    {
+    case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+    case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: return 2;
+    case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+    default: return 0;
+    }
+}
+
+u32 GetGlbComponentCount(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    return 0; // Matrices are not vertex attributes
+}
+
+u32 GetGlbAccessorStride(const GlbDocument& document, const GlbAccessor& accessor)
+{
+    u32 stride = document.views[accessor.view].stride;
+    return stride ? stride : accessor.componentCount * GetGlbComponentSize(accessor.componentType);
+}
+
+// Splits the file in its JSON and BIN chunks and parses the JSON
+bool ReadGlbChunks(const FileView& file, GlbDocument& document)
+{
+    if (file.size < 20)
+        return false;
+
+    u32 header[3];
+    memcpy(header, file.data, sizeof(header));
+    if (header[0] != GLB_MAGIC || header[1] != GLB_VERSION || header[2] > file.size)
+        return false;
+
+    u64 cursor = 12;
+    bool hasJson = false;
+    while (cursor + 8 <= header[2])
+    {
+        u32 chunk[2];
+        memcpy(chunk, file.data + cursor, sizeof(chunk));
+        cursor += 8;
+        if (chunk[0] > header[2] - cursor)
+            return false;
+
+        if (chunk[1] == GLB_CHUNK_JSON && !hasJson)
+        {
+            std::string text((const char*)file.data + cursor, chunk[0]);
+            if (!ParseJson(text, document.json))
+                return false;
+            hasJson = true;
+        }
+        else if (chunk[1] == GLB_CHUNK_BIN && !document.bin)
+        {
+            document.bin = file.data + cursor;
+            document.binSize = chunk[0];
+        }
+        cursor += (chunk[0] + 3) & ~3u; // Chunks are 4 byte aligned
+    }
+    return hasJson && document.json.type == JSON_OBJECT;
+}
+
+bool ReadGlbViews(GlbDocument& document)
+{
+    const JsonValue& buffers = document.json["buffers"];
+    const JsonValue& views = document.json["bufferViews"];
+
+    for (u32 i = 0; i < buffers.Count(); ++i)
+    {
+        // Only the BIN chunk, which is the first buffer without uri
+        if (i > 0 || buffers[i]["uri"].type != JSON_NULL || !document.bin)
+        {
+            LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "%s references external buffers", document.filepath);
+            return false;
+        }
+    }
+
+    document.views.resize(views.Count());
+    for (u32 i = 0; i < views.Count(); ++i)
+    {
+        GlbBufferView& view = document.views[i];
+        view = {};
+        view.offset = (u64)GetJsonNumber(views[i]["byteOffset"], 0.0);
+        view.length = (u64)GetJsonNumber(views[i]["byteLength"], 0.0);
+        view.stride = (u32)GetJsonNumber(views[i]["byteStride"], 0.0);
+        if (GetJsonIndex(views[i]["buffer"]) != 0 || view.offset + view.length > document.binSize || view.stride > 252)
+            return false;
+    }
+    return true;
+}
+
+void ReadGlbAccessors(GlbDocument& document)
+{
+    const JsonValue& accessors = document.json["accessors"];
+    document.accessors.resize(accessors.Count());
+    for (u32 i = 0; i < accessors.Count(); ++i)
+    {
+        const JsonValue& json = accessors[i];
+        GlbAccessor& accessor = document.accessors[i];
+        accessor = {};
+        accessor.view = GetJsonIndex(json["bufferView"]);
+        accessor.offset = (u64)GetJsonNumber(json["byteOffset"], 0.0);
+        accessor.count = (u32)GetJsonNumber(json["count"], 0.0);
+        accessor.componentType = (GLenum)GetJsonNumber(json["componentType"], 0.0);
+        accessor.componentCount = GetGlbComponentCount(json["type"].string);
+        accessor.normalized = json["normalized"].boolean;
+
+        u32 componentSize = GetGlbComponentSize(accessor.componentType);
+        if (accessor.view >= document.views.size() || componentSize == 0 || accessor.componentCount == 0 ||
+            json["sparse"].type != JSON_NULL)
+            continue;
+
+        const GlbBufferView& view = document.views[accessor.view];
+        u64 elementSize = accessor.componentCount * componentSize;
+        u64 stride = GetGlbAccessorStride(document, accessor);
+        u64 lastElementEnd = accessor.count > 0 ? accessor.offset + stride * (accessor.count - 1) + elementSize : 0;
+        accessor.valid = lastElementEnd <= view.length && accessor.offset % componentSize == 0 && view.offset % componentSize == 0;
+    }
+}
+
+bool IsGlbIdentity(const JsonValue& node)
+{
+    const JsonValue& matrix = node["matrix"];
+    for (u32 i = 0; i < matrix.Count(); ++i)
+        if (GetJsonNumber(matrix[i], 0.0) != (i % 5 == 0 ? 1.0 : 0.0))
+            return false;
+
+    const JsonValue& translation = node["translation"];
+    const JsonValue& rotation = node["rotation"];
+    const JsonValue& scale = node["scale"];
+    for (u32 i = 0; i < 4; ++i)
+    {
+        if (GetJsonNumber(translation[i], 0.0) != 0.0 || GetJsonNumber(scale[i], 1.0) != 1.0 ||
+            GetJsonNumber(rotation[i], i == 3 ? 1.0 : 0.0) != (i == 3 ? 1.0 : 0.0))
+            return false;
+    }
+    return true;
+}
+
+// The vertices are uploaded as they are, so the meshes can't be moved by their nodes
+bool CollectGlbMeshes(const GlbDocument& document, u32 nodeIndex, u32 depth, std::vector<u32>& meshes)
+{
+    const JsonValue& node = document.json["nodes"][nodeIndex];
+    if (node.type != JSON_OBJECT || depth > GLB_MAX_NODE_DEPTH)
+        return false;
+
+    if (!IsGlbIdentity(node))
+    {
+        LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "%s uses node transforms", document.filepath);
+        return false;
+    }
+
+    u32 mesh = GetJsonIndex(node["mesh"]);
+    if (mesh != UINT32_MAX && std::find(meshes.begin(), meshes.end(), mesh) == meshes.end())
+        meshes.push_back(mesh);
+
+    const JsonValue& children = node["children"];
+    for (u32 i = 0; i < children.Count(); ++i)
+        if (!CollectGlbMeshes(document, GetJsonIndex(children[i]), depth + 1, meshes))
+            return false;
+    return true;
+}
+
+bool MarkGlbView(GlbDocument& document, u32 accessorIndex, GlbViewUsage usage)
+{
+    GlbBufferView& view = document.views[document.accessors[accessorIndex].view];
+    if (view.usage != GLB_VIEW_UNUSED && view.usage != usage)
+        return false; // GL can't use the same range as vertices and indices
+    view.usage = usage;
+    return true;
+}
+
+bool ReadGlbPrimitives(GlbDocument& document)
+{
+    const JsonValue& json = document.json;
+    const JsonValue& required = json["extensionsRequired"];
+    for (u32 i = 0; i < required.Count(); ++i)
+    {
+        if (required[i].string != "KHR_mesh_quantization")
+        {
+            LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "%s requires the extension %s", document.filepath, required[i].string);
+            return false;
+        }
+    }
+
+    // The meshes of the default scene, or all of them in files without scenes
+    std::vector<u32> meshes;
+    const JsonValue& scenes = json["scenes"];
+    if (scenes.Count() > 0)
+    {
+        u32 sceneIndex = GetJsonIndex(json["scene"]);
+        const JsonValue& rootNodes = scenes[sceneIndex != UINT32_MAX ? sceneIndex : 0]["nodes"];
+        for (u32 i = 0; i < rootNodes.Count(); ++i)
+            if (!CollectGlbMeshes(document, GetJsonIndex(rootNodes[i]), 0, meshes))
+                return false;
+    }
+    else
+    {
+        for (u32 i = 0; i < json["meshes"].Count(); ++i)
+            meshes.push_back(i);
+    }
+
+    for (u32 meshIndex : meshes)
+    {
+        const JsonValue& primitives = json["meshes"][meshIndex]["primitives"];
+        for (u32 p = 0; p < primitives.Count(); ++p)
+        {
+            const JsonValue& primitiveJson = primitives[p];
+            if (GetJsonNumber(primitiveJson["mode"], 4.0) != 4.0)
+                continue; // Points and lines are not rendered
+
+            GlbPrimitive primitive = {};
+            primitive.indexAccessor = GetJsonIndex(primitiveJson["indices"]);
+            primitive.material = GetJsonIndex(primitiveJson["material"]);
+            if (primitive.material != UINT32_MAX && primitive.material >= json["materials"].Count())
+                return false;
+
+            for (u32 a = 0; a < GLB_ATTRIBUTE_COUNT; ++a)
+            {
+                const JsonValue& attribute = primitiveJson["attributes"][GlbAttributes[a].name];
+                u32 accessor = attribute.type == JSON_NULL ? UINT32_MAX : GetJsonIndex(attribute);
+                primitive.attributeAccessors[a] = accessor;
+                if (attribute.type == JSON_NULL)
+                    continue;
+                if (accessor >= document.accessors.size() || !document.accessors[accessor].valid || !MarkGlbView(document, accessor, GLB_VIEW_VERTICES))
+                    return false;
+            }
+
+            // Normals would have to be generated, which Assimp does
+            u32 positions = primitive.attributeAccessors[0];
+            if (positions == UINT32_MAX || primitive.attributeAccessors[1] == UINT32_MAX)
+            {
+                LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "%s has primitives without normals", document.filepath);
+                return false;
+            }
+            primitive.vertexCount = document.accessors[positions].count;
+            for (u32 a = 0; a < GLB_ATTRIBUTE_COUNT; ++a)
+                if (primitive.attributeAccessors[a] != UINT32_MAX && document.accessors[primitive.attributeAccessors[a]].count != primitive.vertexCount)
+                    return false;
+
+            if (primitive.indexAccessor != UINT32_MAX)
+            {
+                if (primitive.indexAccessor >= document.accessors.size())
+                    return false;
+                const GlbAccessor& indices = document.accessors[primitive.indexAccessor];
+                bool validType = indices.componentType == GL_UNSIGNED_BYTE || indices.componentType == GL_UNSIGNED_SHORT || indices.componentType == GL_UNSIGNED_INT;
+                u32 stride = document.views[indices.view].stride;
+                if (!indices.valid || !validType || indices.componentCount != 1 || (stride != 0 && stride != GetGlbComponentSize(indices.componentType)) ||
+                    !MarkGlbView(document, primitive.indexAccessor, GLB_VIEW_INDICES))
+                    return false;
+            }
+
+            document.primitives.push_back(primitive);
+        }
+    }
+
+    if (document.primitives.empty())
+    {
+        LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "%s has no triangles", document.filepath);
+        return false;
+    }
+    return true;
+}
+
+u64 AlignGlbPlacement(u64 offset)
+{
+    return (offset + GLB_VIEW_ALIGNMENT - 1) & ~(u64)(GLB_VIEW_ALIGNMENT - 1);
+}
+
+// Places the used views, and the indices generated for primitives without them, in the buffers
+bool PlaceGlbViews(GlbDocument& document)
+{
+    u64 vertexBufferSize = 0;
+    u64 indexBufferSize = 0;
+    for (GlbBufferView& view : document.views)
+    {
+        u64& bufferSize = view.usage == GLB_VIEW_VERTICES ? vertexBufferSize : indexBufferSize;
+        if (view.usage == GLB_VIEW_UNUSED)
+            continue;
+        bufferSize = AlignGlbPlacement(bufferSize);
+        view.placement = (u32)bufferSize;
+        bufferSize += view.length;
+    }
+    for (GlbPrimitive& primitive : document.primitives)
+    {
+        if (primitive.indexAccessor != UINT32_MAX)
+            continue;
+        indexBufferSize = AlignGlbPlacement(indexBufferSize);
+        primitive.generatedIndexPlacement = (u32)indexBufferSize;
+        indexBufferSize += (u64)primitive.vertexCount * sizeof(u32);
+    }
+
+    document.vertexBufferSize = (u32)vertexBufferSize;
+    document.indexBufferSize = (u32)indexBufferSize;
+    return vertexBufferSize <= UINT32_MAX && indexBufferSize <= UINT32_MAX;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Loading
+
+void UploadGlbBuffers(const GlbDocument& document, Mesh& mesh)
+{
+    glGenBuffers(1, &mesh.vertexBufferHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
+    glBufferData(GL_ARRAY_BUFFER, document.vertexBufferSize, NULL, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &mesh.indexBufferHandle);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, document.indexBufferSize, NULL, GL_STATIC_DRAW);
+
+    // Straight from the mapped file
+    for (const GlbBufferView& view : document.views)
+    {
+        if (view.usage == GLB_VIEW_VERTICES)
+            glBufferSubData(GL_ARRAY_BUFFER, view.placement, view.length, document.bin + view.offset);
+        else if (view.usage == GLB_VIEW_INDICES)
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, view.placement, view.length, document.bin + view.offset);
+    }
+
+    std::vector<u32> sequence;
+    for (const GlbPrimitive& primitive : document.primitives)
+    {
+        if (primitive.indexAccessor != UINT32_MAX)
+            continue;
+        for (u32 i = (u32)sequence.size(); i < primitive.vertexCount; ++i)
+            sequence.push_back(i);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, primitive.generatedIndexPlacement, primitive.vertexCount * sizeof(u32), sequence.data());
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CreateGlbSubmeshes(const GlbDocument& document, Mesh& mesh)
+{
+    for (const GlbPrimitive& primitive : document.primitives)
+    {
+        Submesh submesh = {};
+        submesh.vertexOffset = 0; // The attribute offsets point into the views
+        submesh.vertexBufferLayout.stride = 0;
+
+        for (u32 a = 0; a < GLB_ATTRIBUTE_COUNT; ++a)
+        {
+            if (primitive.attributeAccessors[a] == UINT32_MAX)
+                continue;
+
+            const GlbAccessor& accessor = document.accessors[primitive.attributeAccessors[a]];
+            VertexBufferAttribute attribute = { GlbAttributes[a].location, (u8)accessor.componentCount,
+                                                (u32)(document.views[accessor.view].placement + accessor.offset) };
+            attribute.type = accessor.componentType;
+            attribute.normalized = accessor.normalized;
+            attribute.stride = (u8)GetGlbAccessorStride(document, accessor);
+            submesh.vertexBufferLayout.attributes.push_back(attribute);
+        }
+
+        if (primitive.indexAccessor != UINT32_MAX)
+        {
+            const GlbAccessor& indices = document.accessors[primitive.indexAccessor];
+            submesh.indexOffset = (u32)(document.views[indices.view].placement + indices.offset);
+            submesh.indexCount = indices.count;
+            submesh.indexType = indices.componentType;
+        }
+        else
+        {
+            submesh.indexOffset = primitive.generatedIndexPlacement;
+            submesh.indexCount = primitive.vertexCount;
+            submesh.indexType = GL_UNSIGNED_INT;
+        }
+
+        mesh.submeshes.push_back(std::move(submesh));
+    }
+}
+
+// Bounds of the positions of the primitives. glTF requires the min and max of position accessors,
+// files that miss them have their float positions read
+void ComputeGlbBounds(const GlbDocument& document, Mesh& mesh)
+{
+    const JsonValue& accessors = document.json["accessors"];
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    for (const GlbPrimitive& primitive : document.primitives)
+    {
+        u32 accessorIdx = primitive.attributeAccessors[0];
+        const JsonValue& min = accessors[accessorIdx]["min"];
+        const JsonValue& max = accessors[accessorIdx]["max"];
+        if (min.Count() == 3 && max.Count() == 3)
+        {
+            for (u32 c = 0; c < 3; ++c)
+            {
+                boundsMin[c] = std::min(boundsMin[c], (f32)GetJsonNumber(min[c], 0.0));
+                boundsMax[c] = std::max(boundsMax[c], (f32)GetJsonNumber(max[c], 0.0));
+            }
+            continue;
+        }
+
+        const GlbAccessor& accessor = document.accessors[accessorIdx];
+        if (accessor.componentType != GL_FLOAT || accessor.componentCount != 3)
+            continue;
+        const u8* data = document.bin + document.views[accessor.view].offset + accessor.offset;
+        u32 stride = GetGlbAccessorStride(document, accessor);
+        for (u32 i = 0; i < accessor.count; ++i)
+        {
+            vec3 p;
+            memcpy(&p, data + (u64)i * stride, sizeof(p));
+            boundsMin = glm::min(boundsMin, p);
+            boundsMax = glm::max(boundsMax, p);
+        }
+    }
+
+    if (boundsMin.x <= boundsMax.x)
+        SetMeshBounds(mesh, boundsMin, boundsMax);
+}
+
+void DecodeGlbImageRange(void* data, u32 begin, u32 end)
+{
+    GlbImage* images = (GlbImage*)data;
+    for (u32 i = begin; i < end; ++i)
+    {
+        GlbImage& glbImage = images[i];
+        FileView file = {};
+        const u8* encoded = glbImage.data;
+        u64 size = glbImage.size;
+        if (!glbImage.filepath.empty())
+        {
+            file = MapFile(glbImage.filepath.c_str());
+            encoded = file.data;
+            size = file.size;
+        }
+        if (!encoded)
+            continue;
+
+        // glTF texture coordinates start at the top left corner, unlike the other assets of the
+        // engine, so these images are not flipped. The mip chain is built here too, off the main
+        // thread
+        Image image;
+        bool decoded = DecodeImage(encoded, size, false, image);
+        UnmapFile(file);
+        if (!decoded)
+            continue;
+
+        BuildTextureMips(glbImage.mips, image);
+        FreeImage(image);
+    }
+}
+
+// Percent-encoded characters of relative URIs
+std::string DecodeGlbUri(const std::string& uri)
+{
+    std::string path;
+    for (size_t i = 0; i < uri.size(); ++i)
+    {
+        if (uri[i] == '%' && i + 2 < uri.size())
+        {
+            // Reuses the parser of \u escapes, with two leading zeros
+            char digits[4] = { '0', '0', uri[i + 1], uri[i + 2] };
+            JsonParser parser = { digits, digits + 4 };
+            u32 value;
+            if (ParseJsonHex4(parser, value))
+            {
+                path.push_back((char)value);
+                i += 2;
+                continue;
+            }
+        }
+        path.push_back(uri[i]);
+    }
+    return path;
+}
+
+// Decodes the images used by the materials and creates their textures. Writes the texture index
+// of every image (UINT32_MAX when unused or invalid).
+void LoadGlbImages(App* app, const GlbDocument& document, const std::vector<bool>& usedImages, std::vector<u32>& textureIndices)
+{
+    const JsonValue& imagesJson = document.json["images"];
+    textureIndices.assign(imagesJson.Count(), UINT32_MAX);
+
+    Arena* scratch = GetThreadArena();
+    TempArenaScope tempScope(scratch);
+    String directory = GetDirectoryPart(MakeString(document.filepath, scratch), scratch);
+
+    std::vector<GlbImage> images;
+    std::vector<u32> imageIndices;
+    for (u32 i = 0; i < imagesJson.Count(); ++i)
+    {
+        if (!usedImages[i])
+            continue;
+
+        const JsonValue& json = imagesJson[i];
+        GlbImage image = {};
+        image.key = std::string(document.filepath) + "#image" + std::to_string(i);
+        u32 view = GetJsonIndex(json["bufferView"]);
+        if (view < document.views.size())
+        {
+            image.data = document.bin + document.views[view].offset;
+            image.size = document.views[view].length;
+        }
+        else if (json["uri"].type == JSON_STRING && json["uri"].string.compare(0, 5, "data:") != 0)
+        {
+            std::string filename = DecodeGlbUri(json["uri"].string);
+            image.filepath = MakePath(directory, MakeString(filename.c_str(), scratch), scratch).str;
+        }
+        else
+        {
+            LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "Image %u of %s is not supported", i, document.filepath);
+            continue;
+        }
+
+        images.push_back(image);
+        imageIndices.push_back(i);
+    }
+
+    ParallelFor((u32)images.size(), 1, DecodeGlbImageRange, images.data());
+
+    // Created on this thread, which owns the GL context. Reloads of the model give the textures
+    // created the first time new handles, since their storage is immutable.
+    for (u32 i = 0; i < images.size(); ++i)
+    {
+        TextureMips& mips = images[i].mips;
+        if (mips.levelCount == 0)
+        {
+            LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_ASSETS, "Could not decode image %u of %s", imageIndices[i], document.filepath);
+            continue;
+        }
+
+        u32 texIdx = FindTexture(app, images[i].key.c_str());
+        GLuint texHandle = CreateTexture2DFromMips(mips);
+        if (texIdx != UINT32_MAX)
+        {
+            DeleteTextureLayer(app->textures[texIdx].handle);
+            app->textures[texIdx].handle = texHandle;
+            app->textures[texIdx].state = TEXTURE_STATE_RESIDENT;
+            app->textures[texIdx].memorySize = GetTextureMemorySize(mips);
+            app->materialTexturesChanged = true;
+        }
+        else
+        {
+            Texture texture = {};
+            texture.handle = texHandle;
+            texture.filepath = MakeString(images[i].key.c_str(), &GlobalLevelArena).str;
+            texture.state = TEXTURE_STATE_RESIDENT;
+            texture.memorySize = GetTextureMemorySize(mips);
+            texIdx = AddTexture(app, texture);
+        }
+        textureIndices[imageIndices[i]] = texIdx;
+        ReleaseTextureMips(mips);
+    }
+}
+
+u32 GetGlbTextureImage(const GlbDocument& document, const JsonValue& textureInfo)
+{
+    u32 texture = GetJsonIndex(textureInfo["index"]);
+    return GetJsonIndex(document.json["textures"][texture]["source"]);
+}
+
+void LoadGlbMaterials(App* app, const GlbDocument& document, std::vector<u32>& submeshMaterialIndices)
+{
+    const JsonValue& materialsJson = document.json["materials"];
+    u32 materialCount = materialsJson.Count();
+    u32 imageCount = document.json["images"].Count();
+
+    // Albedo, emissive and normals images of every material
+    std::vector<u32> materialImages(materialCount * 3);
+    std::vector<bool> usedImages(imageCount, false);
+    for (u32 i = 0; i < materialCount; ++i)
+    {
+        const JsonValue& json = materialsJson[i];
+        materialImages[i * 3 + 0] = GetGlbTextureImage(document, json["pbrMetallicRoughness"]["baseColorTexture"]);
+        materialImages[i * 3 + 1] = GetGlbTextureImage(document, json["emissiveTexture"]);
+        materialImages[i * 3 + 2] = GetGlbTextureImage(document, json["normalTexture"]);
+        for (u32 slot = 0; slot < 3; ++slot)
+            if (materialImages[i * 3 + slot] < imageCount)
+                usedImages[materialImages[i * 3 + slot]] = true;
+    }
+
+    std::vector<u32> textureIndices;
+    LoadGlbImages(app, document, usedImages, textureIndices);
+
+    u32 baseMaterialIndex = (u32)app->materials.size();
+    for (u32 i = 0; i < materialCount; ++i)
+    {
+        const JsonValue& json = materialsJson[i];
+        const JsonValue& pbr = json["pbrMetallicRoughness"];
+
+        Material material = {};
+        material.name = json["name"].type == JSON_STRING ? json["name"].string : "Material" + std::to_string(i);
+        material.albedo = vec3(GetJsonNumber(pbr["baseColorFactor"][0u], 1.0), GetJsonNumber(pbr["baseColorFactor"][1], 1.0), GetJsonNumber(pbr["baseColorFactor"][2], 1.0));
+        material.emissive = vec3(GetJsonNumber(json["emissiveFactor"][0u], 0.0), GetJsonNumber(json["emissiveFactor"][1], 0.0), GetJsonNumber(json["emissiveFactor"][2], 0.0));
+        material.smoothness = 1.0f - (f32)GetJsonNumber(pbr["roughnessFactor"], 1.0);
+
+        u32 Material::* const slots[3] = { &Material::albedoTextureIdx, &Material::emissiveTextureIdx, &Material::normalsTextureIdx };
+        for (u32 slot = 0; slot < 3; ++slot)
+        {
+            u32 image = materialImages[i * 3 + slot];
+            if (image < imageCount)
+                material.*slots[slot] = textureIndices[image];
+        }
+        app->materials.push_back(material);
+    }
+
+    // Primitives without material use the glTF default one
+    u32 defaultMaterialIndex = UINT32_MAX;
+    for (const GlbPrimitive& primitive : document.primitives)
+    {
+        if (primitive.material == UINT32_MAX && defaultMaterialIndex == UINT32_MAX)
+        {
+            Material material = {};
+            material.name = "DefaultMaterial";
+            material.albedo = vec3(1.0f);
+            defaultMaterialIndex = (u32)app->materials.size();
+            app->materials.push_back(material);
+        }
+        submeshMaterialIndices.push_back(primitive.material == UINT32_MAX ? defaultMaterialIndex : baseMaterialIndex + primitive.material);
+    }
+}
+
+bool LoadGlbModel(App* app, const char* filepath, Mesh& mesh, std::vector<u32>& submeshMaterialIndices)
+{
+    PROFILE_FUNCTION();
+
+    FileView file = MapFile(filepath);
+    if (!file.data)
+    {
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_ASSETS, "Could not open the model %s", filepath);
+        return false;
+    }
+
+    GlbDocument document = {};
+    document.filepath = filepath;
+    bool supported = ReadGlbChunks(file, document) && ReadGlbViews(document);
+    if (supported)
+    {
+        ReadGlbAccessors(document);
+        supported = ReadGlbPrimitives(document) && PlaceGlbViews(document);
+    }
+    if (!supported)
+    {
+        LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "%s can't be loaded natively, importing it with Assimp", filepath);
+        UnmapFile(file);
+        return false;
+    }
+
+    UploadGlbBuffers(document, mesh);
+    CreateGlbSubmeshes(document, mesh);
+    ComputeGlbBounds(document, mesh);
+    LoadGlbMaterials(app, document, submeshMaterialIndices);
+
+    UnmapFile(file);
+    return true;
+}
@@ -0,0 +1,26 @@
+//
+// gltf_loader.h : Native loader of binary glTF 2.0 files (.glb). The file is mapped and the
+// buffer views used by the meshes are uploaded straight from the mapping into the mesh buffers.
+// The accessors become the vertex layouts of the submeshes (normalized integer and half float
+// attributes included), so the vertices are never unpacked or copied on the CPU, and the glTF
+// materials become engine materials.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define GLB_MAGIC         0x46546C67 // "glTF"
+#define GLB_VERSION       2
+#define GLB_CHUNK_JSON    0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN     0x004E4942 // "BIN\0"
+
+bool IsGlbFile(const char* filepath);
+
+/**
+ * Loads a .glb file: creates the mesh buffers, with one submesh per triangle primitive, and
+ * appends the materials and their textures to the app. Returns false, without side effects,
+ * for files that use something this loader does not support (node transforms, external
+ * buffers, compression extensions...), so the caller can fall back to Assimp.
+ */
+bool LoadGlbModel(App* app, const char* filepath, Mesh& mesh, std::vector<u32>& submeshMaterialIndices);
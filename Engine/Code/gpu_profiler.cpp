@@ -0,0 +1,310 @@
+//
+// gpu_profiler.cpp : Implementation of the GPU pass timings declared in gpu_profiler.h.
+//
+
+#include "gpu_profiler.h"
+#include <imgui.h>
+
+enum GpuQueryType
+{
+    GPU_QUERY_TIME,
+    GPU_QUERY_VERTEX_INVOCATIONS,
+    GPU_QUERY_FRAGMENT_INVOCATIONS,
+    GPU_QUERY_PRIMITIVES,
+    GPU_QUERY_COUNT
+};
+
+static const GLenum GpuQueryTargets[GPU_QUERY_COUNT] =
+{
+    GL_TIME_ELAPSED,
+    GL_VERTEX_SHADER_INVOCATIONS_ARB,
+    GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+    GL_CLIPPING_INPUT_PRIMITIVES_ARB,
+};
+
+struct GpuFrameQueries
+{
+    const char* names[GPU_PROFILER_MAX_ZONES];
+    GLuint      queries[GPU_PROFILER_MAX_ZONES][GPU_QUERY_COUNT];
+    u32         zoneCount;
+    u64         frameIndex;
+    bool        pending; // Issued and not read back yet
+};
+
+struct GpuProfiler
+{
+    bool                        initialized = false;
+    bool                        statisticsSupported = false;
+
+    GpuFrameQueries             frames[GPU_PROFILER_FRAMES_IN_FLIGHT];
+    u64                         frameIndex = 0;
+    bool                        zoneOpen = false;
+
+    std::vector<GpuZoneResult>  results;
+    f32                         frameMs = 0.0f;
+    u64                         resultsFrameIndex = 0;
+    u32                         droppedFrames = 0;
+    u32                         overflowedZones = 0;
+
+    FILE*                       log = NULL;
+};
+
+static GpuProfiler GlobalGpuProfiler;
+
+u32 GpuQueryCount()
+{
+    return GlobalGpuProfiler.statisticsSupported ? GPU_QUERY_COUNT : 1;
+}
+
+void InitGpuProfiler(const OpenGLInfo& glInfo)
+{
+    GpuProfiler& gp = GlobalGpuProfiler;
+    if (gp.initialized)
+        return;
+
+    gp.statisticsSupported = false;
+    for (const std::string& extension : glInfo.glExtensions)
+    {
+        if (extension == "GL_ARB_pipeline_statistics_query")
+        {
+            gp.statisticsSupported = true;
+            break;
+        }
+    }
+
+    for (u32 i = 0; i < GPU_PROFILER_FRAMES_IN_FLIGHT; ++i)
+    {
+        GpuFrameQueries& frame = gp.frames[i];
+        glGenQueries(GPU_PROFILER_MAX_ZONES * GPU_QUERY_COUNT, &frame.queries[0][0]);
+        frame.zoneCount = 0;
+        frame.pending = false;
+    }
+
+    gp.frameIndex = 0;
+    gp.zoneOpen = false;
+    gp.initialized = true;
+
+    if (!gp.statisticsSupported)
+        LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_PROFILER, "GL_ARB_pipeline_statistics_query not supported, only pass timings will be collected");
+}
+
+void ShutdownGpuProfiler()
+{
+    GpuProfiler& gp = GlobalGpuProfiler;
+    if (!gp.initialized)
+        return;
+
+    GpuProfilerStopLog();
+    for (u32 i = 0; i < GPU_PROFILER_FRAMES_IN_FLIGHT; ++i)
+        glDeleteQueries(GPU_PROFILER_MAX_ZONES * GPU_QUERY_COUNT, &gp.frames[i].queries[0][0]);
+
+    gp.results.clear();
+    gp.initialized = false;
+}
+
+bool GpuFrameAvailable(const GpuFrameQueries& frame)
+{
+    u32 queryCount = GpuQueryCount();
+    for (u32 zone = 0; zone < frame.zoneCount; ++zone)
+    {
+        for (u32 query = 0; query < queryCount; ++query)
+        {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(frame.queries[zone][query], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return false;
+        }
+    }
+    return true;
+}
+
+void GpuReadFrame(const GpuFrameQueries& frame)
+{
+    GpuProfiler& gp = GlobalGpuProfiler;
+    gp.results.resize(frame.zoneCount);
+    gp.resultsFrameIndex = frame.frameIndex;
+    gp.frameMs = 0.0f;
+
+    u32 queryCount = GpuQueryCount();
+    for (u32 zone = 0; zone < frame.zoneCount; ++zone)
+    {
+        GLuint64 values[GPU_QUERY_COUNT] = {};
+        for (u32 query = 0; query < queryCount; ++query)
+            glGetQueryObjectui64v(frame.queries[zone][query], GL_QUERY_RESULT, &values[query]);
+
+        GpuZoneResult& result = gp.results[zone];
+        result.name = frame.names[zone];
+        result.ms = (f32)(values[GPU_QUERY_TIME] / 1000000.0);
+        result.vertexInvocations = values[GPU_QUERY_VERTEX_INVOCATIONS];
+        result.fragmentInvocations = values[GPU_QUERY_FRAGMENT_INVOCATIONS];
+        result.primitives = values[GPU_QUERY_PRIMITIVES];
+        gp.frameMs += result.ms;
+
+        if (gp.log)
+        {
+            fprintf(gp.log, "%llu,%s,%.4f,%llu,%llu,%llu\n", (unsigned long long)frame.frameIndex, result.name, result.ms,
+                (unsigned long long)result.vertexInvocations, (unsigned long long)result.fragmentInvocations,
+                (unsigned long long)result.primitives);
+        }
+    }
+}
+
+void GpuProfilerBeginFrame()
+{
+    GpuProfiler& gp = GlobalGpuProfiler;
+    if (!gp.initialized)
+        return;
+
+    // The slot we are about to reuse was issued GPU_PROFILER_FRAMES_IN_FLIGHT frames ago. If the
+    // GPU has not finished it yet its results are dropped instead of waiting for them.
+    GpuFrameQueries& frame = gp.frames[gp.frameIndex % GPU_PROFILER_FRAMES_IN_FLIGHT];
+    if (frame.pending)
+    {
+        if (GpuFrameAvailable(frame))
+            GpuReadFrame(frame);
+        else
+            gp.droppedFrames++;
+    }
+
+    frame.zoneCount = 0;
+    frame.frameIndex = gp.frameIndex;
+    frame.pending = false;
+}
+
+void GpuProfilerEndFrame()
+{
+    GpuProfiler& gp = GlobalGpuProfiler;
+    if (!gp.initialized)
+        return;
+
+    if (gp.zoneOpen)
+        GpuEndZone();
+
+    GpuFrameQueries& frame = gp.frames[gp.frameIndex % GPU_PROFILER_FRAMES_IN_FLIGHT];
+    frame.pending = frame.zoneCount > 0;
+    gp.frameIndex++;
+}
+
+void GpuBeginZone(const char* name)
+{
+    GpuProfiler& gp = GlobalGpuProfiler;
+    if (!gp.initialized)
+        return;
+
+    ASSERT(!gp.zoneOpen, "GPU zones can't be nested");
+
+    GpuFrameQueries& frame = gp.frames[gp.frameIndex % GPU_PROFILER_FRAMES_IN_FLIGHT];
+    if (frame.zoneCount == GPU_PROFILER_MAX_ZONES)
+    {
+        gp.overflowedZones++;
+        return;
+    }
+
+    u32 zone = frame.zoneCount;
+    frame.names[zone] = name;
+
+    u32 queryCount = GpuQueryCount();
+    for (u32 query = 0; query < queryCount; ++query)
+        glBeginQuery(GpuQueryTargets[query], frame.queries[zone][query]);
+
+    gp.zoneOpen = true;
+}
+
+void GpuEndZone()
+{
+    GpuProfiler& gp = GlobalGpuProfiler;
+    if (!gp.initialized || !gp.zoneOpen)
+        return;
+
+    u32 queryCount = GpuQueryCount();
+    for (u32 query = 0; query < queryCount; ++query)
+        glEndQuery(GpuQueryTargets[query]);
+
+    GpuFrameQueries& frame = gp.frames[gp.frameIndex % GPU_PROFILER_FRAMES_IN_FLIGHT];
+    frame.zoneCount++;
+    gp.zoneOpen = false;
+}
+
+const std::vector<GpuZoneResult>& GpuProfilerGetResults()
+{
+    return GlobalGpuProfiler.results;
+}
+
+f32 GpuProfilerGetFrameMs()
+{
+    return GlobalGpuProfiler.frameMs;
+}
+
+u64 GpuProfilerGetResultsFrame()
+{
+    return GlobalGpuProfiler.resultsFrameIndex;
+}
+
+void GpuProfilerStartLog(const char* filepath)
+{
+    GpuProfiler& gp = GlobalGpuProfiler;
+    GpuProfilerStopLog();
+
+    gp.log = fopen(filepath, "w");
+    if (!gp.log)
+    {
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_PROFILER, "Could not open GPU profiler log %s", filepath);
+        return;
+    }
+    fprintf(gp.log, "frame,pass,ms,vertex_invocations,fragment_invocations,primitives\n");
+}
+
+void GpuProfilerStopLog()
+{
+    GpuProfiler& gp = GlobalGpuProfiler;
+    if (gp.log)
+    {
+        fclose(gp.log);
+        gp.log = NULL;
+    }
+}
+
+void GuiGpuProfiler()
+{
+    GpuProfiler& gp = GlobalGpuProfiler;
+    if (!gp.initialized)
+    {
+        ImGui::Text("GPU profiler not initialized");
+        return;
+    }
+
+    ImGui::Text("GPU frame %llu: %.3f ms", (unsigned long long)gp.resultsFrameIndex, gp.frameMs);
+    if (gp.droppedFrames > 0 || gp.overflowedZones > 0)
+        ImGui::Text("Dropped frames: %u, zones over the limit: %u", gp.droppedFrames, gp.overflowedZones);
+    if (!gp.statisticsSupported)
+        ImGui::TextDisabled("Pipeline statistics not supported");
+
+    if (ImGui::Button(gp.log ? "Stop log" : "Start log"))
+    {
+        if (gp.log) GpuProfilerStopLog();
+        else        GpuProfilerStartLog("gpu_profile.csv");
+    }
+
+    ImGui::Columns(gp.statisticsSupported ? 5 : 2, "GpuPasses");
+    ImGui::Text("Pass"); ImGui::NextColumn();
+    ImGui::Text("ms"); ImGui::NextColumn();
+    if (gp.statisticsSupported)
+    {
+        ImGui::Text("VS invocations"); ImGui::NextColumn();
+        ImGui::Text("FS invocations"); ImGui::NextColumn();
+        ImGui::Text("Primitives"); ImGui::NextColumn();
+    }
+    ImGui::Separator();
+    for (const GpuZoneResult& result : gp.results)
+    {
+        ImGui::Text("%s", result.name); ImGui::NextColumn();
+        ImGui::Text("%.3f", result.ms); ImGui::NextColumn();
+        if (gp.statisticsSupported)
+        {
+            ImGui::Text("%llu", (unsigned long long)result.vertexInvocations); ImGui::NextColumn();
+            ImGui::Text("%llu", (unsigned long long)result.fragmentInvocations); ImGui::NextColumn();
+            ImGui::Text("%llu", (unsigned long long)result.primitives); ImGui::NextColumn();
+        }
+    }
+    ImGui::Columns(1);
+}
@@ -0,0 +1,84 @@
+//
+// gpu_profiler.h : Per-pass GPU timings and pipeline statistics. Every pass is wrapped in a
+// GL_TIME_ELAPSED query and, when ARB_pipeline_statistics_query is available, in vertex shader,
+// fragment shader and primitive counters. Queries are buffered over several frames and read
+// back once they are available, so measuring never stalls the pipeline.
+//
+
+#pragma once
+
+#include "engine.h"
+#include "profiler.h"
+
+#define GPU_PROFILER_FRAMES_IN_FLIGHT 3
+#define GPU_PROFILER_MAX_ZONES        32
+
+// ARB_pipeline_statistics_query (not included in the glad loader)
+#define GL_VERTICES_SUBMITTED_ARB          0x82EE
+#define GL_PRIMITIVES_SUBMITTED_ARB        0x82EF
+#define GL_VERTEX_SHADER_INVOCATIONS_ARB   0x82F0
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#define GL_CLIPPING_INPUT_PRIMITIVES_ARB   0x82F6
+
+struct GpuZoneResult
+{
+    const char* name;
+    f32         ms;
+    u64         vertexInvocations;
+    u64         fragmentInvocations;
+    u64         primitives;
+};
+
+/**
+ * Creates the query objects. Must be called with the OpenGL context current.
+ */
+void InitGpuProfiler(const OpenGLInfo& glInfo);
+
+void ShutdownGpuProfiler();
+
+void GpuProfilerBeginFrame();
+
+void GpuProfilerEndFrame();
+
+/**
+ * GL_TIME_ELAPSED queries can't be nested, so zones must be closed before opening the next one.
+ */
+void GpuBeginZone(const char* name);
+
+void GpuEndZone();
+
+struct GpuZoneScope
+{
+    GpuZoneScope(const char* name) { GpuBeginZone(name); }
+    ~GpuZoneScope() { GpuEndZone(); }
+};
+
+#if USE_PROFILER
+#define GPU_PROFILE_SCOPE(name) GpuZoneScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+#else
+#define GPU_PROFILE_SCOPE(name)
+#endif
+
+/**
+ * Zones of the last frame whose queries have been read back.
+ */
+const std::vector<GpuZoneResult>& GpuProfilerGetResults();
+
+f32 GpuProfilerGetFrameMs();
+
+/**
+ * Index of the frame the current results belong to, to tell when new ones have been read back.
+ */
+u64 GpuProfilerGetResultsFrame();
+
+/**
+ * Appends the results of every collected frame to a CSV file until it is stopped.
+ */
+void GpuProfilerStartLog(const char* filepath);
+
+void GpuProfilerStopLog();
+
+/**
+ * Draws the table of passes with their timings and counters.
+ */
+void GuiGpuProfiler();
@@ -0,0 +1,317 @@
+//
+// job_system.cpp : Implementation of the work-stealing thread pool declared in job_system.h.
+//
+
+#include "job_system.h"
+#include "profiler.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+struct Job
+{
+    JobFunction function;
+    void*       data;
+    JobCounter* counter;
+    JobCounter* dependency;
+};
+
+struct WorkerQueue
+{
+    std::mutex      mutex;
+    std::deque<Job> jobs;
+};
+
+struct JobSystem
+{
+    std::vector<std::thread>  threads;
+    WorkerQueue*              queues = NULL; // One per thread, the main thread uses the first one
+    u32                       threadCount = 1;
+
+    std::atomic<bool>         running{ false };
+    std::atomic<i32>          queuedJobs{ 0 };
+    std::mutex                sleepMutex;
+    std::condition_variable   sleepCondition;
+
+    // Jobs whose dependency has not finished yet
+    std::mutex                waitingMutex;
+    std::vector<Job>          waitingJobs;
+};
+
+static JobSystem GlobalJobSystem;
+static thread_local u32 CurrentThreadIndex = 0;
+
+void PushJob(const Job& job)
+{
+    JobSystem& js = GlobalJobSystem;
+    WorkerQueue& queue = js.queues[CurrentThreadIndex < js.threadCount ? CurrentThreadIndex : 0];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+    js.queuedJobs++;
+}
+
+bool PopJob(Job& job)
+{
+    JobSystem& js = GlobalJobSystem;
+    if (js.queuedJobs.load(std::memory_order_relaxed) <= 0)
+        return false;
+
+    // Own jobs are taken from the back (the most recent ones are still in cache)...
+    u32 ownIndex = CurrentThreadIndex < js.threadCount ? CurrentThreadIndex : 0;
+    {
+        WorkerQueue& queue = js.queues[ownIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+            js.queuedJobs--;
+            return true;
+        }
+    }
+
+    // ...and stolen jobs from the front of the other queues
+    for (u32 i = 1; i < js.threadCount; ++i)
+    {
+        WorkerQueue& queue = js.queues[(ownIndex + i) % js.threadCount];
+        std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+        if (lock.owns_lock() && !queue.jobs.empty())
+        {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+            js.queuedJobs--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WakeWorkers(u32 jobCount)
+{
+    JobSystem& js = GlobalJobSystem;
+    std::lock_guard<std::mutex> lock(js.sleepMutex);
+    if (jobCount == 1) js.sleepCondition.notify_one();
+    else               js.sleepCondition.notify_all();
+}
+
+void FinishJob(const Job& job)
+{
+    if (!job.counter)
+        return;
+
+    i32 value = job.counter->value.load();
+    while (value > 1)
+    {
+        if (job.counter->value.compare_exchange_weak(value, value - 1))
+            return;
+    }
+
+    // The last decrement happens under the lock. Once the counter reaches zero its owner may
+    // return from WaitForCounter and reuse its address as the dependency of new jobs, which
+    // must not be released along with the jobs that were waiting for this one
+    JobSystem& js = GlobalJobSystem;
+    u32 releasedJobs = 0;
+    {
+        std::lock_guard<std::mutex> lock(js.waitingMutex);
+        if (--job.counter->value != 0)
+            return;
+
+        // Release the jobs that were waiting for this counter
+        for (u32 i = 0; i < js.waitingJobs.size();)
+        {
+            if (js.waitingJobs[i].dependency == job.counter)
+            {
+                PushJob(js.waitingJobs[i]);
+                js.waitingJobs[i] = js.waitingJobs.back();
+                js.waitingJobs.pop_back();
+                releasedJobs++;
+            }
+            else ++i;
+        }
+    }
+    if (releasedJobs > 0)
+        WakeWorkers(releasedJobs);
+}
+
+void ExecuteJob(const Job& job)
+{
+    PROFILE_SCOPE("Job");
+    job.function(job.data);
+    FinishJob(job);
+}
+
+void WorkerLoop(u32 threadIndex)
+{
+    CurrentThreadIndex = threadIndex;
+    PROFILE_THREAD_NAME("Worker");
+    JobSystem& js = GlobalJobSystem;
+
+    while (js.running)
+    {
+        Job job;
+        if (PopJob(job))
+        {
+            ExecuteJob(job);
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(js.sleepMutex);
+            js.sleepCondition.wait(lock, [&js]() { return js.queuedJobs > 0 || !js.running; });
+        }
+    }
+}
+
+void InitJobSystem(u32 workerCount)
+{
+    JobSystem& js = GlobalJobSystem;
+    ASSERT(!js.running, "The job system is already running");
+
+    if (workerCount == 0)
+    {
+        u32 hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    js.threadCount = workerCount + 1;
+    js.queues = new WorkerQueue[js.threadCount];
+    js.queuedJobs = 0;
+    js.running = true;
+
+    CurrentThreadIndex = 0;
+    for (u32 i = 1; i < js.threadCount; ++i)
+        js.threads.push_back(std::thread(WorkerLoop, i));
+}
+
+void ShutdownJobSystem()
+{
+    JobSystem& js = GlobalJobSystem;
+    if (!js.running)
+        return;
+
+    // Let the pending jobs finish before joining
+    Job job;
+    while (PopJob(job))
+        ExecuteJob(job);
+
+    js.running = false;
+    WakeWorkers(js.threadCount);
+    for (std::thread& thread : js.threads)
+        thread.join();
+    js.threads.clear();
+
+    delete[] js.queues;
+    js.queues = NULL;
+    js.threadCount = 1;
+}
+
+u32 GetJobThreadCount()
+{
+    return GlobalJobSystem.threadCount;
+}
+
+u32 GetJobThreadIndex()
+{
+    return CurrentThreadIndex;
+}
+
+void RunJobs(const JobDecl* jobs, u32 jobCount, JobCounter* counter, JobCounter* dependency)
+{
+    JobSystem& js = GlobalJobSystem;
+
+    if (counter)
+        counter->value += jobCount;
+
+    // Without worker threads the jobs are run right away
+    if (!js.running)
+    {
+        if (dependency)
+            ASSERT(dependency->value == 0, "Dependencies can't be pending without worker threads");
+        for (u32 i = 0; i < jobCount; ++i)
+            ExecuteJob(Job{ jobs[i].function, jobs[i].data, counter, NULL });
+        return;
+    }
+
+    if (dependency)
+    {
+        // Checked under the lock so FinishJob can't release the waiting list in between
+        std::lock_guard<std::mutex> lock(js.waitingMutex);
+        if (dependency->value > 0)
+        {
+            for (u32 i = 0; i < jobCount; ++i)
+                js.waitingJobs.push_back(Job{ jobs[i].function, jobs[i].data, counter, dependency });
+            return;
+        }
+    }
+
+    for (u32 i = 0; i < jobCount; ++i)
+        PushJob(Job{ jobs[i].function, jobs[i].data, counter, NULL });
+    WakeWorkers(jobCount);
+}
+
+void RunJob(JobFunction function, void* data, JobCounter* counter, JobCounter* dependency)
+{
+    JobDecl decl = { function, data };
+    RunJobs(&decl, 1, counter, dependency);
+}
+
+void WaitForCounter(JobCounter* counter)
+{
+    while (counter->value > 0)
+    {
+        Job job;
+        if (PopJob(job))
+            ExecuteJob(job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+struct ParallelForBatch
+{
+    ParallelForFunction function;
+    void*               data;
+    u32                 begin;
+    u32                 end;
+};
+
+void ParallelForJob(void* data)
+{
+    ParallelForBatch* batch = (ParallelForBatch*)data;
+    batch->function(batch->data, batch->begin, batch->end);
+}
+
+void ParallelFor(u32 count, u32 batchSize, ParallelForFunction function, void* data)
+{
+    if (count == 0)
+        return;
+
+    if (batchSize == 0)
+        batchSize = 1;
+
+    // Not worth to go through the queues for a single batch
+    u32 batchCount = (count + batchSize - 1) / batchSize;
+    if (batchCount == 1 || GetJobThreadCount() == 1)
+    {
+        function(data, 0, count);
+        return;
+    }
+
+    std::vector<ParallelForBatch> batches(batchCount);
+    std::vector<JobDecl> jobs(batchCount);
+    for (u32 i = 0; i < batchCount; ++i)
+    {
+        batches[i].function = function;
+        batches[i].data = data;
+        batches[i].begin = i * batchSize;
+        batches[i].end = (i + 1) * batchSize < count ? (i + 1) * batchSize : count;
+        jobs[i] = JobDecl{ ParallelForJob, &batches[i] };
+    }
+
+    JobCounter counter;
+    RunJobs(jobs.data(), batchCount, &counter);
+    WaitForCounter(&counter);
+}
@@ -0,0 +1,66 @@
+//
+// job_system.h : Work-stealing thread pool of the platform layer. Every worker owns a deque of
+// jobs: it pushes and pops its own jobs from the back, and steals from the front of the other
+// deques when it runs out of work. Jobs report completion through counters that can be waited
+// on or used as dependencies of other jobs.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <atomic>
+
+typedef void (*JobFunction)(void* data);
+typedef void (*ParallelForFunction)(void* data, u32 begin, u32 end);
+
+/**
+ * A counter holds the number of jobs that are still pending. It must outlive the jobs
+ * that reference it, and it reaches zero when all of them have finished.
+ */
+struct JobCounter
+{
+    std::atomic<i32> value{ 0 };
+};
+
+struct JobDecl
+{
+    JobFunction function;
+    void*       data;
+};
+
+/**
+ * Creates the worker threads. With a worker count of 0 it creates one worker per
+ * hardware thread except the calling one, which also runs jobs while it waits.
+ */
+void InitJobSystem(u32 workerCount = 0);
+
+void ShutdownJobSystem();
+
+/**
+ * Number of threads that execute jobs, including the main thread.
+ */
+u32 GetJobThreadCount();
+
+/**
+ * Index of the calling thread in the pool: 0 for the main thread and 1..N for the workers.
+ */
+u32 GetJobThreadIndex();
+
+/**
+ * Queues the jobs and adds their count to the counter (can be NULL). When a dependency
+ * is given, the jobs are not started until the dependency counter reaches zero.
+ */
+void RunJobs(const JobDecl* jobs, u32 jobCount, JobCounter* counter, JobCounter* dependency = NULL);
+
+void RunJob(JobFunction function, void* data, JobCounter* counter, JobCounter* dependency = NULL);
+
+/**
+ * Blocks until the counter reaches zero. The calling thread runs pending jobs meanwhile.
+ */
+void WaitForCounter(JobCounter* counter);
+
+/**
+ * Splits [0, count) into ranges of batchSize elements and runs them in parallel.
+ * It returns when the whole range has been processed.
+ */
+void ParallelFor(u32 count, u32 batchSize, ParallelForFunction function, void* data);
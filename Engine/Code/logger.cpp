@@ -0,0 +1,529 @@
+//
+// logger.cpp : Implementation of the asynchronous logger declared in logger.h.
+//
+// Messages are variable sized records in a byte ring buffer. Producers reserve space with a
+// compare-and-swap on the write position, fill the record and publish it by storing its size
+// in the header. The logger thread is the only consumer: it formats the published records in
+// order, clears them and advances the read position. A record that does not fit before the end
+// of the ring is preceded by a padding record, so records are always contiguous.
+//
+
+#include "logger.h"
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <signal.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#define LOG_RING_SIZE           MB(1)       // Must be a power of 2
+#define LOG_RECORD_ALIGNMENT    8
+#define LOG_RECORD_PADDING      0x80000000u // Set in the size of the records that only skip to the ring start
+#define LOG_LINE_SIZE           4096
+#define LOG_IDLE_SLEEP_MS       1
+#define LOG_ABORT_FLUSH_MS      500
+
+struct LogRecordHeader
+{
+    std::atomic<u32> size; // Of the whole record, 0 until the producer publishes it
+    u8               level;
+    u8               category;
+    u16              argsSize;
+    u32              suppressed;
+    u32              threadIndex;
+    u64              timestamp;
+    const char*      format;
+};
+
+struct LogFileSink
+{
+    FILE*    file;
+    LogLevel minLevel;
+    u32      categoryMask;
+};
+
+struct Logger
+{
+    u8*                      ring = NULL;
+    std::atomic<u64>         writePos{ 0 };
+    std::atomic<u64>         readPos{ 0 };
+
+    std::thread              thread;
+    std::atomic<bool>        running{ false };
+
+    std::atomic<u32>         minLevel{ LOG_LEVEL_DEBUG };
+    std::atomic<u32>         categoryMask{ 0xffffffff };
+    u64                      startTime = GetTimeNanoseconds(); // Of the process, so messages logged before InitLogger have a meaningful time
+
+    std::atomic<u64>         written{ 0 };
+    std::atomic<u64>         dropped{ 0 };
+    std::atomic<u64>         suppressed{ 0 };
+    u64                      reportedDropped = 0;
+
+    // Sinks are only used by the logger thread, or by the thread writing synchronously
+    std::mutex               sinksMutex;
+    std::vector<LogFileSink> fileSinks;
+};
+
+static Logger GlobalLogger;
+
+static const char* LogLevelNames[LOG_LEVEL_COUNT] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+static const char* LogCategoryNames[LOG_CATEGORY_COUNT] = { "General", "Platform", "Render", "Assets", "Profiler" };
+
+u32 LogThreadIndex()
+{
+    static std::atomic<u32> threadCount{ 0 };
+    static thread_local u32 threadIndex = threadCount.fetch_add(1);
+    return threadIndex;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Formatting
+
+template<typename T>
+T LogReadArg(const u8*& args)
+{
+    T value;
+    memcpy(&value, args, sizeof(T));
+    args += sizeof(T);
+    return value;
+}
+
+bool IsIntegerConversion(char c) { return strchr("diouxXc", c) != NULL; }
+bool IsFloatConversion(char c)   { return strchr("fFeEgGaA", c) != NULL; }
+
+/**
+ * Formats the message with the encoded arguments. Every conversion of the format is handed to
+ * snprintf with the length modifier of the type that was actually stored.
+ */
+u32 LogFormatMessage(char* out, u32 capacity, const char* format, const u8* args, u32 argsSize)
+{
+    const u8* argsEnd = args + argsSize;
+    u32 len = 0;
+
+    const char* c = format;
+    while (*c && len + 1 < capacity)
+    {
+        if (*c != '%')
+        {
+            out[len++] = *c++;
+            continue;
+        }
+        if (c[1] == '%')
+        {
+            out[len++] = '%';
+            c += 2;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        char spec[48];
+        u32 specLen = 0;
+        spec[specLen++] = *c++;
+        while (*c && strchr("-+ #0", *c) && specLen < 8)
+            spec[specLen++] = *c++;
+
+        // Width and precision, either written or taken from an int argument
+        i32 values[2] = {};
+        bool given[2] = {};
+        for (u32 i = 0; i < 2; ++i)
+        {
+            if (i == 1)
+            {
+                if (*c != '.')
+                    break;
+                c++;
+                given[1] = true;
+            }
+            if (*c == '*')
+            {
+                if (args < argsEnd && (*args == LOG_ARG_I32 || *args == LOG_ARG_U32))
+                {
+                    args++;
+                    values[i] = LogReadArg<i32>(args);
+                    given[i] = true;
+                }
+                c++;
+            }
+            while (*c >= '0' && *c <= '9')
+            {
+                values[i] = std::min(values[i] * 10 + (*c++ - '0'), 4096);
+                given[i] = true;
+            }
+        }
+        if (given[0])
+            specLen += snprintf(spec + specLen, 16, "%d", values[0]);
+        i32 precision = given[1] && values[1] >= 0 ? values[1] : -1;
+
+        while (*c && strchr("hljztLIq", *c))
+        {
+            if (c[0] == 'I' && ((c[1] == '6' && c[2] == '4') || (c[1] == '3' && c[2] == '2')))
+                c += 2;
+            c++;
+        }
+
+        char conversion = *c;
+        if (conversion)
+            c++;
+
+        if (args >= argsEnd)
+        {
+            len += snprintf(out + len, capacity - len, "<missing>");
+            len = std::min(len, capacity - 1);
+            continue;
+        }
+
+        LogArgType type = (LogArgType)*args++;
+        if (precision >= 0 && type != LOG_ARG_STR)
+            specLen += snprintf(spec + specLen, 16, ".%d", precision);
+
+        int written = 0;
+        switch (type)
+        {
+        case LOG_ARG_I32:
+        case LOG_ARG_U32:
+        case LOG_ARG_I64:
+        case LOG_ARG_U64:
+        {
+            bool wide = type == LOG_ARG_I64 || type == LOG_ARG_U64;
+            if (!IsIntegerConversion(conversion))
+                conversion = (type == LOG_ARG_I32 || type == LOG_ARG_I64) ? 'd' : 'u';
+            if (wide)
+            {
+                spec[specLen++] = 'l';
+                spec[specLen++] = 'l';
+            }
+            spec[specLen++] = conversion;
+            spec[specLen] = '\0';
+            if (wide) written = snprintf(out + len, capacity - len, spec, LogReadArg<u64>(args));
+            else      written = snprintf(out + len, capacity - len, spec, LogReadArg<u32>(args));
+            break;
+        }
+        case LOG_ARG_F64:
+            spec[specLen++] = IsFloatConversion(conversion) ? conversion : 'g';
+            spec[specLen] = '\0';
+            written = snprintf(out + len, capacity - len, spec, LogReadArg<f64>(args));
+            break;
+        case LOG_ARG_PTR:
+            spec[specLen++] = 'p';
+            spec[specLen] = '\0';
+            written = snprintf(out + len, capacity - len, spec, LogReadArg<const void*>(args));
+            break;
+        case LOG_ARG_STR:
+        {
+            // The characters are not terminated, so the precision is always given
+            i32 strLen = LogReadArg<u16>(args);
+            specLen += snprintf(spec + specLen, 16, ".%ds", precision >= 0 ? std::min(precision, strLen) : strLen);
+            written = snprintf(out + len, capacity - len, spec, (const char*)args);
+            args += strLen;
+            break;
+        }
+        default:
+            written = snprintf(out + len, capacity - len, "<invalid>");
+            args = argsEnd;
+            break;
+        }
+        len = std::min(len + (written > 0 ? (u32)written : 0), capacity - 1);
+    }
+
+    out[len] = '\0';
+    return len;
+}
+
+void LogEmit(const LogRecordHeader& header, const u8* args)
+{
+    Logger& logger = GlobalLogger;
+
+    char line[LOG_LINE_SIZE];
+    f64 seconds = (header.timestamp - logger.startTime) / 1000000000.0;
+    u32 len = snprintf(line, sizeof(line), "[%9.3f] [%s] [%s] [T%u] ", seconds, LogLevelNames[header.level],
+                       LogCategoryNames[header.category], header.threadIndex);
+    len += LogFormatMessage(line + len, sizeof(line) - len, header.format, args, header.argsSize);
+
+    // Messages that ended in a new line (as the old ILOG calls did) don't need the one of the sinks
+    while (len > 0 && line[len - 1] == '\n')
+        line[--len] = '\0';
+    if (header.suppressed > 0 && len + 1 < sizeof(line))
+        snprintf(line + len, sizeof(line) - len, " (%u similar messages suppressed)", header.suppressed);
+
+    std::lock_guard<std::mutex> lock(logger.sinksMutex);
+    LogString(line);
+    for (LogFileSink& sink : logger.fileSinks)
+    {
+        if (header.level < sink.minLevel || !(sink.categoryMask & (1u << header.category)))
+            continue;
+        fprintf(sink.file, "%s\n", line);
+        if (header.level >= LOG_LEVEL_ERROR)
+            fflush(sink.file);
+    }
+    logger.written.fetch_add(1, std::memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Producers
+
+bool LogIsEnabled(LogLevel level, LogCategory category)
+{
+    Logger& logger = GlobalLogger;
+    return (u32)level >= logger.minLevel.load(std::memory_order_relaxed) &&
+           (logger.categoryMask.load(std::memory_order_relaxed) & (1u << category)) != 0;
+}
+
+bool LogRateLimit(LogSite& site, u32* suppressed)
+{
+    // The window is restarted by the first message after it expires. Two threads may restart
+    // it at the same time, which only lets a few more messages through.
+    u64 now = GetTimeNanoseconds();
+    u64 windowStart = site.windowStart.load(std::memory_order_relaxed);
+    if (now - windowStart > LOG_RATE_LIMIT_WINDOW_NS &&
+        site.windowStart.compare_exchange_strong(windowStart, now, std::memory_order_relaxed))
+    {
+        site.count.store(0, std::memory_order_relaxed);
+    }
+
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= LOG_RATE_LIMIT_MESSAGES)
+    {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        GlobalLogger.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    *suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+void LogSubmit(LogLevel level, LogCategory category, const char* format, const u8* args, u32 argsSize, u32 suppressed)
+{
+    Logger& logger = GlobalLogger;
+
+    LogRecordHeader header;
+    header.level = (u8)level;
+    header.category = (u8)category;
+    header.argsSize = (u16)argsSize;
+    header.suppressed = suppressed;
+    header.threadIndex = LogThreadIndex();
+    header.timestamp = GetTimeNanoseconds();
+    header.format = format;
+
+    if (!logger.running.load(std::memory_order_acquire))
+    {
+        LogEmit(header, args);
+        return;
+    }
+
+    // Reserve the record, plus the padding until the end of the ring if it doesn't fit there
+    u32 recordSize = (sizeof(LogRecordHeader) + argsSize + LOG_RECORD_ALIGNMENT - 1) & ~(LOG_RECORD_ALIGNMENT - 1);
+    u64 pos = logger.writePos.load(std::memory_order_relaxed);
+    u32 offset, padding;
+    for (;;)
+    {
+        offset = (u32)(pos & (LOG_RING_SIZE - 1));
+        padding = recordSize <= LOG_RING_SIZE - offset ? 0 : LOG_RING_SIZE - offset;
+        if (pos + padding + recordSize - logger.readPos.load(std::memory_order_acquire) > LOG_RING_SIZE)
+        {
+            // Never block the caller, the logger thread reports the lost messages
+            logger.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (logger.writePos.compare_exchange_weak(pos, pos + padding + recordSize, std::memory_order_relaxed))
+            break;
+    }
+
+    if (padding > 0)
+    {
+        ((LogRecordHeader*)(logger.ring + offset))->size.store(padding | LOG_RECORD_PADDING, std::memory_order_release);
+        offset = 0;
+    }
+
+    LogRecordHeader* record = (LogRecordHeader*)(logger.ring + offset);
+    record->level = header.level;
+    record->category = header.category;
+    record->argsSize = header.argsSize;
+    record->suppressed = header.suppressed;
+    record->threadIndex = header.threadIndex;
+    record->timestamp = header.timestamp;
+    record->format = header.format;
+    memcpy((u8*)(record + 1), args, argsSize);
+    record->size.store(recordSize, std::memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Consumer
+
+// Writes the published records. Returns false if there was nothing to write.
+bool LogConsume()
+{
+    Logger& logger = GlobalLogger;
+
+    u64 read = logger.readPos.load(std::memory_order_relaxed);
+    u64 write = logger.writePos.load(std::memory_order_acquire);
+    bool consumed = false;
+    while (read < write)
+    {
+        u8* ptr = logger.ring + (read & (LOG_RING_SIZE - 1));
+        LogRecordHeader* record = (LogRecordHeader*)ptr;
+        u32 size = record->size.load(std::memory_order_acquire);
+        if (size == 0)
+            break; // Reserved but still being written, records are written in order
+
+        u32 recordSize = size & ~LOG_RECORD_PADDING;
+        if (!(size & LOG_RECORD_PADDING))
+            LogEmit(*record, (const u8*)(record + 1));
+
+        // Records may start anywhere in the memory of the old ones, so it has to be cleared
+        // before the producers can reserve it again
+        memset(ptr, 0, recordSize);
+        read += recordSize;
+        logger.readPos.store(read, std::memory_order_release);
+        consumed = true;
+    }
+
+    u64 dropped = logger.dropped.load(std::memory_order_relaxed);
+    if (dropped != logger.reportedDropped)
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "[logger] %llu messages dropped, the log ring buffer was full",
+                 (unsigned long long)(dropped - logger.reportedDropped));
+        std::lock_guard<std::mutex> lock(logger.sinksMutex);
+        LogString(line);
+        logger.reportedDropped = dropped;
+    }
+
+    if (consumed)
+    {
+        std::lock_guard<std::mutex> lock(logger.sinksMutex);
+        for (LogFileSink& sink : logger.fileSinks)
+            fflush(sink.file);
+    }
+    return consumed;
+}
+
+void LoggerThread()
+{
+    Logger& logger = GlobalLogger;
+    while (logger.running.load(std::memory_order_acquire))
+    {
+        if (!LogConsume())
+            std::this_thread::sleep_for(std::chrono::milliseconds(LOG_IDLE_SLEEP_MS));
+    }
+    LogConsume();
+}
+
+bool LogFlushFor(u64 timeoutNs)
+{
+    Logger& logger = GlobalLogger;
+    if (!logger.running.load(std::memory_order_acquire))
+        return true;
+
+    u64 target = logger.writePos.load(std::memory_order_acquire);
+    u64 start = GetTimeNanoseconds();
+    while (logger.readPos.load(std::memory_order_acquire) < target)
+    {
+        if (GetTimeNanoseconds() - start > timeoutNs)
+            return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void LogFlush()
+{
+    LogFlushFor(UINT64_MAX);
+}
+
+// Failed asserts abort the process right after logging, give the logger thread a chance to write it
+void LogAbortHandler(int)
+{
+    if (std::this_thread::get_id() != GlobalLogger.thread.get_id())
+        LogFlushFor(LOG_ABORT_FLUSH_MS * 1000000ull);
+}
+
+void InitLogger()
+{
+    Logger& logger = GlobalLogger;
+    if (logger.running)
+        return;
+
+    // The ring is kept after a shutdown, in case a late producer still writes to it
+    if (!logger.ring)
+        logger.ring = (u8*)malloc(LOG_RING_SIZE);
+    memset(logger.ring, 0, LOG_RING_SIZE);
+    logger.writePos = 0;
+    logger.readPos = 0;
+    logger.running = true;
+    logger.thread = std::thread(LoggerThread);
+
+    // Returning from main without ShutdownLogger would destroy a running thread
+    static bool registered = false;
+    if (!registered)
+        atexit(ShutdownLogger);
+    registered = true;
+
+    signal(SIGABRT, LogAbortHandler);
+}
+
+void ShutdownLogger()
+{
+    Logger& logger = GlobalLogger;
+    if (logger.running)
+    {
+        logger.running.store(false, std::memory_order_release);
+        logger.thread.join();
+        signal(SIGABRT, SIG_DFL);
+    }
+
+    std::lock_guard<std::mutex> lock(logger.sinksMutex);
+    for (LogFileSink& sink : logger.fileSinks)
+        fclose(sink.file);
+    logger.fileSinks.clear();
+}
+
+void LogSetMinLevel(LogLevel level)
+{
+    GlobalLogger.minLevel.store(level, std::memory_order_relaxed);
+}
+
+void LogSetCategoryEnabled(LogCategory category, bool enabled)
+{
+    if (enabled) GlobalLogger.categoryMask.fetch_or(1u << category, std::memory_order_relaxed);
+    else         GlobalLogger.categoryMask.fetch_and(~(1u << category), std::memory_order_relaxed);
+}
+
+bool LogAddFileSink(const char* filepath, LogLevel minLevel, u32 categoryMask)
+{
+    FILE* file = fopen(filepath, "w");
+    if (!file)
+    {
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_PLATFORM, "Could not open the log file %s", filepath);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(GlobalLogger.sinksMutex);
+    GlobalLogger.fileSinks.push_back(LogFileSink{ file, minLevel, categoryMask });
+    return true;
+}
+
+bool LogParseLevel(const char* name, LogLevel& level)
+{
+    for (u32 i = 0; i < LOG_LEVEL_COUNT; ++i)
+    {
+        const char* a = name;
+        const char* b = LogLevelNames[i];
+        while (*a && toupper(*a) == *b) { a++; b++; }
+        if (*a == '\0' && *b == '\0')
+        {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+LogStats LogGetStats()
+{
+    LogStats stats;
+    stats.written = GlobalLogger.written.load(std::memory_order_relaxed);
+    stats.dropped = GlobalLogger.dropped.load(std::memory_order_relaxed);
+    stats.suppressed = GlobalLogger.suppressed.load(std::memory_order_relaxed);
+    return stats;
+}
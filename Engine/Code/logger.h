@@ -0,0 +1,225 @@
+//
+// logger.h : Asynchronous logger of the platform layer. Logging a message only copies the
+// format string pointer and the binary encoded arguments into a lock-free ring buffer shared
+// by all threads; a background thread formats the messages and writes them to the console and
+// to the file sinks. The macros can be called from any thread:
+//
+//   ILOG("Loaded %s in %.2f ms", path, ms);                  // Info, general category
+//   LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_ASSETS, "Could not open %s", path);
+//
+// The format must be a string literal, since it is only read by the logger thread. Each call
+// site is rate limited, so a burst of the same message costs a few atomics per call.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <atomic>
+#include <type_traits>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+#define LOG_MAX_ARGS_SIZE         1024      // Encoded arguments of a message, longer strings are truncated
+#define LOG_RATE_LIMIT_MESSAGES   8         // Messages per call site and window...
+#define LOG_RATE_LIMIT_WINDOW_NS  1000000000ull // ...of one second
+
+enum LogLevel
+{
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_COUNT
+};
+
+enum LogCategory
+{
+    LOG_GENERAL,
+    LOG_PLATFORM,
+    LOG_RENDER,
+    LOG_ASSETS,
+    LOG_PROFILER,
+    LOG_CATEGORY_COUNT
+};
+
+/**
+ * Starts the logger thread. Messages logged before it starts or after it stops are formatted
+ * and written synchronously by the calling thread.
+ */
+void InitLogger();
+
+/**
+ * Writes the pending messages, stops the logger thread and closes the file sinks.
+ */
+void ShutdownLogger();
+
+/**
+ * Blocks until every message logged so far has been written.
+ */
+void LogFlush();
+
+/**
+ * Messages below the level, or of a disabled category, are discarded by the calling thread.
+ */
+void LogSetMinLevel(LogLevel level);
+
+void LogSetCategoryEnabled(LogCategory category, bool enabled);
+
+/**
+ * Appends every message of the given level or above (and of the categories in the mask,
+ * one bit per LogCategory) to a file. Error messages are flushed to disk right away.
+ */
+bool LogAddFileSink(const char* filepath, LogLevel minLevel = LOG_LEVEL_DEBUG, u32 categoryMask = 0xffffffff);
+
+bool LogParseLevel(const char* name, LogLevel& level);
+
+struct LogStats
+{
+    u64 written;
+    u64 dropped;    // The ring buffer was full
+    u64 suppressed; // Rate limited
+};
+
+LogStats LogGetStats();
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation details of the macros
+
+// Rate limiting state of a call site
+struct LogSite
+{
+    std::atomic<u64> windowStart;
+    std::atomic<u32> count;
+    std::atomic<u32> suppressed;
+};
+
+enum LogArgType : u8
+{
+    LOG_ARG_I32,
+    LOG_ARG_U32,
+    LOG_ARG_I64,
+    LOG_ARG_U64,
+    LOG_ARG_F64,
+    LOG_ARG_PTR,
+    LOG_ARG_STR, // u16 length followed by the characters, without terminator
+};
+
+struct LogArgWriter
+{
+    u8* cursor;
+    u8* end;
+};
+
+inline void LogEncodeValue(LogArgWriter& writer, LogArgType type, const void* value, u32 size)
+{
+    if (writer.cursor + 1 + size > writer.end)
+        return;
+    *writer.cursor++ = type;
+    memcpy(writer.cursor, value, size);
+    writer.cursor += size;
+}
+
+inline void LogEncodeString(LogArgWriter& writer, const char* str)
+{
+    if (!str)
+        str = "(null)";
+    if (writer.cursor + 1 + sizeof(u16) > writer.end)
+        return;
+
+    size_t available = writer.end - writer.cursor - 1 - sizeof(u16);
+    u16 len = (u16)std::min(strlen(str), std::min(available, (size_t)UINT16_MAX));
+    *writer.cursor++ = LOG_ARG_STR;
+    memcpy(writer.cursor, &len, sizeof(len));
+    memcpy(writer.cursor + sizeof(len), str, len);
+    writer.cursor += sizeof(len) + len;
+}
+
+// Arguments are stored with the type they have after the default argument promotions, so the
+// logger thread passes to snprintf exactly what printf would have received
+inline void LogEncodeInt(LogArgWriter& writer, i64 value, bool isSigned, u32 size)
+{
+    if (size <= 4) { u32 v = (u32)value; LogEncodeValue(writer, isSigned ? LOG_ARG_I32 : LOG_ARG_U32, &v, sizeof(v)); }
+    else           { u64 v = (u64)value; LogEncodeValue(writer, isSigned ? LOG_ARG_I64 : LOG_ARG_U64, &v, sizeof(v)); }
+}
+
+inline void LogEncodeArg(LogArgWriter& w, bool v)               { LogEncodeInt(w, v, true, 4); }
+inline void LogEncodeArg(LogArgWriter& w, char v)               { LogEncodeInt(w, v, true, 4); }
+inline void LogEncodeArg(LogArgWriter& w, signed char v)        { LogEncodeInt(w, v, true, 4); }
+inline void LogEncodeArg(LogArgWriter& w, unsigned char v)      { LogEncodeInt(w, v, true, 4); }
+inline void LogEncodeArg(LogArgWriter& w, short v)              { LogEncodeInt(w, v, true, 4); }
+inline void LogEncodeArg(LogArgWriter& w, unsigned short v)     { LogEncodeInt(w, v, true, 4); }
+inline void LogEncodeArg(LogArgWriter& w, int v)                { LogEncodeInt(w, v, true, 4); }
+inline void LogEncodeArg(LogArgWriter& w, unsigned int v)       { LogEncodeInt(w, v, false, 4); }
+inline void LogEncodeArg(LogArgWriter& w, long v)               { LogEncodeInt(w, v, true, sizeof(long)); }
+inline void LogEncodeArg(LogArgWriter& w, unsigned long v)      { LogEncodeInt(w, (i64)v, false, sizeof(long)); }
+inline void LogEncodeArg(LogArgWriter& w, long long v)          { LogEncodeInt(w, v, true, 8); }
+inline void LogEncodeArg(LogArgWriter& w, unsigned long long v) { LogEncodeInt(w, (i64)v, false, 8); }
+inline void LogEncodeArg(LogArgWriter& w, double v)             { LogEncodeValue(w, LOG_ARG_F64, &v, sizeof(v)); }
+inline void LogEncodeArg(LogArgWriter& w, float v)              { LogEncodeArg(w, (double)v); }
+inline void LogEncodeArg(LogArgWriter& w, long double v)        { LogEncodeArg(w, (double)v); }
+inline void LogEncodeArg(LogArgWriter& w, const char* v)        { LogEncodeString(w, v); }
+inline void LogEncodeArg(LogArgWriter& w, char* v)              { LogEncodeString(w, v); }
+inline void LogEncodeArg(LogArgWriter& w, const unsigned char* v) { LogEncodeString(w, (const char*)v); }
+inline void LogEncodeArg(LogArgWriter& w, unsigned char* v)     { LogEncodeString(w, (const char*)v); }
+inline void LogEncodeArg(LogArgWriter& w, const std::string& v) { LogEncodeString(w, v.c_str()); }
+inline void LogEncodeArg(LogArgWriter& w, std::nullptr_t)       { const void* v = NULL; LogEncodeValue(w, LOG_ARG_PTR, &v, sizeof(v)); }
+
+template<typename T>
+void LogEncodeArg(LogArgWriter& w, T* v)
+{
+    const void* ptr = v;
+    LogEncodeValue(w, LOG_ARG_PTR, &ptr, sizeof(ptr));
+}
+
+template<typename T>
+typename std::enable_if<std::is_enum<T>::value>::type LogEncodeArg(LogArgWriter& w, T v)
+{
+    LogEncodeArg(w, (typename std::underlying_type<T>::type)v);
+}
+
+inline void LogEncodeArgs(LogArgWriter&) {}
+
+template<typename T, typename... Args>
+void LogEncodeArgs(LogArgWriter& writer, const T& arg, const Args&... args)
+{
+    LogEncodeArg(writer, arg);
+    LogEncodeArgs(writer, args...);
+}
+
+bool LogIsEnabled(LogLevel level, LogCategory category);
+
+/**
+ * Applies the rate limit of the call site. Returns false if the message has to be discarded,
+ * otherwise sets suppressed to the messages discarded since the last one that went through.
+ */
+bool LogRateLimit(LogSite& site, u32* suppressed);
+
+void LogSubmit(LogLevel level, LogCategory category, const char* format, const u8* args, u32 argsSize, u32 suppressed);
+
+template<typename... Args>
+void LogWrite(LogSite& site, LogLevel level, LogCategory category, const char* format, const Args&... args)
+{
+    if (!LogIsEnabled(level, category))
+        return;
+
+    u32 suppressed = 0;
+    if (!LogRateLimit(site, &suppressed))
+        return;
+
+    u8 buffer[LOG_MAX_ARGS_SIZE];
+    LogArgWriter writer = { buffer, buffer + sizeof(buffer) };
+    LogEncodeArgs(writer, args...);
+    LogSubmit(level, category, format, buffer, (u32)(writer.cursor - buffer), suppressed);
+}
+
+#define LOG_MESSAGE(level, category, ...)              \
+{                                                      \
+static LogSite logSite;                                \
+LogWrite(logSite, level, category, __VA_ARGS__);       \
+}
+
+#define DLOG(...) LOG_MESSAGE(LOG_LEVEL_DEBUG, LOG_GENERAL, __VA_ARGS__)
+#define ILOG(...) LOG_MESSAGE(LOG_LEVEL_INFO, LOG_GENERAL, __VA_ARGS__)
+#define WLOG(...) LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_GENERAL, __VA_ARGS__)
+#define ELOG(...) LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_GENERAL, __VA_ARGS__)
@@ -0,0 +1,177 @@
+//
+// memory_arena.cpp : Implementation of the linear allocators declared in memory_arena.h.
+//
+
+#include "memory_arena.h"
+#include <string.h>
+#include <stdlib.h>
+
+Arena GlobalFrameArena;
+Arena GlobalLevelArena;
+
+static std::mutex          ThreadArenasMutex;
+static std::vector<Arena*> ThreadArenas;
+static std::atomic<u32>    ThreadArenasGeneration(0); // Bumped by ShutdownArenas, which frees the arenas of every thread
+
+static thread_local Arena* CurrentThreadArena = NULL;
+static thread_local u32    CurrentThreadArenaGeneration = 0;
+
+void InitArenas()
+{
+    CreateArena(&GlobalFrameArena, "Frame", GLOBAL_FRAME_ARENA_SIZE);
+    CreateArena(&GlobalLevelArena, "Level", GLOBAL_LEVEL_ARENA_SIZE);
+}
+
+void ShutdownArenas()
+{
+    DestroyArena(&GlobalFrameArena);
+    DestroyArena(&GlobalLevelArena);
+
+    std::lock_guard<std::mutex> lock(ThreadArenasMutex);
+    for (Arena* arena : ThreadArenas)
+    {
+        DestroyArena(arena);
+        delete arena;
+    }
+    ThreadArenas.clear();
+    ThreadArenasGeneration++;
+    CurrentThreadArena = NULL;
+}
+
+void CreateArena(Arena* arena, const char* name, u64 size)
+{
+    arena->name = name;
+    arena->memory = (u8*)malloc(size);
+    arena->size = size;
+    arena->head = 0;
+    arena->highWatermark = 0;
+    arena->allocationCount = 0;
+    arena->overflowCount = 0;
+    arena->overflowBytes = 0;
+
+    ASSERT(arena->memory != NULL, "Could not reserve the memory of the arena");
+}
+
+void DestroyArena(Arena* arena)
+{
+    ResetArena(arena);
+    free(arena->memory);
+    arena->memory = NULL;
+    arena->size = 0;
+}
+
+void FreeOverflowBlocks(Arena* arena, u32 firstBlock)
+{
+    std::lock_guard<std::mutex> lock(arena->overflowMutex);
+    for (u32 i = firstBlock; i < arena->overflowBlocks.size(); ++i)
+        free(arena->overflowBlocks[i]);
+    arena->overflowBlocks.resize(firstBlock);
+}
+
+void ResetArena(Arena* arena)
+{
+    FreeOverflowBlocks(arena, 0);
+    arena->head = 0;
+}
+
+Arena* GetThreadArena()
+{
+    // The arena of a thread that outlived ShutdownArenas is gone, it gets a new one
+    u32 generation = ThreadArenasGeneration.load();
+    if (!CurrentThreadArena || CurrentThreadArenaGeneration != generation)
+    {
+        CurrentThreadArena = new Arena();
+        CurrentThreadArenaGeneration = generation;
+        CreateArena(CurrentThreadArena, "Thread", THREAD_ARENA_SIZE);
+
+        std::lock_guard<std::mutex> lock(ThreadArenasMutex);
+        ThreadArenas.push_back(CurrentThreadArena);
+    }
+    return CurrentThreadArena;
+}
+
+void* PushOverflow(Arena* arena, u64 byteCount, u64 alignment)
+{
+    // The block is over-allocated so it can be aligned, and the original pointer is kept
+    // just before the returned address in order to free it later
+    u8* block = (u8*)malloc(byteCount + alignment + sizeof(void*));
+    if (!block)
+        return NULL;
+
+    u64 address = ((u64)(block + sizeof(void*)) + alignment - 1) & ~(alignment - 1);
+
+    if (arena->overflowCount++ == 0)
+        ELOG("Arena %s overflowed (%llu bytes requested). Falling back to the heap", arena->name, byteCount);
+    arena->overflowBytes += byteCount;
+
+    std::lock_guard<std::mutex> lock(arena->overflowMutex);
+    arena->overflowBlocks.push_back(block);
+    return (void*)address;
+}
+
+void* PushSizeAligned(Arena* arena, u64 byteCount, u64 alignment)
+{
+    ASSERT(arena->memory != NULL, "The arena must be created first");
+    ASSERT(alignment && !(alignment & (alignment - 1)), "The alignment must be a power of 2");
+
+    // Align the address rather than the offset so alignments bigger than the one of malloc work
+    u64 base = (u64)arena->memory;
+    u64 head = arena->head.load(std::memory_order_relaxed);
+    u64 start, end;
+    do
+    {
+        start = ((base + head + alignment - 1) & ~(alignment - 1)) - base;
+        end = start + byteCount;
+        if (end > arena->size)
+            return PushOverflow(arena, byteCount, alignment);
+    }
+    while (!arena->head.compare_exchange_weak(head, end, std::memory_order_relaxed));
+
+    arena->allocationCount++;
+
+    u64 watermark = arena->highWatermark.load(std::memory_order_relaxed);
+    while (end > watermark && !arena->highWatermark.compare_exchange_weak(watermark, end, std::memory_order_relaxed));
+
+    return arena->memory + start;
+}
+
+void* PushSize(Arena* arena, u64 byteCount)
+{
+    return PushSizeAligned(arena, byteCount, DEFAULT_ARENA_ALIGNMENT);
+}
+
+void* PushBytes(Arena* arena, const void* bytes, u64 byteCount)
+{
+    void* ptr = PushSizeAligned(arena, byteCount, 1);
+    if (ptr)
+        memcpy(ptr, bytes, byteCount);
+    return ptr;
+}
+
+ArenaMarker BeginTempArena(Arena* arena)
+{
+    ArenaMarker marker = {};
+    marker.arena = arena;
+    marker.head = arena->head.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(arena->overflowMutex);
+    marker.overflowBlockCount = (u32)arena->overflowBlocks.size();
+    return marker;
+}
+
+void EndTempArena(ArenaMarker marker)
+{
+    ASSERT(marker.head <= marker.arena->head, "Temporary scopes must be closed in reverse order");
+    FreeOverflowBlocks(marker.arena, marker.overflowBlockCount);
+    marker.arena->head = marker.head;
+}
+
+void ForEachArena(void (*callback)(const Arena* arena, void* userData), void* userData)
+{
+    callback(&GlobalFrameArena, userData);
+    callback(&GlobalLevelArena, userData);
+
+    std::lock_guard<std::mutex> lock(ThreadArenasMutex);
+    for (const Arena* arena : ThreadArenas)
+        callback(arena, userData);
+}
@@ -0,0 +1,104 @@
+//
+// memory_arena.h : Linear allocators of the platform layer. Every arena is a single block of
+// memory with a head that only moves forward. Allocations are aligned and thread-safe, and
+// temporary scopes can roll the head back to a previous marker.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <atomic>
+#include <mutex>
+
+#define GLOBAL_FRAME_ARENA_SIZE MB(16)
+#define GLOBAL_LEVEL_ARENA_SIZE MB(64)
+#define THREAD_ARENA_SIZE       MB(8)
+
+#define DEFAULT_ARENA_ALIGNMENT 16
+
+struct Arena
+{
+    const char*        name;
+    u8*                memory;
+    u64                size;
+
+    std::atomic<u64>   head;
+
+    // Statistics
+    std::atomic<u64>   highWatermark;
+    std::atomic<u32>   allocationCount;
+    std::atomic<u32>   overflowCount;
+    std::atomic<u64>   overflowBytes;
+
+    // Allocations that did not fit are served by the heap until the arena is reset
+    std::mutex         overflowMutex;
+    std::vector<void*> overflowBlocks;
+};
+
+struct ArenaMarker
+{
+    Arena* arena;
+    u64    head;
+    u32    overflowBlockCount;
+};
+
+/**
+ * Arena reset at the end of every frame. Everything allocated from it is temporary
+ * and must be copied if it needs to persist for several frames.
+ */
+extern Arena GlobalFrameArena;
+
+/**
+ * Arena that lives as long as the loaded scene. Use it for data that is created while
+ * loading and never released on its own, like the file paths of textures and models.
+ */
+extern Arena GlobalLevelArena;
+
+void InitArenas();
+
+void ShutdownArenas();
+
+void CreateArena(Arena* arena, const char* name, u64 size);
+
+void DestroyArena(Arena* arena);
+
+void ResetArena(Arena* arena);
+
+/**
+ * Returns the scratch arena of the calling thread, creating it the first time, and again
+ * after ShutdownArenas. Thread arenas are never shared, so they are the right place for
+ * temporary scopes in jobs running on worker threads.
+ */
+Arena* GetThreadArena();
+
+void* PushSizeAligned(Arena* arena, u64 byteCount, u64 alignment);
+
+void* PushSize(Arena* arena, u64 byteCount);
+
+void* PushBytes(Arena* arena, const void* bytes, u64 byteCount);
+
+#define PushArray(arena, type, count) (type*)PushSizeAligned(arena, sizeof(type) * (count), alignof(type))
+#define PushStruct(arena, type)       (type*)PushSizeAligned(arena, sizeof(type), alignof(type))
+
+/**
+ * Temporary scopes store the head of an arena and restore it later. They must only be
+ * used on arenas that are not being filled by other threads at the same time (e.g.
+ * the thread arena or the frame arena from the main thread).
+ */
+ArenaMarker BeginTempArena(Arena* arena);
+
+void EndTempArena(ArenaMarker marker);
+
+struct TempArenaScope
+{
+    TempArenaScope(Arena* arena) { marker = BeginTempArena(arena); }
+    ~TempArenaScope() { EndTempArena(marker); }
+
+    ArenaMarker marker;
+};
+
+/**
+ * Calls a function for the frame, level and every thread arena. Used to display the
+ * memory statistics in the editor.
+ */
+void ForEachArena(void (*callback)(const Arena* arena, void* userData), void* userData);
@@ -0,0 +1,426 @@
+//
+// mesh_cache.cpp : Implementation of the cooked mesh files declared in mesh_cache.h.
+//
+// File layout (little endian, every section 16 byte aligned):
+//   CookedMeshHeader
+//   CookedMeshDependency[dependencyCount]
+//   CookedMaterial[materialCount]
+//   CookedSubmesh[submeshCount]
+//   strings (null terminated, referenced by offset)
+//   vertex data (the vertex buffer as uploaded to the GPU)
+//   index data (the index buffer as uploaded to the GPU)
+//
+
+#include "mesh_cache.h"
+#include "assimp_model_loading.h"
+#include "vertex_compression.h"
+#include "texture_streaming.h"
+#include "profiler.h"
+
+#define COOKED_MESH_NO_STRING      UINT32_MAX
+#define COOKED_MESH_MAX_ATTRIBUTES 8
+#define COOKED_MESH_ALIGNMENT      16
+
+struct CookedMeshHeader
+{
+    u32 magic;
+    u32 version;
+    u32 importFlags;
+    u32 dependencyCount;
+    u32 materialCount;
+    u32 submeshCount;
+    u64 fileSize;
+    u64 dependenciesOffset;
+    u64 materialsOffset;
+    u64 submeshesOffset;
+    u64 stringsOffset;
+    u64 stringsSize;
+    u64 vertexDataOffset;
+    u64 vertexDataSize;
+    u64 indexDataOffset;
+    u64 indexDataSize;
+    f32 boundsCenter[3];
+    f32 boundsRadius;
+};
+
+struct CookedMeshDependency
+{
+    u32 path;
+    u32 padding;
+    u64 size;
+    u64 hash;
+};
+
+// Texture slots of a material, in the order they are stored
+static u32 Material::* const CookedTextureSlots[] =
+{
+    &Material::albedoTextureIdx,
+    &Material::emissiveTextureIdx,
+    &Material::specularTextureIdx,
+    &Material::normalsTextureIdx,
+    &Material::bumpTextureIdx,
+};
+
+static const TextureUsage CookedTextureUsages[ARRAY_COUNT(CookedTextureSlots)] =
+{
+    TEXTURE_USAGE_COLOR,
+    TEXTURE_USAGE_COLOR,
+    TEXTURE_USAGE_MASK,
+    TEXTURE_USAGE_VECTOR,
+    TEXTURE_USAGE_MASK,
+};
+
+struct CookedMaterial
+{
+    u32 name;
+    f32 albedo[3];
+    f32 emissive[3];
+    f32 smoothness;
+    u32 textures[ARRAY_COUNT(CookedTextureSlots)]; // Paths, the textures are loaded with the mesh
+};
+
+struct CookedVertexAttribute
+{
+    u8  location;
+    u8  componentCount;
+    u8  normalized;
+    u8  stride;
+    u32 offset;
+    u32 type;
+};
+
+struct CookedSubmeshLod
+{
+    u32 firstIndex;
+    u32 indexCount;
+    f32 error;
+};
+
+struct CookedSubmesh
+{
+    u32                   vertexOffset; // In bytes, from the start of the vertex data
+    u32                   vertexSize;
+    u32                   indexOffset;  // In bytes, from the start of the index data
+    u32                   indexCount;   // Of all the levels of detail
+    u32                   indexType;
+    u32                   materialIndex;
+    f32                   positionScale[3];
+    f32                   positionOffset[3];
+    u8                    stride;
+    u8                    attributeCount;
+    u8                    lodCount;
+    u8                    padding;
+    CookedVertexAttribute attributes[COOKED_MESH_MAX_ATTRIBUTES];
+    CookedSubmeshLod      lods[MAX_SUBMESH_LODS];
+};
+
+std::string GetCookedMeshPath(const char* filepath)
+{
+    std::string path = COOKED_MESH_DIRECTORY "/";
+    if (filepath[0] == '.' && (filepath[1] == '/' || filepath[1] == '\\'))
+        filepath += 2;
+    for (const char* c = filepath; *c; ++c)
+        path.push_back(*c == '/' || *c == '\\' || *c == ':' ? '_' : *c);
+    return path + ".mesh";
+}
+
+u64 AlignCookedOffset(u64 offset)
+{
+    return (offset + COOKED_MESH_ALIGNMENT - 1) & ~(u64)(COOKED_MESH_ALIGNMENT - 1);
+}
+
+u32 AddCookedString(std::vector<char>& strings, const char* str)
+{
+    u32 offset = (u32)strings.size();
+    strings.insert(strings.end(), str, str + strlen(str) + 1);
+    return offset;
+}
+
+bool WriteCookedMesh(App* app, const char* filepath, const Mesh& mesh, const std::vector<u32>& submeshMaterialIndices,
+                     u32 baseMaterialIndex, u32 materialCount, const std::vector<std::string>& dependencies)
+{
+    PROFILE_FUNCTION();
+    std::vector<char> strings;
+
+    std::vector<CookedMeshDependency> cookedDependencies;
+    for (const std::string& dependency : dependencies)
+    {
+        FileView file = MapFile(dependency.c_str());
+        if (!file.data)
+            return false;
+
+        CookedMeshDependency cooked = {};
+        cooked.path = AddCookedString(strings, dependency.c_str());
+        cooked.size = file.size;
+        cooked.hash = HashBytes(file.data, file.size);
+        cookedDependencies.push_back(cooked);
+        UnmapFile(file);
+    }
+
+    std::vector<CookedMaterial> cookedMaterials(materialCount);
+    for (u32 i = 0; i < materialCount; ++i)
+    {
+        const Material& material = app->materials[baseMaterialIndex + i];
+        CookedMaterial& cooked = cookedMaterials[i];
+        cooked.name = AddCookedString(strings, material.name.c_str());
+        memcpy(cooked.albedo, &material.albedo, sizeof(cooked.albedo));
+        memcpy(cooked.emissive, &material.emissive, sizeof(cooked.emissive));
+        cooked.smoothness = material.smoothness;
+        for (u32 slot = 0; slot < ARRAY_COUNT(CookedTextureSlots); ++slot)
+        {
+            u32 texIdx = material.*CookedTextureSlots[slot];
+            cooked.textures[slot] = texIdx < app->textures.size()
+                ? AddCookedString(strings, app->textures[texIdx].filepath)
+                : COOKED_MESH_NO_STRING;
+        }
+    }
+
+    u64 vertexDataSize = 0;
+    u64 indexDataSize = 0;
+    std::vector<CookedSubmesh> cookedSubmeshes(mesh.submeshes.size());
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        CookedSubmesh& cooked = cookedSubmeshes[i];
+        if (submesh.vertexBufferLayout.attributes.size() > COOKED_MESH_MAX_ATTRIBUTES ||
+            submeshMaterialIndices[i] - baseMaterialIndex >= materialCount)
+            return false;
+
+        // 4 byte aligned, like the buffers of UploadMeshBuffers
+        cooked.vertexOffset = (u32)((vertexDataSize + 3) & ~3ull);
+        cooked.vertexSize = (u32)submesh.vertices.size();
+        cooked.indexOffset = (u32)((indexDataSize + 3) & ~3ull);
+        cooked.indexCount = (u32)submesh.indices.size();
+        cooked.indexType = submesh.indexType;
+        cooked.materialIndex = submeshMaterialIndices[i] - baseMaterialIndex;
+        memcpy(cooked.positionScale, &submesh.positionScale, sizeof(cooked.positionScale));
+        memcpy(cooked.positionOffset, &submesh.positionOffset, sizeof(cooked.positionOffset));
+        cooked.stride = submesh.vertexBufferLayout.stride;
+        cooked.attributeCount = (u8)submesh.vertexBufferLayout.attributes.size();
+        cooked.lodCount = (u8)submesh.lodCount;
+        for (u32 j = 0; j < submesh.lodCount; ++j)
+            cooked.lods[j] = CookedSubmeshLod{ submesh.lods[j].firstIndex, submesh.lods[j].indexCount, submesh.lods[j].error };
+        for (u32 j = 0; j < cooked.attributeCount; ++j)
+        {
+            const VertexBufferAttribute& attribute = submesh.vertexBufferLayout.attributes[j];
+            CookedVertexAttribute& cookedAttribute = cooked.attributes[j];
+            cookedAttribute.location = attribute.location;
+            cookedAttribute.componentCount = attribute.componentCount;
+            cookedAttribute.normalized = attribute.normalized ? 1 : 0;
+            cookedAttribute.stride = attribute.stride;
+            cookedAttribute.offset = attribute.offset;
+            cookedAttribute.type = attribute.type;
+        }
+
+        vertexDataSize = cooked.vertexOffset + (u64)cooked.vertexSize;
+        indexDataSize = cooked.indexOffset + (u64)cooked.indexCount * GetIndexSize(cooked.indexType);
+    }
+    if (vertexDataSize > UINT32_MAX || indexDataSize > UINT32_MAX)
+        return false;
+
+    CookedMeshHeader header = {};
+    header.magic = COOKED_MESH_MAGIC;
+    header.version = COOKED_MESH_VERSION;
+    header.importFlags = ASSIMP_IMPORT_FLAGS;
+    header.dependencyCount = (u32)cookedDependencies.size();
+    header.materialCount = materialCount;
+    header.submeshCount = (u32)cookedSubmeshes.size();
+    header.dependenciesOffset = AlignCookedOffset(sizeof(CookedMeshHeader));
+    header.materialsOffset = AlignCookedOffset(header.dependenciesOffset + cookedDependencies.size() * sizeof(CookedMeshDependency));
+    header.submeshesOffset = AlignCookedOffset(header.materialsOffset + cookedMaterials.size() * sizeof(CookedMaterial));
+    header.stringsOffset = AlignCookedOffset(header.submeshesOffset + cookedSubmeshes.size() * sizeof(CookedSubmesh));
+    header.stringsSize = strings.size();
+    header.vertexDataOffset = AlignCookedOffset(header.stringsOffset + header.stringsSize);
+    header.vertexDataSize = vertexDataSize;
+    header.indexDataOffset = AlignCookedOffset(header.vertexDataOffset + header.vertexDataSize);
+    header.indexDataSize = indexDataSize;
+    memcpy(header.boundsCenter, &mesh.boundsCenter, sizeof(header.boundsCenter));
+    header.boundsRadius = mesh.boundsRadius;
+    header.fileSize = header.indexDataOffset + header.indexDataSize;
+
+    std::vector<u8> contents((size_t)header.fileSize);
+    u8* base = contents.data();
+    memcpy(base, &header, sizeof(header));
+    if (!cookedDependencies.empty())
+        memcpy(base + header.dependenciesOffset, cookedDependencies.data(), cookedDependencies.size() * sizeof(CookedMeshDependency));
+    if (!cookedMaterials.empty())
+        memcpy(base + header.materialsOffset, cookedMaterials.data(), cookedMaterials.size() * sizeof(CookedMaterial));
+    if (!cookedSubmeshes.empty())
+        memcpy(base + header.submeshesOffset, cookedSubmeshes.data(), cookedSubmeshes.size() * sizeof(CookedSubmesh));
+    if (!strings.empty())
+        memcpy(base + header.stringsOffset, strings.data(), strings.size());
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        memcpy(base + header.vertexDataOffset + cookedSubmeshes[i].vertexOffset, submesh.vertices.data(), cookedSubmeshes[i].vertexSize);
+        PackSubmeshIndices(submesh, base + header.indexDataOffset + cookedSubmeshes[i].indexOffset);
+    }
+
+    std::string cookedPath = GetCookedMeshPath(filepath);
+    if (!CreateDirectoryIfMissing(COOKED_MESH_DIRECTORY) || !WriteBinaryFile(cookedPath.c_str(), base, header.fileSize))
+        return false;
+
+    LOG_MESSAGE(LOG_LEVEL_DEBUG, LOG_ASSETS, "Cooked %s into %s (%llu bytes)", filepath, cookedPath, header.fileSize);
+    return true;
+}
+
+bool IsCookedSectionInFile(u64 offset, u64 size, u64 fileSize)
+{
+    return offset <= fileSize && size <= fileSize - offset;
+}
+
+// Checks everything the loader relies on, so a corrupt or truncated file is imported again
+// instead of reading out of bounds
+bool IsCookedMeshValid(const FileView& file)
+{
+    if (file.size < sizeof(CookedMeshHeader))
+        return false;
+
+    const CookedMeshHeader* header = (const CookedMeshHeader*)file.data;
+    if (header->magic != COOKED_MESH_MAGIC || header->version != COOKED_MESH_VERSION ||
+        header->importFlags != ASSIMP_IMPORT_FLAGS || header->fileSize != file.size)
+        return false;
+
+    if (!IsCookedSectionInFile(header->dependenciesOffset, (u64)header->dependencyCount * sizeof(CookedMeshDependency), file.size) ||
+        !IsCookedSectionInFile(header->materialsOffset, (u64)header->materialCount * sizeof(CookedMaterial), file.size) ||
+        !IsCookedSectionInFile(header->submeshesOffset, (u64)header->submeshCount * sizeof(CookedSubmesh), file.size) ||
+        !IsCookedSectionInFile(header->stringsOffset, header->stringsSize, file.size) ||
+        !IsCookedSectionInFile(header->vertexDataOffset, header->vertexDataSize, file.size) ||
+        !IsCookedSectionInFile(header->indexDataOffset, header->indexDataSize, file.size))
+        return false;
+
+    const char* strings = (const char*)file.data + header->stringsOffset;
+    if (header->stringsSize > 0 && strings[header->stringsSize - 1] != '\0')
+        return false;
+
+    const CookedMeshDependency* dependencies = (const CookedMeshDependency*)(file.data + header->dependenciesOffset);
+    for (u32 i = 0; i < header->dependencyCount; ++i)
+        if (dependencies[i].path >= header->stringsSize)
+            return false;
+
+    const CookedMaterial* materials = (const CookedMaterial*)(file.data + header->materialsOffset);
+    for (u32 i = 0; i < header->materialCount; ++i)
+    {
+        if (materials[i].name >= header->stringsSize)
+            return false;
+        for (u32 slot = 0; slot < ARRAY_COUNT(CookedTextureSlots); ++slot)
+            if (materials[i].textures[slot] != COOKED_MESH_NO_STRING && materials[i].textures[slot] >= header->stringsSize)
+                return false;
+    }
+
+    const CookedSubmesh* submeshes = (const CookedSubmesh*)(file.data + header->submeshesOffset);
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        const CookedSubmesh& submesh = submeshes[i];
+        if (submesh.attributeCount > COOKED_MESH_MAX_ATTRIBUTES || submesh.materialIndex >= header->materialCount ||
+            !IsCookedSectionInFile(submesh.vertexOffset, submesh.vertexSize, header->vertexDataSize) ||
+            (submesh.indexType != GL_UNSIGNED_SHORT && submesh.indexType != GL_UNSIGNED_INT) ||
+            !IsCookedSectionInFile(submesh.indexOffset, (u64)submesh.indexCount * GetIndexSize(submesh.indexType), header->indexDataSize) ||
+            submesh.lodCount > MAX_SUBMESH_LODS)
+            return false;
+        for (u32 j = 0; j < submesh.lodCount; ++j)
+            if (!IsCookedSectionInFile(submesh.lods[j].firstIndex, submesh.lods[j].indexCount, submesh.indexCount))
+                return false;
+    }
+
+    return true;
+}
+
+bool AreCookedMeshDependenciesUnchanged(const FileView& file)
+{
+    const CookedMeshHeader* header = (const CookedMeshHeader*)file.data;
+    const CookedMeshDependency* dependencies = (const CookedMeshDependency*)(file.data + header->dependenciesOffset);
+    const char* strings = (const char*)file.data + header->stringsOffset;
+
+    for (u32 i = 0; i < header->dependencyCount; ++i)
+    {
+        FileView dependency = MapFile(strings + dependencies[i].path);
+        bool unchanged = dependency.data && dependency.size == dependencies[i].size &&
+                         HashBytes(dependency.data, dependency.size) == dependencies[i].hash;
+        UnmapFile(dependency);
+        if (!unchanged)
+            return false;
+    }
+    return true;
+}
+
+bool LoadCookedMesh(App* app, const char* filepath, Mesh& mesh, std::vector<u32>& submeshMaterialIndices)
+{
+    PROFILE_FUNCTION();
+
+    std::string cookedPath = GetCookedMeshPath(filepath);
+    FileView file = MapFile(cookedPath.c_str());
+    if (!file.data)
+        return false;
+
+    if (!IsCookedMeshValid(file) || !AreCookedMeshDependenciesUnchanged(file))
+    {
+        LOG_MESSAGE(LOG_LEVEL_INFO, LOG_ASSETS, "Cooked mesh %s is outdated, importing %s", cookedPath, filepath);
+        UnmapFile(file);
+        return false;
+    }
+
+    const CookedMeshHeader* header = (const CookedMeshHeader*)file.data;
+    const CookedMaterial* materials = (const CookedMaterial*)(file.data + header->materialsOffset);
+    const CookedSubmesh* submeshes = (const CookedSubmesh*)(file.data + header->submeshesOffset);
+    const char* strings = (const char*)file.data + header->stringsOffset;
+
+    u32 baseMaterialIndex = (u32)app->materials.size();
+    for (u32 i = 0; i < header->materialCount; ++i)
+    {
+        const CookedMaterial& cooked = materials[i];
+        Material material = {};
+        material.name = strings + cooked.name;
+        memcpy(&material.albedo, cooked.albedo, sizeof(cooked.albedo));
+        memcpy(&material.emissive, cooked.emissive, sizeof(cooked.emissive));
+        material.smoothness = cooked.smoothness;
+        for (u32 slot = 0; slot < ARRAY_COUNT(CookedTextureSlots); ++slot)
+            if (cooked.textures[slot] != COOKED_MESH_NO_STRING)
+                material.*CookedTextureSlots[slot] = RequestTexture2D(app, strings + cooked.textures[slot], CookedTextureUsages[slot]);
+        app->materials.push_back(material);
+    }
+
+    memcpy(&mesh.boundsCenter, header->boundsCenter, sizeof(header->boundsCenter));
+    mesh.boundsRadius = header->boundsRadius;
+    mesh.submeshes.resize(header->submeshCount);
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        const CookedSubmesh& cooked = submeshes[i];
+        Submesh& submesh = mesh.submeshes[i];
+        submesh.vertexBufferLayout.stride = cooked.stride;
+        for (u32 j = 0; j < cooked.attributeCount; ++j)
+        {
+            const CookedVertexAttribute& cookedAttribute = cooked.attributes[j];
+            VertexBufferAttribute attribute = { cookedAttribute.location, cookedAttribute.componentCount, cookedAttribute.offset };
+            attribute.type = cookedAttribute.type;
+            attribute.normalized = cookedAttribute.normalized != 0;
+            attribute.stride = cookedAttribute.stride;
+            submesh.vertexBufferLayout.attributes.push_back(attribute);
+        }
+        submesh.vertexOffset = cooked.vertexOffset;
+        submesh.indexOffset = cooked.indexOffset;
+        submesh.indexCount = cooked.lodCount > 0 ? cooked.lods[0].indexCount : cooked.indexCount;
+        submesh.indexType = cooked.indexType;
+        submesh.lodCount = cooked.lodCount;
+        for (u32 j = 0; j < cooked.lodCount; ++j)
+            submesh.lods[j] = SubmeshLod{ cooked.lods[j].firstIndex, cooked.lods[j].indexCount, cooked.lods[j].error };
+        memcpy(&submesh.positionScale, cooked.positionScale, sizeof(cooked.positionScale));
+        memcpy(&submesh.positionOffset, cooked.positionOffset, sizeof(cooked.positionOffset));
+        submeshMaterialIndices.push_back(baseMaterialIndex + cooked.materialIndex);
+    }
+
+    // Straight from the mapped file to the driver
+    glGenBuffers(1, &mesh.vertexBufferHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)header->vertexDataSize, file.data + header->vertexDataOffset, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &mesh.indexBufferHandle);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)header->indexDataSize, file.data + header->indexDataOffset, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    UnmapFile(file);
+    return true;
+}
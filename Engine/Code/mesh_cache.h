@@ -0,0 +1,35 @@
+//
+// mesh_cache.h : Cooked meshes. Once a model has been imported (by the OBJ importer or Assimp),
+// its compressed vertices, indices (with their levels of detail), vertex layouts and materials
+// are written to a binary file in the Cooked directory. Later launches map that file and upload
+// it straight into the mesh buffers, skipping the importers and the Assimp post-processing
+// steps. The cooked file stores a hash of every file read by the import (the model and its .mtl),
+// so editing any of them triggers a new import.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define COOKED_MESH_DIRECTORY "Cooked"
+#define COOKED_MESH_MAGIC     0x48534d45 // "EMSH"
+#define COOKED_MESH_VERSION   5          // Increase when the format or the import changes
+
+/**
+ * Loads the cooked version of a model file: creates the mesh buffers and appends the materials
+ * to the app. Returns false, without side effects, if there is no cooked file or it is outdated.
+ */
+bool LoadCookedMesh(App* app, const char* filepath, Mesh& mesh, std::vector<u32>& submeshMaterialIndices);
+
+/**
+ * Writes the cooked version of a mesh that has just been imported, so its submeshes still hold
+ * the vertices and indices. Its materials are the materialCount ones that start at
+ * baseMaterialIndex, and the dependencies are the files read by the import.
+ */
+bool WriteCookedMesh(App* app, const char* filepath, const Mesh& mesh, const std::vector<u32>& submeshMaterialIndices,
+                     u32 baseMaterialIndex, u32 materialCount, const std::vector<std::string>& dependencies);
+
+/**
+ * Path of the cooked file of a model, e.g. "Cooked/Lake_CastleLake.obj.mesh".
+ */
+std::string GetCookedMeshPath(const char* filepath);
@@ -0,0 +1,442 @@
+//
+// mesh_optimization.cpp : Implementation of the mesh optimization declared in
+// mesh_optimization.h.
+//
+// The vertex cache step is Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": every vertex
+// scores by its position in the simulated cache and by the triangles it still has to emit, and
+// the next triangle is the best scored one among the triangles of the cached vertices. The
+// overdraw step follows Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw", on top of that order.
+//
+
+#include "mesh_optimization.h"
+#include "profiler.h"
+#include "job_system.h"
+#include <algorithm>
+#include <float.h>
+
+#define FORSYTH_LAST_TRIANGLE_SCORE  0.75f
+#define FORSYTH_CACHE_DECAY_POWER    1.5f
+#define FORSYTH_VALENCE_BOOST_SCALE  2.0f
+#define FORSYTH_VALENCE_BOOST_POWER  0.5f
+#define FORSYTH_MAX_VALENCE          32   // The valence boost is flat beyond this
+
+struct ForsythScores
+{
+    f32 cache[VERTEX_CACHE_SIZE];       // By cache position
+    f32 valence[FORSYTH_MAX_VALENCE + 1]; // By triangles left to emit
+};
+
+static ForsythScores ComputeForsythScores()
+{
+    ForsythScores scores = {};
+    for (u32 i = 0; i < VERTEX_CACHE_SIZE; ++i)
+    {
+        // The vertices of the last triangle score the same, so the order they were emitted in
+        // doesn't matter
+        if (i < 3)
+            scores.cache[i] = FORSYTH_LAST_TRIANGLE_SCORE;
+        else
+            scores.cache[i] = powf(1.0f - (f32)(i - 3) / (VERTEX_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+    }
+    for (u32 i = 1; i <= FORSYTH_MAX_VALENCE; ++i)
+        scores.valence[i] = FORSYTH_VALENCE_BOOST_SCALE * powf((f32)i, -FORSYTH_VALENCE_BOOST_POWER);
+    return scores;
+}
+
+static const ForsythScores GlobalForsythScores = ComputeForsythScores();
+
+f32 GetForsythVertexScore(i32 cachePosition, u32 liveTriangles)
+{
+    if (liveTriangles == 0)
+        return -1.0f; // Nothing left to draw with this vertex
+
+    f32 score = cachePosition >= 0 ? GlobalForsythScores.cache[cachePosition] : 0.0f;
+    return score + GlobalForsythScores.valence[std::min(liveTriangles, (u32)FORSYTH_MAX_VALENCE)];
+}
+
+VertexCacheStats AnalyzeVertexCache(const u32* indices, u32 indexCount, u32 vertexCount)
+{
+    // FIFO cache: a vertex is cached if fewer than VERTEX_CACHE_SIZE misses happened since it
+    // was loaded
+    std::vector<u32> loadTime(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    u32 time = VERTEX_CACHE_SIZE + 1;
+    u32 misses = 0;
+    u32 usedVertices = 0;
+    for (u32 i = 0; i < indexCount; ++i)
+    {
+        u32 vertex = indices[i];
+        if (time - loadTime[vertex] > VERTEX_CACHE_SIZE)
+        {
+            loadTime[vertex] = time++;
+            misses++;
+        }
+        if (!used[vertex])
+        {
+            used[vertex] = true;
+            usedVertices++;
+        }
+    }
+
+    VertexCacheStats stats = {};
+    stats.acmr = indexCount >= 3 ? (f32)misses / (indexCount / 3) : 0.0f;
+    stats.atvr = usedVertices > 0 ? (f32)misses / usedVertices : 0.0f;
+    return stats;
+}
+
+void OptimizeVertexCache(u32* destination, const u32* indices, u32 indexCount, u32 vertexCount)
+{
+    u32 triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles of every vertex. The first liveTriangles[v] of each list are the ones not
+    // emitted yet.
+    std::vector<u32> liveTriangles(vertexCount, 0);
+    for (u32 i = 0; i < triangleCount * 3; ++i)
+        liveTriangles[indices[i]]++;
+
+    std::vector<u32> adjacencyOffsets(vertexCount + 1, 0);
+    for (u32 v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+    std::vector<u32> adjacency(triangleCount * 3);
+    std::vector<u32> fillCursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (u32 i = 0; i < triangleCount * 3; ++i)
+        adjacency[fillCursors[indices[i]]++] = i / 3;
+
+    std::vector<f32> vertexScores(vertexCount);
+    for (u32 v = 0; v < vertexCount; ++v)
+        vertexScores[v] = GetForsythVertexScore(-1, liveTriangles[v]);
+
+    std::vector<f32> triangleScores(triangleCount);
+    u32 current = 0;
+    for (u32 t = 0; t < triangleCount; ++t)
+    {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+        if (triangleScores[t] > triangleScores[current])
+            current = t;
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    u32 cache[VERTEX_CACHE_SIZE + 3];
+    u32 cacheCount = 0;
+    u32 inputCursor = 0;
+
+    for (u32 output = 0; output < triangleCount; ++output)
+    {
+        // Dead end (no cached vertex has triangles left), continue with the next triangle of the
+        // input order
+        if (current == UINT32_MAX)
+        {
+            while (emitted[inputCursor])
+                inputCursor++;
+            current = inputCursor;
+        }
+
+        const u32* triangle = indices + current * 3;
+        destination[output * 3 + 0] = triangle[0];
+        destination[output * 3 + 1] = triangle[1];
+        destination[output * 3 + 2] = triangle[2];
+        emitted[current] = true;
+
+        for (u32 i = 0; i < 3; ++i)
+        {
+            u32 vertex = triangle[i];
+            u32* vertexTriangles = adjacency.data() + adjacencyOffsets[vertex];
+            u32 live = liveTriangles[vertex];
+            for (u32 j = 0; j < live; ++j)
+            {
+                if (vertexTriangles[j] == current)
+                {
+                    vertexTriangles[j] = vertexTriangles[live - 1];
+                    vertexTriangles[live - 1] = current;
+                    liveTriangles[vertex]--;
+                    break;
+                }
+            }
+        }
+
+        // The vertices of the triangle go to the front, the last ones fall out
+        u32 newCache[VERTEX_CACHE_SIZE + 3] = { triangle[0], triangle[1], triangle[2] };
+        u32 newCacheCount = 3;
+        for (u32 i = 0; i < cacheCount; ++i)
+            if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+                newCache[newCacheCount++] = cache[i];
+
+        for (u32 i = 0; i < newCacheCount; ++i)
+        {
+            u32 vertex = newCache[i];
+            f32 score = GetForsythVertexScore(i < VERTEX_CACHE_SIZE ? (i32)i : -1, liveTriangles[vertex]);
+            f32 delta = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+
+            const u32* vertexTriangles = adjacency.data() + adjacencyOffsets[vertex];
+            for (u32 j = 0; j < liveTriangles[vertex]; ++j)
+                triangleScores[vertexTriangles[j]] += delta;
+        }
+
+        current = UINT32_MAX;
+        f32 bestScore = 0.0f;
+        cacheCount = std::min(newCacheCount, (u32)VERTEX_CACHE_SIZE);
+        for (u32 i = 0; i < cacheCount; ++i)
+        {
+            cache[i] = newCache[i];
+            const u32* vertexTriangles = adjacency.data() + adjacencyOffsets[cache[i]];
+            for (u32 j = 0; j < liveTriangles[cache[i]]; ++j)
+            {
+                if (current == UINT32_MAX || triangleScores[vertexTriangles[j]] > bestScore)
+                {
+                    current = vertexTriangles[j];
+                    bestScore = triangleScores[current];
+                }
+            }
+        }
+    }
+}
+
+struct OverdrawCluster
+{
+    u32 firstTriangle;
+    u32 triangleCount;
+    f32 sortKey;
+};
+
+vec3 GetOptimizationPosition(const u8* positions, u32 positionStride, u32 vertex)
+{
+    return glm::make_vec3((const f32*)(positions + (size_t)vertex * positionStride));
+}
+
+void OptimizeOverdraw(u32* indices, u32 indexCount, const u8* positions, u32 positionStride, u32 vertexCount, f32 threshold)
+{
+    u32 triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    std::vector<u32> loadTime(vertexCount, 0);
+    u32 time = VERTEX_CACHE_SIZE + 1;
+    auto countMisses = [&](u32 t)
+    {
+        u32 misses = 0;
+        for (u32 i = 0; i < 3; ++i)
+        {
+            u32 vertex = indices[t * 3 + i];
+            if (time - loadTime[vertex] > VERTEX_CACHE_SIZE)
+            {
+                loadTime[vertex] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    };
+
+    // Hard boundaries: triangles with three misses, where the cache order starts over
+    std::vector<u32> hardBoundaries;
+    u32 totalMisses = 0;
+    for (u32 t = 0; t < triangleCount; ++t)
+    {
+        u32 misses = countMisses(t);
+        if (t == 0 || misses == 3)
+            hardBoundaries.push_back(t);
+        totalMisses += misses;
+    }
+    hardBoundaries.push_back(triangleCount);
+    f32 maxAcmr = threshold * totalMisses / triangleCount;
+
+    // Soft boundaries: the hard clusters are split further wherever starting with an empty
+    // cache keeps the ACMR within the threshold
+    std::vector<OverdrawCluster> clusters;
+    for (u32 h = 0; h + 1 < hardBoundaries.size(); ++h)
+    {
+        u32 clusterStart = hardBoundaries[h];
+        u32 clusterMisses = 0;
+        time += VERTEX_CACHE_SIZE + 1;
+        for (u32 t = hardBoundaries[h]; t < hardBoundaries[h + 1]; ++t)
+        {
+            clusterMisses += countMisses(t);
+            if (t + 1 == hardBoundaries[h + 1] || clusterMisses <= maxAcmr * (t + 1 - clusterStart))
+            {
+                clusters.push_back(OverdrawCluster{ clusterStart, t + 1 - clusterStart, 0.0f });
+                clusterStart = t + 1;
+                clusterMisses = 0;
+                time += VERTEX_CACHE_SIZE + 1;
+            }
+        }
+    }
+
+    // Area weighted centroids and normals
+    vec3 meshCentroid = vec3(0.0f);
+    f32 meshArea = 0.0f;
+    std::vector<vec3> clusterCentroids(clusters.size());
+    std::vector<vec3> clusterNormals(clusters.size());
+    for (u32 c = 0; c < clusters.size(); ++c)
+    {
+        vec3 centroid = vec3(0.0f);
+        vec3 normal = vec3(0.0f);
+        f32 area = 0.0f;
+        for (u32 t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].triangleCount; ++t)
+        {
+            vec3 p0 = GetOptimizationPosition(positions, positionStride, indices[t * 3 + 0]);
+            vec3 p1 = GetOptimizationPosition(positions, positionStride, indices[t * 3 + 1]);
+            vec3 p2 = GetOptimizationPosition(positions, positionStride, indices[t * 3 + 2]);
+            vec3 triangleNormal = glm::cross(p1 - p0, p2 - p0);
+            f32 triangleArea = glm::length(triangleNormal);
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += triangleNormal;
+            area += triangleArea;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        clusterCentroids[c] = area > 0.0f ? centroid / area : vec3(0.0f);
+        f32 normalLength = glm::length(normal);
+        clusterNormals[c] = normalLength > 0.0f ? normal / normalLength : vec3(0.0f);
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    for (u32 c = 0; c < clusters.size(); ++c)
+        clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const OverdrawCluster& a, const OverdrawCluster& b)
+    {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<u32> sorted;
+    sorted.reserve(triangleCount * 3);
+    for (const OverdrawCluster& cluster : clusters)
+        sorted.insert(sorted.end(), indices + cluster.firstTriangle * 3, indices + (cluster.firstTriangle + cluster.triangleCount) * 3);
+    memcpy(indices, sorted.data(), sorted.size() * sizeof(u32));
+}
+
+u32 OptimizeVertexFetch(Submesh& submesh)
+{
+    u32 stride = submesh.vertexBufferLayout.stride;
+    u32 vertexCount = stride > 0 ? (u32)(submesh.vertices.size() / stride) : 0;
+    std::vector<u32> remap(vertexCount, UINT32_MAX);
+    std::vector<u8> vertices;
+    vertices.reserve(submesh.vertices.size());
+
+    u32 newVertexCount = 0;
+    for (u32& index : submesh.indices)
+    {
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = newVertexCount++;
+            const u8* vertex = submesh.vertices.data() + (size_t)index * stride;
+            vertices.insert(vertices.end(), vertex, vertex + stride);
+        }
+        index = remap[index];
+    }
+
+    submesh.vertices.swap(vertices);
+    return newVertexCount;
+}
+
+struct MeshOptimization
+{
+    Mesh*                         mesh;
+    std::vector<u8>               optimized; // Not vector<bool>, the workers write it concurrently
+    std::vector<VertexCacheStats> before;
+    std::vector<VertexCacheStats> after;
+};
+
+const VertexBufferAttribute* FindOptimizationPositions(const Submesh& submesh)
+{
+    for (const VertexBufferAttribute& attribute : submesh.vertexBufferLayout.attributes)
+        if (attribute.stride != 0)
+            return NULL; // Not interleaved
+    for (const VertexBufferAttribute& attribute : submesh.vertexBufferLayout.attributes)
+        if (attribute.location == 0 && attribute.type == GL_FLOAT && attribute.componentCount == 3)
+            return &attribute;
+    return NULL;
+}
+
+void ComputeMeshBounds(Mesh& mesh)
+{
+    // Bounding sphere around the center of the bounding box
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    for (const Submesh& submesh : mesh.submeshes)
+    {
+        const VertexBufferAttribute* positions = FindOptimizationPositions(submesh);
+        u32 stride = submesh.vertexBufferLayout.stride;
+        for (size_t offset = 0; positions && offset + stride <= submesh.vertices.size(); offset += stride)
+        {
+            vec3 p = glm::make_vec3((const f32*)(submesh.vertices.data() + offset + positions->offset));
+            boundsMin = glm::min(boundsMin, p);
+            boundsMax = glm::max(boundsMax, p);
+        }
+    }
+    if (boundsMin.x > boundsMax.x)
+        return;
+
+    mesh.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    mesh.boundsRadius = 0.0f;
+    for (const Submesh& submesh : mesh.submeshes)
+    {
+        const VertexBufferAttribute* positions = FindOptimizationPositions(submesh);
+        u32 stride = submesh.vertexBufferLayout.stride;
+        for (size_t offset = 0; positions && offset + stride <= submesh.vertices.size(); offset += stride)
+        {
+            vec3 p = glm::make_vec3((const f32*)(submesh.vertices.data() + offset + positions->offset));
+            mesh.boundsRadius = std::max(mesh.boundsRadius, glm::length(p - mesh.boundsCenter));
+        }
+    }
+}
+
+void SetMeshBounds(Mesh& mesh, vec3 boundsMin, vec3 boundsMax)
+{
+    mesh.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    mesh.boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+}
+
+void OptimizeSubmeshRange(void* data, u32 begin, u32 end)
+{
+    MeshOptimization* optimization = (MeshOptimization*)data;
+    for (u32 i = begin; i < end; ++i)
+    {
+        Submesh& submesh = optimization->mesh->submeshes[i];
+        const VertexBufferAttribute* positions = FindOptimizationPositions(submesh);
+        u32 stride = submesh.vertexBufferLayout.stride;
+        u32 indexCount = (u32)submesh.indices.size();
+        if (!positions || stride == 0 || indexCount == 0 || indexCount % 3 != 0)
+            continue;
+
+        u32 vertexCount = (u32)(submesh.vertices.size() / stride);
+        optimization->before[i] = AnalyzeVertexCache(submesh.indices.data(), indexCount, vertexCount);
+
+        std::vector<u32> indices(indexCount);
+        OptimizeVertexCache(indices.data(), submesh.indices.data(), indexCount, vertexCount);
+        OptimizeOverdraw(indices.data(), indexCount, submesh.vertices.data() + positions->offset, stride, vertexCount, OVERDRAW_CLUSTER_THRESHOLD);
+        submesh.indices.swap(indices);
+        vertexCount = OptimizeVertexFetch(submesh);
+
+        optimization->after[i] = AnalyzeVertexCache(submesh.indices.data(), indexCount, vertexCount);
+        optimization->optimized[i] = 1;
+    }
+}
+
+void OptimizeMesh(Mesh& mesh, const char* name)
+{
+    PROFILE_FUNCTION();
+    u32 submeshCount = (u32)mesh.submeshes.size();
+
+    MeshOptimization optimization;
+    optimization.mesh = &mesh;
+    optimization.optimized.resize(submeshCount, 0);
+    optimization.before.resize(submeshCount);
+    optimization.after.resize(submeshCount);
+    ParallelFor(submeshCount, 1, OptimizeSubmeshRange, &optimization);
+
+    for (u32 i = 0; i < submeshCount; ++i)
+    {
+        if (!optimization.optimized[i])
+            continue;
+        const VertexCacheStats& before = optimization.before[i];
+        const VertexCacheStats& after = optimization.after[i];
+        LOG_MESSAGE(LOG_LEVEL_INFO, LOG_ASSETS, "Optimized submesh %u of %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+                    i, name, before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+}
@@ -0,0 +1,72 @@
+//
+// mesh_optimization.h : Import-time reordering of the triangles and vertices of the submeshes,
+// so the GPU transforms each vertex as few times as possible. Runs on the float vertices the
+// importers produce, before they are compressed, uploaded and cooked:
+//   1. Vertex cache: triangles reordered with Forsyth's algorithm for a FIFO post-transform cache.
+//   2. Overdraw: the result is split in clusters at cache flushes, and the clusters are sorted
+//      so the ones facing away from the center of the submesh (likely occluders) go first.
+//   3. Vertex fetch: vertices renumbered in the order the indices use them, so vertex fetches
+//      walk the buffer sequentially. Vertices no triangle uses are dropped.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define VERTEX_CACHE_SIZE           16    // Of the simulated post-transform cache
+#define OVERDRAW_CLUSTER_THRESHOLD  1.05f // Clusters can raise the ACMR of the submesh up to this factor
+
+/**
+ * Transform cache efficiency of a triangle list with a FIFO cache of VERTEX_CACHE_SIZE entries.
+ * ACMR is the average transformed vertices per triangle (0.5 is the ideal for regular grids, 3
+ * the worst case) and ATVR the transformed vertices per vertex (1 is the ideal).
+ */
+struct VertexCacheStats
+{
+    f32 acmr;
+    f32 atvr;
+};
+
+VertexCacheStats AnalyzeVertexCache(const u32* indices, u32 indexCount, u32 vertexCount);
+
+/**
+ * Writes the triangles of indices to destination (which can't alias it) in vertex cache order.
+ */
+void OptimizeVertexCache(u32* destination, const u32* indices, u32 indexCount, u32 vertexCount);
+
+/**
+ * Reorders the clusters of a triangle list that is already in vertex cache order, outward
+ * facing clusters first. positions points to the first position, positionStride bytes apart.
+ */
+void OptimizeOverdraw(u32* indices, u32 indexCount, const u8* positions, u32 positionStride, u32 vertexCount, f32 threshold);
+
+/**
+ * Renumbers the vertices of the submesh in the order of its indices and drops the unused ones.
+ * Works on any interleaved layout. Returns the new vertex count.
+ */
+u32 OptimizeVertexFetch(Submesh& submesh);
+
+/**
+ * Position attribute of a submesh in the interleaved float layout of the importers, NULL for any
+ * other layout (the submeshes of the glTF loader, or already compressed ones).
+ */
+const VertexBufferAttribute* FindOptimizationPositions(const Submesh& submesh);
+
+/**
+ * Sets the bounding sphere of a mesh (Mesh::boundsCenter and boundsRadius) around the center of
+ * the bounding box of its float positions. Every importer computes the bounds, the levels of
+ * detail and the texture residency depend on them. Meshes without float positions keep theirs.
+ */
+void ComputeMeshBounds(Mesh& mesh);
+
+/**
+ * Sets the bounding sphere of a mesh to the one around a box, for the loaders that only know the
+ * extent of the positions (the glTF accessors store it).
+ */
+void SetMeshBounds(Mesh& mesh, vec3 boundsMin, vec3 boundsMax);
+
+/**
+ * Runs the three steps on every submesh of an imported mesh (in parallel, on the job system)
+ * and logs the ACMR and ATVR of every submesh before and after. name is only used in the log.
+ */
+void OptimizeMesh(Mesh& mesh, const char* name);
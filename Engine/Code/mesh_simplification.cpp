@@ -0,0 +1,548 @@
+//
+// mesh_simplification.cpp : Implementation of the levels of detail declared in
+// mesh_simplification.h.
+//
+// The simplification works on positions: the vertices that only differ in their normals or
+// texture coordinates (the sides of a seam) share a position, and a collapse moves all of them
+// at once, each onto the vertex of the other end of the edge on its side of the seam. Collapses
+// run in passes: every pass picks the cheapest edge of every position, sorts them by cost and
+// performs them in order, skipping the ones next to a collapse of the same pass, until enough
+// triangles are gone. A collapse is rejected when
+//   - it would pull an open border inwards (border vertices only move along the border),
+//   - a side of a seam has no vertex to move onto,
+//   - the endpoints share neighbours other than the ones of the edge triangles, which would
+//     make the surface non-manifold,
+//   - a remaining triangle around the moving vertex would rotate too much or flip.
+//
+
+#include "mesh_simplification.h"
+#include "mesh_optimization.h"
+#include "profiler.h"
+#include "job_system.h"
+#include <algorithm>
+
+#define SIMPLIFY_EDGE_WEIGHT    4.0f  // Of the quadrics that keep borders and seams in place, relative to the faces
+#define SIMPLIFY_MIN_NORMAL_DOT 0.25f // Cosine of the largest rotation of a triangle in a collapse
+
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes, times their weights
+struct Quadric
+{
+    f64 a00, a11, a22, a01, a02, a12;
+    f64 b0, b1, b2;
+    f64 c;
+    f64 weight;
+};
+
+Quadric MakePlaneQuadric(vec3 normal, f32 distance, f32 weight)
+{
+    Quadric q;
+    q.a00 = weight * normal.x * normal.x;
+    q.a11 = weight * normal.y * normal.y;
+    q.a22 = weight * normal.z * normal.z;
+    q.a01 = weight * normal.x * normal.y;
+    q.a02 = weight * normal.x * normal.z;
+    q.a12 = weight * normal.y * normal.z;
+    q.b0 = weight * normal.x * distance;
+    q.b1 = weight * normal.y * distance;
+    q.b2 = weight * normal.z * distance;
+    q.c = weight * distance * distance;
+    q.weight = weight;
+    return q;
+}
+
+void AddQuadric(Quadric& q, const Quadric& other)
+{
+    q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+    q.a01 += other.a01; q.a02 += other.a02; q.a12 += other.a12;
+    q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+    q.c += other.c;
+    q.weight += other.weight;
+}
+
+// Weighted mean of the squared distances from p to the planes
+f64 EvaluateQuadric(const Quadric& q, vec3 p)
+{
+    f64 x = p.x, y = p.y, z = p.z;
+    f64 value = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+                2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    return q.weight > 0.0 ? std::max(value, 0.0) / q.weight : 0.0;
+}
+
+struct EdgeCollapse
+{
+    u32 from; // Position ids
+    u32 to;
+    f64 cost;
+};
+
+struct Simplifier
+{
+    const u8*            positions;
+    u32                  positionStride;
+    std::vector<u32>     positionIds; // Of every vertex, the first vertex with the same position
+    std::vector<Quadric> quadrics;    // By position id
+    std::vector<u8>      border;      // By position id, on an open border
+    std::vector<u8>      locked;      // By position id, on a non-manifold edge
+
+    // Triangles of every position id, rebuilt on every pass
+    std::vector<u32>     adjacencyOffsets;
+    std::vector<u32>     adjacency;
+
+    std::vector<u32>     remap;       // Of every vertex, the one it collapsed onto in this pass
+    std::vector<u8>      collapsed;   // By position id, touched by a collapse of this pass
+    f64                  maxCost;
+
+    // Scratch of TryEdgeCollapse
+    std::vector<std::pair<u32, u32>> vertexMoves; // Vertices of the collapsed position, and the ones they move onto
+    std::vector<u32>     edgeNeighbours;          // Third vertices of the triangles of the edge
+    std::vector<u32>     fromNeighbours;
+};
+
+struct DirectedEdgeUses
+{
+    u32 triangles;    // With the positions of the edge, in its direction
+    u32 sameVertices; // Of those, the ones with the same vertices too
+};
+
+vec3 GetSimplifierPosition(const Simplifier& simplifier, u32 vertex)
+{
+    return glm::make_vec3((const f32*)(simplifier.positions + (size_t)vertex * simplifier.positionStride));
+}
+
+u32 GetSimplifierPositionId(const Simplifier& simplifier, const u32* indices, u32 corner)
+{
+    return simplifier.positionIds[simplifier.remap[indices[corner]]];
+}
+
+bool IsTriangleDegenerate(u32 a, u32 b, u32 c)
+{
+    return a == b || b == c || a == c;
+}
+
+u32 HashPosition(vec3 p)
+{
+    u32 bits[3];
+    memcpy(bits, &p, sizeof(bits));
+    return bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u;
+}
+
+// Ids of the positions, on an open addressing table of the first vertex of every position
+void MergeSimplifierPositions(Simplifier& simplifier, u32 vertexCount)
+{
+    u32 tableSize = 1;
+    while (tableSize < vertexCount * 2)
+        tableSize *= 2;
+    std::vector<u32> table(tableSize, UINT32_MAX);
+
+    simplifier.positionIds.resize(vertexCount);
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        vec3 p = GetSimplifierPosition(simplifier, v) + vec3(0.0f); // -0 and 0 are the same position
+        u32 slot = HashPosition(p) & (tableSize - 1);
+        while (table[slot] != UINT32_MAX && GetSimplifierPosition(simplifier, table[slot]) + vec3(0.0f) != p)
+            slot = (slot + 1) & (tableSize - 1);
+        if (table[slot] == UINT32_MAX)
+            table[slot] = v;
+        simplifier.positionIds[v] = table[slot];
+    }
+}
+
+void BuildSimplifierAdjacency(Simplifier& simplifier, const std::vector<u32>& indices)
+{
+    u32 vertexCount = (u32)simplifier.positionIds.size();
+    simplifier.adjacencyOffsets.assign(vertexCount + 1, 0);
+    for (u32 index : indices)
+        simplifier.adjacencyOffsets[simplifier.positionIds[index] + 1]++;
+    for (u32 v = 0; v < vertexCount; ++v)
+        simplifier.adjacencyOffsets[v + 1] += simplifier.adjacencyOffsets[v];
+
+    simplifier.adjacency.resize(indices.size());
+    std::vector<u32> fillCursors(simplifier.adjacencyOffsets.begin(), simplifier.adjacencyOffsets.end() - 1);
+    for (u32 i = 0; i < indices.size(); ++i)
+        simplifier.adjacency[fillCursors[simplifier.positionIds[indices[i]]]++] = i / 3;
+}
+
+DirectedEdgeUses FindDirectedEdge(const Simplifier& simplifier, const std::vector<u32>& indices, u32 fromVertex, u32 toVertex)
+{
+    u32 from = simplifier.positionIds[fromVertex];
+    u32 to = simplifier.positionIds[toVertex];
+    DirectedEdgeUses uses = { 0, 0 };
+    for (u32 a = simplifier.adjacencyOffsets[from]; a < simplifier.adjacencyOffsets[from + 1]; ++a)
+    {
+        const u32* triangle = indices.data() + simplifier.adjacency[a] * 3;
+        for (u32 i = 0; i < 3; ++i)
+        {
+            u32 next = triangle[(i + 1) % 3];
+            if (simplifier.positionIds[triangle[i]] == from && simplifier.positionIds[next] == to)
+            {
+                uses.triangles++;
+                if (triangle[i] == fromVertex && next == toVertex)
+                    uses.sameVertices++;
+            }
+        }
+    }
+    return uses;
+}
+
+// Merges the vertices that share a position, computes the quadrics of every position and finds
+// its borders. Drops the triangles without area.
+void InitializeSimplifier(Simplifier& simplifier, std::vector<u32>& indices, u32 vertexCount)
+{
+    MergeSimplifierPositions(simplifier, vertexCount);
+    simplifier.remap.resize(vertexCount);
+    for (u32 v = 0; v < vertexCount; ++v)
+        simplifier.remap[v] = v;
+
+    u32 kept = 0;
+    for (u32 t = 0; t < indices.size() / 3; ++t)
+    {
+        const u32* triangle = indices.data() + t * 3;
+        if (IsTriangleDegenerate(simplifier.positionIds[triangle[0]], simplifier.positionIds[triangle[1]], simplifier.positionIds[triangle[2]]))
+            continue;
+        memmove(indices.data() + kept * 3, triangle, 3 * sizeof(u32));
+        kept++;
+    }
+    indices.resize(kept * 3);
+    BuildSimplifierAdjacency(simplifier, indices);
+
+    Quadric zero = {};
+    simplifier.quadrics.assign(vertexCount, zero);
+    simplifier.border.assign(vertexCount, 0);
+    simplifier.locked.assign(vertexCount, 0);
+    for (u32 t = 0; t < indices.size() / 3; ++t)
+    {
+        const u32* triangle = indices.data() + t * 3;
+        vec3 p[3];
+        u32 ids[3];
+        for (u32 i = 0; i < 3; ++i)
+        {
+            p[i] = GetSimplifierPosition(simplifier, triangle[i]);
+            ids[i] = simplifier.positionIds[triangle[i]];
+        }
+
+        vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        f32 length = glm::length(normal);
+        if (length <= 0.0f)
+            continue;
+        normal /= length;
+        Quadric face = MakePlaneQuadric(normal, -glm::dot(normal, p[0]), length * 0.5f);
+        for (u32 i = 0; i < 3; ++i)
+            AddQuadric(simplifier.quadrics[ids[i]], face);
+
+        for (u32 i = 0; i < 3; ++i)
+        {
+            // An edge used twice in the same direction, or by more than two triangles, is
+            // non-manifold
+            u32 j = (i + 1) % 3;
+            DirectedEdgeUses forward = FindDirectedEdge(simplifier, indices, triangle[i], triangle[j]);
+            DirectedEdgeUses backward = FindDirectedEdge(simplifier, indices, triangle[j], triangle[i]);
+            if (forward.triangles > 1 || backward.triangles > 1)
+            {
+                simplifier.locked[ids[i]] = simplifier.locked[ids[j]] = 1;
+                continue;
+            }
+
+            // Open borders, and seams (the triangle on the other side uses other vertices), get a
+            // plane through the edge perpendicular to the triangle, so they stay in place
+            bool isBorder = backward.triangles == 0;
+            bool isSeam = !isBorder && backward.sameVertices == 0;
+            if (isBorder)
+                simplifier.border[ids[i]] = simplifier.border[ids[j]] = 1;
+            if (isBorder || isSeam)
+            {
+                vec3 edge = p[j] - p[i];
+                vec3 edgeNormal = glm::cross(edge, normal);
+                f32 edgeLength = glm::length(edgeNormal);
+                if (edgeLength <= 0.0f)
+                    continue;
+                edgeNormal /= edgeLength;
+                Quadric edgeQuadric = MakePlaneQuadric(edgeNormal, -glm::dot(edgeNormal, p[i]), glm::dot(edge, edge) * SIMPLIFY_EDGE_WEIGHT);
+                AddQuadric(simplifier.quadrics[ids[i]], edgeQuadric);
+                AddQuadric(simplifier.quadrics[ids[j]], edgeQuadric);
+            }
+        }
+    }
+}
+
+f64 GetCollapseCost(const Simplifier& simplifier, u32 from, u32 to)
+{
+    Quadric q = simplifier.quadrics[from];
+    AddQuadric(q, simplifier.quadrics[to]);
+    return EvaluateQuadric(q, GetSimplifierPosition(simplifier, to));
+}
+
+// The cheapest collapse of every position that isn't ruled out already by its borders
+void FindEdgeCollapses(const Simplifier& simplifier, const std::vector<u32>& indices, std::vector<EdgeCollapse>& collapses)
+{
+    collapses.clear();
+    u32 vertexCount = (u32)simplifier.positionIds.size();
+    for (u32 from = 0; from < vertexCount; ++from)
+    {
+        if (simplifier.locked[from])
+            continue;
+
+        EdgeCollapse best = { from, UINT32_MAX, DBL_MAX };
+        for (u32 a = simplifier.adjacencyOffsets[from]; a < simplifier.adjacencyOffsets[from + 1]; ++a)
+        {
+            const u32* triangle = indices.data() + simplifier.adjacency[a] * 3;
+            for (u32 i = 0; i < 3; ++i)
+            {
+                u32 to = simplifier.positionIds[triangle[i]];
+                if (to == from || to == best.to || (simplifier.border[from] && !simplifier.border[to]))
+                    continue;
+                f64 cost = GetCollapseCost(simplifier, from, to);
+                if (cost < best.cost)
+                {
+                    best.to = to;
+                    best.cost = cost;
+                }
+            }
+        }
+        if (best.to != UINT32_MAX)
+            collapses.push_back(best);
+    }
+
+    std::sort(collapses.begin(), collapses.end(), [](const EdgeCollapse& a, const EdgeCollapse& b)
+    {
+        return a.cost < b.cost;
+    });
+}
+
+bool ContainsId(const std::vector<u32>& ids, u32 id)
+{
+    return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+// Moves the position from onto to, if the collapse keeps the surface valid. Returns the number
+// of triangles removed, 0 when it is rejected.
+u32 TryEdgeCollapse(Simplifier& simplifier, const std::vector<u32>& indices, u32 from, u32 to)
+{
+    std::vector<std::pair<u32, u32>>& vertexMoves = simplifier.vertexMoves;
+    std::vector<u32>& edgeNeighbours = simplifier.edgeNeighbours;
+    std::vector<u32>& fromNeighbours = simplifier.fromNeighbours;
+    vertexMoves.clear();
+    edgeNeighbours.clear();
+    fromNeighbours.clear();
+    vec3 fromPosition = GetSimplifierPosition(simplifier, from);
+    vec3 toPosition = GetSimplifierPosition(simplifier, to);
+    bool unmatchedVertex = false;
+
+    for (u32 a = simplifier.adjacencyOffsets[from]; a < simplifier.adjacencyOffsets[from + 1]; ++a)
+    {
+        const u32* triangle = indices.data() + simplifier.adjacency[a] * 3;
+        u32 ids[3];
+        for (u32 i = 0; i < 3; ++i)
+            ids[i] = GetSimplifierPositionId(simplifier, triangle, i);
+        if (IsTriangleDegenerate(ids[0], ids[1], ids[2]))
+            continue;
+
+        u32 corner = ids[0] == from ? 0 : ids[1] == from ? 1 : 2;
+        u32 vertex = simplifier.remap[triangle[corner]];
+        u32 next = (corner + 1) % 3;
+        u32 previous = (corner + 2) % 3;
+
+        u32 toCorner = ids[next] == to ? next : ids[previous] == to ? previous : UINT32_MAX;
+        if (toCorner != UINT32_MAX)
+        {
+            u32 toVertex = simplifier.remap[triangle[toCorner]];
+            bool found = false;
+            for (const std::pair<u32, u32>& move : vertexMoves)
+            {
+                if (move.first == vertex)
+                {
+                    if (move.second != toVertex)
+                        return 0; // Each side of a seam moves onto a single vertex
+                    found = true;
+                }
+            }
+            if (!found)
+                vertexMoves.push_back(std::make_pair(vertex, toVertex));
+            edgeNeighbours.push_back(ids[toCorner == next ? previous : next]);
+            continue;
+        }
+
+        fromNeighbours.push_back(ids[next]);
+        fromNeighbours.push_back(ids[previous]);
+
+        vec3 p1 = GetSimplifierPosition(simplifier, ids[next]);
+        vec3 p2 = GetSimplifierPosition(simplifier, ids[previous]);
+        vec3 normalBefore = glm::cross(p1 - fromPosition, p2 - fromPosition);
+        vec3 normalAfter = glm::cross(p1 - toPosition, p2 - toPosition);
+        if (glm::dot(normalBefore, normalAfter) <= SIMPLIFY_MIN_NORMAL_DOT * glm::length(normalBefore) * glm::length(normalAfter))
+            return 0;
+
+        bool moved = false;
+        for (const std::pair<u32, u32>& move : vertexMoves)
+            moved |= move.first == vertex;
+        if (!moved)
+            unmatchedVertex = true; // Checked again below, its edge triangle can come later
+    }
+
+    u32 edgeTriangles = (u32)edgeNeighbours.size();
+    if (edgeTriangles != (simplifier.border[from] ? 1u : 2u))
+        return 0;
+
+    if (unmatchedVertex)
+    {
+        for (u32 a = simplifier.adjacencyOffsets[from]; a < simplifier.adjacencyOffsets[from + 1]; ++a)
+        {
+            const u32* triangle = indices.data() + simplifier.adjacency[a] * 3;
+            for (u32 i = 0; i < 3; ++i)
+            {
+                if (GetSimplifierPositionId(simplifier, triangle, i) != from)
+                    continue;
+                bool moved = false;
+                for (const std::pair<u32, u32>& move : vertexMoves)
+                    moved |= move.first == simplifier.remap[triangle[i]];
+                if (!moved)
+                    return 0;
+            }
+        }
+    }
+
+    // Link condition: the only neighbours the endpoints share are the ones of the edge triangles
+    for (u32 a = simplifier.adjacencyOffsets[to]; a < simplifier.adjacencyOffsets[to + 1]; ++a)
+    {
+        const u32* triangle = indices.data() + simplifier.adjacency[a] * 3;
+        for (u32 i = 0; i < 3; ++i)
+        {
+            u32 id = GetSimplifierPositionId(simplifier, triangle, i);
+            if (id != to && id != from && ContainsId(fromNeighbours, id) && !ContainsId(edgeNeighbours, id))
+                return 0;
+        }
+    }
+
+    for (const std::pair<u32, u32>& move : vertexMoves)
+        simplifier.remap[move.first] = move.second;
+    AddQuadric(simplifier.quadrics[to], simplifier.quadrics[from]);
+    simplifier.collapsed[from] = simplifier.collapsed[to] = 1;
+    simplifier.maxCost = std::max(simplifier.maxCost, EvaluateQuadric(simplifier.quadrics[to], toPosition));
+    return edgeTriangles;
+}
+
+u32 SimplifyTriangles(u32* destination, const u32* indices, u32 indexCount, const u8* positions, u32 positionStride,
+                      u32 vertexCount, u32 targetIndexCount, f32* error)
+{
+    std::vector<u32> current(indices, indices + indexCount - indexCount % 3);
+    Simplifier simplifier;
+    simplifier.positions = positions;
+    simplifier.positionStride = positionStride;
+    simplifier.maxCost = 0.0;
+    InitializeSimplifier(simplifier, current, vertexCount);
+
+    u32 targetTriangles = targetIndexCount / 3;
+    std::vector<EdgeCollapse> collapses;
+    while (current.size() / 3 > targetTriangles)
+    {
+        BuildSimplifierAdjacency(simplifier, current);
+        FindEdgeCollapses(simplifier, current, collapses);
+
+        u32 triangleCount = (u32)current.size() / 3;
+        u32 removed = 0;
+        simplifier.collapsed.assign(vertexCount, 0);
+        for (const EdgeCollapse& collapse : collapses)
+        {
+            if (triangleCount - removed <= targetTriangles)
+                break;
+            if (simplifier.collapsed[collapse.from] || simplifier.collapsed[collapse.to])
+                continue;
+            removed += TryEdgeCollapse(simplifier, current, collapse.from, collapse.to);
+        }
+        if (removed == 0)
+            break;
+
+        u32 kept = 0;
+        for (u32 t = 0; t < triangleCount; ++t)
+        {
+            u32 triangle[3];
+            for (u32 i = 0; i < 3; ++i)
+                triangle[i] = simplifier.remap[current[t * 3 + i]];
+            if (IsTriangleDegenerate(simplifier.positionIds[triangle[0]], simplifier.positionIds[triangle[1]], simplifier.positionIds[triangle[2]]))
+                continue;
+            memcpy(current.data() + kept * 3, triangle, sizeof(triangle));
+            kept++;
+        }
+        current.resize(kept * 3);
+        for (u32 v = 0; v < vertexCount; ++v)
+            simplifier.remap[v] = v;
+    }
+
+    if (!current.empty())
+        memcpy(destination, current.data(), current.size() * sizeof(u32));
+    *error = (f32)sqrt(simplifier.maxCost);
+    return (u32)current.size();
+}
+
+struct MeshLodGeneration
+{
+    Mesh*           mesh;
+    f32             radius;
+    std::vector<u8> generated; // Not vector<bool>, the workers write it concurrently
+};
+
+void GenerateSubmeshLodsRange(void* data, u32 begin, u32 end)
+{
+    MeshLodGeneration* generation = (MeshLodGeneration*)data;
+    for (u32 i = begin; i < end; ++i)
+    {
+        Submesh& submesh = generation->mesh->submeshes[i];
+        const VertexBufferAttribute* positions = FindOptimizationPositions(submesh);
+        u32 stride = submesh.vertexBufferLayout.stride;
+        u32 indexCount = (u32)submesh.indices.size();
+        if (!positions || stride == 0 || indexCount % 3 != 0 || indexCount / 3 < MESH_LOD_MIN_TRIANGLES)
+            continue;
+
+        u32 vertexCount = (u32)(submesh.vertices.size() / stride);
+        const u8* vertexPositions = submesh.vertices.data() + positions->offset;
+
+        submesh.lodCount = 1;
+        submesh.lods[0] = SubmeshLod{ 0, indexCount, 0.0f };
+
+        // Every level is simplified from the previous one, so the errors add up
+        std::vector<u32> level(submesh.indices);
+        f32 error = 0.0f;
+        while (submesh.lodCount < MAX_SUBMESH_LODS)
+        {
+            u32 previousCount = (u32)level.size();
+            u32 target = (u32)(previousCount / 3 * MESH_LOD_TRIANGLE_RATIO) * 3;
+            f32 levelError = 0.0f;
+            u32 count = SimplifyTriangles(level.data(), level.data(), previousCount, vertexPositions, stride, vertexCount, target, &levelError);
+            if (count == 0 || count > previousCount * MESH_LOD_MIN_REDUCTION)
+                break;
+            error += levelError;
+
+            std::vector<u32> ordered(count);
+            OptimizeVertexCache(ordered.data(), level.data(), count, vertexCount);
+            level.swap(ordered);
+
+            SubmeshLod& lod = submesh.lods[submesh.lodCount++];
+            lod.firstIndex = (u32)submesh.indices.size();
+            lod.indexCount = count;
+            lod.error = generation->radius > 0.0f ? error / generation->radius : 0.0f;
+            submesh.indices.insert(submesh.indices.end(), level.begin(), level.end());
+        }
+        generation->generated[i] = 1;
+    }
+}
+
+void GenerateMeshLods(Mesh& mesh, const char* name)
+{
+    PROFILE_FUNCTION();
+    u32 submeshCount = (u32)mesh.submeshes.size();
+
+    MeshLodGeneration generation;
+    generation.mesh = &mesh;
+    generation.radius = mesh.boundsRadius;
+    generation.generated.resize(submeshCount, 0);
+    ParallelFor(submeshCount, 1, GenerateSubmeshLodsRange, &generation);
+
+    for (u32 i = 0; i < submeshCount; ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        if (!generation.generated[i])
+            continue;
+        const SubmeshLod& last = submesh.lods[submesh.lodCount - 1];
+        LOG_MESSAGE(LOG_LEVEL_INFO, LOG_ASSETS, "Generated %u levels of detail for submesh %u of %s: %u -> %u triangles, error %.4f",
+                    submesh.lodCount, i, name, submesh.lods[0].indexCount / 3, last.indexCount / 3, last.error);
+    }
+}
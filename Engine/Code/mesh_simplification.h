@@ -0,0 +1,34 @@
+//
+// mesh_simplification.h : Import-time generation of the levels of detail of the submeshes.
+// Every level is a simplified triangle list over the vertices of the full detail one, so the
+// levels only add indices: they are appended to the indices of the submesh and share its vertex
+// buffer range. The simplification collapses edges onto one of their vertices, cheapest first by
+// their quadric error (Garland and Heckbert, "Surface Simplification Using Quadric Error
+// Metrics"). Open borders and texture or normal seams are kept in place.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define MESH_LOD_TRIANGLE_RATIO 0.5f  // Triangles of every level, relative to the previous one
+#define MESH_LOD_MIN_REDUCTION  0.8f  // A level that keeps more triangles of the previous one is dropped
+#define MESH_LOD_MIN_TRIANGLES  32    // Submeshes this small get no levels of detail
+
+/**
+ * Simplifies a triangle list towards targetIndexCount indices, collapsing edges until it gets
+ * there or no collapse is left that keeps the topology and doesn't flip triangles. Writes the
+ * result to destination (which can alias indices) and returns its index count. positions points
+ * to the first float position, positionStride bytes apart. The largest distance the surface
+ * moved, in model units, is written to error.
+ */
+u32 SimplifyTriangles(u32* destination, const u32* indices, u32 indexCount, const u8* positions, u32 positionStride,
+                      u32 vertexCount, u32 targetIndexCount, f32* error);
+
+/**
+ * Fills the levels of detail of the submeshes of an imported mesh (in parallel, on the job
+ * system), up to MAX_SUBMESH_LODS including the full detail one. Runs on the float vertices of
+ * the importers, after OptimizeMesh and ComputeMeshBounds, since the errors of the levels are
+ * relative to the bounding radius. name is only used in the log.
+ */
+void GenerateMeshLods(Mesh& mesh, const char* name);
@@ -0,0 +1,978 @@
+//
+// microbenchmark.cpp : Implementation of the microbenchmarks declared in microbenchmark.h.
+//
+
+#include "microbenchmark.h"
+#include "buffer_management.h"
+#include "assimp_model_loading.h"
+#include "obj_loader.h"
+#include "mesh_optimization.h"
+#include "mesh_simplification.h"
+#include "vertex_compression.h"
+#include "texture_cache.h"
+#include "texture_compression.h"
+#include "texture_registry.h"
+#include "profiler.h"
+#include "job_system.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MICROBENCHMARK_DEFAULT_REPETITIONS 10
+#define MICROBENCHMARK_DEFAULT_MIN_TIME_MS 20.0
+#define MICROBENCHMARK_MAX_ITERATIONS      (1ull << 32)
+
+////////////////////////////////////////////////////////////////////////////////
+// Allocation counting
+
+#ifdef MICROBENCHMARK_BUILD
+
+static std::atomic<u64> AllocationCount(0);
+static std::atomic<u64> AllocationBytes(0);
+
+void* operator new(size_t size)
+{
+    AllocationCount.fetch_add(1, std::memory_order_relaxed);
+    AllocationBytes.fetch_add(size, std::memory_order_relaxed);
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+#define COUNTS_ALLOCATIONS 1
+u64 GetAllocationCount() { return AllocationCount.load(std::memory_order_relaxed); }
+u64 GetAllocationBytes() { return AllocationBytes.load(std::memory_order_relaxed); }
+
+#else
+
+#define COUNTS_ALLOCATIONS 0
+u64 GetAllocationCount() { return 0; }
+u64 GetAllocationBytes() { return 0; }
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Measurement
+
+// Runs the measured operation the given number of times
+typedef void (*MicrobenchmarkBody)(void* data, u64 iterations);
+
+struct MicrobenchmarkSettings
+{
+    const char*                       filter;
+    u32                               repetitions;
+    u64                               minTimeNs;
+    std::vector<MicrobenchmarkResult> results;
+};
+
+// Written by the benchmarks so the compiler can't discard the measured work
+static volatile u64 MicrobenchmarkSink;
+
+bool MicrobenchmarkSelected(const MicrobenchmarkSettings& settings, const char* name)
+{
+    return !settings.filter || strstr(name, settings.filter) != NULL;
+}
+
+u64 RunMicrobenchmarkBody(MicrobenchmarkBody body, void* data, u64 iterations)
+{
+    // Zones recorded by the measured code are discarded after every run, so the profiler
+    // does not accumulate millions of events
+    ProfilerBeginFrame();
+    u64 start = GetTimeNanoseconds();
+    body(data, iterations);
+    u64 elapsed = GetTimeNanoseconds() - start;
+    ProfilerEndFrame();
+    return elapsed;
+}
+
+void Microbenchmark(MicrobenchmarkSettings& settings, const char* name, MicrobenchmarkBody body, void* data,
+                    f64 processedBytes = 0.0)
+{
+    // Find how many iterations last at least the minimum time, which also warms up the caches
+    u64 iterations = 1;
+    for (;;)
+    {
+        u64 elapsed = RunMicrobenchmarkBody(body, data, iterations);
+        if (elapsed >= settings.minTimeNs || iterations >= MICROBENCHMARK_MAX_ITERATIONS)
+            break;
+
+        u64 next = elapsed > 0 ? (u64)(iterations * 1.2 * settings.minTimeNs / elapsed) : iterations * 10;
+        iterations = std::min(std::max(next, iterations * 2), iterations * 10);
+    }
+
+    std::vector<f64> samples;
+    u64 allocations = 0;
+    u64 bytes = 0;
+    for (u32 rep = 0; rep < settings.repetitions; ++rep)
+    {
+        u64 allocationsBefore = GetAllocationCount();
+        u64 bytesBefore = GetAllocationBytes();
+        u64 elapsed = RunMicrobenchmarkBody(body, data, iterations);
+        allocations += GetAllocationCount() - allocationsBefore;
+        bytes += GetAllocationBytes() - bytesBefore;
+        samples.push_back((f64)elapsed / iterations);
+    }
+
+    f64 mean = 0.0;
+    for (f64 sample : samples)
+        mean += sample;
+    mean /= samples.size();
+    f64 variance = 0.0;
+    for (f64 sample : samples)
+        variance += (sample - mean) * (sample - mean);
+    variance /= samples.size() > 1 ? samples.size() - 1 : 1;
+    std::sort(samples.begin(), samples.end());
+
+    f64 operations = (f64)iterations * settings.repetitions;
+    MicrobenchmarkResult result = {};
+    result.name = name;
+    result.iterations = iterations;
+    result.medianNs = samples[samples.size() / 2];
+    result.minNs = samples[0];
+    result.stddevNs = sqrt(variance);
+    result.bytesPerOp = COUNTS_ALLOCATIONS ? bytes / operations : -1.0;
+    result.allocsPerOp = COUNTS_ALLOCATIONS ? allocations / operations : -1.0;
+    result.processedBytes = processedBytes;
+    settings.results.push_back(result);
+
+    printf("%-48s %12.1f %12.1f %7.1f%% %12llu", name, result.medianNs, result.minNs,
+           result.medianNs > 0.0 ? 100.0 * result.stddevNs / result.medianNs : 0.0, (unsigned long long)iterations);
+    if (COUNTS_ALLOCATIONS)
+        printf(" %12.1f %10.2f", result.bytesPerOp, result.allocsPerOp);
+    else
+        printf(" %12s %10s", "-", "-");
+    if (processedBytes > 0.0)
+        printf(" %9.1f MB/s", processedBytes / result.medianNs * 1000.0);
+    printf("\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ProcessAssimpMesh
+
+struct AssimpMeshBenchmark
+{
+    aiMesh mesh;
+};
+
+// Grid of quads in the XZ plane, with the same attributes assimp gives us for the models
+void BuildBenchmarkAssimpMesh(aiMesh& mesh, u32 side)
+{
+    mesh.mNumVertices = side * side;
+    mesh.mVertices = new aiVector3D[mesh.mNumVertices];
+    mesh.mNormals = new aiVector3D[mesh.mNumVertices];
+    mesh.mTangents = new aiVector3D[mesh.mNumVertices];
+    mesh.mBitangents = new aiVector3D[mesh.mNumVertices];
+    mesh.mTextureCoords[0] = new aiVector3D[mesh.mNumVertices];
+    mesh.mNumUVComponents[0] = 2;
+
+    for (u32 z = 0; z < side; ++z)
+    {
+        for (u32 x = 0; x < side; ++x)
+        {
+            u32 i = z * side + x;
+            mesh.mVertices[i] = aiVector3D((f32)x, sinf(x * 0.1f) * cosf(z * 0.1f), (f32)z);
+            mesh.mNormals[i] = aiVector3D(0.0f, 1.0f, 0.0f);
+            mesh.mTangents[i] = aiVector3D(1.0f, 0.0f, 0.0f);
+            mesh.mBitangents[i] = aiVector3D(0.0f, 0.0f, -1.0f);
+            mesh.mTextureCoords[0][i] = aiVector3D((f32)x / side, (f32)z / side, 0.0f);
+        }
+    }
+
+    mesh.mNumFaces = (side - 1) * (side - 1) * 2;
+    mesh.mFaces = new aiFace[mesh.mNumFaces];
+    u32 face = 0;
+    for (u32 z = 0; z + 1 < side; ++z)
+    {
+        for (u32 x = 0; x + 1 < side; ++x)
+        {
+            u32 i = z * side + x;
+            u32 quad[6] = { i, i + side, i + 1, i + 1, i + side, i + side + 1 };
+            for (u32 t = 0; t < 2; ++t)
+            {
+                aiFace& f = mesh.mFaces[face++];
+                f.mNumIndices = 3;
+                f.mIndices = new unsigned int[3];
+                memcpy(f.mIndices, quad + t * 3, 3 * sizeof(unsigned int));
+            }
+        }
+    }
+}
+
+void ProcessAssimpMeshBody(void* data, u64 iterations)
+{
+    AssimpMeshBenchmark* bench = (AssimpMeshBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        Mesh mesh = {};
+        std::vector<u32> submeshMaterialIndices;
+        ProcessAssimpMesh(NULL, &bench->mesh, &mesh, 0, submeshMaterialIndices);
+        MicrobenchmarkSink += mesh.submeshes[0].vertices.size();
+    }
+}
+
+void RunProcessAssimpMeshBenchmarks(MicrobenchmarkSettings& settings)
+{
+    static const u32 sides[] = { 32, 256 };
+    static const char* names[] = { "ProcessAssimpMesh/1k vertices", "ProcessAssimpMesh/64k vertices" };
+    for (u32 i = 0; i < ARRAY_COUNT(sides); ++i)
+    {
+        if (!MicrobenchmarkSelected(settings, names[i]))
+            continue;
+
+        AssimpMeshBenchmark bench;
+        BuildBenchmarkAssimpMesh(bench.mesh, sides[i]);
+        f64 sourceBytes = (f64)bench.mesh.mNumVertices * 5 * sizeof(aiVector3D) + bench.mesh.mNumFaces * 3 * sizeof(u32);
+        Microbenchmark(settings, names[i], ProcessAssimpMeshBody, &bench, sourceBytes);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CompressMeshVertices
+
+struct VertexCompressionBenchmark
+{
+    Mesh source; // Float vertices, copied before every compression (the copy is part of the time)
+};
+
+void CompressMeshVerticesBody(void* data, u64 iterations)
+{
+    VertexCompressionBenchmark* bench = (VertexCompressionBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        Mesh mesh = bench->source;
+        MicrobenchmarkSink += CompressMeshVertices(mesh);
+    }
+}
+
+void RunVertexCompressionBenchmarks(MicrobenchmarkSettings& settings)
+{
+    static const u32 sides[] = { 32, 256 };
+    static const char* names[] = { "CompressMeshVertices/1k vertices", "CompressMeshVertices/64k vertices" };
+    for (u32 i = 0; i < ARRAY_COUNT(sides); ++i)
+    {
+        if (!MicrobenchmarkSelected(settings, names[i]))
+            continue;
+
+        AssimpMeshBenchmark assimpMesh;
+        BuildBenchmarkAssimpMesh(assimpMesh.mesh, sides[i]);
+        VertexCompressionBenchmark bench;
+        std::vector<u32> submeshMaterialIndices;
+        ProcessAssimpMesh(NULL, &assimpMesh.mesh, &bench.source, 0, submeshMaterialIndices);
+        Microbenchmark(settings, names[i], CompressMeshVerticesBody, &bench, (f64)bench.source.submeshes[0].vertices.size());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// OptimizeVertexCache
+
+struct VertexCacheBenchmark
+{
+    std::vector<u32> indices;
+    std::vector<u32> optimized;
+    u32              vertexCount;
+};
+
+void OptimizeVertexCacheBody(void* data, u64 iterations)
+{
+    VertexCacheBenchmark* bench = (VertexCacheBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        OptimizeVertexCache(bench->optimized.data(), bench->indices.data(), (u32)bench->indices.size(), bench->vertexCount);
+        MicrobenchmarkSink += bench->optimized[0];
+    }
+}
+
+void RunMeshOptimizationBenchmarks(MicrobenchmarkSettings& settings)
+{
+    static const u32 sides[] = { 32, 256 };
+    static const char* names[] = { "OptimizeVertexCache/1k vertices", "OptimizeVertexCache/64k vertices" };
+    for (u32 i = 0; i < ARRAY_COUNT(sides); ++i)
+    {
+        if (!MicrobenchmarkSelected(settings, names[i]))
+            continue;
+
+        AssimpMeshBenchmark assimpMesh;
+        BuildBenchmarkAssimpMesh(assimpMesh.mesh, sides[i]);
+        Mesh mesh = {};
+        std::vector<u32> submeshMaterialIndices;
+        ProcessAssimpMesh(NULL, &assimpMesh.mesh, &mesh, 0, submeshMaterialIndices);
+
+        VertexCacheBenchmark bench;
+        bench.indices = mesh.submeshes[0].indices;
+        bench.optimized.resize(bench.indices.size());
+        bench.vertexCount = assimpMesh.mesh.mNumVertices;
+        Microbenchmark(settings, names[i], OptimizeVertexCacheBody, &bench, (f64)bench.indices.size() * sizeof(u32));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SimplifyTriangles
+
+struct SimplificationBenchmark
+{
+    Mesh             mesh;
+    std::vector<u32> simplified;
+};
+
+void SimplifyTrianglesBody(void* data, u64 iterations)
+{
+    SimplificationBenchmark* bench = (SimplificationBenchmark*)data;
+    const Submesh& submesh = bench->mesh.submeshes[0];
+    u32 stride = submesh.vertexBufferLayout.stride;
+    u32 indexCount = (u32)submesh.indices.size();
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        f32 error = 0.0f;
+        u32 count = SimplifyTriangles(bench->simplified.data(), submesh.indices.data(), indexCount, submesh.vertices.data(), stride,
+                                      (u32)(submesh.vertices.size() / stride), indexCount / 6 * 3, &error);
+        MicrobenchmarkSink += count;
+    }
+}
+
+void RunMeshSimplificationBenchmarks(MicrobenchmarkSettings& settings)
+{
+    static const u32 sides[] = { 32, 256 };
+    static const char* names[] = { "SimplifyTriangles/1k vertices", "SimplifyTriangles/64k vertices" };
+    for (u32 i = 0; i < ARRAY_COUNT(sides); ++i)
+    {
+        if (!MicrobenchmarkSelected(settings, names[i]))
+            continue;
+
+        AssimpMeshBenchmark assimpMesh;
+        BuildBenchmarkAssimpMesh(assimpMesh.mesh, sides[i]);
+        SimplificationBenchmark bench;
+        std::vector<u32> submeshMaterialIndices;
+        ProcessAssimpMesh(NULL, &assimpMesh.mesh, &bench.mesh, 0, submeshMaterialIndices);
+        bench.simplified.resize(bench.mesh.submeshes[0].indices.size());
+        Microbenchmark(settings, names[i], SimplifyTrianglesBody, &bench, (f64)bench.simplified.size() * sizeof(u32));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ProcessAssimpScene
+
+#define SCENE_BENCHMARK_MESH_COUNT 1024
+
+struct AssimpSceneBenchmark
+{
+    aiMesh  mesh;
+    aiScene scene;
+    App*    app;
+};
+
+void ProcessAssimpSceneBody(void* data, u64 iterations)
+{
+    AssimpSceneBenchmark* bench = (AssimpSceneBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        Mesh mesh = {};
+        std::vector<u32> submeshMaterialIndices;
+        ProcessAssimpScene(bench->app, &bench->scene, "benchmark.obj", &mesh, submeshMaterialIndices);
+        MicrobenchmarkSink += mesh.submeshes.size();
+    }
+}
+
+// Many small meshes, as in the big scenes, imported with and without the worker threads
+void RunProcessAssimpSceneBenchmarks(MicrobenchmarkSettings& settings)
+{
+    static const char* names[] = { "ProcessAssimpScene/1024 meshes", "ProcessAssimpScene/1024 meshes, job system" };
+    if (!MicrobenchmarkSelected(settings, names[0]) && !MicrobenchmarkSelected(settings, names[1]))
+        return;
+
+    AssimpSceneBenchmark bench;
+    BuildBenchmarkAssimpMesh(bench.mesh, 32);
+    bench.app = new App();
+
+    // Every node mesh is the same aiMesh, the scene does not own them
+    bench.scene.mRootNode = new aiNode();
+    bench.scene.mNumMeshes = SCENE_BENCHMARK_MESH_COUNT;
+    bench.scene.mMeshes = new aiMesh*[SCENE_BENCHMARK_MESH_COUNT];
+    bench.scene.mRootNode->mNumMeshes = SCENE_BENCHMARK_MESH_COUNT;
+    bench.scene.mRootNode->mMeshes = new unsigned int[SCENE_BENCHMARK_MESH_COUNT];
+    for (u32 i = 0; i < SCENE_BENCHMARK_MESH_COUNT; ++i)
+    {
+        bench.scene.mMeshes[i] = &bench.mesh;
+        bench.scene.mRootNode->mMeshes[i] = i;
+    }
+
+    f64 sourceBytes = SCENE_BENCHMARK_MESH_COUNT * ((f64)bench.mesh.mNumVertices * 5 * sizeof(aiVector3D) + bench.mesh.mNumFaces * 3 * sizeof(u32));
+    if (MicrobenchmarkSelected(settings, names[0]))
+        Microbenchmark(settings, names[0], ProcessAssimpSceneBody, &bench, sourceBytes);
+    if (MicrobenchmarkSelected(settings, names[1]))
+    {
+        InitJobSystem();
+        Microbenchmark(settings, names[1], ProcessAssimpSceneBody, &bench, sourceBytes);
+        ShutdownJobSystem();
+    }
+
+    delete[] bench.scene.mMeshes;
+    bench.scene.mMeshes = NULL;
+    bench.scene.mNumMeshes = 0;
+    delete bench.app;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// OBJ import
+
+struct ObjImportBenchmark
+{
+    const char* filepath;
+};
+
+void ImportObjFileBody(void* data, u64 iterations)
+{
+    ObjImportBenchmark* bench = (ObjImportBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        ObjImport import;
+        ImportObjFile(bench->filepath, import);
+        MicrobenchmarkSink += import.submeshes.size();
+    }
+}
+
+// The CPU side of the Assimp path for the same file: import and submesh filling
+void ImportAssimpObjBody(void* data, u64 iterations)
+{
+    ObjImportBenchmark* bench = (ObjImportBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        const aiScene* scene = ImportAssimpScene(bench->filepath);
+        if (!scene)
+            continue;
+
+        std::vector<const aiMesh*> meshes;
+        CollectAssimpMeshes(scene, scene->mRootNode, meshes);
+        std::vector<Submesh> submeshes(meshes.size());
+        for (u32 m = 0; m < meshes.size(); ++m)
+            FillAssimpSubmesh(meshes[m], submeshes[m]);
+        aiReleaseImport(scene);
+        MicrobenchmarkSink += submeshes.size();
+    }
+}
+
+void RunObjImportBenchmarks(MicrobenchmarkSettings& settings)
+{
+    static const char* files[] =
+    {
+        "Primitives/Sphere.obj",
+        "Patrick/Patrick.obj",
+        "Lake/CastleLake.obj",
+    };
+
+    for (const char* filepath : files)
+    {
+        std::string nativeName = std::string("ImportObjFile/") + filepath;
+        std::string assimpName = std::string("ImportAssimpScene/") + filepath;
+        std::string nativeJobsName = nativeName + ", job system";
+        bool native = MicrobenchmarkSelected(settings, nativeName.c_str());
+        bool nativeJobs = MicrobenchmarkSelected(settings, nativeJobsName.c_str());
+        bool assimp = MicrobenchmarkSelected(settings, assimpName.c_str());
+        if (!native && !nativeJobs && !assimp)
+            continue;
+
+        FileView view = MapFile(filepath);
+        if (!view.data)
+        {
+            ELOG("Microbenchmark: could not read %s (run it from the WorkingDir)", filepath);
+            continue;
+        }
+        f64 fileSize = (f64)view.size;
+        UnmapFile(view);
+
+        ObjImportBenchmark bench = { filepath };
+        if (assimp)
+            Microbenchmark(settings, assimpName.c_str(), ImportAssimpObjBody, &bench, fileSize);
+        if (native)
+            Microbenchmark(settings, nativeName.c_str(), ImportObjFileBody, &bench, fileSize);
+        if (nativeJobs)
+        {
+            InitJobSystem();
+            Microbenchmark(settings, nativeJobsName.c_str(), ImportObjFileBody, &bench, fileSize);
+            ShutdownJobSystem();
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// TransformConstructor
+
+#define TRANSFORM_BENCHMARK_COUNT 1024
+
+struct TransformBenchmark
+{
+    Transform transforms[TRANSFORM_BENCHMARK_COUNT];
+    glm::mat4 worldMatrix;
+};
+
+void TransformConstructorBody(void* data, u64 iterations)
+{
+    TransformBenchmark* bench = (TransformBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+        bench->worldMatrix = TransformConstructor(bench->transforms[i % TRANSFORM_BENCHMARK_COUNT]);
+    MicrobenchmarkSink += (u64)bench->worldMatrix[3][0];
+}
+
+void RunTransformBenchmarks(MicrobenchmarkSettings& settings)
+{
+    const char* name = "TransformConstructor";
+    if (!MicrobenchmarkSelected(settings, name))
+        return;
+
+    TransformBenchmark* bench = new TransformBenchmark();
+    for (u32 i = 0; i < TRANSFORM_BENCHMARK_COUNT; ++i)
+    {
+        f32 t = (f32)i;
+        bench->transforms[i] = Transform(vec3(fmodf(t, 100.0f), fmodf(t * 0.37f, 50.0f), fmodf(t * 0.11f, 100.0f)),
+                                         vec3(fmodf(t * 7.0f, 360.0f), fmodf(t * 3.0f, 360.0f), 0.0f),
+                                         vec3(1.0f + fmodf(t, 3.0f)));
+    }
+    Microbenchmark(settings, name, TransformConstructorBody, bench);
+    delete bench;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// std140 packing (buffer_management.h), on a CPU side buffer instead of a mapped one
+
+#define PACKING_BENCHMARK_BLOCKS 1024
+
+struct PackingBenchmark
+{
+    Buffer           buffer;
+    std::vector<u8>  storage;
+    glm::mat4        world;
+    glm::mat4        worldViewProjection;
+    Light            light;
+};
+
+// One entity block as UniformBufferAlignment used to push it, aligned to the usual 256 bytes
+void PushMat4Body(void* data, u64 iterations)
+{
+    PackingBenchmark* bench = (PackingBenchmark*)data;
+    Buffer& buffer = bench->buffer;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        if (i % PACKING_BENCHMARK_BLOCKS == 0)
+            buffer.head = 0;
+        AlignHead(buffer, 256);
+        PushMat4(buffer, bench->world);
+        PushMat4(buffer, bench->worldViewProjection);
+    }
+    MicrobenchmarkSink += buffer.head;
+}
+
+// One light as UploadLights pushes it into the light storage buffer
+void PushLightBody(void* data, u64 iterations)
+{
+    PackingBenchmark* bench = (PackingBenchmark*)data;
+    Buffer& buffer = bench->buffer;
+    const Light& light = bench->light;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        if (i % PACKING_BENCHMARK_BLOCKS == 0)
+            buffer.head = 0;
+        AlignHead(buffer, sizeof(vec4));
+        PushUInt(buffer,  light.type);
+        PushVec3(buffer,  light.color);
+        PushVec3(buffer,  light.direction);
+        PushVec3(buffer,  light.position);
+        PushFloat(buffer, light.radius);
+        PushFloat(buffer, light.intensity);
+    }
+    MicrobenchmarkSink += buffer.head;
+}
+
+void RunPackingBenchmarks(MicrobenchmarkSettings& settings)
+{
+    PackingBenchmark bench;
+    bench.storage.resize(PACKING_BENCHMARK_BLOCKS * 256);
+    bench.buffer = {};
+    bench.buffer.size = (u32)bench.storage.size();
+    bench.buffer.data = bench.storage.data();
+    bench.world = TransformConstructor(Transform(vec3(1.0f, 2.0f, 3.0f), vec3(10.0f, 20.0f, 30.0f), vec3(2.0f)));
+    bench.worldViewProjection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f) * bench.world;
+    bench.light = InstanceLight(POINT_LIGHT, "Benchmark Light");
+
+    if (MicrobenchmarkSelected(settings, "PushMat4/entity block"))
+        Microbenchmark(settings, "PushMat4/entity block", PushMat4Body, &bench, 2 * sizeof(glm::mat4));
+    if (MicrobenchmarkSelected(settings, "PushAlignedData/light"))
+        Microbenchmark(settings, "PushAlignedData/light", PushLightBody, &bench);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scene lookups: LoadTexture2D path search, FindVAO and GetNewEntityName
+
+struct LookupBenchmark
+{
+    App*                      app;
+    std::vector<std::string>  paths; // Kept as std::string so each lookup only costs the search
+    Mesh                      mesh;
+    Program                   program;
+    std::string               entityName;
+};
+
+void LoadTexture2DBody(void* data, u64 iterations)
+{
+    LookupBenchmark* bench = (LookupBenchmark*)data;
+    u32 pathCount = (u32)bench->paths.size();
+    for (u64 i = 0; i < iterations; ++i)
+        MicrobenchmarkSink += LoadTexture2D(bench->app, bench->paths[i % pathCount].c_str());
+}
+
+void FindVAOBody(void* data, u64 iterations)
+{
+    LookupBenchmark* bench = (LookupBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+        MicrobenchmarkSink += FindVAO(bench->mesh, 0, bench->program);
+}
+
+void GetNewEntityNameBody(void* data, u64 iterations)
+{
+    LookupBenchmark* bench = (LookupBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+        MicrobenchmarkSink += GetNewEntityName(bench->app, bench->entityName).size();
+}
+
+void RunLookupBenchmarks(MicrobenchmarkSettings& settings)
+{
+    // Every lookup hits, so LoadTexture2D returns before loading anything and FindVAO before
+    // creating a vertex array: none of them reaches GL
+    static const u32 textureCounts[] = { 16, 256, 4096 };
+    static const char* textureNames[] = { "LoadTexture2D/lookup 16 textures", "LoadTexture2D/lookup 256 textures",
+                                          "LoadTexture2D/lookup 4096 textures" };
+    for (u32 t = 0; t < ARRAY_COUNT(textureCounts); ++t)
+    {
+        if (!MicrobenchmarkSelected(settings, textureNames[t]))
+            continue;
+
+        // The texture paths live in the level arena, which is rolled back with the app
+        TempArenaScope levelScope(&GlobalLevelArena);
+        App* app = new App();
+        LookupBenchmark bench;
+        bench.app = app;
+        for (u32 i = 0; i < textureCounts[t]; ++i)
+        {
+            char path[64];
+            snprintf(path, sizeof(path), "Lake/textures/texture_%04u.png", i);
+            Texture texture = {};
+            texture.handle = i + 1;
+            texture.filepath = MakeString(path, &GlobalLevelArena).str;
+            AddTexture(app, texture);
+            bench.paths.push_back(path);
+        }
+        Microbenchmark(settings, textureNames[t], LoadTexture2DBody, &bench);
+        delete app;
+    }
+
+    static const u32 vaoCounts[] = { 1, 8 };
+    static const char* vaoNames[] = { "FindVAO/1 program", "FindVAO/8 programs" };
+    for (u32 v = 0; v < ARRAY_COUNT(vaoCounts); ++v)
+    {
+        if (!MicrobenchmarkSelected(settings, vaoNames[v]))
+            continue;
+
+        // The searched program is the last one, the worst case of the linear search
+        LookupBenchmark bench;
+        bench.mesh.submeshes.push_back(Submesh{});
+        for (u32 i = 0; i < vaoCounts[v]; ++i)
+            bench.mesh.submeshes[0].vaos.push_back(Vao{ i + 1, 100 + i });
+        bench.program = {};
+        bench.program.handle = 100 + vaoCounts[v] - 1;
+        Microbenchmark(settings, vaoNames[v], FindVAOBody, &bench);
+    }
+
+    static const u32 entityCounts[] = { 100, 10000 };
+    static const char* entityNames[] = { "GetNewEntityName/100 entities", "GetNewEntityName/10k entities" };
+    for (u32 e = 0; e < ARRAY_COUNT(entityCounts); ++e)
+    {
+        if (!MicrobenchmarkSelected(settings, entityNames[e]))
+            continue;
+
+        App* app = new App();
+        LookupBenchmark bench;
+        bench.app = app;
+        bench.entityName = "Sphere";
+        static const char* primitives[] = { "Cube", "Sphere", "Plane", "Torus" };
+        for (u32 i = 0; i < entityCounts[e]; ++i)
+        {
+            Entity entity;
+            entity.name = std::string(primitives[i % ARRAY_COUNT(primitives)]) + " " + std::to_string(i);
+            app->entities.push_back(entity);
+        }
+        Microbenchmark(settings, entityNames[e], GetNewEntityNameBody, &bench);
+        delete app;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Image decode
+
+struct DecodeBenchmark
+{
+    std::vector<u8> file;
+};
+
+void StbDecodeBody(void* data, u64 iterations)
+{
+    DecodeBenchmark* bench = (DecodeBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        // Same settings as PrepareTextureMips
+        Image image;
+        if (DecodeImage(bench->file.data(), bench->file.size(), true, image))
+        {
+            MicrobenchmarkSink += ((u8*)image.pixels)[0];
+            FreeImage(image);
+        }
+    }
+}
+
+struct ExpandBenchmark
+{
+    std::vector<u8> src;
+    std::vector<u8> dst;
+    u32             count;
+    u32             channelCount;
+};
+
+void ExpandToRgba8Body(void* data, u64 iterations)
+{
+    ExpandBenchmark* bench = (ExpandBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        ExpandToRgba8(bench->src.data(), bench->count, bench->channelCount, bench->dst.data());
+        MicrobenchmarkSink += bench->dst[0];
+    }
+}
+
+bool ReadBinaryFile(const char* filepath, std::vector<u8>& contents)
+{
+    FILE* file = fopen(filepath, "rb");
+    if (!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    contents.resize(size > 0 ? size : 0);
+    bool ok = size > 0 && fread(contents.data(), 1, contents.size(), file) == contents.size();
+    fclose(file);
+    return ok;
+}
+
+void RunDecodeBenchmarks(MicrobenchmarkSettings& settings)
+{
+    static const char* files[] =
+    {
+        "color_white.png",
+        "dice.png",
+        "Water/dudvmap.png",
+        "Patrick/Skin_Patrick.png",
+        "Lake/textures/texture_sand.jpeg",
+        "Lake/textures/texture_building.jpeg",
+        "Skybox/front.jpg",
+    };
+
+    for (const char* filepath : files)
+    {
+        std::string name = std::string("stbi_load/") + filepath;
+        if (!MicrobenchmarkSelected(settings, name.c_str()))
+            continue;
+
+        DecodeBenchmark bench;
+        if (!ReadBinaryFile(filepath, bench.file))
+        {
+            ELOG("Microbenchmark: could not read %s (run it from the WorkingDir)", filepath);
+            continue;
+        }
+
+        Microbenchmark(settings, name.c_str(), StbDecodeBody, &bench, (f64)bench.file.size());
+    }
+
+    // Level 0 of the images without alpha, a 2048 texel row at a time
+    static const u32 channelCounts[] = { 1, 3 };
+    static const char* expandNames[] = { "ExpandToRgba8/grey 2048", "ExpandToRgba8/rgb 2048" };
+    for (u32 i = 0; i < ARRAY_COUNT(channelCounts); ++i)
+    {
+        if (!MicrobenchmarkSelected(settings, expandNames[i]))
+            continue;
+
+        ExpandBenchmark bench;
+        bench.count = 2048;
+        bench.channelCount = channelCounts[i];
+        bench.src.resize((u64)bench.count * bench.channelCount);
+        for (u64 j = 0; j < bench.src.size(); ++j)
+            bench.src[j] = (u8)(j * 2654435761u >> 24);
+        bench.dst.resize((u64)bench.count * 4);
+        Microbenchmark(settings, expandNames[i], ExpandToRgba8Body, &bench, (f64)bench.dst.size());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// DownsampleRgba8
+
+struct DownsampleBenchmark
+{
+    std::vector<u8> src;
+    std::vector<u8> dst;
+    u32             size;
+};
+
+void DownsampleRgba8Body(void* data, u64 iterations)
+{
+    DownsampleBenchmark* bench = (DownsampleBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        DownsampleRgba8(bench->src.data(), bench->size, bench->size, bench->dst.data());
+        MicrobenchmarkSink += bench->dst[0];
+    }
+}
+
+void RunDownsampleBenchmarks(MicrobenchmarkSettings& settings)
+{
+    static const u32 sizes[] = { 256, 2048 };
+    static const char* names[] = { "DownsampleRgba8/256x256", "DownsampleRgba8/2048x2048" };
+    for (u32 i = 0; i < ARRAY_COUNT(sizes); ++i)
+    {
+        if (!MicrobenchmarkSelected(settings, names[i]))
+            continue;
+
+        DownsampleBenchmark bench;
+        bench.size = sizes[i];
+        bench.src.resize((u64)sizes[i] * sizes[i] * 4);
+        for (u64 j = 0; j < bench.src.size(); ++j)
+            bench.src[j] = (u8)(j * 2654435761u >> 24);
+        bench.dst.resize(bench.src.size() / 4);
+        Microbenchmark(settings, names[i], DownsampleRgba8Body, &bench, (f64)bench.src.size());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CompressTextureLevel
+
+#define COMPRESSION_BENCHMARK_SIZE 256
+
+struct CompressionBenchmark
+{
+    std::vector<u8> pixels;
+    std::vector<u8> compressed;
+    GLenum          format;
+};
+
+void CompressTextureLevelBody(void* data, u64 iterations)
+{
+    CompressionBenchmark* bench = (CompressionBenchmark*)data;
+    for (u64 i = 0; i < iterations; ++i)
+    {
+        CompressTextureLevel(bench->format, bench->pixels.data(), COMPRESSION_BENCHMARK_SIZE, COMPRESSION_BENCHMARK_SIZE,
+                             bench->compressed.data());
+        MicrobenchmarkSink += bench->compressed[0];
+    }
+}
+
+void RunCompressionBenchmarks(MicrobenchmarkSettings& settings)
+{
+    static const GLenum formats[] =
+    {
+        GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RED_RGTC1,
+        GL_COMPRESSED_RG_RGTC2, GL_COMPRESSED_RGBA_BPTC_UNORM,
+    };
+    for (GLenum format : formats)
+    {
+        std::string name = std::string("CompressTextureLevel/") + GetTextureFormatName(format) + " 256x256";
+        if (!MicrobenchmarkSelected(settings, name.c_str()))
+            continue;
+
+        // Gradients with some noise, closer to real textures than pure noise
+        CompressionBenchmark bench;
+        bench.format = format;
+        bench.pixels.resize(COMPRESSION_BENCHMARK_SIZE * COMPRESSION_BENCHMARK_SIZE * 4);
+        for (u32 y = 0; y < COMPRESSION_BENCHMARK_SIZE; ++y)
+        {
+            for (u32 x = 0; x < COMPRESSION_BENCHMARK_SIZE; ++x)
+            {
+                u8* pixel = &bench.pixels[(y * COMPRESSION_BENCHMARK_SIZE + x) * 4];
+                u32 noise = (x * 73856093u ^ y * 19349663u) >> 27;
+                pixel[0] = (u8)(x + noise);
+                pixel[1] = (u8)(y + noise);
+                pixel[2] = (u8)((x + y) / 2);
+                pixel[3] = (u8)(255 - x / 2 + noise);
+            }
+        }
+        bench.compressed.resize(GetTextureLevelSize(format, COMPRESSION_BENCHMARK_SIZE, COMPRESSION_BENCHMARK_SIZE));
+        Microbenchmark(settings, name.c_str(), CompressTextureLevelBody, &bench, (f64)bench.pixels.size());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int RunMicrobenchmarks(int argc, char** argv)
+{
+    MicrobenchmarkSettings settings;
+    settings.filter = HasArgument(argc, argv, "--microbench-filter") ? GetArgumentValue(argc, argv, "--microbench-filter", "") : NULL;
+    settings.repetitions = MICROBENCHMARK_DEFAULT_REPETITIONS;
+    if (HasArgument(argc, argv, "--microbench-repetitions"))
+        settings.repetitions = std::max(1, atoi(GetArgumentValue(argc, argv, "--microbench-repetitions", "")));
+    f64 minTimeMs = MICROBENCHMARK_DEFAULT_MIN_TIME_MS;
+    if (HasArgument(argc, argv, "--microbench-min-time"))
+        minTimeMs = atof(GetArgumentValue(argc, argv, "--microbench-min-time", ""));
+    settings.minTimeNs = (u64)(minTimeMs * 1000000.0);
+
+    printf("Microbenchmarks: %u repetitions of at least %.1f ms, times per operation%s\n", settings.repetitions,
+           settings.minTimeNs / 1000000.0, COUNTS_ALLOCATIONS ? "" : " (build the Microbenchmark project to count allocations)");
+    printf("%-48s %12s %12s %8s %12s %12s %10s\n", "benchmark", "median (ns)", "min (ns)", "stddev", "iterations", "B/op", "allocs/op");
+
+    // Zones of the measured functions are recorded as in the editor, but without filling the history
+    ProfilerSetPaused(true);
+
+    RunProcessAssimpMeshBenchmarks(settings);
+    RunVertexCompressionBenchmarks(settings);
+    RunMeshOptimizationBenchmarks(settings);
+    RunMeshSimplificationBenchmarks(settings);
+    RunProcessAssimpSceneBenchmarks(settings);
+    RunObjImportBenchmarks(settings);
+    RunTransformBenchmarks(settings);
+    RunPackingBenchmarks(settings);
+    RunLookupBenchmarks(settings);
+    RunDecodeBenchmarks(settings);
+    RunDownsampleBenchmarks(settings);
+    RunCompressionBenchmarks(settings);
+
+    ProfilerSetPaused(false);
+
+    if (settings.results.empty())
+    {
+        ELOG("No microbenchmark matches the filter %s", settings.filter ? settings.filter : "");
+        return 1;
+    }
+    return 0;
+}
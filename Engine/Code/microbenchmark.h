@@ -0,0 +1,32 @@
+//
+// microbenchmark.h : Microbenchmarks of the engine CPU hot paths. They run without a window or
+// GL context, so every optimization to one of these paths can be measured on its own:
+//
+//   --microbench [--microbench-filter text] [--microbench-repetitions N] [--microbench-min-time ms]
+//
+// The Microbenchmark project (MICROBENCHMARK_BUILD) runs them by default and also counts the
+// bytes and allocations done through operator new. Memory allocated with malloc (stb_image)
+// is not counted.
+//
+
+#pragma once
+
+#include "engine.h"
+
+struct MicrobenchmarkResult
+{
+    std::string name;
+    u64         iterations;     // Iterations of each repetition
+    f64         medianNs;       // Per operation
+    f64         minNs;
+    f64         stddevNs;
+    f64         bytesPerOp;     // Negative if allocations are not counted in this build
+    f64         allocsPerOp;
+    f64         processedBytes; // Input bytes handled per operation, 0 if not meaningful
+};
+
+/**
+ * Reads the --microbench-* options, runs the benchmarks whose name contains the filter and
+ * prints one line per benchmark. Returns the process exit code.
+ */
+int RunMicrobenchmarks(int argc, char** argv);
@@ -0,0 +1,1027 @@
+//
+// obj_loader.cpp : Implementation of the OBJ/MTL importer declared in obj_loader.h.
+//
+// The file is split in chunks at line boundaries and parsed in two parallel passes. The first one
+// only counts the vertex attributes of every chunk, which gives each chunk the base index of its
+// attributes; the second one parses them straight into their final arrays and resolves the face
+// indices (including the relative ones) without any fix-up. The triangles keep the position,
+// texture coordinate and normal indices of their corners, and each submesh turns its corners into
+// vertices on its own job.
+//
+
+#include "obj_loader.h"
+#include "profiler.h"
+#include "job_system.h"
+#include "texture_streaming.h"
+#include <string.h>
+
+#define OBJ_MAX_CHUNKS_PER_THREAD 4
+
+// Indices of a face corner in the attribute arrays, -1 when the corner does not have the attribute
+struct ObjCorner
+{
+    i32 position;
+    i32 texCoord;
+    i32 normal;
+};
+
+// The triangles from firstTriangle to the start of the next run use the same material
+struct ObjMaterialRun
+{
+    u32 material; // Index in the materialNames of the chunk
+    u32 firstTriangle;
+};
+
+struct ObjChunk
+{
+    const char*                 begin;
+    const char*                 end;
+
+    // Counting pass
+    u32                         positionCount;
+    u32                         texCoordCount;
+    u32                         normalCount;
+    bool                        changesMaterial;
+    std::string                 lastMaterial;      // Name in the last usemtl of the chunk
+    std::vector<std::string>    materialLibraries;
+
+    // Parsing pass
+    u32                         firstPosition;
+    u32                         firstTexCoord;
+    u32                         firstNormal;
+    std::string                 initialMaterial;   // The one in use where the chunk starts
+    std::vector<std::string>    materialNames;
+    std::vector<u32>            materialIndices;   // Index of every name in the materials of the model
+    std::vector<ObjMaterialRun> runs;
+    std::vector<ObjCorner>      corners;           // Three per triangle
+    const char*                 errorLine;
+};
+
+struct ObjMaterial
+{
+    Material    material;
+    std::string texturePaths[OBJ_TEXTURE_SLOT_COUNT];
+};
+
+struct ObjModel
+{
+    std::vector<ObjChunk>    chunks;
+    std::vector<vec3>        positions;
+    std::vector<vec2>        texCoords;
+    std::vector<vec3>        normals;
+    std::vector<ObjMaterial> materials;
+};
+
+static u32 Material::* const ObjTextureSlots[OBJ_TEXTURE_SLOT_COUNT] =
+{
+    &Material::albedoTextureIdx,
+    &Material::emissiveTextureIdx,
+    &Material::specularTextureIdx,
+    &Material::normalsTextureIdx,
+    &Material::bumpTextureIdx,
+};
+
+static const TextureUsage ObjTextureUsages[OBJ_TEXTURE_SLOT_COUNT] =
+{
+    TEXTURE_USAGE_COLOR,
+    TEXTURE_USAGE_COLOR,
+    TEXTURE_USAGE_MASK,
+    TEXTURE_USAGE_VECTOR,
+    TEXTURE_USAGE_MASK,
+};
+
+struct ObjTextureKeyword
+{
+    const char* keyword;
+    u32         slot;
+};
+
+// Same texture types Assimp reads from the MTL statements
+static const ObjTextureKeyword ObjTextureKeywords[] =
+{
+    { "map_Kd",   0 },
+    { "map_Ke",   1 },
+    { "map_Ks",   2 },
+    { "map_Kn",   3 },
+    { "norm",     3 },
+    { "map_bump", 4 },
+    { "map_Bump", 4 },
+    { "bump",     4 },
+};
+
+bool IsObjFile(const char* filepath)
+{
+    size_t len = strlen(filepath);
+    if (len < 4)
+        return false;
+    const char* extension = filepath + len - 4;
+    return extension[0] == '.' && (extension[1] | 0x20) == 'o' && (extension[2] | 0x20) == 'b' && (extension[3] | 0x20) == 'j';
+}
+
+///////////////////////////////////////////////////////////////////////
+// Tokenizing
+
+inline bool IsObjSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool IsObjDigit(char c)
+{
+    return (u32)(c - '0') < 10u;
+}
+
+inline const char* SkipObjSpaces(const char* p, const char* end)
+{
+    while (p < end && IsObjSpace(*p))
+        ++p;
+    return p;
+}
+
+inline const char* FindObjLineEnd(const char* p, const char* end)
+{
+    // memchr is vectorized by the C runtime, this is where most of the bytes are scanned
+    const char* newline = (const char*)memchr(p, '\n', end - p);
+    return newline ? newline : end;
+}
+
+// Returns the text after the keyword if the line starts with it, NULL otherwise
+inline const char* MatchObjKeyword(const char* p, const char* lineEnd, const char* keyword)
+{
+    while (*keyword)
+    {
+        if (p == lineEnd || *p != *keyword)
+            return NULL;
+        ++p, ++keyword;
+    }
+    return (p == lineEnd || IsObjSpace(*p)) ? p : NULL;
+}
+
+// Rest of the line without the surrounding spaces, so names and paths can contain spaces
+inline std::string GetObjLineRest(const char* p, const char* lineEnd)
+{
+    p = SkipObjSpaces(p, lineEnd);
+    while (lineEnd > p && IsObjSpace(lineEnd[-1]))
+        --lineEnd;
+    return std::string(p, lineEnd - p);
+}
+
+// Eight ASCII digits at once in a 64-bit register (SWAR), the way fast_float does it
+inline bool AreEightObjDigits(u64 chars)
+{
+    return (((chars & 0xF0F0F0F0F0F0F0F0ull) | (((chars + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull);
+}
+
+inline u32 ParseEightObjDigits(u64 chars)
+{
+    const u64 mask = 0x000000FF000000FFull;
+    const u64 mul1 = 0x000F424000000064ull; // 100 + (1000000 << 32)
+    const u64 mul2 = 0x0000271000000001ull; // 1 + (10000 << 32)
+    chars -= 0x3030303030303030ull;
+    chars = (chars * 10) + (chars >> 8);
+    chars = (((chars & mask) * mul1) + (((chars >> 16) & mask) * mul2)) >> 32;
+    return (u32)chars;
+}
+
+static const f64 ObjPowersOfTen[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Accumulates decimal digits into the mantissa, 8 at a time when possible. Only the first 19
+// significant digits fit in the mantissa, the dropped ones adjust the exponent.
+inline const char* ParseObjDigits(const char* p, const char* end, u64& mantissa, u32& significantDigits, i32& droppedDigits)
+{
+    while (end - p >= 8 && significantDigits + 8 <= 19)
+    {
+        u64 chars;
+        memcpy(&chars, p, 8);
+        if (!AreEightObjDigits(chars))
+            break;
+        mantissa = mantissa * 100000000ull + ParseEightObjDigits(chars);
+        significantDigits = mantissa ? significantDigits + 8 : 0;
+        p += 8;
+    }
+    while (p < end && IsObjDigit(*p))
+    {
+        if (significantDigits < 19)
+        {
+            mantissa = mantissa * 10 + (u64)(*p - '0');
+            if (mantissa)
+                significantDigits++; // Leading zeros don't count
+        }
+        else
+        {
+            droppedDigits++;
+        }
+        ++p;
+    }
+    return p;
+}
+
+// Parses [sign] digits [. digits] [e [sign] digits]. Returns NULL if there is no number.
+const char* ParseObjFloat(const char* p, const char* end, f32* value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    const char* digitsBegin = p;
+    u64 mantissa = 0;
+    u32 significantDigits = 0;
+    i32 droppedDigits = 0;
+    p = ParseObjDigits(p, end, mantissa, significantDigits, droppedDigits);
+    i32 exponent = droppedDigits;
+
+    if (p < end && *p == '.')
+    {
+        ++p;
+        const char* fractionBegin = p;
+        i32 droppedFractionDigits = 0;
+        p = ParseObjDigits(p, end, mantissa, significantDigits, droppedFractionDigits);
+        exponent -= (i32)(p - fractionBegin) - droppedFractionDigits;
+    }
+    if (p == digitsBegin || (p == digitsBegin + 1 && *digitsBegin == '.'))
+        return NULL;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* exponentBegin = p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negativeExponent = *p++ == '-';
+        if (p < end && IsObjDigit(*p))
+        {
+            i32 explicitExponent = 0;
+            while (p < end && IsObjDigit(*p))
+            {
+                if (explicitExponent < 10000)
+                    explicitExponent = explicitExponent * 10 + (*p - '0');
+                ++p;
+            }
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+        }
+        else
+        {
+            p = exponentBegin; // Not an exponent after all
+        }
+    }
+
+    // Exact for the usual mantissas and exponents, within an ulp of the double otherwise,
+    // which is below the precision of the float
+    f64 result = (f64)mantissa;
+    if (mantissa == 0)
+        result = 0.0;
+    else if (exponent < 0 && exponent >= -22)
+        result /= ObjPowersOfTen[-exponent];
+    else if (exponent > 0 && exponent <= 22)
+        result *= ObjPowersOfTen[exponent];
+    else if (exponent != 0)
+        result *= pow(10.0, (f64)exponent);
+
+    *value = (f32)(negative ? -result : result);
+    return p;
+}
+
+// Parses a face index and turns it into a 0-based index. Relative (negative) indices count back
+// from the elements read so far. Returns NULL if there is no index or it is out of bounds.
+const char* ParseObjIndex(const char* p, const char* end, u32 readCount, u32 totalCount, i32* index)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    const char* digitsBegin = p;
+    i64 value = 0;
+    while (p < end && IsObjDigit(*p))
+    {
+        if (value <= UINT32_MAX)
+            value = value * 10 + (*p - '0');
+        ++p;
+    }
+    if (p == digitsBegin || value == 0)
+        return NULL;
+
+    i64 resolved = negative ? (i64)readCount - value : value - 1;
+    if (resolved < 0 || resolved >= (i64)totalCount)
+        return NULL;
+    *index = (i32)resolved;
+    return p;
+}
+
+const char* ParseObjFloats(const char* p, const char* end, f32* values, u32 count, u32 requiredCount)
+{
+    for (u32 i = 0; i < count; ++i)
+    {
+        p = SkipObjSpaces(p, end);
+        const char* next = ParseObjFloat(p, end, &values[i]);
+        if (!next)
+        {
+            if (i < requiredCount)
+                return NULL;
+            values[i] = 0.0f;
+            continue;
+        }
+        p = next;
+    }
+    return p;
+}
+
+// Colors with a single value are grays
+const char* ParseObjColor(const char* p, const char* end, f32* rgb)
+{
+    p = ParseObjFloats(p, end, rgb, 1, 1);
+    if (!p)
+        return NULL;
+    const char* next = ParseObjFloats(p, end, rgb + 1, 2, 2);
+    if (!next)
+    {
+        rgb[1] = rgb[2] = rgb[0];
+        return p;
+    }
+    return next;
+}
+
+///////////////////////////////////////////////////////////////////////
+// OBJ parsing
+
+void CountObjChunkRange(void* data, u32 begin, u32 end)
+{
+    ObjModel* model = (ObjModel*)data;
+    for (u32 chunkIdx = begin; chunkIdx < end; ++chunkIdx)
+    {
+        ObjChunk& chunk = model->chunks[chunkIdx];
+        for (const char* line = chunk.begin; line < chunk.end;)
+        {
+            const char* lineEnd = FindObjLineEnd(line, chunk.end);
+            const char* p = SkipObjSpaces(line, lineEnd);
+            line = lineEnd + 1;
+
+            if (lineEnd - p < 2)
+                continue;
+            if (p[0] == 'v')
+            {
+                if (IsObjSpace(p[1]))
+                    chunk.positionCount++;
+                else if (p[1] == 't' && MatchObjKeyword(p, lineEnd, "vt"))
+                    chunk.texCoordCount++;
+                else if (p[1] == 'n' && MatchObjKeyword(p, lineEnd, "vn"))
+                    chunk.normalCount++;
+            }
+            else if (const char* rest = MatchObjKeyword(p, lineEnd, "usemtl"))
+            {
+                chunk.changesMaterial = true;
+                chunk.lastMaterial = GetObjLineRest(rest, lineEnd);
+            }
+            else if (const char* rest = MatchObjKeyword(p, lineEnd, "mtllib"))
+            {
+                chunk.materialLibraries.push_back(GetObjLineRest(rest, lineEnd));
+            }
+        }
+    }
+}
+
+void UseObjMaterial(ObjChunk& chunk, const std::string& name)
+{
+    u32 material = 0;
+    while (material < chunk.materialNames.size() && chunk.materialNames[material] != name)
+        ++material;
+    if (material == chunk.materialNames.size())
+        chunk.materialNames.push_back(name);
+
+    u32 triangleCount = (u32)(chunk.corners.size() / 3);
+    if (!chunk.runs.empty() && chunk.runs.back().firstTriangle == triangleCount)
+        chunk.runs.back().material = material; // No triangles used the previous one
+    else
+        chunk.runs.push_back(ObjMaterialRun{ material, triangleCount });
+}
+
+// Parses the corners of a face and appends it as a fan of triangles
+bool ParseObjFace(ObjModel* model, ObjChunk& chunk, const char* p, const char* lineEnd, u32 positionsRead, u32 texCoordsRead, u32 normalsRead)
+{
+    ObjCorner first = {};
+    ObjCorner previous = {};
+    u32 cornerCount = 0;
+
+    for (;;)
+    {
+        p = SkipObjSpaces(p, lineEnd);
+        if (p >= lineEnd)
+            break;
+
+        ObjCorner corner = { -1, -1, -1 };
+        p = ParseObjIndex(p, lineEnd, positionsRead, (u32)model->positions.size(), &corner.position);
+        if (!p)
+            return false;
+        if (p < lineEnd && *p == '/')
+        {
+            ++p;
+            if (p < lineEnd && *p != '/')
+            {
+                p = ParseObjIndex(p, lineEnd, texCoordsRead, (u32)model->texCoords.size(), &corner.texCoord);
+                if (!p)
+                    return false;
+            }
+            if (p < lineEnd && *p == '/')
+            {
+                p = ParseObjIndex(p + 1, lineEnd, normalsRead, (u32)model->normals.size(), &corner.normal);
+                if (!p)
+                    return false;
+            }
+        }
+        if (p < lineEnd && !IsObjSpace(*p))
+            return false;
+
+        if (cornerCount == 0)
+        {
+            first = corner;
+        }
+        else if (cornerCount >= 2)
+        {
+            chunk.corners.push_back(first);
+            chunk.corners.push_back(previous);
+            chunk.corners.push_back(corner);
+        }
+        previous = corner;
+        cornerCount++;
+    }
+
+    // Faces with less than three corners are points and lines, which are not rendered
+    return true;
+}
+
+void ParseObjChunkRange(void* data, u32 begin, u32 end)
+{
+    ObjModel* model = (ObjModel*)data;
+    for (u32 chunkIdx = begin; chunkIdx < end; ++chunkIdx)
+    {
+        ObjChunk& chunk = model->chunks[chunkIdx];
+        chunk.corners.reserve((chunk.end - chunk.begin) / 16);
+        UseObjMaterial(chunk, chunk.initialMaterial);
+
+        u32 positionIdx = chunk.firstPosition;
+        u32 texCoordIdx = chunk.firstTexCoord;
+        u32 normalIdx = chunk.firstNormal;
+
+        for (const char* line = chunk.begin; line < chunk.end;)
+        {
+            const char* lineEnd = FindObjLineEnd(line, chunk.end);
+            const char* p = SkipObjSpaces(line, lineEnd);
+            const char* lineBegin = line;
+            line = lineEnd + 1;
+
+            if (lineEnd - p < 2)
+                continue;
+
+            bool parsed = true;
+            if (p[0] == 'v')
+            {
+                if (IsObjSpace(p[1]))
+                    parsed = ParseObjFloats(p + 1, lineEnd, &model->positions[positionIdx++].x, 3, 3) != NULL;
+                else if (p[1] == 't' && MatchObjKeyword(p, lineEnd, "vt"))
+                    parsed = ParseObjFloats(p + 2, lineEnd, &model->texCoords[texCoordIdx++].x, 2, 1) != NULL;
+                else if (p[1] == 'n' && MatchObjKeyword(p, lineEnd, "vn"))
+                    parsed = ParseObjFloats(p + 2, lineEnd, &model->normals[normalIdx++].x, 3, 3) != NULL;
+            }
+            else if (p[0] == 'f' && IsObjSpace(p[1]))
+            {
+                parsed = ParseObjFace(model, chunk, p + 1, lineEnd, positionIdx, texCoordIdx, normalIdx);
+            }
+            else if (const char* rest = MatchObjKeyword(p, lineEnd, "usemtl"))
+            {
+                UseObjMaterial(chunk, GetObjLineRest(rest, lineEnd));
+            }
+
+            if (!parsed)
+            {
+                chunk.errorLine = lineBegin;
+                break;
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// MTL parsing
+
+ObjMaterial MakeDefaultObjMaterial(const std::string& name)
+{
+    // Same defaults as the Assimp OBJ importer
+    ObjMaterial material = {};
+    material.material.name = name;
+    material.material.albedo = vec3(0.6f);
+    return material;
+}
+
+// Texture statements can start with options (-bm 1.0 map.png), the path is the rest of the line
+std::string GetObjTexturePath(const char* p, const char* lineEnd)
+{
+    for (;;)
+    {
+        p = SkipObjSpaces(p, lineEnd);
+        if (p >= lineEnd || *p != '-')
+            break;
+
+        const char* option = p;
+        while (p < lineEnd && !IsObjSpace(*p))
+            ++p;
+        u32 optionLen = (u32)(p - option);
+
+        // -o, -s and -t take up to three numbers, -mm two, the rest one argument
+        u32 maxArguments = 1;
+        bool numericArguments = false;
+        if (optionLen == 2 && (option[1] == 'o' || option[1] == 's' || option[1] == 't'))
+            maxArguments = 3, numericArguments = true;
+        else if (optionLen == 3 && option[1] == 'm' && option[2] == 'm')
+            maxArguments = 2, numericArguments = true;
+
+        for (u32 i = 0; i < maxArguments; ++i)
+        {
+            const char* argument = SkipObjSpaces(p, lineEnd);
+            f32 unused;
+            if (numericArguments && i > 0 && !ParseObjFloat(argument, lineEnd, &unused))
+                break;
+            p = argument;
+            while (p < lineEnd && !IsObjSpace(*p))
+                ++p;
+        }
+    }
+    return GetObjLineRest(p, lineEnd);
+}
+
+void ParseObjMaterialLibrary(const char* text, const char* end, String directory, std::vector<ObjMaterial>& materials)
+{
+    Arena* scratch = GetThreadArena();
+    ObjMaterial* material = NULL;
+
+    for (const char* line = text; line < end;)
+    {
+        const char* lineEnd = FindObjLineEnd(line, end);
+        const char* p = SkipObjSpaces(line, lineEnd);
+        line = lineEnd + 1;
+
+        if (p == lineEnd || *p == '#')
+            continue;
+
+        if (const char* rest = MatchObjKeyword(p, lineEnd, "newmtl"))
+        {
+            materials.push_back(MakeDefaultObjMaterial(GetObjLineRest(rest, lineEnd)));
+            material = &materials.back();
+            continue;
+        }
+        if (!material)
+            continue;
+
+        f32 values[3];
+        if (const char* rest = MatchObjKeyword(p, lineEnd, "Kd"))
+        {
+            if (ParseObjColor(rest, lineEnd, values))
+                material->material.albedo = vec3(values[0], values[1], values[2]);
+        }
+        else if (const char* rest = MatchObjKeyword(p, lineEnd, "Ke"))
+        {
+            if (ParseObjColor(rest, lineEnd, values))
+                material->material.emissive = vec3(values[0], values[1], values[2]);
+        }
+        else if (const char* rest = MatchObjKeyword(p, lineEnd, "Ns"))
+        {
+            if (ParseObjFloats(rest, lineEnd, values, 1, 1))
+                material->material.smoothness = values[0] / 256.0f;
+        }
+        else
+        {
+            for (const ObjTextureKeyword& texture : ObjTextureKeywords)
+            {
+                if (const char* rest = MatchObjKeyword(p, lineEnd, texture.keyword))
+                {
+                    std::string filename = GetObjTexturePath(rest, lineEnd);
+                    if (!filename.empty())
+                    {
+                        TempArenaScope tempScope(scratch);
+                        String filepath = MakePath(directory, MakeString(filename.c_str(), scratch), scratch);
+                        material->texturePaths[texture.slot] = filepath.str;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Submesh building
+
+inline vec3 OrthogonalObjVector(vec3 normal)
+{
+    vec3 axis = fabsf(normal.x) < 0.9f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+    return glm::normalize(glm::cross(normal, axis));
+}
+
+struct ObjSubmeshJob
+{
+    const ObjModel* model;
+    u32             material;
+    Submesh*        submesh;
+};
+
+template <typename Function>
+void ForEachObjTriangle(const ObjModel& model, u32 material, Function function)
+{
+    for (const ObjChunk& chunk : model.chunks)
+    {
+        u32 chunkTriangles = (u32)(chunk.corners.size() / 3);
+        for (u32 run = 0; run < chunk.runs.size(); ++run)
+        {
+            if (chunk.materialIndices[chunk.runs[run].material] != material)
+                continue;
+            u32 lastTriangle = run + 1 < chunk.runs.size() ? chunk.runs[run + 1].firstTriangle : chunkTriangles;
+            for (u32 triangle = chunk.runs[run].firstTriangle; triangle < lastTriangle; ++triangle)
+                function(&chunk.corners[triangle * 3]);
+        }
+    }
+}
+
+void BuildObjSubmesh(const ObjModel& model, u32 material, Submesh& submesh)
+{
+    PROFILE_FUNCTION();
+
+    u32 triangleCount = 0;
+    bool hasTexCoords = false;
+    bool generateNormals = false;
+    i32 minPosition = INT32_MAX;
+    i32 maxPosition = 0;
+    ForEachObjTriangle(model, material, [&](const ObjCorner* corners)
+    {
+        triangleCount++;
+        for (u32 i = 0; i < 3; ++i)
+        {
+            hasTexCoords |= corners[i].texCoord >= 0;
+            generateNormals |= corners[i].normal < 0;
+            minPosition = std::min(minPosition, corners[i].position);
+            maxPosition = std::max(maxPosition, corners[i].position);
+        }
+    });
+
+    // Corners with the same indices become the same vertex. The hash buckets are the positions
+    // used by the submesh, and each one chains the vertices created for that position. Files
+    // reference positions mostly in order, so the buckets are visited almost sequentially and
+    // the chains are short (one vertex per UV seam or hard edge).
+    u32 positionRange = (u32)(maxPosition - minPosition + 1);
+    std::vector<u32> firstVertex(positionRange, UINT32_MAX);
+    std::vector<u32> nextVertex;
+    nextVertex.reserve(triangleCount * 3 / 2);
+
+    std::vector<ObjCorner> vertexCorners;
+    vertexCorners.reserve(triangleCount * 3 / 2);
+    submesh.indices.resize(triangleCount * 3);
+    u32* indices = submesh.indices.data();
+
+    // Smooth normals for the corners without one: the face normals around each position
+    std::vector<vec3> smoothNormals(generateNormals ? positionRange : 0, vec3(0.0f));
+
+    ForEachObjTriangle(model, material, [&](const ObjCorner* corners)
+    {
+        for (u32 i = 0; i < 3; ++i)
+        {
+            const ObjCorner& corner = corners[i];
+            u32& bucket = firstVertex[corner.position - minPosition];
+            u32 vertex = bucket;
+            while (vertex != UINT32_MAX && (vertexCorners[vertex].texCoord != corner.texCoord || vertexCorners[vertex].normal != corner.normal))
+                vertex = nextVertex[vertex];
+            if (vertex == UINT32_MAX)
+            {
+                vertex = (u32)vertexCorners.size();
+                vertexCorners.push_back(corner);
+                nextVertex.push_back(bucket);
+                bucket = vertex;
+            }
+            *indices++ = vertex;
+        }
+
+        if (generateNormals && (corners[0].normal < 0 || corners[1].normal < 0 || corners[2].normal < 0))
+        {
+            const vec3& p0 = model.positions[corners[0].position];
+            vec3 faceNormal = glm::cross(model.positions[corners[1].position] - p0, model.positions[corners[2].position] - p0);
+            f32 length = glm::length(faceNormal);
+            if (length > 0.0f)
+                faceNormal /= length;
+            for (u32 i = 0; i < 3; ++i)
+                if (corners[i].normal < 0)
+                    smoothNormals[corners[i].position - minPosition] += faceNormal;
+        }
+    });
+
+    u32 vertexCount = (u32)vertexCorners.size();
+    std::vector<vec3> normals(vertexCount);
+    std::vector<vec2> texCoords(hasTexCoords ? vertexCount : 0);
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        const ObjCorner& corner = vertexCorners[i];
+        if (corner.normal >= 0)
+        {
+            normals[i] = model.normals[corner.normal];
+        }
+        else
+        {
+            vec3 normal = smoothNormals[corner.position - minPosition];
+            f32 length = glm::length(normal);
+            normals[i] = length > 0.0f ? normal / length : vec3(0.0f, 1.0f, 0.0f);
+        }
+        if (hasTexCoords)
+            texCoords[i] = corner.texCoord >= 0 ? model.texCoords[corner.texCoord] : vec2(0.0f);
+    }
+
+    // Tangent space, accumulated over the faces around each vertex with the same formula as
+    // Assimp (and then orthogonalized), so normal mapped models look the same with both paths
+    std::vector<vec3> tangents(hasTexCoords ? vertexCount : 0, vec3(0.0f));
+    std::vector<vec3> bitangents(hasTexCoords ? vertexCount : 0, vec3(0.0f));
+    if (hasTexCoords)
+    {
+        const u32* triangle = submesh.indices.data();
+        for (u32 t = 0; t < triangleCount; ++t, triangle += 3)
+        {
+            vec3 p0 = model.positions[vertexCorners[triangle[0]].position];
+            vec3 v = model.positions[vertexCorners[triangle[1]].position] - p0;
+            vec3 w = model.positions[vertexCorners[triangle[2]].position] - p0;
+
+            f32 sx = texCoords[triangle[1]].x - texCoords[triangle[0]].x, sy = texCoords[triangle[1]].y - texCoords[triangle[0]].y;
+            f32 tx = texCoords[triangle[2]].x - texCoords[triangle[0]].x, ty = texCoords[triangle[2]].y - texCoords[triangle[0]].y;
+            f32 dirCorrection = (tx * sy - ty * sx) < 0.0f ? -1.0f : 1.0f;
+            if (sx * ty == sy * tx)
+            {
+                // The corners share texture coordinates, use the default directions
+                sx = 0.0f; sy = 1.0f;
+                tx = 1.0f; ty = 0.0f;
+            }
+
+            vec3 tangent = (w * sy - v * ty) * dirCorrection;
+            vec3 bitangent = (w * sx - v * tx) * dirCorrection;
+            for (u32 i = 0; i < 3; ++i)
+            {
+                tangents[triangle[i]] += tangent;
+                bitangents[triangle[i]] += bitangent;
+            }
+        }
+
+        for (u32 i = 0; i < vertexCount; ++i)
+        {
+            vec3 normal = normals[i];
+            vec3 tangent = tangents[i] - normal * glm::dot(tangents[i], normal);
+            vec3 bitangent = bitangents[i] - normal * glm::dot(bitangents[i], normal);
+            f32 tangentLength = glm::length(tangent);
+            f32 bitangentLength = glm::length(bitangent);
+            tangents[i] = tangentLength > 1e-12f ? tangent / tangentLength : OrthogonalObjVector(normal);
+            bitangents[i] = bitangentLength > 1e-12f ? bitangent / bitangentLength : glm::cross(tangents[i], normal);
+        }
+    }
+
+    // Same vertex format as FillAssimpSubmesh
+    VertexBufferLayout vertexBufferLayout = {};
+    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
+    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) });
+    vertexBufferLayout.stride = 6 * sizeof(float);
+    if (hasTexCoords)
+    {
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, vertexBufferLayout.stride });
+        vertexBufferLayout.stride += 2 * sizeof(float);
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 3, 3, vertexBufferLayout.stride });
+        vertexBufferLayout.stride += 3 * sizeof(float);
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 4, 3, vertexBufferLayout.stride });
+        vertexBufferLayout.stride += 3 * sizeof(float);
+    }
+    submesh.vertexBufferLayout = vertexBufferLayout;
+
+    submesh.vertices.resize((size_t)vertexCount * vertexBufferLayout.stride);
+    float* vertices = (float*)submesh.vertices.data();
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        const vec3& position = model.positions[vertexCorners[i].position];
+        *vertices++ = position.x;
+        *vertices++ = position.y;
+        *vertices++ = position.z;
+        *vertices++ = normals[i].x;
+        *vertices++ = normals[i].y;
+        *vertices++ = normals[i].z;
+
+        if (hasTexCoords)
+        {
+            *vertices++ = texCoords[i].x;
+            *vertices++ = texCoords[i].y;
+            *vertices++ = tangents[i].x;
+            *vertices++ = tangents[i].y;
+            *vertices++ = tangents[i].z;
+
+            // Flipped like the Assimp bitangents in FillAssimpSubmesh
+            *vertices++ = -bitangents[i].x;
+            *vertices++ = -bitangents[i].y;
+            *vertices++ = -bitangents[i].z;
+        }
+    }
+}
+
+void BuildObjSubmeshRange(void* data, u32 begin, u32 end)
+{
+    ObjSubmeshJob* jobs = (ObjSubmeshJob*)data;
+    for (u32 i = begin; i < end; ++i)
+        BuildObjSubmesh(*jobs[i].model, jobs[i].material, *jobs[i].submesh);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Import
+
+void SplitObjChunks(const FileView& view, std::vector<ObjChunk>& chunks)
+{
+    const char* text = (const char*)view.data;
+    const char* end = text + view.size;
+
+    u64 maxChunks = (u64)GetJobThreadCount() * OBJ_MAX_CHUNKS_PER_THREAD;
+    u64 chunkCount = std::max<u64>(1, std::min<u64>(view.size / OBJ_CHUNK_SIZE, maxChunks));
+
+    const char* chunkBegin = text;
+    for (u64 i = 1; i <= chunkCount && chunkBegin < end; ++i)
+    {
+        const char* chunkEnd = end;
+        if (i < chunkCount)
+        {
+            chunkEnd = std::max(chunkBegin, text + view.size * i / chunkCount);
+            chunkEnd = FindObjLineEnd(chunkEnd, end);
+            chunkEnd = chunkEnd < end ? chunkEnd + 1 : end;
+        }
+
+        chunks.push_back(ObjChunk{});
+        chunks.back().begin = chunkBegin;
+        chunks.back().end = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+}
+
+bool ImportObjFile(const char* filepath, ObjImport& import)
+{
+    PROFILE_FUNCTION();
+    std::vector<std::string>& dependencies = import.dependencies;
+
+    FileView view = MapFile(filepath);
+    if (!view.data)
+    {
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_ASSETS, "Could not open the model %s", filepath);
+        return false;
+    }
+    dependencies.push_back(filepath);
+
+    ObjModel model;
+    SplitObjChunks(view, model.chunks);
+    u32 chunkCount = (u32)model.chunks.size();
+    ParallelFor(chunkCount, 1, CountObjChunkRange, &model);
+
+    // Give every chunk the base indices of its attributes and the material it starts with
+    u32 positionCount = 0, texCoordCount = 0, normalCount = 0;
+    std::string material;
+    std::vector<std::string> materialLibraries;
+    for (ObjChunk& chunk : model.chunks)
+    {
+        chunk.firstPosition = positionCount;
+        chunk.firstTexCoord = texCoordCount;
+        chunk.firstNormal = normalCount;
+        chunk.initialMaterial = material;
+        positionCount += chunk.positionCount;
+        texCoordCount += chunk.texCoordCount;
+        normalCount += chunk.normalCount;
+        if (chunk.changesMaterial)
+            material = chunk.lastMaterial;
+        for (const std::string& library : chunk.materialLibraries)
+            if (std::find(materialLibraries.begin(), materialLibraries.end(), library) == materialLibraries.end())
+                materialLibraries.push_back(library);
+    }
+
+    model.positions.resize(positionCount);
+    model.texCoords.resize(texCoordCount);
+    model.normals.resize(normalCount);
+    ParallelFor(chunkCount, 1, ParseObjChunkRange, &model);
+
+    for (const ObjChunk& chunk : model.chunks)
+    {
+        if (chunk.errorLine)
+        {
+            const char* lineEnd = FindObjLineEnd(chunk.errorLine, (const char*)view.data + view.size);
+            std::string line(chunk.errorLine, std::min<size_t>(lineEnd - chunk.errorLine, 64));
+            LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "Could not parse \"%s\" in %s, importing it with Assimp", line, filepath);
+            UnmapFile(view);
+            return false;
+        }
+    }
+    UnmapFile(view); // Every chunk keeps its own copy of the material names
+
+    Arena* scratch = GetThreadArena();
+    TempArenaScope tempScope(scratch);
+    String directory = GetDirectoryPart(MakeString(filepath, scratch), scratch);
+
+    for (const std::string& library : materialLibraries)
+    {
+        String libraryPath = MakePath(directory, MakeString(library.c_str(), scratch), scratch);
+        FileView libraryView = MapFile(libraryPath.str);
+        if (!libraryView.data)
+        {
+            LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "Could not open the material library %s", libraryPath.str);
+            continue;
+        }
+        dependencies.push_back(libraryPath.str);
+        const char* text = (const char*)libraryView.data;
+        ParseObjMaterialLibrary(text, text + libraryView.size, directory, model.materials);
+        UnmapFile(libraryView);
+    }
+
+    // Resolve the material names of the chunks. Names missing from the libraries get a material
+    // with the default properties, as Assimp does. Submeshes follow the order of first use.
+    std::vector<u32> submeshMaterials;
+    for (ObjChunk& chunk : model.chunks)
+    {
+        std::vector<bool> used(chunk.materialNames.size(), false);
+        u32 chunkTriangles = (u32)(chunk.corners.size() / 3);
+        for (u32 run = 0; run < chunk.runs.size(); ++run)
+        {
+            u32 lastTriangle = run + 1 < chunk.runs.size() ? chunk.runs[run + 1].firstTriangle : chunkTriangles;
+            if (lastTriangle > chunk.runs[run].firstTriangle)
+                used[chunk.runs[run].material] = true;
+        }
+
+        chunk.materialIndices.resize(chunk.materialNames.size(), UINT32_MAX);
+        for (u32 i = 0; i < chunk.materialNames.size(); ++i)
+        {
+            if (!used[i])
+                continue;
+
+            const std::string& name = chunk.materialNames[i].empty() ? "DefaultMaterial" : chunk.materialNames[i];
+            u32 index = 0;
+            while (index < model.materials.size() && model.materials[index].material.name != name)
+                ++index;
+            if (index == model.materials.size())
+            {
+                if (!chunk.materialNames[i].empty())
+                    LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "Material %s of %s not found, using the default one", name, filepath);
+                model.materials.push_back(MakeDefaultObjMaterial(name));
+            }
+            chunk.materialIndices[i] = index;
+
+            if (std::find(submeshMaterials.begin(), submeshMaterials.end(), index) == submeshMaterials.end())
+                submeshMaterials.push_back(index);
+        }
+    }
+
+    if (submeshMaterials.empty())
+    {
+        LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_ASSETS, "The model %s has no faces, importing it with Assimp", filepath);
+        return false;
+    }
+
+    import.submeshMaterials = submeshMaterials;
+    import.submeshes.resize(submeshMaterials.size());
+    std::vector<ObjSubmeshJob> submeshJobs(submeshMaterials.size());
+    for (u32 i = 0; i < submeshMaterials.size(); ++i)
+        submeshJobs[i] = ObjSubmeshJob{ &model, submeshMaterials[i], &import.submeshes[i] };
+    ParallelFor((u32)submeshJobs.size(), 1, BuildObjSubmeshRange, submeshJobs.data());
+
+    import.materials.resize(model.materials.size());
+    import.texturePaths.resize(model.materials.size() * OBJ_TEXTURE_SLOT_COUNT);
+    for (u32 i = 0; i < model.materials.size(); ++i)
+    {
+        import.materials[i] = std::move(model.materials[i].material);
+        for (u32 slot = 0; slot < OBJ_TEXTURE_SLOT_COUNT; ++slot)
+            import.texturePaths[i * OBJ_TEXTURE_SLOT_COUNT + slot] = std::move(model.materials[i].texturePaths[slot]);
+    }
+
+    return true;
+}
+
+bool LoadObjModel(App* app, const char* filepath, Mesh& mesh, std::vector<u32>& submeshMaterialIndices,
+                  std::vector<std::string>& dependencies)
+{
+    PROFILE_FUNCTION();
+
+    ObjImport import;
+    if (!ImportObjFile(filepath, import))
+        return false;
+
+    u32 baseMaterialIndex = (u32)app->materials.size();
+    for (u32 i = 0; i < import.submeshes.size(); ++i)
+    {
+        mesh.submeshes.push_back(std::move(import.submeshes[i]));
+        submeshMaterialIndices.push_back(baseMaterialIndex + import.submeshMaterials[i]);
+    }
+
+    // The textures stream in while the model is drawn with placeholders
+    for (u32 i = 0; i < import.materials.size(); ++i)
+    {
+        Material& material = import.materials[i];
+        for (u32 slot = 0; slot < OBJ_TEXTURE_SLOT_COUNT; ++slot)
+        {
+            u32 texture = i * OBJ_TEXTURE_SLOT_COUNT + slot;
+            if (!import.texturePaths[texture].empty())
+                material.*ObjTextureSlots[slot] = RequestTexture2D(app, import.texturePaths[texture].c_str(), ObjTextureUsages[slot]);
+        }
+        app->materials.push_back(material);
+    }
+
+    dependencies.insert(dependencies.end(), import.dependencies.begin(), import.dependencies.end());
+    return true;
+}
@@ -0,0 +1,42 @@
+//
+// obj_loader.h : Native importer of Wavefront OBJ/MTL files, the format of most of our assets.
+// Big files are split in chunks of lines that are parsed in parallel on the job system, the
+// vertices are deduplicated with a hash table and the missing normals and the tangent space are
+// generated here. It produces the same submesh layout as the Assimp path (one submesh per
+// material), so the rest of the engine does not know which importer loaded a model.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define OBJ_CHUNK_SIZE         MB(1) // Minimum bytes parsed by each job
+#define OBJ_TEXTURE_SLOT_COUNT 5     // Albedo, emissive, specular, normals and bump, as the Assimp path
+
+/**
+ * Everything read from an OBJ file and its MTL libraries, before anything is created in the app.
+ */
+struct ObjImport
+{
+    std::vector<Submesh>     submeshes;         // One per material, without buffers
+    std::vector<u32>         submeshMaterials;  // Index in materials of every submesh
+    std::vector<Material>    materials;         // Without textures
+    std::vector<std::string> texturePaths;      // OBJ_TEXTURE_SLOT_COUNT per material, empty when missing
+    std::vector<std::string> dependencies;      // The OBJ file and the MTL files read
+};
+
+bool IsObjFile(const char* filepath);
+
+/**
+ * Parses an OBJ file and its MTL libraries and builds the submeshes, on the job system. It does
+ * not touch the app or GL, so it can run on any thread.
+ */
+bool ImportObjFile(const char* filepath, ObjImport& import);
+
+/**
+ * Imports an OBJ file and the MTL libraries it references, appending the materials to the app
+ * and the paths of the files read to dependencies. Returns false if the file could not be read
+ * or uses something this importer does not support, so the caller can fall back to Assimp.
+ */
+bool LoadObjModel(App* app, const char* filepath, Mesh& mesh, std::vector<u32>& submeshMaterialIndices,
+                  std::vector<std::string>& dependencies);
@@ -12,25 +12,61 @@
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
 #include "engine.h"
+#include "memory_arena.h"
+#include "job_system.h"
+#include "benchmark.h"
+#include "profiler.h"
+#include "gpu_profiler.h"
+#include "texture_streaming.h"
+#include "texture_pages.h"
+#include "camera_path.h"
+#include "stress_scene.h"
+#include "microbenchmark.h"
+#include "file_watcher.h"
 
 #include <GLFW/glfw3.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <chrono>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+// Headless runs on Linux use EGL directly, so they work without any display server
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define HEADLESS_EGL 1
+#else
+#define HEADLESS_EGL 0
+#endif
+
+// The benchmark target runs headless unless --window is given
+#ifdef BENCHMARK_BUILD
+#define HEADLESS_BY_DEFAULT 1
+#else
+#define HEADLESS_BY_DEFAULT 0
+#endif
+
+// The microbenchmark target only runs the microbenchmarks, no window or GL context is created
+#ifdef MICROBENCHMARK_BUILD
+#define MICROBENCHMARKS_BY_DEFAULT 1
+#else
+#define MICROBENCHMARKS_BY_DEFAULT 0
+#endif
+
 #define WINDOW_TITLE  "Advanced Graphics Programming"
 #define WINDOW_WIDTH  1920
 #define WINDOW_HEIGHT 1080
 
-#define GLOBAL_FRAME_ARENA_SIZE MB(16)
-u8* GlobalFrameArenaMemory = NULL;
-u32 GlobalFrameArenaHead = 0;
-
 void OnGlfwError(int errorCode, const char *errorMessage)
 {
 	fprintf(stderr, "glfw failed with error %d: %s\n", errorCode, errorMessage);
@@ -120,12 +156,327 @@ void OnGlfwCloseWindow(GLFWwindow* window)
     app->isRunning = false;
 }
 
-int main()
+struct HeadlessContext
+{
+#if HEADLESS_EGL
+    EGLDisplay  display;
+    EGLContext  context;
+    EGLSurface  surface;
+#else
+    GLFWwindow* window;
+#endif
+};
+
+#if HEADLESS_EGL
+bool CreateHeadlessContext(HeadlessContext& ctx, ivec2 size)
+{
+    ctx = {};
+
+    // The surfaceless platform needs neither X11 nor Wayland, and it is also available on
+    // llvmpipe (LIBGL_ALWAYS_SOFTWARE=1) for machines without a GPU
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    ctx.display = EGL_NO_DISPLAY;
+    if (getPlatformDisplay)
+        ctx.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (ctx.display == EGL_NO_DISPLAY)
+        ctx.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (ctx.display == EGL_NO_DISPLAY || !eglInitialize(ctx.display, &major, &minor))
+    {
+        ELOG("eglInitialize() failed\n");
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_DEPTH_SIZE, 24,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(ctx.display, configAttribs, &config, 1, &configCount) || configCount == 0)
+    {
+        ELOG("eglChooseConfig() found no OpenGL pbuffer config\n");
+        eglTerminate(ctx.display);
+        return false;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+    };
+    ctx.context = eglCreateContext(ctx.display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (ctx.context == EGL_NO_CONTEXT)
+    {
+        ELOG("eglCreateContext() failed\n");
+        eglTerminate(ctx.display);
+        return false;
+    }
+
+    // The engine renders into its own framebuffers, the pbuffer is only there to make the
+    // context current (without it we rely on EGL_KHR_surfaceless_context)
+    const EGLint pbufferAttribs[] = { EGL_WIDTH, size.x, EGL_HEIGHT, size.y, EGL_NONE };
+    ctx.surface = eglCreatePbufferSurface(ctx.display, config, pbufferAttribs);
+    if (!eglMakeCurrent(ctx.display, ctx.surface, ctx.surface, ctx.context))
+    {
+        ELOG("eglMakeCurrent() failed\n");
+        return false;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+        ELOG("Failed to initialize OpenGL context\n");
+        return false;
+    }
+    return true;
+}
+
+void DestroyHeadlessContext(HeadlessContext& ctx)
+{
+    eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (ctx.surface != EGL_NO_SURFACE)
+        eglDestroySurface(ctx.display, ctx.surface);
+    eglDestroyContext(ctx.display, ctx.context);
+    eglTerminate(ctx.display);
+}
+#else
+bool CreateHeadlessContext(HeadlessContext& ctx, ivec2 size)
+{
+    // Elsewhere a hidden window is enough: nothing is ever presented
+    ctx = {};
+    glfwSetErrorCallback(OnGlfwError);
+    if (!glfwInit())
+    {
+        ELOG("glfwInit() failed\n");
+        return false;
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    ctx.window = glfwCreateWindow(size.x, size.y, WINDOW_TITLE, NULL, NULL);
+    if (!ctx.window)
+    {
+        ELOG("glfwCreateWindow() failed\n");
+        glfwTerminate();
+        return false;
+    }
+
+    glfwMakeContextCurrent(ctx.window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        ELOG("Failed to initialize OpenGL context\n");
+        return false;
+    }
+    return true;
+}
+
+void DestroyHeadlessContext(HeadlessContext& ctx)
+{
+    glfwDestroyWindow(ctx.window);
+    glfwTerminate();
+}
+#endif
+
+/**
+ * Runs Init once and Update/Render for the requested number of frames without presenting
+ * anything nor creating the ImGui context, then prints the timing summary.
+ *
+ * With --flythrough path.txt the camera follows the path (see camera_path.h) and the frames
+ * advance by a fixed timestep, so every run renders exactly the same frames. The summary can be
+ * written with --output-json/--output-csv and checked against a previous JSON with --baseline;
+ * the run then fails (exit code 1) if it is slower than --threshold percent.
+ */
+int RunHeadless(int argc, char** argv)
+{
+    ivec2 resolution(WINDOW_WIDTH, WINDOW_HEIGHT);
+    sscanf(GetArgumentValue(argc, argv, "--resolution", ""), "%dx%d", &resolution.x, &resolution.y);
+    u32 frameCount = atoi(GetArgumentValue(argc, argv, "--frames", "600"));
+    u32 warmupFrames = atoi(GetArgumentValue(argc, argv, "--warmup-frames", "60"));
+
+    CameraPath path;
+    bool flythrough = HasArgument(argc, argv, "--flythrough");
+    if (flythrough && !LoadCameraPath(path, GetArgumentValue(argc, argv, "--flythrough", "flythrough.txt")))
+        return -1;
+
+    // Fixed timestep: by default the flythrough is played once at 60 frames per second
+    f32 fixedTimestep = (f32)atof(GetArgumentValue(argc, argv, "--timestep", flythrough ? "0.0166667" : "0"));
+    if (flythrough && !(fixedTimestep > 0.0f))
+    {
+        ELOG("--timestep must be greater than 0 to play a flythrough\n");
+        return -1;
+    }
+    if (flythrough && !HasArgument(argc, argv, "--frames"))
+        frameCount = (u32)(path.duration / fixedTimestep) + 1;
+
+    App app         = {};
+    app.deltaTime   = 1.0f/60.0f;
+    app.displaySize = resolution;
+    app.isRunning   = true;
+    if (HasArgument(argc, argv, "--texture-budget"))
+        app.textureBudgetMB = atoi(GetArgumentValue(argc, argv, "--texture-budget"));
+
+    HeadlessContext context;
+    if (!CreateHeadlessContext(context, resolution))
+        return -1;
+
+    InitArenas();
+    PROFILE_THREAD_NAME("Main");
+    InitJobSystem();
+
+    if (HasArgument(argc, argv, "--trace-frames"))
+        ProfilerStartCapture(atoi(GetArgumentValue(argc, argv, "--trace-frames")),
+                             GetArgumentValue(argc, argv, "--trace-file", "profile_trace.json"));
+
+    Init(&app);
+
+    if (flythrough)
+        ApplyCameraPathScene(&app, path);
+
+    StressSceneParams stressParams;
+    if (ParseStressSceneArguments(argc, argv, stressParams))
+        GenerateStressScene(&app, stressParams);
+
+    // Every frame measured draws the scene with all its textures
+    FlushTextureStreaming(&app);
+
+    if (HasArgument(argc, argv, "--gpu-log"))
+        GpuProfilerStartLog(GetArgumentValue(argc, argv, "--gpu-log", "gpu_profile.csv"));
+
+    if (fixedTimestep > 0.0f)
+        app.deltaTime = fixedTimestep;
+
+    FrameTimings timings;
+    u64 lastGpuFrame = 0;
+    u64 lastFrameTime = GetTimeNanoseconds();
+    for (u32 frame = 0; frame < warmupFrames + frameCount; ++frame)
+    {
+        ProfilerBeginFrame();
+
+        Update(&app);
+
+        // The warm up frames stay on the first keyframe
+        if (flythrough)
+            SampleCameraPath(path, frame < warmupFrames ? 0.0f : (frame - warmupFrames) * fixedTimestep, app.camera);
+
+        GpuProfilerBeginFrame();
+        Render(&app);
+        GpuProfilerEndFrame();
+        glFlush();
+
+        u64 currentFrameTime = GetTimeNanoseconds();
+        f32 frameSeconds = (f32)((currentFrameTime - lastFrameTime) / 1000000000.0);
+        lastFrameTime = currentFrameTime;
+        app.deltaTime = fixedTimestep > 0.0f ? fixedTimestep : frameSeconds;
+
+        ResetArena(&GlobalFrameArena);
+
+        ProfilerEndFrame();
+
+        if (frame < warmupFrames)
+            continue;
+
+        timings.cpuMs.push_back(frameSeconds * 1000.0f);
+        timings.updateMs.push_back(ProfilerGetZoneMs("Update"));
+        timings.renderMs.push_back(ProfilerGetZoneMs("Render"));
+
+        // Only frames issued after the warm up and read back since the last check
+        u64 gpuFrame = GpuProfilerGetResultsFrame();
+        if (gpuFrame != lastGpuFrame && gpuFrame >= warmupFrames && !GpuProfilerGetResults().empty())
+        {
+            timings.gpuMs.push_back(GpuProfilerGetFrameMs());
+            AddGpuPassTimings(timings, GpuProfilerGetResults());
+            lastGpuFrame = gpuFrame;
+        }
+    }
+
+    PrintFrameTimings(timings, resolution);
+
+    int result = 0;
+    if (HasArgument(argc, argv, "--output-json"))
+        WriteFrameTimingsJson(timings, resolution, GetArgumentValue(argc, argv, "--output-json", "frame_timings.json"));
+    if (HasArgument(argc, argv, "--output-csv"))
+        WriteFrameTimingsCsv(timings, GetArgumentValue(argc, argv, "--output-csv", "frame_timings.csv"));
+    if (HasArgument(argc, argv, "--baseline"))
+    {
+        f32 threshold = (f32)atof(GetArgumentValue(argc, argv, "--threshold", "10"));
+        if (!CompareFrameTimingsWithBaseline(timings, GetArgumentValue(argc, argv, "--baseline", "baseline.json"), threshold))
+        {
+            printf("Performance regression over %.1f%% against the baseline\n", threshold);
+            result = 1;
+        }
+    }
+
+    ShutdownTextureStreaming();
+    ShutdownTexturePages();
+    ShutdownGpuProfiler();
+    ShutdownJobSystem();
+    ShutdownArenas();
+    DestroyHeadlessContext(context);
+
+    return result;
+}
+
+void InitLoggerFromArguments(int argc, char** argv)
+{
+    InitLogger();
+
+    if (HasArgument(argc, argv, "--log-file"))
+        LogAddFileSink(GetArgumentValue(argc, argv, "--log-file"));
+
+    LogLevel level;
+    const char* levelName = GetArgumentValue(argc, argv, "--log-level", "debug");
+    if (LogParseLevel(levelName, level))
+        LogSetMinLevel(level);
+    else
+        LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_PLATFORM, "Unknown log level %s (debug, info, warning or error)", levelName);
+}
+
+int main(int argc, char** argv)
 {
+    InitLoggerFromArguments(argc, argv);
+
+    if (MICROBENCHMARKS_BY_DEFAULT || HasArgument(argc, argv, "--microbench"))
+    {
+        InitArenas();
+        int result = RunMicrobenchmarks(argc, argv);
+        ShutdownArenas();
+        ShutdownLogger();
+        return result;
+    }
+
+    if (HasArgument(argc, argv, "--bench-jobs"))
+    {
+        InitArenas();
+        RunJobSystemBenchmark(atoi(GetArgumentValue(argc, argv, "--bench-jobs-elements", "262144")));
+        ShutdownArenas();
+        ShutdownLogger();
+        return 0;
+    }
+
+    bool headless = HEADLESS_BY_DEFAULT ? !HasArgument(argc, argv, "--window") : HasArgument(argc, argv, "--headless");
+    if (headless)
+    {
+        int result = RunHeadless(argc, argv);
+        ShutdownLogger();
+        return result;
+    }
+
     App app         = {};
     app.deltaTime   = 1.0f/60.0f;
     app.displaySize = ivec2(WINDOW_WIDTH, WINDOW_HEIGHT);
     app.isRunning   = true;
+    if (HasArgument(argc, argv, "--texture-budget"))
+        app.textureBudgetMB = atoi(GetArgumentValue(argc, argv, "--texture-budget"));
 
 		glfwSetErrorCallback(OnGlfwError);
 
@@ -203,12 +554,33 @@ int main()
 
     f64 lastFrameTime = glfwGetTime();
 
-    GlobalFrameArenaMemory = (u8*)malloc(GLOBAL_FRAME_ARENA_SIZE);
+    InitArenas();
+    PROFILE_THREAD_NAME("Main");
+    InitJobSystem();
+
+    // Capture the first frames (including Init) with --trace-frames N
+    if (HasArgument(argc, argv, "--trace-frames"))
+        ProfilerStartCapture(atoi(GetArgumentValue(argc, argv, "--trace-frames")),
+                             GetArgumentValue(argc, argv, "--trace-file", "profile_trace.json"));
 
     Init(&app);
 
+    StressSceneParams stressParams;
+    if (ParseStressSceneArguments(argc, argv, stressParams))
+        GenerateStressScene(&app, stressParams);
+
+    // Shaders, textures and models edited under the working directory are reloaded by Update
+    if (!HasArgument(argc, argv, "--no-hot-reload"))
+        InitFileWatcher(".");
+
+    // Per-pass GPU timings of every frame with --gpu-log file.csv
+    if (HasArgument(argc, argv, "--gpu-log"))
+        GpuProfilerStartLog(GetArgumentValue(argc, argv, "--gpu-log", "gpu_profile.csv"));
+
     while (app.isRunning)
     {
+        ProfilerBeginFrame();
+
         // Tell GLFW to call platform callbacks
         glfwPollEvents();
 
@@ -247,19 +619,30 @@ int main()
         app.input.mouseDelta = glm::vec2(0.0f, 0.0f);
 
         // Render
+        GpuProfilerBeginFrame();
         Render(&app);
 
         // ImGui Render
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
-            GLFWwindow* backup_current_context = glfwGetCurrentContext();
-            ImGui::UpdatePlatformWindows();
-            ImGui::RenderPlatformWindowsDefault();
-            glfwMakeContextCurrent(backup_current_context);
+        {
+            PROFILE_SCOPE("ImGui Render");
+            {
+                GPU_PROFILE_SCOPE("ImGui");
+                ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            }
+            GpuProfilerEndFrame();
+            if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
+                GLFWwindow* backup_current_context = glfwGetCurrentContext();
+                ImGui::UpdatePlatformWindows();
+                ImGui::RenderPlatformWindowsDefault();
+                glfwMakeContextCurrent(backup_current_context);
+            }
         }
 
         // Present image on screen
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("Swap Buffers");
+            glfwSwapBuffers(window);
+        }
 
         // Frame time
         f64 currentFrameTime = glfwGetTime();
@@ -267,10 +650,17 @@ int main()
         lastFrameTime = currentFrameTime;
 
         // Reset frame allocator
-        GlobalFrameArenaHead = 0;
+        ResetArena(&GlobalFrameArena);
+
+        ProfilerEndFrame();
     }
 
-    free(GlobalFrameArenaMemory);
+    ShutdownFileWatcher();
+    ShutdownTextureStreaming();
+    ShutdownTexturePages();
+    ShutdownGpuProfiler();
+    ShutdownJobSystem();
+    ShutdownArenas();
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -279,110 +669,260 @@ int main()
 
     glfwTerminate();
 
+    ShutdownLogger();
+
     return 0;
 }
 
-u32 Strlen(const char* string)
+bool HasArgument(int argc, char** argv, const char* option)
 {
-    u32 len = 0;
-    while (*string++) len++;
-    return len;
+    for (int i = 1; i < argc; ++i)
+        if (strcmp(argv[i], option) == 0)
+            return true;
+    return false;
 }
 
-void* PushSize(u32 byteCount)
+const char* GetArgumentValue(int argc, char** argv, const char* option, const char* defaultValue)
 {
-    ASSERT(GlobalFrameArenaHead + byteCount <= GLOBAL_FRAME_ARENA_SIZE,
-           "Trying to allocate more temp memory than available");
-
-    u8* curPtr = GlobalFrameArenaMemory + GlobalFrameArenaHead;
-    GlobalFrameArenaHead += byteCount;
-    return curPtr;
+    for (int i = 1; i < argc - 1; ++i)
+        if (strcmp(argv[i], option) == 0)
+            return argv[i + 1];
+    return defaultValue;
 }
 
-void* PushBytes(const void* bytes, u32 byteCount)
+u32 Strlen(const char* string)
 {
-    ASSERT(GlobalFrameArenaHead + byteCount <= GLOBAL_FRAME_ARENA_SIZE,
-            "Trying to allocate more temp memory than available");
-
-    u8* srcPtr = (u8*)bytes;
-    u8* curPtr = GlobalFrameArenaMemory + GlobalFrameArenaHead;
-    u8* dstPtr = GlobalFrameArenaMemory + GlobalFrameArenaHead;
-    GlobalFrameArenaHead += byteCount;
-    while (byteCount--) *dstPtr++ = *srcPtr++;
-    return curPtr;
+    u32 len = 0;
+    while (*string++) len++;
+    return len;
 }
 
-u8* PushChar(u8 c)
+String MakeString(const char *cstr, Arena* arena)
 {
-    ASSERT(GlobalFrameArenaHead + 1 <= GLOBAL_FRAME_ARENA_SIZE,
-            "Trying to allocate more temp memory than available");
-    u8* ptr = GlobalFrameArenaMemory + GlobalFrameArenaHead;
-    GlobalFrameArenaHead++;
-    *ptr = c;
-    return ptr;
-}
+    if (!arena) arena = &GlobalFrameArena;
 
-String MakeString(const char *cstr)
-{
     String str = {};
     str.len = Strlen(cstr);
-    str.str = (char*)PushBytes(cstr, str.len);
-              PushChar(0);
+    str.str = (char*)PushBytes(arena, cstr, str.len + 1);
     return str;
 }
 
-String MakePath(String dir, String filename)
+String MakePath(String dir, String filename, Arena* arena)
 {
+    if (!arena) arena = &GlobalFrameArena;
+
+    // Allocated at once so the string stays contiguous when other threads use the arena
     String str = {};
     str.len = dir.len + filename.len + 1;
-    str.str = (char*)PushBytes(dir.str, dir.len);
-              PushChar('/');
-              PushBytes(filename.str, filename.len);
-              PushChar(0);
+    str.str = (char*)PushSizeAligned(arena, str.len + 1, 1);
+    memcpy(str.str, dir.str, dir.len);
+    str.str[dir.len] = '/';
+    memcpy(str.str + dir.len + 1, filename.str, filename.len);
+    str.str[str.len] = 0;
     return str;
 }
 
-String GetDirectoryPart(String path)
+String GetDirectoryPart(String path, Arena* arena)
 {
+    if (!arena) arena = &GlobalFrameArena;
+
     String str = {};
     i32 len = (i32)path.len;
-    while (len >= 0) {
+    while (len > 0) {
         len--;
         if (path.str[len] == '/' || path.str[len] == '\\')
             break;
     }
     str.len = (u32)len;
-    str.str = (char*)PushBytes(path.str, str.len);
-              PushChar(0);
+    str.str = (char*)PushSizeAligned(arena, str.len + 1, 1);
+    memcpy(str.str, path.str, str.len);
+    str.str[str.len] = 0;
     return str;
 }
 
-String ReadTextFile(const char* filepath)
+// Mapped views of empty files point here, since a zero length mapping is an error
+static const u8 EmptyFileData[1] = {};
+
+FileView MapFile(const char* filepath)
 {
-    String fileText = {};
+    FileView view = {};
 
-    FILE* file = fopen(filepath, "rb");
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return view;
 
-    if (file)
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
     {
-        fseek(file, 0, SEEK_END);
-        fileText.len = ftell(file);
-        fseek(file, 0, SEEK_SET);
+        CloseHandle(file);
+        return view;
+    }
 
-        fileText.str = (char*)PushSize(fileText.len + 1);
-        fread(fileText.str, sizeof(char), fileText.len, file);
-        fileText.str[fileText.len] = '\0';
+    if (size.QuadPart == 0)
+    {
+        view.data = EmptyFileData;
+    }
+    else
+    {
+        // The view keeps the mapping and the file open, so both handles can be closed right away
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping)
+        {
+            view.data = (const u8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            view.size = view.data ? (u64)size.QuadPart : 0;
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return view;
+
+    struct stat attrib;
+    if (fstat(fd, &attrib) != 0 || !S_ISREG(attrib.st_mode))
+    {
+        close(fd);
+        return view;
+    }
+
+    if (attrib.st_size == 0)
+    {
+        view.data = EmptyFileData;
+    }
+    else
+    {
+        void* data = mmap(NULL, (size_t)attrib.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            // Loaders read the whole file from start to end
+            madvise(data, (size_t)attrib.st_size, MADV_SEQUENTIAL);
+            madvise(data, (size_t)attrib.st_size, MADV_WILLNEED);
+            view.data = (const u8*)data;
+            view.size = (u64)attrib.st_size;
+        }
+    }
+    close(fd);
+#endif
+
+    return view;
+}
 
-        fclose(file);
+void UnmapFile(FileView& view)
+{
+    if (view.data && view.data != EmptyFileData)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(view.data);
+#else
+        munmap((void*)view.data, (size_t)view.size);
+#endif
+    }
+    view = {};
+}
+
+String ReadTextFile(const char* filepath, Arena* arena)
+{
+    if (!arena) arena = &GlobalFrameArena;
+
+    String fileText = {};
+
+    FileView view = MapFile(filepath);
+
+    if (view.data && view.size < UINT32_MAX)
+    {
+        // The copy is writable and null terminated, unlike the mapped view
+        fileText.len = (u32)view.size;
+        fileText.str = (char*)PushSize(arena, fileText.len + 1);
+        memcpy(fileText.str, view.data, fileText.len);
+        fileText.str[fileText.len] = '\0';
     }
     else
     {
-        ELOG("fopen() failed reading file %s", filepath);
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_PLATFORM, "Could not read file %s", filepath);
     }
 
+    UnmapFile(view);
     return fileText;
 }
 
+bool WriteBinaryFile(const char* filepath, const void* data, u64 size)
+{
+    // Written next to the destination and renamed, so readers never map a partial file
+    std::string tempPath = std::string(filepath) + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file)
+    {
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_PLATFORM, "fopen() failed writing file %s", tempPath);
+        return false;
+    }
+
+    bool written = fwrite(data, 1, (size_t)size, file) == size;
+    written = fclose(file) == 0 && written;
+
+#ifdef _WIN32
+    written = written && MoveFileExA(tempPath.c_str(), filepath, MOVEFILE_REPLACE_EXISTING);
+#else
+    written = written && rename(tempPath.c_str(), filepath) == 0;
+#endif
+    if (!written)
+    {
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_PLATFORM, "Could not write file %s", filepath);
+        remove(tempPath.c_str());
+    }
+    return written;
+}
+
+bool CreateDirectoryIfMissing(const char* path)
+{
+#ifdef _WIN32
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+u64 HashBytes(const void* data, u64 size, u64 seed)
+{
+    // MurmurHash64A
+    const u64 m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+
+    u64 h = seed ^ (size * m);
+
+    const u8* bytes = (const u8*)data;
+    const u8* end = bytes + (size & ~7ull);
+    for (; bytes != end; bytes += 8)
+    {
+        u64 k;
+        memcpy(&k, bytes, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    switch (size & 7)
+    {
+    case 7: h ^= (u64)bytes[6] << 48; // fallthrough
+    case 6: h ^= (u64)bytes[5] << 40; // fallthrough
+    case 5: h ^= (u64)bytes[4] << 32; // fallthrough
+    case 4: h ^= (u64)bytes[3] << 24; // fallthrough
+    case 3: h ^= (u64)bytes[2] << 16; // fallthrough
+    case 2: h ^= (u64)bytes[1] << 8;  // fallthrough
+    case 1: h ^= (u64)bytes[0];
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
 u64 GetFileLastWriteTimestamp(const char* filepath)
 {
 #ifdef _WIN32
@@ -397,16 +937,22 @@ u64 GetFileLastWriteTimestamp(const char* filepath)
         return(conversor.u64time);
     }
 #else
-    // NOTE: This has not been tested in unix-like systems
+    // Nanoseconds, so two writes within the same second are told apart
     struct stat attrib;
     if (stat(filepath, &attrib) == 0) {
-        return attrib.st_mtime;
+        return (u64)attrib.st_mtim.tv_sec * 1000000000ull + (u64)attrib.st_mtim.tv_nsec;
     }
 #endif
 
     return 0;
 }
 
+u64 GetTimeNanoseconds()
+{
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 void LogString(const char* str)
 {
 #ifdef _WIN32
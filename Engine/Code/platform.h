@@ -65,17 +65,60 @@ struct String
     u32   len;
 };
 
-String MakeString(const char *cstr);
+struct Arena;
 
-String MakePath(String dir, String filename);
+/**
+ * String functions allocate from the given arena, or from the frame arena when none
+ * is given. Frame arena strings are temporary and are released at the end of the frame.
+ */
+String MakeString(const char *cstr, Arena* arena = NULL);
+
+String MakePath(String dir, String filename, Arena* arena = NULL);
+
+String GetDirectoryPart(String path, Arena* arena = NULL);
+
+/**
+ * Read-only view of a whole file mapped in memory. Loaders read the file contents straight
+ * from the page cache, without copying them into an arena, so the file size is not limited
+ * by the arenas. The data is not null terminated.
+ */
+struct FileView
+{
+    const u8* data;
+    u64       size;
+};
+
+/**
+ * Maps a file for reading until UnmapFile is called. Returns a view with NULL data if the file
+ * could not be opened, without logging, so callers can probe for optional files. Files must
+ * not be truncated while they are mapped; replacing them (as editors do on save) is fine.
+ */
+FileView MapFile(const char* filepath);
+
+void UnmapFile(FileView& view);
+
+/**
+ * Reads a whole file and returns a null terminated and writable copy of its contents. The
+ * returned string is temporary and should be copied if it needs to persist for several frames.
+ * Prefer MapFile for big files or when the contents are only read.
+ */
+String ReadTextFile(const char *filepath, Arena* arena = NULL);
 
-String GetDirectoryPart(String path);
+/**
+ * Writes a whole file, replacing it only once all the contents have been written.
+ */
+bool WriteBinaryFile(const char* filepath, const void* data, u64 size);
+
+/**
+ * Creates a directory (not its parents). Returns true if it exists afterwards.
+ */
+bool CreateDirectoryIfMissing(const char* path);
 
 /**
- * Reads a whole file and returns a string with its contents. The returned string
- * is temporary and should be copied if it needs to persist for several frames.
+ * Non-cryptographic 64-bit hash of a memory block (MurmurHash64A), used to detect modified
+ * source files of cooked assets.
  */
-String ReadTextFile(const char *filepath);
+u64 HashBytes(const void* data, u64 size, u64 seed = 0);
 
 /**
  * It retrieves a timestamp indicating the last time the file was modified.
@@ -84,19 +127,25 @@ String ReadTextFile(const char *filepath);
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
 /**
- * It logs a string to whichever outputs are configured in the platform layer.
- * By default, the string is printed in the output console of VisualStudio.
+ * Command line helpers. GetArgumentValue returns the token that follows the given
+ * option (e.g. "--frames 500"), or the default value when the option is missing.
  */
-void LogString(const char* str);
+bool HasArgument(int argc, char** argv, const char* option);
+
+const char* GetArgumentValue(int argc, char** argv, const char* option, const char* defaultValue = NULL);
 
-#define ILOG(...)                 \
-{                                 \
-char logBuffer[1024] = {};        \
-sprintf_s(logBuffer, __VA_ARGS__);\
-LogString(logBuffer);             \
-}
+/**
+ * Monotonic high resolution clock in nanoseconds. Unlike glfwGetTime() it does not
+ * need the window to be created, so it can be used by benchmarks and worker threads.
+ */
+u64 GetTimeNanoseconds();
 
-#define ELOG(...) ILOG(__VA_ARGS__)
+/**
+ * It writes a string to the console output of the platform: the output console of VisualStudio
+ * on Windows and stderr elsewhere. Use the ILOG/ELOG macros of logger.h instead, this is the
+ * console sink of the logger.
+ */
+void LogString(const char* str);
 
 #define ARRAY_COUNT(array) (sizeof(array)/sizeof(array[0]))
 
@@ -109,3 +158,5 @@ LogString(logBuffer);             \
 #define PI  3.14159265359f
 #define TAU 6.28318530718f
 
+// Logging macros (ILOG, ELOG...), they need the types above
+#include "logger.h"
@@ -0,0 +1,371 @@
+//
+// profiler.cpp : Implementation of the CPU profiler declared in profiler.h.
+//
+
+#include "profiler.h"
+#include <imgui.h>
+#include <string.h>
+#include <mutex>
+#include <algorithm>
+
+struct ProfilerThread
+{
+    std::mutex                mutex;
+    std::vector<ProfileEvent> events;
+    u16                       depth;
+    u16                       index;
+    const char*               name;
+};
+
+struct ProfileFrame
+{
+    u64                       start;
+    u64                       end;
+    std::vector<ProfileEvent> events;
+};
+
+struct Profiler
+{
+    std::mutex                   threadsMutex;
+    std::vector<ProfilerThread*> threads;
+
+    ProfileFrame                 frames[PROFILER_HISTORY_FRAMES];
+    ProfileFrame                 pausedFrame;      // Receives the frames while the history is paused
+    u32                          frameIndex = 0;   // Next frame to be written
+    u32                          frameCount = 0;
+    u64                          currentFrameStart = 0;
+
+    bool                         paused = false;
+    i32                          selectedFrame = -1; // -1 follows the last frame
+    f32                          timelineZoom = 1.0f;
+
+    // Capture
+    bool                         capturing = false;
+    u32                          captureFramesLeft = 0;
+    std::string                  capturePath;
+    std::vector<ProfileEvent>    captureEvents;
+};
+
+static Profiler GlobalProfiler;
+static thread_local ProfilerThread* CurrentProfilerThread = NULL;
+
+ProfilerThread* GetProfilerThread()
+{
+    if (!CurrentProfilerThread)
+    {
+        CurrentProfilerThread = new ProfilerThread();
+        CurrentProfilerThread->depth = 0;
+        CurrentProfilerThread->name = "Thread";
+
+        std::lock_guard<std::mutex> lock(GlobalProfiler.threadsMutex);
+        CurrentProfilerThread->index = (u16)GlobalProfiler.threads.size();
+        GlobalProfiler.threads.push_back(CurrentProfilerThread);
+    }
+    return CurrentProfilerThread;
+}
+
+ProfileScope::ProfileScope(const char* zoneName)
+{
+    name = zoneName;
+    GetProfilerThread()->depth++;
+    start = GetTimeNanoseconds();
+}
+
+ProfileScope::~ProfileScope()
+{
+    u64 end = GetTimeNanoseconds();
+    ProfilerThread* thread = CurrentProfilerThread;
+    thread->depth--;
+
+    ProfileEvent event = { name, start, end, thread->depth, thread->index };
+    std::lock_guard<std::mutex> lock(thread->mutex);
+    thread->events.push_back(event);
+}
+
+void ProfilerSetThreadName(const char* name)
+{
+    GetProfilerThread()->name = name;
+}
+
+void ProfilerBeginFrame()
+{
+    GlobalProfiler.currentFrameStart = GetTimeNanoseconds();
+}
+
+void WriteChromeTrace(const char* filepath, const std::vector<ProfileEvent>& events)
+{
+    FILE* file = fopen(filepath, "wb");
+    if (!file)
+    {
+        LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_PROFILER, "Could not write the profiler capture %s", filepath);
+        return;
+    }
+
+    u64 origin = UINT64_MAX;
+    for (const ProfileEvent& event : events)
+        origin = std::min(origin, event.start);
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    {
+        std::lock_guard<std::mutex> lock(GlobalProfiler.threadsMutex);
+        for (const ProfilerThread* thread : GlobalProfiler.threads)
+            fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}},\n",
+                    thread->index, thread->name, thread->index);
+    }
+    for (u32 i = 0; i < events.size(); ++i)
+    {
+        const ProfileEvent& event = events[i];
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                event.name, event.threadIndex, (event.start - origin) / 1000.0, (event.end - event.start) / 1000.0,
+                i + 1 < events.size() ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    fclose(file);
+
+    LOG_MESSAGE(LOG_LEVEL_INFO, LOG_PROFILER, "Profiler capture written to %s (%u zones)", filepath, (u32)events.size());
+}
+
+void ProfilerEndFrame()
+{
+    Profiler& profiler = GlobalProfiler;
+
+    // A paused profiler keeps showing the same history
+    ProfileFrame& frame = profiler.paused ? profiler.pausedFrame : profiler.frames[profiler.frameIndex];
+    frame.start = profiler.currentFrameStart;
+    frame.end = GetTimeNanoseconds();
+    frame.events.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(profiler.threadsMutex);
+        for (ProfilerThread* thread : profiler.threads)
+        {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            frame.events.insert(frame.events.end(), thread->events.begin(), thread->events.end());
+            thread->events.clear();
+        }
+    }
+
+    if (profiler.capturing)
+    {
+        profiler.captureEvents.insert(profiler.captureEvents.end(), frame.events.begin(), frame.events.end());
+        if (--profiler.captureFramesLeft == 0)
+        {
+            WriteChromeTrace(profiler.capturePath.c_str(), profiler.captureEvents);
+            profiler.captureEvents.clear();
+            profiler.capturing = false;
+        }
+    }
+
+    if (!profiler.paused)
+    {
+        profiler.frameIndex = (profiler.frameIndex + 1) % PROFILER_HISTORY_FRAMES;
+        profiler.frameCount = std::min(profiler.frameCount + 1, (u32)PROFILER_HISTORY_FRAMES);
+    }
+}
+
+void ProfilerStartCapture(u32 frameCount, const char* filepath)
+{
+    Profiler& profiler = GlobalProfiler;
+    if (profiler.capturing || frameCount == 0)
+        return;
+
+    profiler.capturing = true;
+    profiler.captureFramesLeft = frameCount;
+    profiler.capturePath = filepath;
+    profiler.captureEvents.clear();
+}
+
+bool ProfilerIsCapturing()
+{
+    return GlobalProfiler.capturing;
+}
+
+void ProfilerSetPaused(bool paused)
+{
+    GlobalProfiler.paused = paused;
+}
+
+const ProfileFrame* GetHistoryFrame(u32 framesAgo)
+{
+    Profiler& profiler = GlobalProfiler;
+    if (framesAgo >= profiler.frameCount)
+        return NULL;
+    u32 index = (profiler.frameIndex + PROFILER_HISTORY_FRAMES - 1 - framesAgo) % PROFILER_HISTORY_FRAMES;
+    return &profiler.frames[index];
+}
+
+f32 ProfilerGetLastFrameMs()
+{
+    const ProfileFrame* frame = GetHistoryFrame(0);
+    return frame ? (frame->end - frame->start) / 1000000.0f : 0.0f;
+}
+
+f32 ProfilerGetZoneMs(const char* name)
+{
+    const ProfileFrame* frame = GetHistoryFrame(0);
+    if (!frame)
+        return 0.0f;
+
+    u64 total = 0;
+    for (const ProfileEvent& event : frame->events)
+        if (strcmp(event.name, name) == 0)
+            total += event.end - event.start;
+    return total / 1000000.0f;
+}
+
+ImU32 ZoneColor(const char* name)
+{
+    // Stable color per zone name
+    u32 hash = 2166136261u;
+    for (const char* c = name; *c; ++c)
+        hash = (hash ^ (u8)*c) * 16777619u;
+    return ImColor::HSV((hash % 360) / 360.0f, 0.55f, 0.75f);
+}
+
+void GuiProfilerTimeline(const ProfileFrame& frame)
+{
+    Profiler& profiler = GlobalProfiler;
+    const f32 rowHeight = ImGui::GetTextLineHeightWithSpacing();
+    const f32 frameMs = (frame.end - frame.start) / 1000000.0f;
+
+    u32 maxDepth[256] = {};
+    u32 threadCount = 0;
+    for (const ProfileEvent& event : frame.events)
+    {
+        if (event.threadIndex >= ARRAY_COUNT(maxDepth)) continue;
+        maxDepth[event.threadIndex] = std::max(maxDepth[event.threadIndex], (u32)event.depth + 1);
+        threadCount = std::max(threadCount, (u32)event.threadIndex + 1);
+    }
+
+    f32 totalRows = 0.0f;
+    for (u32 i = 0; i < threadCount; ++i)
+        totalRows += std::max(1u, maxDepth[i]);
+
+    ImGui::SliderFloat("Zoom", &profiler.timelineZoom, 1.0f, 50.0f, "%.1fx");
+    ImGui::BeginChild("Timeline", ImVec2(0.0f, (totalRows + threadCount) * rowHeight + 20.0f), true, ImGuiWindowFlags_HorizontalScrollbar);
+
+    const f32 width = ImGui::GetContentRegionAvail().x * profiler.timelineZoom;
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    const f32 pixelsPerNs = width / (f32)std::max<u64>(frame.end - frame.start, 1);
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+    f32 rowY = origin.y;
+    f32 threadY[256] = {};
+    for (u32 i = 0; i < threadCount; ++i)
+    {
+        threadY[i] = rowY + rowHeight;
+        const char* threadName = "Thread";
+        {
+            std::lock_guard<std::mutex> lock(profiler.threadsMutex);
+            if (i < profiler.threads.size()) threadName = profiler.threads[i]->name;
+        }
+        char label[64];
+        sprintf(label, "%s %u", threadName, i);
+        drawList->AddText(ImVec2(origin.x, rowY), IM_COL32(200, 200, 200, 255), label);
+        rowY += rowHeight * (std::max(1u, maxDepth[i]) + 1);
+    }
+
+    const ImVec2 mouse = ImGui::GetIO().MousePos;
+    for (const ProfileEvent& event : frame.events)
+    {
+        if (event.threadIndex >= threadCount || event.end < frame.start)
+            continue;
+
+        f32 x0 = origin.x + (f32)((i64)event.start - (i64)frame.start) * pixelsPerNs;
+        f32 x1 = origin.x + (f32)((i64)event.end - (i64)frame.start) * pixelsPerNs;
+        x0 = std::max(x0, origin.x);
+        x1 = std::max(x1, x0 + 1.0f);
+        f32 y0 = threadY[event.threadIndex] + event.depth * rowHeight;
+        f32 y1 = y0 + rowHeight - 1.0f;
+
+        drawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), ZoneColor(event.name));
+        if (x1 - x0 > ImGui::CalcTextSize(event.name).x + 4.0f)
+            drawList->AddText(ImVec2(x0 + 2.0f, y0), IM_COL32(0, 0, 0, 255), event.name);
+
+        if (mouse.x >= x0 && mouse.x <= x1 && mouse.y >= y0 && mouse.y <= y1 && ImGui::IsWindowHovered())
+            ImGui::SetTooltip("%s\n%.3f ms", event.name, (event.end - event.start) / 1000000.0f);
+    }
+
+    ImGui::Dummy(ImVec2(width, rowY - origin.y));
+    ImGui::EndChild();
+
+    ImGui::Text("Frame: %.3f ms", frameMs);
+}
+
+void GuiProfilerZones(const ProfileFrame& frame)
+{
+    struct ZoneTotal { const char* name; u64 total; u32 calls; };
+    std::vector<ZoneTotal> totals;
+    for (const ProfileEvent& event : frame.events)
+    {
+        u32 i = 0;
+        while (i < totals.size() && strcmp(totals[i].name, event.name) != 0) ++i;
+        if (i == totals.size()) totals.push_back(ZoneTotal{ event.name, 0, 0 });
+        totals[i].total += event.end - event.start;
+        totals[i].calls++;
+    }
+    std::sort(totals.begin(), totals.end(), [](const ZoneTotal& a, const ZoneTotal& b) { return a.total > b.total; });
+
+    ImGui::Columns(3, "ProfilerZones");
+    ImGui::Text("Zone"); ImGui::NextColumn();
+    ImGui::Text("Total (ms)"); ImGui::NextColumn();
+    ImGui::Text("Calls"); ImGui::NextColumn();
+    ImGui::Separator();
+    for (const ZoneTotal& zone : totals)
+    {
+        ImGui::Text("%s", zone.name); ImGui::NextColumn();
+        ImGui::Text("%.3f", zone.total / 1000000.0f); ImGui::NextColumn();
+        ImGui::Text("%u", zone.calls); ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+}
+
+void GuiProfiler()
+{
+    Profiler& profiler = GlobalProfiler;
+
+    if (!ImGui::Begin("Profiler"))
+    {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Checkbox("Pause", &profiler.paused);
+    ImGui::SameLine();
+    if (profiler.capturing)
+    {
+        ImGui::Text("Capturing... %u frames left", profiler.captureFramesLeft);
+    }
+    else if (ImGui::Button("Capture 120 frames"))
+    {
+        ProfilerStartCapture(120, "profile_trace.json");
+    }
+
+    // Frame time history, oldest frame first. Clicking a bar selects its frame
+    f32 history[PROFILER_HISTORY_FRAMES] = {};
+    for (u32 i = 0; i < profiler.frameCount; ++i)
+    {
+        const ProfileFrame* frame = GetHistoryFrame(profiler.frameCount - 1 - i);
+        history[i] = (frame->end - frame->start) / 1000000.0f;
+    }
+    ImGui::PlotHistogram("##FrameTimes", history, profiler.frameCount, 0, "Frame times (ms)", 0.0f, 50.0f, ImVec2(0.0f, 60.0f));
+    if (ImGui::IsItemClicked() && profiler.frameCount > 0)
+    {
+        f32 t = (ImGui::GetIO().MousePos.x - ImGui::GetItemRectMin().x) / ImGui::GetItemRectSize().x;
+        i32 index = (i32)(t * profiler.frameCount);
+        profiler.selectedFrame = (i32)profiler.frameCount - 1 - std::max(0, std::min(index, (i32)profiler.frameCount - 1));
+        profiler.paused = true;
+    }
+    if (!profiler.paused)
+        profiler.selectedFrame = -1;
+
+    const ProfileFrame* frame = GetHistoryFrame(profiler.selectedFrame < 0 ? 0 : profiler.selectedFrame);
+    if (frame)
+    {
+        GuiProfilerTimeline(*frame);
+        if (ImGui::CollapsingHeader("Zones", ImGuiTreeNodeFlags_DefaultOpen))
+            GuiProfilerZones(*frame);
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,85 @@
+//
+// profiler.h : Hierarchical CPU profiler. Scoped zones are recorded per thread and grouped in
+// frames, which are displayed as a timeline in the editor and can be exported as a Chrome trace
+// (chrome://tracing or https://ui.perfetto.dev). Define USE_PROFILER as 0 to compile it out.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#ifndef USE_PROFILER
+#define USE_PROFILER 1
+#endif
+
+#define PROFILER_HISTORY_FRAMES 240
+
+struct ProfileEvent
+{
+    const char* name;  // Must be a string literal, only the pointer is stored
+    u64         start; // Nanoseconds
+    u64         end;
+    u16         depth;
+    u16         threadIndex;
+};
+
+struct ProfileScope
+{
+    ProfileScope(const char* name);
+    ~ProfileScope();
+
+    const char* name;
+    u64         start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if USE_PROFILER
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_THREAD_NAME(name) ProfilerSetThreadName(name)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD_NAME(name)
+#endif
+
+/**
+ * Names the calling thread in the timeline and in the exported traces.
+ */
+void ProfilerSetThreadName(const char* name);
+
+/**
+ * Frame boundaries. Zones closed between both calls are shown in the timeline.
+ */
+void ProfilerBeginFrame();
+
+void ProfilerEndFrame();
+
+/**
+ * Records every zone of the following frames and writes them as a Chrome trace JSON file
+ * once the given number of frames has been captured.
+ */
+void ProfilerStartCapture(u32 frameCount, const char* filepath);
+
+bool ProfilerIsCapturing();
+
+/**
+ * Freezes the frame history shown in the editor. Frames keep being closed (and captured)
+ * but each one replaces the previous instead of being added to the history.
+ */
+void ProfilerSetPaused(bool paused);
+
+/**
+ * Duration in milliseconds of the last frame and of its zones with the given name.
+ */
+f32 ProfilerGetLastFrameMs();
+
+f32 ProfilerGetZoneMs(const char* name);
+
+/**
+ * Draws the profiler window: frame time history, timeline of the selected frame per
+ * thread and the list of zones sorted by their total time.
+ */
+void GuiProfiler();
@@ -0,0 +1,279 @@
+//
+// stress_scene.cpp : Implementation of the procedural stress scenes declared in stress_scene.h.
+//
+
+#include "stress_scene.h"
+#include "profiler.h"
+#include <imgui.h>
+#include <random>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define STRESS_CLUSTER_COUNT 8
+
+static const char* StressDistributionNames[STRESS_DISTRIBUTION_COUNT] = { "grid", "random", "clusters" };
+
+// Copies of a model that only differ in their albedo, created once and reused
+struct StressModelVariant
+{
+    u32 sourceModel;
+    u32 variant;
+    u32 model;
+};
+
+static std::vector<StressModelVariant> StressModelVariants;
+
+// Hues a golden ratio of the color wheel apart, so consecutive variants differ the most
+vec3 GetStressVariantTint(u32 variant)
+{
+    f32 hue = fmodf(variant * 0.618034f, 1.0f) * 6.0f;
+    vec3 tint = glm::clamp(vec3(fabsf(hue - 3.0f) - 1.0f, 2.0f - fabsf(hue - 2.0f), 2.0f - fabsf(hue - 4.0f)), 0.0f, 1.0f);
+    return glm::mix(vec3(1.0f), tint, 0.75f);
+}
+
+u32 GetStressModelVariant(App* app, u32 sourceModel, u32 variant)
+{
+    if (variant == 0)
+        return sourceModel;
+
+    for (const StressModelVariant& it : StressModelVariants)
+        if (it.sourceModel == sourceModel && it.variant == variant)
+            return it.model;
+
+    // Only color images make sense as albedo: not the normal or distortion maps, nor the
+    // placeholders of the engine
+    std::vector<u32> albedoTextures;
+    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
+    {
+        const Texture& tex = app->textures[texIdx];
+        bool placeholder = texIdx == app->whiteTexIdx || texIdx == app->blackTexIdx || texIdx == app->magentaTexIdx;
+        if (tex.usage == TEXTURE_USAGE_COLOR && tex.state != TEXTURE_STATE_MISSING && !placeholder)
+            albedoTextures.push_back(texIdx);
+    }
+
+    Model model = app->models[sourceModel];
+    model.filepath = ""; // Hot reloads go through the source model, which owns the mesh
+    for (u32& materialIdx : model.materialIdx)
+    {
+        Material material = app->materials[materialIdx];
+        material.name += " (stress " + std::to_string(variant) + ")";
+        if (!albedoTextures.empty())
+            material.albedoTextureIdx = albedoTextures[(variant - 1) % albedoTextures.size()];
+        else
+            material.albedo *= GetStressVariantTint(variant);
+        app->materials.push_back(material);
+        materialIdx = (u32)app->materials.size() - 1;
+    }
+    app->models.push_back(model);
+
+    u32 modelIdx = (u32)app->models.size() - 1;
+    StressModelVariants.push_back(StressModelVariant{ sourceModel, variant, modelIdx });
+    return modelIdx;
+}
+
+// The values come straight from the output of mt19937, which the standard defines, and not from
+// the std distributions, whose algorithms differ between standard libraries. Draws are
+// sequenced one per statement, since the evaluation order of arguments is unspecified.
+struct StressPlacement
+{
+    std::mt19937       random;
+    StressDistribution distribution;
+    f32                extent;
+    u32                gridSide;
+    vec2               clusters[STRESS_CLUSTER_COUNT];
+
+    StressPlacement(const StressSceneParams& params, u32 count, u32 seed)
+        : random(seed), distribution(params.distribution), extent(params.extent)
+    {
+        gridSide = (u32)ceilf(sqrtf((f32)count));
+        for (u32 i = 0; i < STRESS_CLUSTER_COUNT; ++i)
+            clusters[i] = Uniform2(-0.4f, 0.4f) * extent;
+    }
+
+    // [0, 1) from the top 24 bits, which a float holds exactly
+    f32 Unit() { return (random() >> 8) * (1.0f / 16777216.0f); }
+
+    f32 Uniform(f32 min, f32 max) { return min + (max - min) * Unit(); }
+
+    vec2 Uniform2(f32 min, f32 max)
+    {
+        f32 x = Uniform(min, max);
+        f32 y = Uniform(min, max);
+        return vec2(x, y);
+    }
+
+    vec3 Uniform3(f32 min, f32 max)
+    {
+        f32 x = Uniform(min, max);
+        f32 y = Uniform(min, max);
+        f32 z = Uniform(min, max);
+        return vec3(x, y, z);
+    }
+
+    // Approximately standard normal: the sum of 12 uniforms has mean 6 and variance 1
+    f32 Normal()
+    {
+        f32 sum = 0.0f;
+        for (u32 i = 0; i < 12; ++i)
+            sum += Unit();
+        return sum - 6.0f;
+    }
+
+    // Position on the ground plane of the i-th element
+    vec2 Place(u32 i)
+    {
+        switch (distribution)
+        {
+        case STRESS_GRID:
+        {
+            f32 spacing = extent / gridSide;
+            return vec2((i % gridSide) + 0.5f, (i / gridSide) + 0.5f) * spacing - vec2(extent * 0.5f);
+        }
+        case STRESS_CLUSTERS:
+        {
+            vec2 center = clusters[i % STRESS_CLUSTER_COUNT];
+            f32 x = Normal();
+            f32 y = Normal();
+            return center + vec2(x, y) * (extent * 0.05f);
+        }
+        case STRESS_RANDOM:
+        default:
+            return Uniform2(-0.5f, 0.5f) * extent;
+        }
+    }
+};
+
+void GenerateStressScene(App* app, const StressSceneParams& params)
+{
+    PROFILE_FUNCTION();
+
+    // Candidate models: the primitives and optionally whatever the scene had loaded
+    std::vector<u32> sourceModels = app->primitiveIndex;
+    if (params.useLoadedModels)
+    {
+        for (const Entity& entity : app->entities)
+            if (std::find(sourceModels.begin(), sourceModels.end(), entity.modelIndex) == sourceModels.end())
+                sourceModels.push_back(entity.modelIndex);
+    }
+
+    // Without primitives nor loaded models there is nothing to place, the scene stays as it was
+    if (sourceModels.empty())
+    {
+        LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_GENERAL, "Stress scene: there are no models to place");
+        return;
+    }
+
+    if (!params.keepScene)
+    {
+        app->entities.clear();
+        app->lights.clear();
+    }
+
+    u32 materialCount = params.materialCount > 0 ? params.materialCount : 1;
+    std::vector<u32> models;
+    for (u32 variant = 0; variant < materialCount; ++variant)
+        for (u32 source : sourceModels)
+            models.push_back(GetStressModelVariant(app, source, variant));
+
+    // Entities
+    StressPlacement entityPlacement(params, params.entityCount, params.seed);
+    app->entities.reserve(app->entities.size() + params.entityCount);
+    for (u32 i = 0; i < params.entityCount; ++i)
+    {
+        vec2 ground = entityPlacement.Place(i);
+        Entity entity;
+        entity.transform.position = vec3(ground.x, entityPlacement.Uniform(0.0f, params.extent * 0.1f), ground.y);
+        entity.transform.rotation = entityPlacement.Uniform3(0.0f, 360.0f);
+        entity.transform.scale = vec3(entityPlacement.Uniform(0.5f, 2.0f));
+        entity.worldMatrix = TransformConstructor(entity.transform);
+        entity.modelIndex = models[entityPlacement.random() % models.size()];
+        entity.name = "Stress Entity " + std::to_string(i);
+        app->entities.push_back(entity);
+    }
+
+    // Lights, with a radius that keeps a similar overlap whatever their number
+    StressPlacement lightPlacement(params, params.lightCount, params.seed * 31 + 7);
+    f32 radius = std::max(5.0f, 2.0f * params.extent / sqrtf((f32)std::max(1u, params.lightCount)));
+    app->lights.reserve(app->lights.size() + params.lightCount);
+    for (u32 i = 0; i < params.lightCount; ++i)
+    {
+        vec3 color = glm::normalize(lightPlacement.Uniform3(0.1f, 1.0f));
+        if (i == 0)
+        {
+            Light light = InstanceLight(DIRECTIONAL_LIGHT, "Stress Directional Light");
+            light.position = vec3(0.0f, params.extent * 0.25f, 0.0f);
+            light.direction = vec3(0.3f, 1.0f, 0.2f);
+            light.color = vec3(0.5f);
+            app->lights.push_back(light);
+            continue;
+        }
+
+        vec2 ground = lightPlacement.Place(i);
+        Light light = InstanceLight(POINT_LIGHT, "Stress Light " + std::to_string(i));
+        light.position = vec3(ground.x, lightPlacement.Uniform(1.0f, params.extent * 0.1f + 1.0f), ground.y);
+        light.color = color;
+        light.radius = radius;
+        app->lights.push_back(light);
+    }
+
+    ILOG("Stress scene: %u entities, %u lights, %u models (seed %u, %s)", (u32)app->entities.size(), (u32)app->lights.size(),
+         (u32)models.size(), params.seed, StressDistributionNames[params.distribution]);
+}
+
+bool ParseStressSceneArguments(int argc, char** argv, StressSceneParams& params)
+{
+    if (!HasArgument(argc, argv, "--stress-entities") && !HasArgument(argc, argv, "--stress-lights"))
+        return false;
+
+    params = StressSceneParams();
+    params.entityCount = atoi(GetArgumentValue(argc, argv, "--stress-entities", "1000"));
+    params.lightCount = atoi(GetArgumentValue(argc, argv, "--stress-lights", "16"));
+    params.seed = atoi(GetArgumentValue(argc, argv, "--stress-seed", "1"));
+    params.extent = (f32)atof(GetArgumentValue(argc, argv, "--stress-extent", "100"));
+    params.materialCount = atoi(GetArgumentValue(argc, argv, "--stress-materials", "1"));
+    params.useLoadedModels = HasArgument(argc, argv, "--stress-models");
+    params.keepScene = HasArgument(argc, argv, "--stress-keep-scene");
+
+    const char* distribution = GetArgumentValue(argc, argv, "--stress-distribution", "random");
+    for (u32 i = 0; i < STRESS_DISTRIBUTION_COUNT; ++i)
+        if (strcmp(distribution, StressDistributionNames[i]) == 0)
+            params.distribution = (StressDistribution)i;
+
+    return true;
+}
+
+void GuiStressScene(App* app)
+{
+    static StressSceneParams params;
+
+    if (!ImGui::CollapsingHeader("Stress Scene"))
+        return;
+
+    ImGui::Text("Current: %u entities, %u lights", (u32)app->entities.size(), (u32)app->lights.size());
+
+    int entityCount = (int)params.entityCount;
+    if (ImGui::DragInt("Entities", &entityCount, 10.0f, 0, 100000))
+        params.entityCount = (u32)entityCount;
+    int lightCount = (int)params.lightCount;
+    if (ImGui::DragInt("Lights", &lightCount, 1.0f, 0, 4096))
+        params.lightCount = (u32)lightCount;
+    int materialCount = (int)params.materialCount;
+    if (ImGui::SliderInt("Materials", &materialCount, 1, 16))
+        params.materialCount = (u32)materialCount;
+    int seed = (int)params.seed;
+    if (ImGui::InputInt("Seed", &seed))
+        params.seed = (u32)seed;
+    ImGui::DragFloat("Extent", &params.extent, 1.0f, 1.0f, 10000.0f);
+
+    int distribution = (int)params.distribution;
+    if (ImGui::Combo("Distribution", &distribution, StressDistributionNames, STRESS_DISTRIBUTION_COUNT))
+        params.distribution = (StressDistribution)distribution;
+
+    ImGui::Checkbox("Use loaded models", &params.useLoadedModels);
+    ImGui::Checkbox("Keep current scene", &params.keepScene);
+
+    if (ImGui::Button("Generate"))
+        GenerateStressScene(app, params);
+}
@@ -0,0 +1,50 @@
+//
+// stress_scene.h : Procedural scenes to measure how the renderer scales with the number of
+// entities and lights. Scenes are generated from a seed, so the same parameters give the same
+// scene, with any compiler and standard library. Available from the Inspector window and from
+// the command line:
+//
+//   --stress-entities N --stress-lights M [--stress-seed S] [--stress-distribution grid|random|clusters]
+//   [--stress-extent E] [--stress-materials K] [--stress-models] [--stress-keep-scene]
+//
+
+#pragma once
+
+#include "engine.h"
+
+enum StressDistribution
+{
+    STRESS_GRID,     // Regular grid filling the area
+    STRESS_RANDOM,   // Uniformly scattered
+    STRESS_CLUSTERS, // Gathered around a few random centers
+
+    STRESS_DISTRIBUTION_COUNT
+};
+
+struct StressSceneParams
+{
+    u32                entityCount = 1000;
+    u32                lightCount = 16;
+    u32                seed = 1;
+    StressDistribution distribution = STRESS_RANDOM;
+    f32                extent = 100.0f;   // Side of the square area the scene is spread over
+    u32                materialCount = 1; // Albedo variations of every model (1 keeps the original materials)
+    bool               useLoadedModels = false; // Also pick the models of the entities loaded in Init
+    bool               keepScene = false; // Add to the current entities and lights instead of replacing them
+};
+
+/**
+ * Replaces (or extends) the entities and lights of the scene. The first generated light is
+ * directional so every entity is lit, the rest are point lights.
+ */
+void GenerateStressScene(App* app, const StressSceneParams& params);
+
+/**
+ * Reads the --stress-* options. Returns false if no stress scene was requested.
+ */
+bool ParseStressSceneArguments(int argc, char** argv, StressSceneParams& params);
+
+/**
+ * Parameters and "Generate" button, drawn inside the Inspector window.
+ */
+void GuiStressScene(App* app);
@@ -0,0 +1,586 @@
+//
+// texture_cache.cpp : Implementation of the cooked textures declared in texture_cache.h.
+//
+// File layout (little endian, every level 16 byte aligned):
+//   CookedTextureHeader
+//   levels, from the smallest to the largest (RGBA8 rows or rows of blocks, tightly packed)
+//
+
+#include "texture_cache.h"
+#include "texture_compression.h"
+#include "profiler.h"
+#include "job_system.h"
+#include "texture_pages.h"
+#include <stb_image.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXTURE_CACHE_SSE2
+#endif
+
+#define COOKED_TEXTURE_ALIGNMENT 16
+
+struct CookedTextureLevel
+{
+    u64 offset;
+    u64 size;
+};
+
+struct CookedTextureHeader
+{
+    u32                magic;
+    u32                version;
+    u32                width;
+    u32                height;
+    u32                internalFormat;
+    u32                usage;
+    u32                levelCount;
+    u32                padding;
+    u64                fileSize;
+    u64                sourceSize; // Size and hash of the image file
+    u64                sourceHash;
+    CookedTextureLevel levels[COOKED_TEXTURE_MAX_LEVELS]; // Indexed by level, level 0 is the full size one
+};
+
+std::string GetCookedTexturePath(const char* filepath)
+{
+    std::string path = COOKED_TEXTURE_DIRECTORY "/";
+    if (filepath[0] == '.' && (filepath[1] == '/' || filepath[1] == '\\'))
+        filepath += 2;
+    for (const char* c = filepath; *c; ++c)
+        path.push_back(*c == '/' || *c == '\\' || *c == ':' ? '_' : *c);
+    return path + ".tex";
+}
+
+u64 AlignCookedTextureOffset(u64 offset)
+{
+    return (offset + COOKED_TEXTURE_ALIGNMENT - 1) & ~(u64)(COOKED_TEXTURE_ALIGNMENT - 1);
+}
+
+u32 GetMipLevelCount(u32 width, u32 height)
+{
+    u32 levelCount = 1;
+    for (u32 size = std::max(width, height); size > 1; size >>= 1)
+        ++levelCount;
+    return levelCount;
+}
+
+u32 GetMipSize(u32 size, u32 level)
+{
+    return std::max(size >> level, 1u);
+}
+
+u64 GetMipLevelSize(GLenum format, u32 width, u32 height, u32 level)
+{
+    return GetTextureLevelSize(format, GetMipSize(width, level), GetMipSize(height, level));
+}
+
+// Vertical pass of the downsampling: weighs 4 rows by 1 3 3 1 into 16-bit sums (up to 2040)
+void SumRowsRgba8(const u8* row0, const u8* row1, const u8* row2, const u8* row3, u32 count, u16* dst)
+{
+    u32 i = 0;
+#ifdef TEXTURE_CACHE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(row0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(row1 + i));
+        __m128i c = _mm_loadu_si128((const __m128i*)(row2 + i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(row3 + i));
+
+        __m128i outerLo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(d, zero));
+        __m128i outerHi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(d, zero));
+        __m128i innerLo = _mm_add_epi16(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+        __m128i innerHi = _mm_add_epi16(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+
+        __m128i sumLo = _mm_add_epi16(outerLo, _mm_add_epi16(innerLo, _mm_add_epi16(innerLo, innerLo)));
+        __m128i sumHi = _mm_add_epi16(outerHi, _mm_add_epi16(innerHi, _mm_add_epi16(innerHi, innerHi)));
+        _mm_storeu_si128((__m128i*)(dst + i), sumLo);
+        _mm_storeu_si128((__m128i*)(dst + i + 8), sumHi);
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = (u16)(row0[i] + row3[i] + 3 * (row1[i] + row2[i]));
+}
+
+// Horizontal pass of the downsampling: weighs 4 pixels of the summed row by 1 3 3 1 for every
+// destination pixel and normalizes by the 64 of both passes. The row starts with a copy of the
+// first source pixel, so destination pixel x reads the padded pixels 2x to 2x + 3.
+void FilterRowRgba8(const u16* row, u32 dstWidth, u8* dst)
+{
+    u32 x = 0;
+#ifdef TEXTURE_CACHE_SSE2
+    // 2 destination pixels (8 channels) per iteration
+    const __m128i round = _mm_set1_epi16(32);
+    for (; x + 2 <= dstWidth; x += 2)
+    {
+        const u16* p = row + x * 8;
+        __m128i a = _mm_loadu_si128((const __m128i*)p);        // Padded pixels 2x, 2x + 1
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + 8));  // 2x + 2, 2x + 3
+        __m128i c = _mm_loadu_si128((const __m128i*)(p + 16)); // 2x + 4, 2x + 5
+
+        __m128i tap0 = _mm_unpacklo_epi64(a, b);
+        __m128i tap1 = _mm_unpackhi_epi64(a, b);
+        __m128i tap2 = _mm_unpacklo_epi64(b, c);
+        __m128i tap3 = _mm_unpackhi_epi64(b, c);
+
+        __m128i inner = _mm_add_epi16(tap1, tap2);
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(tap0, tap3), _mm_add_epi16(inner, _mm_add_epi16(inner, inner)));
+        __m128i result = _mm_srli_epi16(_mm_add_epi16(sum, round), 6);
+        _mm_storel_epi64((__m128i*)(dst + x * 4), _mm_packus_epi16(result, result));
+    }
+#endif
+    for (; x < dstWidth; ++x)
+    {
+        const u16* p = row + x * 8;
+        for (u32 c = 0; c < 4; ++c)
+        {
+            u32 sum = p[c] + 3 * (p[4 + c] + p[8 + c]) + p[12 + c];
+            dst[x * 4 + c] = (u8)((sum + 32) >> 6);
+        }
+    }
+}
+
+void DownsampleRgba8(const u8* src, u32 width, u32 height, u8* dst)
+{
+    u32 dstWidth = std::max(width / 2, 1u);
+    u32 dstHeight = std::max(height / 2, 1u);
+
+    // Summed row with a pixel of padding on the left and as many as needed on the right, copies
+    // of the edge pixels (the filter clamps to the edges, as the textures do)
+    u32 paddedWidth = 2 * dstWidth + 2;
+    std::vector<u16> row(paddedWidth * 4);
+    u16* rowPixels = row.data() + 4;
+
+    for (u32 y = 0; y < dstHeight; ++y)
+    {
+        const u8* rows[4];
+        for (i32 i = 0; i < 4; ++i)
+        {
+            i32 srcY = std::min(std::max((i32)(2 * y) - 1 + i, 0), (i32)height - 1);
+            rows[i] = src + (u64)srcY * width * 4;
+        }
+        SumRowsRgba8(rows[0], rows[1], rows[2], rows[3], width * 4, rowPixels);
+
+        memcpy(row.data(), rowPixels, 4 * sizeof(u16));
+        for (u32 x = width + 1; x < paddedWidth; ++x)
+            memcpy(row.data() + x * 4, rowPixels + (width - 1) * 4, 4 * sizeof(u16));
+
+        FilterRowRgba8(row.data(), dstWidth, dst + (u64)y * dstWidth * 4);
+    }
+}
+
+bool DecodeImage(const u8* data, u64 size, bool flipVertically, Image& image)
+{
+    if (size > INT32_MAX)
+        return false;
+
+    // stb_image keeps the flag per thread, so it is set on every call
+    stbi_set_flip_vertically_on_load_thread(flipVertically ? 1 : 0);
+    image = {};
+    image.pixels = stbi_load_from_memory(data, (int)size, &image.size.x, &image.size.y, &image.nchannels, 0);
+    if (!image.pixels)
+        return false;
+
+    image.stride = image.size.x * image.nchannels;
+    return true;
+}
+
+u32 LoadUnaligned32(const u8* src)
+{
+    u32 value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+void ExpandToRgba8(const u8* src, u32 count, u32 channelCount, u8* dst)
+{
+    u32 x = 0;
+#ifdef TEXTURE_CACHE_SSE2
+    const __m128i opaque = _mm_set1_epi8((char)0xFF);
+    switch (channelCount)
+    {
+    case 1:
+        // Grey bytes interleaved with themselves and with the alpha: g g g 255
+        for (; x + 16 <= count; x += 16)
+        {
+            __m128i grey = _mm_loadu_si128((const __m128i*)(src + x));
+            __m128i greyGreyLo = _mm_unpacklo_epi8(grey, grey);
+            __m128i greyGreyHi = _mm_unpackhi_epi8(grey, grey);
+            __m128i greyAlphaLo = _mm_unpacklo_epi8(grey, opaque);
+            __m128i greyAlphaHi = _mm_unpackhi_epi8(grey, opaque);
+            _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_unpacklo_epi16(greyGreyLo, greyAlphaLo));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), _mm_unpackhi_epi16(greyGreyLo, greyAlphaLo));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 32), _mm_unpacklo_epi16(greyGreyHi, greyAlphaHi));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 48), _mm_unpackhi_epi16(greyGreyHi, greyAlphaHi));
+        }
+        break;
+    case 2:
+        // The grey byte of every pair doubled, interleaved with the pairs: g g g a
+        for (; x + 8 <= count; x += 8)
+        {
+            __m128i greyAlpha = _mm_loadu_si128((const __m128i*)(src + x * 2));
+            __m128i grey = _mm_and_si128(greyAlpha, _mm_set1_epi16(0x00FF));
+            __m128i greyGrey = _mm_or_si128(grey, _mm_slli_epi16(grey, 8));
+            _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_unpacklo_epi16(greyGrey, greyAlpha));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), _mm_unpackhi_epi16(greyGrey, greyAlpha));
+        }
+        break;
+    case 3:
+        // Every pixel read as 4 bytes, whose last one (the red of the next pixel) is replaced by
+        // the alpha. The last pixel is left to the scalar loop so nothing is read past the row
+        for (; x + 9 <= count; x += 8)
+        {
+            const u8* pixels = src + x * 3;
+            __m128i lo = _mm_setr_epi32(LoadUnaligned32(pixels), LoadUnaligned32(pixels + 3),
+                                        LoadUnaligned32(pixels + 6), LoadUnaligned32(pixels + 9));
+            __m128i hi = _mm_setr_epi32(LoadUnaligned32(pixels + 12), LoadUnaligned32(pixels + 15),
+                                        LoadUnaligned32(pixels + 18), LoadUnaligned32(pixels + 21));
+            _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_or_si128(lo, _mm_slli_epi32(opaque, 24)));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), _mm_or_si128(hi, _mm_slli_epi32(opaque, 24)));
+        }
+        break;
+    }
+#endif
+
+    src += x * channelCount;
+    dst += x * 4;
+    for (; x < count; ++x, src += channelCount, dst += 4)
+    {
+        switch (channelCount)
+        {
+        case 1: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 255; break;
+        case 2: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+        case 3: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255; break;
+        default: memcpy(dst, src, 4); break;
+        }
+    }
+}
+
+void BuildTextureMips(TextureMips& mips, const Image& image)
+{
+    PROFILE_FUNCTION();
+
+    mips.width = (u32)image.size.x;
+    mips.height = (u32)image.size.y;
+    mips.internalFormat = image.nchannels == 2 || image.nchannels == 4 ? GL_RGBA8 : GL_RGB8;
+    mips.levelCount = GetMipLevelCount(mips.width, mips.height);
+
+    u64 offsets[COOKED_TEXTURE_MAX_LEVELS];
+    u64 size = 0;
+    for (u32 level = 0; level < mips.levelCount; ++level)
+    {
+        offsets[level] = size;
+        size += GetMipLevelSize(mips.internalFormat, mips.width, mips.height, level);
+    }
+    mips.pixels.resize(size);
+    for (u32 level = 0; level < mips.levelCount; ++level)
+        mips.levels[level] = mips.pixels.data() + offsets[level];
+
+    // Level 0: expand to RGBA8, grey images to grey RGB
+    for (u32 y = 0; y < mips.height; ++y)
+        ExpandToRgba8((const u8*)image.pixels + (u64)y * image.stride, mips.width, image.nchannels,
+                      mips.pixels.data() + (u64)y * mips.width * 4);
+
+    for (u32 level = 1; level < mips.levelCount; ++level)
+        DownsampleRgba8(mips.levels[level - 1], GetMipSize(mips.width, level - 1), GetMipSize(mips.height, level - 1),
+                        mips.pixels.data() + offsets[level]);
+}
+
+bool IsCookedTextureValid(FileView file, TextureUsage usage, u64 sourceSize, u64 sourceHash)
+{
+    if (file.size < sizeof(CookedTextureHeader))
+        return false;
+
+    const CookedTextureHeader* header = (const CookedTextureHeader*)file.data;
+    if (header->magic != COOKED_TEXTURE_MAGIC || header->version != COOKED_TEXTURE_VERSION ||
+        header->fileSize != file.size || header->usage != (u32)usage || header->sourceSize != sourceSize ||
+        header->sourceHash != sourceHash)
+        return false;
+
+    if (header->width == 0 || header->height == 0 || header->levelCount > COOKED_TEXTURE_MAX_LEVELS ||
+        header->levelCount != GetMipLevelCount(header->width, header->height) ||
+        (header->internalFormat != GL_RGB8 && header->internalFormat != GL_RGBA8 &&
+         !IsCompressedTextureFormat(header->internalFormat)))
+        return false;
+
+    for (u32 level = 0; level < header->levelCount; ++level)
+    {
+        const CookedTextureLevel& cookedLevel = header->levels[level];
+        if (cookedLevel.size != GetMipLevelSize(header->internalFormat, header->width, header->height, level) ||
+            cookedLevel.offset < sizeof(CookedTextureHeader) || cookedLevel.offset > file.size ||
+            cookedLevel.size > file.size - cookedLevel.offset)
+            return false;
+    }
+
+    return true;
+}
+
+bool LoadCookedTexture(TextureMips& mips, const char* filepath, TextureUsage usage, u64 sourceSize, u64 sourceHash)
+{
+    std::string cookedPath = GetCookedTexturePath(filepath);
+    FileView file = MapFile(cookedPath.c_str());
+    if (!file.data)
+        return false;
+
+    if (!IsCookedTextureValid(file, usage, sourceSize, sourceHash))
+    {
+        LOG_MESSAGE(LOG_LEVEL_INFO, LOG_ASSETS, "Cooked texture %s is outdated, decoding %s", cookedPath, filepath);
+        UnmapFile(file);
+        return false;
+    }
+
+    const CookedTextureHeader* header = (const CookedTextureHeader*)file.data;
+    mips.width = header->width;
+    mips.height = header->height;
+    mips.internalFormat = header->internalFormat;
+    mips.levelCount = header->levelCount;
+    for (u32 level = 0; level < mips.levelCount; ++level)
+        mips.levels[level] = file.data + header->levels[level].offset;
+    mips.file = file;
+    return true;
+}
+
+bool WriteCookedTexture(const char* filepath, const TextureMips& mips, TextureUsage usage, u64 sourceSize, u64 sourceHash)
+{
+    PROFILE_FUNCTION();
+
+    CookedTextureHeader header = {};
+    header.magic = COOKED_TEXTURE_MAGIC;
+    header.version = COOKED_TEXTURE_VERSION;
+    header.width = mips.width;
+    header.height = mips.height;
+    header.internalFormat = mips.internalFormat;
+    header.usage = usage;
+    header.levelCount = mips.levelCount;
+    header.sourceSize = sourceSize;
+    header.sourceHash = sourceHash;
+
+    // Smallest level first, so the ones a streamer would upload first come first in the file
+    u64 offset = AlignCookedTextureOffset(sizeof(CookedTextureHeader));
+    for (u32 level = mips.levelCount; level-- > 0;)
+    {
+        header.levels[level].offset = offset;
+        header.levels[level].size = GetMipLevelSize(mips.internalFormat, mips.width, mips.height, level);
+        offset = AlignCookedTextureOffset(offset + header.levels[level].size);
+    }
+    header.fileSize = offset;
+
+    std::vector<u8> contents(header.fileSize);
+    memcpy(contents.data(), &header, sizeof(header));
+    for (u32 level = 0; level < mips.levelCount; ++level)
+        memcpy(contents.data() + header.levels[level].offset, mips.levels[level], header.levels[level].size);
+
+    std::string cookedPath = GetCookedTexturePath(filepath);
+    if (!CreateDirectoryIfMissing(COOKED_TEXTURE_DIRECTORY) || !WriteBinaryFile(cookedPath.c_str(), contents.data(), header.fileSize))
+        return false;
+
+    LOG_MESSAGE(LOG_LEVEL_DEBUG, LOG_ASSETS, "Cooked %s into %s (%llu bytes)", filepath, cookedPath, header.fileSize);
+    return true;
+}
+
+bool PrepareTextureMips(TextureMips& mips, const char* filepath, TextureUsage usage)
+{
+    FileView source = MapFile(filepath);
+    if (!source.data)
+    {
+        UnmapFile(source);
+        return false;
+    }
+    return PrepareTextureMips(mips, filepath, usage, source, HashBytes(source.data, source.size));
+}
+
+bool PrepareTextureMips(TextureMips& mips, const char* filepath, TextureUsage usage, FileView source, u64 sourceHash)
+{
+    PROFILE_FUNCTION();
+
+    if (source.size > INT32_MAX)
+    {
+        UnmapFile(source);
+        return false;
+    }
+
+    if (LoadCookedTexture(mips, filepath, usage, source.size, sourceHash))
+    {
+        UnmapFile(source);
+        return true;
+    }
+
+    Image image;
+    bool decoded = DecodeImage(source.data, source.size, true, image);
+    u64 sourceSize = source.size;
+    UnmapFile(source);
+    if (!decoded)
+        return false;
+
+    BuildTextureMips(mips, image);
+    FreeImage(image);
+
+    GLenum format = ChooseTextureFormat(mips, usage);
+    if (format != mips.internalFormat)
+    {
+        u64 uncompressedSize = mips.pixels.size();
+        f32 psnr = CompressTextureMips(mips, format);
+        LOG_MESSAGE(LOG_LEVEL_INFO, LOG_ASSETS, "Compressed %s to %s: %llu KB to %llu KB, PSNR %.2f dB", filepath,
+                    GetTextureFormatName(format), uncompressedSize / 1024, (u64)mips.pixels.size() / 1024, psnr);
+    }
+
+    WriteCookedTexture(filepath, mips, usage, sourceSize, sourceHash);
+    return true;
+}
+
+struct TextureMipsBatch
+{
+    TextureMips*        mips;
+    const char* const*  filepaths;
+    const TextureUsage* usages;
+};
+
+void PrepareTextureMipsRange(void* data, u32 begin, u32 end)
+{
+    TextureMipsBatch* batch = (TextureMipsBatch*)data;
+    for (u32 i = begin; i < end; ++i)
+        PrepareTextureMips(batch->mips[i], batch->filepaths[i], batch->usages[i]);
+}
+
+void PrepareTextureMipsBatch(TextureMips* mips, const char* const* filepaths, const TextureUsage* usages, u32 count)
+{
+    PROFILE_FUNCTION();
+    TextureMipsBatch batch = { mips, filepaths, usages };
+    ParallelFor(count, 1, PrepareTextureMipsRange, &batch);
+}
+
+// Storage format of the mips, compressed formats that the driver doesn't sample are decoded
+GLenum GetTextureStorageFormat(const TextureMips& mips)
+{
+    if (IsCompressedTextureFormat(mips.internalFormat) && !IsCompressedTextureFormatSupported(mips.internalFormat))
+        return GL_RGBA8;
+    return mips.internalFormat;
+}
+
+// Uploads every level into the bound texture, whose storage has been allocated
+void UploadTextureMips(GLenum target, const TextureMips& mips)
+{
+    GLenum storageFormat = GetTextureStorageFormat(mips);
+    std::vector<u8> decoded;
+    for (u32 level = 0; level < mips.levelCount; ++level)
+    {
+        u32 width = GetMipSize(mips.width, level);
+        u32 height = GetMipSize(mips.height, level);
+        const u8* pixels = mips.levels[level];
+        if (storageFormat == mips.internalFormat && IsCompressedTextureFormat(storageFormat))
+        {
+            GLsizei size = (GLsizei)GetTextureLevelSize(storageFormat, width, height);
+            glCompressedTexSubImage2D(target, level, 0, 0, width, height, storageFormat, size, pixels);
+            continue;
+        }
+
+        if (storageFormat != mips.internalFormat)
+        {
+            decoded.resize((u64)width * height * 4);
+            DecompressTextureLevel(mips.internalFormat, pixels, width, height, decoded.data());
+            pixels = decoded.data();
+        }
+        glTexSubImage2D(target, level, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+}
+
+void DecompressUnsupportedTextureMips(TextureMips& mips)
+{
+    if (GetTextureStorageFormat(mips) == mips.internalFormat)
+        return;
+
+    PROFILE_FUNCTION();
+    u64 offsets[COOKED_TEXTURE_MAX_LEVELS];
+    u64 size = 0;
+    for (u32 level = 0; level < mips.levelCount; ++level)
+    {
+        offsets[level] = size;
+        size += GetMipLevelSize(GL_RGBA8, mips.width, mips.height, level);
+    }
+
+    std::vector<u8> pixels(size);
+    for (u32 level = 0; level < mips.levelCount; ++level)
+        DecompressTextureLevel(mips.internalFormat, mips.levels[level], GetMipSize(mips.width, level),
+                               GetMipSize(mips.height, level), pixels.data() + offsets[level]);
+
+    UnmapFile(mips.file);
+    mips.file = {};
+    mips.pixels.swap(pixels);
+    mips.internalFormat = GL_RGBA8;
+    for (u32 level = 0; level < mips.levelCount; ++level)
+        mips.levels[level] = mips.pixels.data() + offsets[level];
+}
+
+u64 GetMipChainSize(GLenum format, u32 width, u32 height, u32 firstLevel, u32 levelCount)
+{
+    u64 size = 0;
+    for (u32 level = firstLevel; level < levelCount; ++level)
+        size += GetMipLevelSize(format, width, height, level);
+    return size;
+}
+
+u64 GetTextureMemorySize(const TextureMips& mips, u32 firstLevel)
+{
+    return GetMipChainSize(GetTextureStorageFormat(mips), mips.width, mips.height, firstLevel, mips.levelCount);
+}
+
+GLuint CreateTexture2DStorage(GLenum format, u32 width, u32 height, u32 levelCount)
+{
+    return CreateTextureLayer(format, width, height, levelCount);
+}
+
+GLuint CreateTexture2DStorage(const TextureMips& mips, u32 firstLevel)
+{
+    return CreateTexture2DStorage(GetTextureStorageFormat(mips), GetMipSize(mips.width, firstLevel),
+                                  GetMipSize(mips.height, firstLevel), mips.levelCount - firstLevel);
+}
+
+GLuint CreateTexture2DFromMips(const TextureMips& mips)
+{
+    PROFILE_FUNCTION();
+
+    GLuint texHandle = CreateTexture2DStorage(mips);
+    glBindTexture(GL_TEXTURE_2D, texHandle);
+    UploadTextureMips(GL_TEXTURE_2D, mips);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texHandle;
+}
+
+GLuint CreateCubemapFromMips(const TextureMips* faces)
+{
+    PROFILE_FUNCTION();
+
+    GLuint texHandle;
+    glGenTextures(1, &texHandle);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texHandle);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, faces[0].levelCount, GetTextureStorageFormat(faces[0]), faces[0].width, faces[0].height);
+    for (u32 face = 0; face < 6; ++face)
+    {
+        if (faces[face].width != faces[0].width || faces[face].height != faces[0].height ||
+            faces[face].internalFormat != faces[0].internalFormat)
+        {
+            LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_ASSETS, "Face %u of the cube map doesn't match the first one", face);
+            continue;
+        }
+        UploadTextureMips(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, faces[face]);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    return texHandle;
+}
+
+void ReleaseTextureMips(TextureMips& mips)
+{
+    UnmapFile(mips.file);
+    mips.file = {};
+    std::vector<u8>().swap(mips.pixels);
+    mips.levelCount = 0;
+}
@@ -0,0 +1,137 @@
+//
+// texture_cache.h : Cooked textures. The first time an image file is loaded as a texture, it is
+// decoded, its whole mip chain is built and the chain is written to a container in the Cooked
+// directory, laid out like KTX2: a header with the level index, then the levels from the
+// smallest to the largest, as the GPU takes them. Later launches map that file and upload its
+// levels straight into immutable texture storage, skipping the decoding, the mip generation and
+// the block compression (see texture_compression.h). The container stores a hash of the image
+// file, so editing it cooks the texture again.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define COOKED_TEXTURE_DIRECTORY  "Cooked"
+#define COOKED_TEXTURE_MAGIC      0x58455445 // "ETEX"
+#define COOKED_TEXTURE_VERSION    2          // Increase when the format or the mip generation changes
+#define COOKED_TEXTURE_MAX_LEVELS 16         // Up to 32768 pixels wide
+
+/**
+ * Mip chain of a texture, ready to be uploaded. The levels are RGBA8 (the alpha of RGB8
+ * textures is ignored) or compressed blocks, and point either into the mapped cooked file or
+ * into pixels.
+ */
+struct TextureMips
+{
+    u32             width;
+    u32             height;
+    GLenum          internalFormat; // GL_RGB8, GL_RGBA8 or one of the compressed formats
+    u32             levelCount;
+    const u8*       levels[COOKED_TEXTURE_MAX_LEVELS]; // Level 0 is the full size one
+    FileView        file;
+    std::vector<u8> pixels;
+};
+
+u32 GetMipLevelCount(u32 width, u32 height);
+
+u32 GetMipSize(u32 size, u32 level);
+
+/**
+ * Bytes of a level of a texture whose level 0 is width x height.
+ */
+u64 GetMipLevelSize(GLenum format, u32 width, u32 height, u32 level);
+
+/**
+ * Bytes of the levels from firstLevel to the smallest one.
+ */
+u64 GetMipChainSize(GLenum format, u32 width, u32 height, u32 firstLevel, u32 levelCount);
+
+/**
+ * Halves an RGBA8 image (down to 1 pixel per side) with a separable [1 3 3 1] tent filter,
+ * which keeps more detail than averaging 2x2 blocks without aliasing. Uses SSE2 when available.
+ * dst holds max(width / 2, 1) x max(height / 2, 1) pixels.
+ */
+void DownsampleRgba8(const u8* src, u32 width, u32 height, u8* dst);
+
+/**
+ * Decodes an image file in memory with stb_image, flipped vertically (as the engine expects
+ * except for glTF) if asked. The flag only applies to this call, so decodes with and without
+ * flipping can run on several threads at once. The pixels are freed with FreeImage.
+ */
+bool DecodeImage(const u8* data, u64 size, bool flipVertically, Image& image);
+
+/**
+ * Expands a row of 1 (grey), 2 (grey and alpha), 3 (RGB) or 4 channel pixels to RGBA8, with
+ * SSE2 when available.
+ */
+void ExpandToRgba8(const u8* src, u32 count, u32 channelCount, u8* dst);
+
+/**
+ * Converts a decoded image to RGBA8 and builds its mip chain in mips.pixels.
+ */
+void BuildTextureMips(TextureMips& mips, const Image& image);
+
+/**
+ * Fills mips from the cooked version of an image file, or decodes the image (flipped
+ * vertically, as the engine expects), builds its mips, compresses them in the format of the
+ * usage and cooks it when the cooked version is missing or outdated. Doesn't touch GL, so
+ * textures can be prepared on worker threads. Returns false, logging nothing, if the image can't
+ * be read.
+ */
+bool PrepareTextureMips(TextureMips& mips, const char* filepath, TextureUsage usage);
+
+/**
+ * Same, from the image file already mapped, and hashed with HashBytes. Unmaps it.
+ */
+bool PrepareTextureMips(TextureMips& mips, const char* filepath, TextureUsage usage, FileView source, u64 sourceHash);
+
+/**
+ * Prepares several textures in parallel on the job system. The mips of the files that can't be
+ * read are left without levels.
+ */
+void PrepareTextureMipsBatch(TextureMips* mips, const char* const* filepaths, const TextureUsage* usages, u32 count);
+
+/**
+ * Decodes the levels to RGBA8, into mips.pixels, if the driver doesn't sample their compressed
+ * format. Doesn't touch GL, so it can run on the workers that prepare the mips.
+ */
+void DecompressUnsupportedTextureMips(TextureMips& mips);
+
+/**
+ * Bytes of GPU memory that the storage of the mips takes, from firstLevel down.
+ */
+u64 GetTextureMemorySize(const TextureMips& mips, u32 firstLevel = 0);
+
+/**
+ * Creates a texture for levelCount levels, sampled trilinearly, in a layer of a texture page
+ * (see texture_pages.h), and leaves its levels to be uploaded. Delete it with DeleteTextureLayer.
+ */
+GLuint CreateTexture2DStorage(GLenum format, u32 width, u32 height, u32 levelCount);
+
+/**
+ * Same, for the chain of the mips from firstLevel down: level firstLevel of the mips is level 0
+ * of the texture.
+ */
+GLuint CreateTexture2DStorage(const TextureMips& mips, u32 firstLevel = 0);
+
+/**
+ * Creates a texture for the whole mip chain, in a layer of a texture page, and uploads it.
+ */
+GLuint CreateTexture2DFromMips(const TextureMips& mips);
+
+/**
+ * Creates a cube map from the mips of its 6 faces, in the order of the GL_TEXTURE_CUBE_MAP_*
+ * targets. Faces whose size or format differs from the first one are left empty.
+ */
+GLuint CreateCubemapFromMips(const TextureMips* faces);
+
+/**
+ * Unmaps the cooked file or frees the pixels of the mips.
+ */
+void ReleaseTextureMips(TextureMips& mips);
+
+/**
+ * Path of the cooked file of an image, e.g. "Cooked/Patrick_Color.png.tex".
+ */
+std::string GetCookedTexturePath(const char* filepath);
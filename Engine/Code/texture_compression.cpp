@@ -0,0 +1,991 @@
+//
+// texture_compression.cpp : Implementation of the block compression declared in
+// texture_compression.h.
+//
+
+#include "texture_compression.h"
+#include "job_system.h"
+#include "profiler.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXTURE_COMPRESSION_SSE2
+#endif
+
+#define BLOCK_PIXEL_COUNT       16
+#define BLOCK_REFINEMENT_PASSES 2  // Least squares fits of the endpoints after the first guess
+#define BLOCK_AXIS_ITERATIONS   8  // Power iterations to find the principal axis of the colors
+
+static bool GlobalS3tcSupported = false;
+
+// Pixels of a block, one array per channel so that SSE2 handles 4 pixels at a time
+struct BlockPixels
+{
+    alignas(16) f32 channels[4][BLOCK_PIXEL_COUNT];
+};
+
+// Weight of the second endpoint for every index, in the order of the palettes
+static const f32 Bc1Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+static const f32 Bc4Weights[8] = { 0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f };
+static const u32 Bc7Weights2[4] = { 0, 21, 43, 64 };
+static const f32 Bc7Weights2F[4] = { 0 / 64.0f, 21 / 64.0f, 43 / 64.0f, 64 / 64.0f };
+static const u32 Bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+static const f32 Bc7Weights4F[16] =
+{
+    0 / 64.0f, 4 / 64.0f, 9 / 64.0f, 13 / 64.0f, 17 / 64.0f, 21 / 64.0f, 26 / 64.0f, 30 / 64.0f,
+    34 / 64.0f, 38 / 64.0f, 43 / 64.0f, 47 / 64.0f, 51 / 64.0f, 55 / 64.0f, 60 / 64.0f, 64 / 64.0f,
+};
+
+void InitTextureCompression(const OpenGLInfo& glInfo)
+{
+    GlobalS3tcSupported = false;
+    for (const std::string& extension : glInfo.glExtensions)
+    {
+        if (extension == "GL_EXT_texture_compression_s3tc")
+        {
+            GlobalS3tcSupported = true;
+            break;
+        }
+    }
+
+    if (!GlobalS3tcSupported)
+        LOG_MESSAGE(LOG_LEVEL_WARNING, LOG_RENDER, "BC1 and BC3 textures are not supported, they will be decoded on upload");
+}
+
+bool IsCompressedTextureFormat(GLenum format)
+{
+    switch (format)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_RED_RGTC1:
+    case GL_COMPRESSED_RG_RGTC2:
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool IsCompressedTextureFormatSupported(GLenum format)
+{
+    if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        return GlobalS3tcSupported;
+    return IsCompressedTextureFormat(format);
+}
+
+const char* GetTextureFormatName(GLenum format)
+{
+    switch (format)
+    {
+    case GL_RGB8:                           return "RGB8";
+    case GL_RGBA8:                          return "RGBA8";
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:   return "BC1";
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:  return "BC3";
+    case GL_COMPRESSED_RED_RGTC1:           return "BC4";
+    case GL_COMPRESSED_RG_RGTC2:            return "BC5";
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:     return "BC7";
+    default:                                return "Unknown";
+    }
+}
+
+u32 GetBlockBytes(GLenum format)
+{
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+}
+
+u32 GetBlockCount(u32 size)
+{
+    return (size + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+}
+
+u64 GetTextureLevelSize(GLenum format, u32 width, u32 height)
+{
+    if (IsCompressedTextureFormat(format))
+        return (u64)GetBlockCount(width) * GetBlockCount(height) * GetBlockBytes(format);
+    return (u64)width * height * 4;
+}
+
+GLenum ChooseTextureFormat(const TextureMips& mips, TextureUsage usage)
+{
+    // Only the top level has to be made of whole blocks, the driver pads the smaller ones
+    if (mips.width % TEXTURE_BLOCK_SIZE != 0 || mips.height % TEXTURE_BLOCK_SIZE != 0)
+        return mips.internalFormat;
+
+    if (usage == TEXTURE_USAGE_MASK)
+        return GL_COMPRESSED_RED_RGTC1;
+    if (usage == TEXTURE_USAGE_VECTOR)
+        return GL_COMPRESSED_RG_RGTC2;
+
+    // The alpha of RGB8 mips is always 255
+    bool opaque = true;
+    bool grey = true;
+    const u8* pixel = mips.levels[0];
+    for (u64 i = 0, count = (u64)mips.width * mips.height; i < count && (opaque || grey); ++i, pixel += 4)
+    {
+        opaque = opaque && pixel[3] == 255;
+        grey = grey && pixel[0] == pixel[1] && pixel[1] == pixel[2];
+    }
+
+    if (opaque)
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    return grey ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_BPTC_UNORM;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Endpoint fitting, shared by the formats
+
+void LoadBlockPixels(const u8* pixels, u32 width, u32 height, u32 blockX, u32 blockY, BlockPixels& block)
+{
+    for (u32 y = 0; y < TEXTURE_BLOCK_SIZE; ++y)
+    {
+        u32 srcY = std::min(blockY * TEXTURE_BLOCK_SIZE + y, height - 1);
+        for (u32 x = 0; x < TEXTURE_BLOCK_SIZE; ++x)
+        {
+            u32 srcX = std::min(blockX * TEXTURE_BLOCK_SIZE + x, width - 1);
+            const u8* src = pixels + ((u64)srcY * width + srcX) * 4;
+            for (u32 c = 0; c < 4; ++c)
+                block.channels[c][y * TEXTURE_BLOCK_SIZE + x] = src[c];
+        }
+    }
+}
+
+// Writes the index of the palette entry closest to every pixel, over the first channelCount
+// channels, and returns the total squared error
+f32 FindClosestIndices(const BlockPixels& block, const f32 (*palette)[4], u32 paletteSize, u32 channelCount, u8* indices)
+{
+#ifdef TEXTURE_COMPRESSION_SSE2
+    // The palette entries go through the 4 groups of 4 pixels, whose channels stay in registers
+    __m128 pixels[4][4];
+    __m128 best[4];
+    __m128 bestIndex[4];
+    for (u32 group = 0; group < 4; ++group)
+    {
+        for (u32 c = 0; c < channelCount; ++c)
+            pixels[group][c] = _mm_load_ps(&block.channels[c][group * 4]);
+        best[group] = _mm_set1_ps(FLT_MAX);
+        bestIndex[group] = _mm_setzero_ps();
+    }
+
+    for (u32 entry = 0; entry < paletteSize; ++entry)
+    {
+        __m128 entryChannels[4];
+        for (u32 c = 0; c < channelCount; ++c)
+            entryChannels[c] = _mm_set1_ps(palette[entry][c]);
+        __m128 entryIndex = _mm_set1_ps((f32)entry);
+
+        for (u32 group = 0; group < 4; ++group)
+        {
+            __m128 error = _mm_setzero_ps();
+            for (u32 c = 0; c < channelCount; ++c)
+            {
+                __m128 d = _mm_sub_ps(pixels[group][c], entryChannels[c]);
+                error = _mm_add_ps(error, _mm_mul_ps(d, d));
+            }
+            __m128 closer = _mm_cmplt_ps(error, best[group]);
+            best[group] = _mm_min_ps(error, best[group]);
+            bestIndex[group] = _mm_or_ps(_mm_and_ps(closer, entryIndex), _mm_andnot_ps(closer, bestIndex[group]));
+        }
+    }
+
+    __m128 total = _mm_setzero_ps();
+    for (u32 group = 0; group < 4; ++group)
+    {
+        total = _mm_add_ps(total, best[group]);
+
+        alignas(16) i32 lanes[4];
+        _mm_store_si128((__m128i*)lanes, _mm_cvttps_epi32(bestIndex[group]));
+        for (u32 j = 0; j < 4; ++j)
+            indices[group * 4 + j] = (u8)lanes[j];
+    }
+
+    alignas(16) f32 sums[4];
+    _mm_store_ps(sums, total);
+    return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+    f32 total = 0.0f;
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+    {
+        f32 best = FLT_MAX;
+        for (u32 entry = 0; entry < paletteSize; ++entry)
+        {
+            f32 error = 0.0f;
+            for (u32 c = 0; c < channelCount; ++c)
+            {
+                f32 d = block.channels[c][i] - palette[entry][c];
+                error += d * d;
+            }
+            if (error < best)
+            {
+                best = error;
+                indices[i] = (u8)entry;
+            }
+        }
+        total += best;
+    }
+    return total;
+#endif
+}
+
+// Initial endpoints: the extremes of the block colors along their principal axis, which is
+// found by power iteration on their covariance
+void FitBlockEndpoints(const BlockPixels& block, u32 channelCount, f32* endpoint0, f32* endpoint1)
+{
+    f32 mean[4] = {};
+    for (u32 c = 0; c < channelCount; ++c)
+    {
+        for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+            mean[c] += block.channels[c][i];
+        mean[c] /= BLOCK_PIXEL_COUNT;
+    }
+
+    f32 covariance[4][4] = {};
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        for (u32 a = 0; a < channelCount; ++a)
+            for (u32 b = a; b < channelCount; ++b)
+                covariance[a][b] += (block.channels[a][i] - mean[a]) * (block.channels[b][i] - mean[b]);
+
+    // Start from the channel that varies the most, it can't be orthogonal to the axis
+    u32 start = 0;
+    for (u32 a = 0; a < channelCount; ++a)
+    {
+        for (u32 b = 0; b < a; ++b)
+            covariance[a][b] = covariance[b][a];
+        if (covariance[a][a] > covariance[start][start])
+            start = a;
+    }
+
+    f32 axis[4] = {};
+    for (u32 c = 0; c < channelCount; ++c)
+        axis[c] = covariance[start][c];
+    for (u32 iteration = 0; iteration < BLOCK_AXIS_ITERATIONS; ++iteration)
+    {
+        f32 next[4] = {};
+        f32 largest = 0.0f;
+        for (u32 a = 0; a < channelCount; ++a)
+        {
+            for (u32 b = 0; b < channelCount; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            largest = std::max(largest, fabsf(next[a]));
+        }
+        if (largest == 0.0f)
+            break;
+        for (u32 c = 0; c < channelCount; ++c)
+            axis[c] = next[c] / largest;
+    }
+
+    f32 length = 0.0f;
+    for (u32 c = 0; c < channelCount; ++c)
+        length += axis[c] * axis[c];
+    length = sqrtf(length);
+
+    f32 minT = 0.0f, maxT = 0.0f;
+    if (length > 0.0f)
+    {
+        for (u32 c = 0; c < channelCount; ++c)
+            axis[c] /= length;
+
+        minT = FLT_MAX;
+        maxT = -FLT_MAX;
+        for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        {
+            f32 t = 0.0f;
+            for (u32 c = 0; c < channelCount; ++c)
+                t += (block.channels[c][i] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+    }
+
+    for (u32 c = 0; c < channelCount; ++c)
+    {
+        endpoint0[c] = std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+        endpoint1[c] = std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+    }
+}
+
+// Least squares endpoints for the chosen indices, weights holds the weight of the second
+// endpoint for every index. Returns false if the indices don't determine them.
+bool RefineBlockEndpoints(const BlockPixels& block, u32 channelCount, const u8* indices, const f32* weights,
+                          f32* endpoint0, f32* endpoint1)
+{
+    f32 a = 0.0f, b = 0.0f, c = 0.0f;
+    f32 rhs0[4] = {}, rhs1[4] = {};
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+    {
+        f32 w = weights[indices[i]];
+        a += (1.0f - w) * (1.0f - w);
+        b += (1.0f - w) * w;
+        c += w * w;
+        for (u32 channel = 0; channel < channelCount; ++channel)
+        {
+            rhs0[channel] += (1.0f - w) * block.channels[channel][i];
+            rhs1[channel] += w * block.channels[channel][i];
+        }
+    }
+
+    f32 determinant = a * c - b * b;
+    if (fabsf(determinant) < 1e-6f)
+        return false;
+
+    for (u32 channel = 0; channel < channelCount; ++channel)
+    {
+        f32 e0 = (c * rhs0[channel] - b * rhs1[channel]) / determinant;
+        f32 e1 = (a * rhs1[channel] - b * rhs0[channel]) / determinant;
+        endpoint0[channel] = std::min(std::max(e0, 0.0f), 255.0f);
+        endpoint1[channel] = std::min(std::max(e1, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+u8 QuantizeUnorm8(f32 value)
+{
+    return (u8)std::min(std::max(value + 0.5f, 0.0f), 255.0f);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BC1: two RGB565 endpoints and 2-bit indices into 4 colors
+
+u16 QuantizeRgb565(const f32* color)
+{
+    u32 r = (u32)std::min(color[0] * 31.0f / 255.0f + 0.5f, 31.0f);
+    u32 g = (u32)std::min(color[1] * 63.0f / 255.0f + 0.5f, 63.0f);
+    u32 b = (u32)std::min(color[2] * 31.0f / 255.0f + 0.5f, 31.0f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+void ExpandRgb565(u16 color, u32* rgb)
+{
+    u32 r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Colors of a block, as decoded. BC3 blocks always use 4 colors, BC1 blocks use 3 and black
+// when the first endpoint isn't the largest.
+void GetBc1Palette(u16 color0, u16 color1, bool fourColors, u32 (*palette)[4])
+{
+    ExpandRgb565(color0, palette[0]);
+    ExpandRgb565(color1, palette[1]);
+    for (u32 c = 0; c < 3; ++c)
+    {
+        if (fourColors || color0 > color1)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    for (u32 i = 0; i < 4; ++i)
+        palette[i][3] = 255;
+}
+
+// Only writes 4 color blocks, which are valid in BC3 too
+void EncodeBc1Block(const BlockPixels& block, u8* dst)
+{
+    f32 endpoint0[4], endpoint1[4];
+    FitBlockEndpoints(block, 3, endpoint0, endpoint1);
+
+    u16 bestColors[2] = {};
+    u8 bestIndices[BLOCK_PIXEL_COUNT] = {};
+    f32 bestError = FLT_MAX;
+    for (u32 pass = 0; pass <= BLOCK_REFINEMENT_PASSES; ++pass)
+    {
+        // The first color has to be the largest for the block to have 4 colors
+        u16 color0 = QuantizeRgb565(endpoint0);
+        u16 color1 = QuantizeRgb565(endpoint1);
+        if (color0 < color1)
+        {
+            std::swap(color0, color1);
+            for (u32 c = 0; c < 3; ++c)
+                std::swap(endpoint0[c], endpoint1[c]);
+        }
+
+        u32 palette[4][4];
+        GetBc1Palette(color0, color1, true, palette);
+        f32 paletteF[4][4];
+        for (u32 i = 0; i < 4; ++i)
+            for (u32 c = 0; c < 4; ++c)
+                paletteF[i][c] = (f32)palette[i][c];
+
+        // Equal endpoints make a 3 color block, only its first color is used then
+        u8 indices[BLOCK_PIXEL_COUNT];
+        f32 error = FindClosestIndices(block, paletteF, color0 == color1 ? 1 : 4, 3, indices);
+        if (error < bestError)
+        {
+            bestError = error;
+            bestColors[0] = color0;
+            bestColors[1] = color1;
+            memcpy(bestIndices, indices, sizeof(indices));
+        }
+
+        if (error == 0.0f || !RefineBlockEndpoints(block, 3, indices, Bc1Weights, endpoint0, endpoint1))
+            break;
+    }
+
+    dst[0] = (u8)bestColors[0];
+    dst[1] = (u8)(bestColors[0] >> 8);
+    dst[2] = (u8)bestColors[1];
+    dst[3] = (u8)(bestColors[1] >> 8);
+    u32 bits = 0;
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        bits |= (u32)bestIndices[i] << (2 * i);
+    memcpy(dst + 4, &bits, sizeof(bits));
+}
+
+void DecodeBc1Block(const u8* src, bool fourColors, u8* pixels)
+{
+    u16 color0 = (u16)(src[0] | (src[1] << 8));
+    u16 color1 = (u16)(src[2] | (src[3] << 8));
+    u32 palette[4][4];
+    GetBc1Palette(color0, color1, fourColors, palette);
+
+    u32 bits;
+    memcpy(&bits, src + 4, sizeof(bits));
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        for (u32 c = 0; c < 4; ++c)
+            pixels[i * 4 + c] = (u8)palette[(bits >> (2 * i)) & 3][c];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BC4: two 8-bit endpoints and 3-bit indices into 8 values of a single channel
+
+void GetBc4Palette(u32 value0, u32 value1, u32* palette)
+{
+    palette[0] = value0;
+    palette[1] = value1;
+    if (value0 > value1)
+    {
+        for (u32 i = 2; i < 8; ++i)
+            palette[i] = ((8 - i) * value0 + (i - 1) * value1) / 7;
+    }
+    else
+    {
+        for (u32 i = 2; i < 6; ++i)
+            palette[i] = ((6 - i) * value0 + (i - 1) * value1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// Only writes 8 value blocks
+void EncodeBc4Block(const BlockPixels& block, u32 channel, u8* dst)
+{
+    BlockPixels values;
+    memcpy(values.channels[0], block.channels[channel], sizeof(values.channels[0]));
+
+    f32 endpoint0 = 255.0f, endpoint1 = 0.0f;
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+    {
+        endpoint0 = std::min(endpoint0, values.channels[0][i]);
+        endpoint1 = std::max(endpoint1, values.channels[0][i]);
+    }
+
+    u8 bestValues[2] = {};
+    u8 bestIndices[BLOCK_PIXEL_COUNT] = {};
+    f32 bestError = FLT_MAX;
+    for (u32 pass = 0; pass <= BLOCK_REFINEMENT_PASSES; ++pass)
+    {
+        // The first value has to be the largest for the block to have 8 values
+        u8 value0 = QuantizeUnorm8(endpoint0);
+        u8 value1 = QuantizeUnorm8(endpoint1);
+        if (value0 < value1)
+        {
+            std::swap(value0, value1);
+            std::swap(endpoint0, endpoint1);
+        }
+
+        u32 palette[8];
+        GetBc4Palette(value0, value1, palette);
+        f32 paletteF[8][4] = {};
+        for (u32 i = 0; i < 8; ++i)
+            paletteF[i][0] = (f32)palette[i];
+
+        u8 indices[BLOCK_PIXEL_COUNT];
+        f32 error = FindClosestIndices(values, paletteF, value0 == value1 ? 1 : 8, 1, indices);
+        if (error < bestError)
+        {
+            bestError = error;
+            bestValues[0] = value0;
+            bestValues[1] = value1;
+            memcpy(bestIndices, indices, sizeof(indices));
+        }
+
+        if (error == 0.0f || !RefineBlockEndpoints(values, 1, indices, Bc4Weights, &endpoint0, &endpoint1))
+            break;
+    }
+
+    dst[0] = bestValues[0];
+    dst[1] = bestValues[1];
+    u64 bits = 0;
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        bits |= (u64)bestIndices[i] << (3 * i);
+    for (u32 i = 0; i < 6; ++i)
+        dst[2 + i] = (u8)(bits >> (8 * i));
+}
+
+void DecodeBc4Block(const u8* src, u32 channel, u8* pixels)
+{
+    u32 palette[8];
+    GetBc4Palette(src[0], src[1], palette);
+
+    u64 bits = 0;
+    for (u32 i = 0; i < 6; ++i)
+        bits |= (u64)src[2 + i] << (8 * i);
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        pixels[i * 4 + channel] = (u8)palette[(bits >> (3 * i)) & 7];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BC7, in its two single subset modes. Mode 6 has RGBA endpoints of 7 bits plus a low bit each
+// and 4-bit indices into 16 colors, which suits smooth color maps. Mode 5 has RGB endpoints of
+// 7 bits and alpha endpoints of 8 bits, each with its own 2-bit indices, which follows alpha
+// edges that don't match the color ones. Blocks are encoded in both and keep the closest.
+
+void WriteBlockBits(u8* dst, u32& bit, u32 value, u32 count)
+{
+    for (u32 i = 0; i < count; ++i, ++bit)
+        dst[bit >> 3] |= (u8)(((value >> i) & 1) << (bit & 7));
+}
+
+u32 ReadBlockBits(const u8* src, u32& bit, u32 count)
+{
+    u32 value = 0;
+    for (u32 i = 0; i < count; ++i, ++bit)
+        value |= (u32)((src[bit >> 3] >> (bit & 7)) & 1) << i;
+    return value;
+}
+
+u32 InterpolateBc7(u32 endpoint0, u32 endpoint1, u32 weight)
+{
+    return ((64 - weight) * endpoint0 + weight * endpoint1 + 32) >> 6;
+}
+
+u32 ExpandBc7Endpoint(u32 quantized, u32 bits)
+{
+    return bits == 8 ? quantized : (quantized << 1) | (quantized >> 6);
+}
+
+// Endpoint with the given low bit closest to a color, as its 7 high bits
+void QuantizeBc7Endpoint(const f32* color, u32 lowBit, u32* quantized)
+{
+    for (u32 c = 0; c < 4; ++c)
+        quantized[c] = (u32)std::min(std::max((color[c] - lowBit) * 0.5f + 0.5f, 0.0f), 127.0f);
+}
+
+f32 EncodeBc7Mode6Block(const BlockPixels& block, u8* dst)
+{
+    f32 endpoint0[4], endpoint1[4];
+    FitBlockEndpoints(block, 4, endpoint0, endpoint1);
+
+    u32 bestEndpoints[2][4] = {};
+    u32 bestLowBits[2] = {};
+    u8 bestIndices[BLOCK_PIXEL_COUNT] = {};
+    f32 bestError = FLT_MAX;
+    for (u32 pass = 0; pass <= BLOCK_REFINEMENT_PASSES; ++pass)
+    {
+        f32 passError = FLT_MAX;
+        u8 passIndices[BLOCK_PIXEL_COUNT];
+        for (u32 lowBits = 0; lowBits < 4; ++lowBits)
+        {
+            u32 lowBit0 = lowBits & 1, lowBit1 = lowBits >> 1;
+            u32 quantized0[4], quantized1[4];
+            QuantizeBc7Endpoint(endpoint0, lowBit0, quantized0);
+            QuantizeBc7Endpoint(endpoint1, lowBit1, quantized1);
+
+            f32 palette[16][4];
+            for (u32 c = 0; c < 4; ++c)
+            {
+                u32 full0 = (quantized0[c] << 1) | lowBit0;
+                u32 full1 = (quantized1[c] << 1) | lowBit1;
+                for (u32 i = 0; i < 16; ++i)
+                    palette[i][c] = (f32)InterpolateBc7(full0, full1, Bc7Weights4[i]);
+            }
+
+            u8 indices[BLOCK_PIXEL_COUNT];
+            f32 error = FindClosestIndices(block, palette, 16, 4, indices);
+            if (error < passError)
+            {
+                passError = error;
+                memcpy(passIndices, indices, sizeof(indices));
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                memcpy(bestEndpoints[0], quantized0, sizeof(quantized0));
+                memcpy(bestEndpoints[1], quantized1, sizeof(quantized1));
+                bestLowBits[0] = lowBit0;
+                bestLowBits[1] = lowBit1;
+                memcpy(bestIndices, indices, sizeof(indices));
+            }
+        }
+
+        if (bestError == 0.0f || !RefineBlockEndpoints(block, 4, passIndices, Bc7Weights4F, endpoint0, endpoint1))
+            break;
+    }
+
+    // The first index is stored without its high bit, so it has to be below 8
+    if (bestIndices[0] >= 8)
+    {
+        for (u32 c = 0; c < 4; ++c)
+            std::swap(bestEndpoints[0][c], bestEndpoints[1][c]);
+        std::swap(bestLowBits[0], bestLowBits[1]);
+        for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+            bestIndices[i] = 15 - bestIndices[i];
+    }
+
+    memset(dst, 0, 16);
+    u32 bit = 0;
+    WriteBlockBits(dst, bit, 1 << 6, 7);
+    for (u32 c = 0; c < 4; ++c)
+    {
+        WriteBlockBits(dst, bit, bestEndpoints[0][c], 7);
+        WriteBlockBits(dst, bit, bestEndpoints[1][c], 7);
+    }
+    WriteBlockBits(dst, bit, bestLowBits[0], 1);
+    WriteBlockBits(dst, bit, bestLowBits[1], 1);
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        WriteBlockBits(dst, bit, bestIndices[i], i == 0 ? 3 : 4);
+    return bestError;
+}
+
+// Endpoints of the given bits and 2-bit indices for the first channelCount channels, as the
+// color or the alpha of a mode 5 block. The first index is below 2, as the block stores it.
+f32 EncodeBc7Mode5Channels(const BlockPixels& block, u32 channelCount, u32 bits, u32* bestQuantized0, u32* bestQuantized1,
+                           u8* bestIndices)
+{
+    f32 endpoint0[4], endpoint1[4];
+    FitBlockEndpoints(block, channelCount, endpoint0, endpoint1);
+
+    u32 maxValue = (1u << bits) - 1;
+    f32 bestError = FLT_MAX;
+    for (u32 pass = 0; pass <= BLOCK_REFINEMENT_PASSES; ++pass)
+    {
+        u32 quantized0[4], quantized1[4];
+        f32 palette[4][4];
+        for (u32 c = 0; c < channelCount; ++c)
+        {
+            quantized0[c] = (u32)(endpoint0[c] * maxValue / 255.0f + 0.5f);
+            quantized1[c] = (u32)(endpoint1[c] * maxValue / 255.0f + 0.5f);
+            u32 full0 = ExpandBc7Endpoint(quantized0[c], bits);
+            u32 full1 = ExpandBc7Endpoint(quantized1[c], bits);
+            for (u32 i = 0; i < 4; ++i)
+                palette[i][c] = (f32)InterpolateBc7(full0, full1, Bc7Weights2[i]);
+        }
+
+        u8 indices[BLOCK_PIXEL_COUNT];
+        f32 error = FindClosestIndices(block, palette, 4, channelCount, indices);
+        if (error < bestError)
+        {
+            bestError = error;
+            memcpy(bestQuantized0, quantized0, channelCount * sizeof(u32));
+            memcpy(bestQuantized1, quantized1, channelCount * sizeof(u32));
+            memcpy(bestIndices, indices, sizeof(indices));
+        }
+
+        if (error == 0.0f || !RefineBlockEndpoints(block, channelCount, indices, Bc7Weights2F, endpoint0, endpoint1))
+            break;
+    }
+
+    if (bestIndices[0] >= 2)
+    {
+        for (u32 c = 0; c < channelCount; ++c)
+            std::swap(bestQuantized0[c], bestQuantized1[c]);
+        for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+            bestIndices[i] = 3 - bestIndices[i];
+    }
+    return bestError;
+}
+
+f32 EncodeBc7Mode5Block(const BlockPixels& block, u8* dst)
+{
+    u32 color[2][4], alpha[2][4];
+    u8 colorIndices[BLOCK_PIXEL_COUNT], alphaIndices[BLOCK_PIXEL_COUNT];
+    f32 error = EncodeBc7Mode5Channels(block, 3, 7, color[0], color[1], colorIndices);
+
+    BlockPixels alphas;
+    memcpy(alphas.channels[0], block.channels[3], sizeof(alphas.channels[0]));
+    error += EncodeBc7Mode5Channels(alphas, 1, 8, alpha[0], alpha[1], alphaIndices);
+
+    // No rotation: the alpha endpoints hold the alpha channel
+    memset(dst, 0, 16);
+    u32 bit = 0;
+    WriteBlockBits(dst, bit, 1 << 5, 6);
+    WriteBlockBits(dst, bit, 0, 2);
+    for (u32 c = 0; c < 3; ++c)
+    {
+        WriteBlockBits(dst, bit, color[0][c], 7);
+        WriteBlockBits(dst, bit, color[1][c], 7);
+    }
+    WriteBlockBits(dst, bit, alpha[0][0], 8);
+    WriteBlockBits(dst, bit, alpha[1][0], 8);
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        WriteBlockBits(dst, bit, colorIndices[i], i == 0 ? 1 : 2);
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        WriteBlockBits(dst, bit, alphaIndices[i], i == 0 ? 1 : 2);
+    return error;
+}
+
+void EncodeBc7Block(const BlockPixels& block, u8* dst)
+{
+    f32 error = EncodeBc7Mode6Block(block, dst);
+    if (error == 0.0f)
+        return;
+
+    u8 mode5[16];
+    if (EncodeBc7Mode5Block(block, mode5) < error)
+        memcpy(dst, mode5, sizeof(mode5));
+}
+
+void DecodeBc7Block(const u8* src, u8* pixels)
+{
+    // The mode is the number of zeros before the first set bit
+    u32 bit = 0;
+    u32 mode = 0;
+    while (mode < 8 && ReadBlockBits(src, bit, 1) == 0)
+        ++mode;
+
+    if (mode == 6)
+    {
+        u32 endpoints[2][4];
+        for (u32 c = 0; c < 4; ++c)
+        {
+            endpoints[0][c] = ReadBlockBits(src, bit, 7) << 1;
+            endpoints[1][c] = ReadBlockBits(src, bit, 7) << 1;
+        }
+        u32 lowBit0 = ReadBlockBits(src, bit, 1);
+        u32 lowBit1 = ReadBlockBits(src, bit, 1);
+
+        for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        {
+            u32 weight = Bc7Weights4[ReadBlockBits(src, bit, i == 0 ? 3 : 4)];
+            for (u32 c = 0; c < 4; ++c)
+                pixels[i * 4 + c] = (u8)InterpolateBc7(endpoints[0][c] | lowBit0, endpoints[1][c] | lowBit1, weight);
+        }
+    }
+    else if (mode == 5)
+    {
+        u32 rotation = ReadBlockBits(src, bit, 2);
+        u32 endpoints[2][4];
+        for (u32 c = 0; c < 3; ++c)
+        {
+            endpoints[0][c] = ExpandBc7Endpoint(ReadBlockBits(src, bit, 7), 7);
+            endpoints[1][c] = ExpandBc7Endpoint(ReadBlockBits(src, bit, 7), 7);
+        }
+        endpoints[0][3] = ReadBlockBits(src, bit, 8);
+        endpoints[1][3] = ReadBlockBits(src, bit, 8);
+
+        for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        {
+            u32 weight = Bc7Weights2[ReadBlockBits(src, bit, i == 0 ? 1 : 2)];
+            for (u32 c = 0; c < 3; ++c)
+                pixels[i * 4 + c] = (u8)InterpolateBc7(endpoints[0][c], endpoints[1][c], weight);
+        }
+        for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+        {
+            u32 weight = Bc7Weights2[ReadBlockBits(src, bit, i == 0 ? 1 : 2)];
+            pixels[i * 4 + 3] = (u8)InterpolateBc7(endpoints[0][3], endpoints[1][3], weight);
+            if (rotation != 0)
+                std::swap(pixels[i * 4 + 3], pixels[i * 4 + rotation - 1]);
+        }
+    }
+    else
+    {
+        memset(pixels, 0, BLOCK_PIXEL_COUNT * 4);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Whole images
+
+void EncodeBlock(GLenum format, const BlockPixels& block, u8* dst)
+{
+    switch (format)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        EncodeBc1Block(block, dst);
+        break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        EncodeBc4Block(block, 3, dst);
+        EncodeBc1Block(block, dst + 8);
+        break;
+    case GL_COMPRESSED_RED_RGTC1:
+        EncodeBc4Block(block, 0, dst);
+        break;
+    case GL_COMPRESSED_RG_RGTC2:
+        EncodeBc4Block(block, 0, dst);
+        EncodeBc4Block(block, 1, dst + 8);
+        break;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        EncodeBc7Block(block, dst);
+        break;
+    }
+}
+
+void DecodeBlock(GLenum format, const u8* src, u8* pixels)
+{
+    // Channels missing from the format read as 0, and alpha as 255
+    for (u32 i = 0; i < BLOCK_PIXEL_COUNT; ++i)
+    {
+        pixels[i * 4 + 0] = pixels[i * 4 + 1] = pixels[i * 4 + 2] = 0;
+        pixels[i * 4 + 3] = 255;
+    }
+
+    switch (format)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        DecodeBc1Block(src, false, pixels);
+        break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        DecodeBc1Block(src + 8, true, pixels);
+        DecodeBc4Block(src, 3, pixels);
+        break;
+    case GL_COMPRESSED_RED_RGTC1:
+        DecodeBc4Block(src, 0, pixels);
+        break;
+    case GL_COMPRESSED_RG_RGTC2:
+        DecodeBc4Block(src, 0, pixels);
+        DecodeBc4Block(src + 8, 1, pixels);
+        break;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        DecodeBc7Block(src, pixels);
+        break;
+    }
+}
+
+void CompressBlockRows(GLenum format, const u8* pixels, u32 width, u32 height, u32 firstRow, u32 rowCount, u8* dst)
+{
+    u32 blockBytes = GetBlockBytes(format);
+    u32 blocksX = GetBlockCount(width);
+    u8* block = dst + (u64)firstRow * blocksX * blockBytes;
+    for (u32 blockY = firstRow; blockY < firstRow + rowCount; ++blockY)
+    {
+        for (u32 blockX = 0; blockX < blocksX; ++blockX, block += blockBytes)
+        {
+            BlockPixels blockPixels;
+            LoadBlockPixels(pixels, width, height, blockX, blockY, blockPixels);
+            EncodeBlock(format, blockPixels, block);
+        }
+    }
+}
+
+void CompressTextureLevel(GLenum format, const u8* pixels, u32 width, u32 height, u8* dst)
+{
+    CompressBlockRows(format, pixels, width, height, 0, GetBlockCount(height), dst);
+}
+
+void DecompressTextureLevel(GLenum format, const u8* src, u32 width, u32 height, u8* dst)
+{
+    u32 blockBytes = GetBlockBytes(format);
+    for (u32 blockY = 0; blockY < GetBlockCount(height); ++blockY)
+    {
+        for (u32 blockX = 0; blockX < GetBlockCount(width); ++blockX, src += blockBytes)
+        {
+            u8 pixels[BLOCK_PIXEL_COUNT * 4];
+            DecodeBlock(format, src, pixels);
+
+            // Blocks past the edges are cropped
+            u32 columns = std::min(width - blockX * TEXTURE_BLOCK_SIZE, (u32)TEXTURE_BLOCK_SIZE);
+            u32 rows = std::min(height - blockY * TEXTURE_BLOCK_SIZE, (u32)TEXTURE_BLOCK_SIZE);
+            for (u32 y = 0; y < rows; ++y)
+            {
+                u8* row = dst + (((u64)blockY * TEXTURE_BLOCK_SIZE + y) * width + blockX * TEXTURE_BLOCK_SIZE) * 4;
+                memcpy(row, pixels + y * TEXTURE_BLOCK_SIZE * 4, columns * 4);
+            }
+        }
+    }
+}
+
+struct MipsCompression
+{
+    GLenum             format;
+    const TextureMips* mips;
+    u8*                levels[COOKED_TEXTURE_MAX_LEVELS];
+    u32                firstRows[COOKED_TEXTURE_MAX_LEVELS + 1]; // Block rows of all the levels, one after another
+};
+
+void CompressMipsRange(void* data, u32 begin, u32 end)
+{
+    MipsCompression* compression = (MipsCompression*)data;
+    const TextureMips& mips = *compression->mips;
+    for (u32 level = 0; level < mips.levelCount && begin < end; ++level)
+    {
+        u32 levelBegin = std::max(begin, compression->firstRows[level]);
+        u32 levelEnd = std::min(end, compression->firstRows[level + 1]);
+        if (levelBegin >= levelEnd)
+            continue;
+
+        CompressBlockRows(compression->format, mips.levels[level], GetMipSize(mips.width, level), GetMipSize(mips.height, level),
+                          levelBegin - compression->firstRows[level], levelEnd - levelBegin, compression->levels[level]);
+    }
+}
+
+f32 CompressTextureMips(TextureMips& mips, GLenum format)
+{
+    PROFILE_FUNCTION();
+
+    MipsCompression compression = {};
+    compression.format = format;
+    compression.mips = &mips;
+
+    u64 offsets[COOKED_TEXTURE_MAX_LEVELS];
+    u64 size = 0;
+    for (u32 level = 0; level < mips.levelCount; ++level)
+    {
+        offsets[level] = size;
+        size += GetTextureLevelSize(format, GetMipSize(mips.width, level), GetMipSize(mips.height, level));
+        compression.firstRows[level + 1] = compression.firstRows[level] + GetBlockCount(GetMipSize(mips.height, level));
+    }
+
+    std::vector<u8> pixels(size);
+    for (u32 level = 0; level < mips.levelCount; ++level)
+        compression.levels[level] = pixels.data() + offsets[level];
+
+    // A few block rows per job, the top level alone has hundreds of them
+    ParallelFor(compression.firstRows[mips.levelCount], 4, CompressMipsRange, &compression);
+
+    f32 psnr = ComputeCompressionPsnr(format, mips.levels[0], compression.levels[0], mips.width, mips.height);
+
+    mips.pixels.swap(pixels);
+    mips.internalFormat = format;
+    for (u32 level = 0; level < mips.levelCount; ++level)
+        mips.levels[level] = mips.pixels.data() + offsets[level];
+    return psnr;
+}
+
+f32 ComputeCompressionPsnr(GLenum format, const u8* original, const u8* compressed, u32 width, u32 height)
+{
+    u32 channelCount = 4;
+    if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+        channelCount = 3;
+    else if (format == GL_COMPRESSED_RED_RGTC1)
+        channelCount = 1;
+    else if (format == GL_COMPRESSED_RG_RGTC2)
+        channelCount = 2;
+
+    std::vector<u8> decoded((u64)width * height * 4);
+    DecompressTextureLevel(format, compressed, width, height, decoded.data());
+
+    f64 squaredError = 0.0;
+    for (u64 i = 0, count = (u64)width * height; i < count; ++i)
+    {
+        for (u32 c = 0; c < channelCount; ++c)
+        {
+            f64 d = (f64)original[i * 4 + c] - decoded[i * 4 + c];
+            squaredError += d * d;
+        }
+    }
+
+    if (squaredError == 0.0)
+        return INFINITY;
+    f64 meanSquaredError = squaredError / ((f64)width * height * channelCount);
+    return (f32)(10.0 * log10(255.0 * 255.0 / meanSquaredError));
+}
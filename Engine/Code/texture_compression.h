@@ -0,0 +1,78 @@
+//
+// texture_compression.h : Block compression of the cooked textures. Every 4x4 block of pixels is
+// encoded to 8 or 16 bytes in one of the BC formats that the GPU samples directly:
+//   BC1 (RGB, 4 bits per pixel) for opaque color maps
+//   BC3 (RGBA, 8 bpp) for grey color maps with alpha, whose alpha gets a block of its own
+//   BC7 (RGBA, 8 bpp) for the other color maps with alpha, in its single subset modes 5 and 6
+//   BC4 (R, 4 bpp) for single channel masks
+//   BC5 (RG, 8 bpp) for normal and distortion maps, as two BC4 blocks
+// The encoders fit the endpoints to the principal axis of the block colors and refine them by
+// least squares, picking the indices with SSE2. The block rows of a texture are encoded in
+// parallel on the job system.
+//
+
+#pragma once
+
+#include "texture_cache.h"
+
+// From EXT_texture_compression_s3tc, which is not part of the core profile
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#define TEXTURE_BLOCK_SIZE 4 // Pixels per side of a block
+
+/**
+ * Checks which block formats the driver samples. BC1 and BC3 need EXT_texture_compression_s3tc,
+ * BC4, BC5 and BC7 are core. Must be called with the OpenGL context current.
+ */
+void InitTextureCompression(const OpenGLInfo& glInfo);
+
+bool IsCompressedTextureFormat(GLenum format);
+
+/**
+ * Textures in compressed formats that the driver doesn't sample are decoded when uploaded.
+ */
+bool IsCompressedTextureFormatSupported(GLenum format);
+
+/**
+ * Short name of a texture format for the log and the UI, e.g. "BC7" or "RGBA8".
+ */
+const char* GetTextureFormatName(GLenum format);
+
+/**
+ * Bytes of an image in the format. Uncompressed formats (GL_RGB8 and GL_RGBA8) are stored as
+ * RGBA8, compressed ones take whole blocks even if the image is smaller.
+ */
+u64 GetTextureLevelSize(GLenum format, u32 width, u32 height);
+
+/**
+ * Format of the mips for the usage, or their uncompressed one if the top level can't be split in
+ * whole blocks.
+ */
+GLenum ChooseTextureFormat(const TextureMips& mips, TextureUsage usage);
+
+/**
+ * Encodes an RGBA8 image. Blocks that go past the edges repeat the edge pixels.
+ */
+void CompressTextureLevel(GLenum format, const u8* pixels, u32 width, u32 height, u8* dst);
+
+/**
+ * Decodes a compressed image into RGBA8, with the channels that the format lacks set as OpenGL
+ * samples them (0 for color, 255 for alpha). Only modes 5 and 6 of BC7 are decoded, the ones
+ * that the encoder writes.
+ */
+void DecompressTextureLevel(GLenum format, const u8* src, u32 width, u32 height, u8* dst);
+
+/**
+ * Compresses every level of mips built by BuildTextureMips, on the job system, and replaces its
+ * pixels with the compressed ones. Returns the PSNR of the top level, in dB.
+ */
+f32 CompressTextureMips(TextureMips& mips, GLenum format);
+
+/**
+ * Peak signal to noise ratio of a compressed image against the RGBA8 original, over the channels
+ * that the format keeps. Infinite when they are identical.
+ */
+f32 ComputeCompressionPsnr(GLenum format, const u8* original, const u8* compressed, u32 width, u32 height);
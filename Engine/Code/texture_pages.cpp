@@ -0,0 +1,240 @@
+//
+// texture_pages.cpp : Implementation of the texture pages declared in texture_pages.h.
+//
+
+#include "texture_pages.h"
+#include "texture_cache.h"
+#include "texture_compression.h"
+#include "profiler.h"
+#include <imgui.h>
+#include <algorithm>
+
+struct TexturePage
+{
+    GLuint           handle; // 0 once deleted, its slot is taken by the next new page
+    GLenum           format;
+    u32              width;
+    u32              height;
+    u32              levelCount;
+    u32              layerCount;
+    std::vector<u32> freeLayers;
+};
+
+struct TexturePages
+{
+    std::vector<TexturePage>                 pages;
+    std::unordered_map<GLuint, TextureLayer> layers; // Of every view
+};
+
+static TexturePages GlobalTexturePages;
+
+void SetTextureSampling(GLenum target)
+{
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+// Bytes of a page, its free layers included
+u64 GetTexturePageSize(const TexturePage& page)
+{
+    return GetMipChainSize(page.format, page.width, page.height, 0, page.levelCount) * page.layerCount;
+}
+
+// Page of the kind with a free layer, UINT32_MAX if they are all full. kindLayers gets the
+// layers of the pages of the kind together
+u32 FindFreeTexturePage(GLenum format, u32 width, u32 height, u32 levelCount, u32* kindLayers)
+{
+    TexturePages& tp = GlobalTexturePages;
+    *kindLayers = 0;
+    for (u32 i = 0; i < tp.pages.size(); ++i)
+    {
+        const TexturePage& page = tp.pages[i];
+        if (page.handle == 0 || page.format != format || page.width != width || page.height != height || page.levelCount != levelCount)
+            continue;
+        if (!page.freeLayers.empty())
+            return i;
+        *kindLayers += page.layerCount;
+    }
+    return UINT32_MAX;
+}
+
+// Layers of the next page of a kind
+u32 GetNewTexturePageLayers(GLenum format, u32 width, u32 height, u32 levelCount, u32 kindLayers, bool singleLayerPage)
+{
+    if (singleLayerPage)
+        return 1;
+
+    u64 layerSize = GetMipChainSize(format, width, height, 0, levelCount);
+    u32 layerCount = std::min(std::max(kindLayers, (u32)TEXTURE_PAGE_MIN_LAYERS), (u32)TEXTURE_PAGE_MAX_LAYERS);
+    return (u32)std::max<u64>(std::min<u64>(layerCount, TEXTURE_PAGE_MAX_SIZE / layerSize), 1);
+}
+
+// Page with a free layer for the texture, a new one if those of its kind are full
+u32 FindTexturePage(GLenum format, u32 width, u32 height, u32 levelCount, bool singleLayerPage)
+{
+    TexturePages& tp = GlobalTexturePages;
+    u32 kindLayers;
+    u32 pageIdx = FindFreeTexturePage(format, width, height, levelCount, &kindLayers);
+    if (pageIdx != UINT32_MAX)
+        return pageIdx;
+
+    PROFILE_FUNCTION();
+    TexturePage page;
+    page.format = format;
+    page.width = width;
+    page.height = height;
+    page.levelCount = levelCount;
+    page.layerCount = GetNewTexturePageLayers(format, width, height, levelCount, kindLayers, singleLayerPage);
+    for (u32 layer = page.layerCount; layer-- > 0;)
+        page.freeLayers.push_back(layer);
+
+    glGenTextures(1, &page.handle);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, page.handle);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, format, width, height, page.layerCount);
+    SetTextureSampling(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // The slot of a deleted page is taken first
+    pageIdx = 0;
+    while (pageIdx < tp.pages.size() && tp.pages[pageIdx].handle != 0)
+        ++pageIdx;
+    if (pageIdx == tp.pages.size())
+        tp.pages.push_back(page);
+    else
+        tp.pages[pageIdx] = page;
+    return pageIdx;
+}
+
+GLuint CreateTextureLayer(GLenum format, u32 width, u32 height, u32 levelCount, bool singleLayerPage)
+{
+    TexturePages& tp = GlobalTexturePages;
+    u32 pageIdx = FindTexturePage(format, width, height, levelCount, singleLayerPage);
+    TexturePage& page = tp.pages[pageIdx];
+    u32 layer = page.freeLayers.back();
+    page.freeLayers.pop_back();
+
+    GLuint view;
+    glGenTextures(1, &view);
+    glTextureView(view, GL_TEXTURE_2D, page.handle, format, 0, levelCount, layer, 1);
+    glBindTexture(GL_TEXTURE_2D, view);
+    SetTextureSampling(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    tp.layers[view] = TextureLayer{ pageIdx, layer };
+    return view;
+}
+
+u64 GetTextureLayerCost(GLenum format, u32 width, u32 height, u32 levelCount)
+{
+    u32 kindLayers;
+    if (FindFreeTexturePage(format, width, height, levelCount, &kindLayers) != UINT32_MAX)
+        return 0;
+
+    u32 layerCount = GetNewTexturePageLayers(format, width, height, levelCount, kindLayers, false);
+    return GetMipChainSize(format, width, height, 0, levelCount) * layerCount;
+}
+
+void DeleteTextureLayer(GLuint handle)
+{
+    TexturePages& tp = GlobalTexturePages;
+    auto it = tp.layers.find(handle);
+    glDeleteTextures(1, &handle);
+    if (it == tp.layers.end())
+        return;
+
+    TexturePage& page = tp.pages[it->second.page];
+    page.freeLayers.push_back(it->second.layer);
+    tp.layers.erase(it);
+    if (page.freeLayers.size() == page.layerCount)
+    {
+        glDeleteTextures(1, &page.handle);
+        page.handle = 0;
+        page.freeLayers.clear();
+    }
+}
+
+TextureLayer GetTextureLayer(GLuint handle)
+{
+    TexturePages& tp = GlobalTexturePages;
+    auto it = tp.layers.find(handle);
+    return it != tp.layers.end() ? it->second : TextureLayer{ UINT32_MAX, 0 };
+}
+
+void ResetTexturePageUnits(TexturePageUnits& units)
+{
+    for (u32& page : units.pages)
+        page = UINT32_MAX;
+    units.nextUnit = 0;
+}
+
+u32 BindTexturePage(u32 page, TexturePageUnits& units)
+{
+    for (u32 unit = 0; unit < TEXTURE_PAGE_UNITS; ++unit)
+        if (units.pages[unit] == page)
+            return unit;
+
+    u32 unit = units.nextUnit;
+    units.nextUnit = (unit + 1) % TEXTURE_PAGE_UNITS;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, GlobalTexturePages.pages[page].handle);
+    units.pages[unit] = page;
+    return unit;
+}
+
+void ShutdownTexturePages()
+{
+    TexturePages& tp = GlobalTexturePages;
+    for (TexturePage& page : tp.pages)
+    {
+        if (page.handle != 0)
+            glDeleteTextures(1, &page.handle);
+    }
+    tp.pages.clear();
+    tp.layers.clear();
+}
+
+u64 GetTexturePagesMemory()
+{
+    u64 size = 0;
+    for (const TexturePage& page : GlobalTexturePages.pages)
+    {
+        if (page.handle != 0)
+            size += GetTexturePageSize(page);
+    }
+    return size;
+}
+
+void GuiTexturePages()
+{
+    TexturePages& tp = GlobalTexturePages;
+    u32 pageCount = 0;
+    u64 allocatedSize = 0;
+    u64 usedSize = 0;
+    for (const TexturePage& page : tp.pages)
+    {
+        if (page.handle == 0)
+            continue;
+        u64 layerSize = GetMipChainSize(page.format, page.width, page.height, 0, page.levelCount);
+        pageCount++;
+        allocatedSize += GetTexturePageSize(page);
+        usedSize += layerSize * (page.layerCount - page.freeLayers.size());
+    }
+
+    ImGui::Text("Pages: %u, %u texture units", pageCount, TEXTURE_PAGE_UNITS);
+    ImGui::Text("Memory: %.2f MB, %.2f MB of it in free layers", allocatedSize / (1024.0f * 1024.0f),
+                (allocatedSize - usedSize) / (1024.0f * 1024.0f));
+
+    if (ImGui::TreeNode("Layers"))
+    {
+        for (u32 i = 0; i < tp.pages.size(); ++i)
+        {
+            const TexturePage& page = tp.pages[i];
+            if (page.handle != 0)
+                ImGui::Text("%u: %s %ux%u, %u levels, %u of %u layers", i, GetTextureFormatName(page.format), page.width, page.height,
+                            page.levelCount, page.layerCount - (u32)page.freeLayers.size(), page.layerCount);
+        }
+        ImGui::TreePop();
+    }
+}
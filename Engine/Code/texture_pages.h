@@ -0,0 +1,88 @@
+//
+// texture_pages.h : Storage of the 2D textures, grouped into pages: GL_TEXTURE_2D_ARRAY textures
+// whose layers share a size, a format and a level count. Every texture takes a layer of a page
+// and its handle is a view of that layer (glTextureView), so it is still uploaded, copied and
+// bound like any GL_TEXTURE_2D. The shaders that draw materials sample the pages instead: the
+// material storage buffer (see UploadMaterials) holds the page and the layer of the textures of
+// every material, and each batch of draws binds the pages it samples to units that a table of the
+// pass hands out (TexturePageUnits), so batches don't bind anything while their pages stay bound.
+//
+// Views can't follow their storage to a larger texture, so pages never grow: a full page is
+// followed by another one, with as many layers as the earlier ones of its kind together. Only
+// the textures whose levels are evicted (see texture_residency.h) take a page of a single layer
+// when their new size has no free layer, since a larger page would take more memory than the
+// eviction frees.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define TEXTURE_PAGE_UNITS      16                 // Texture units of the pages, the size of uTexturePages in shaders.glsl
+#define TEXTURE_PAGE_MIN_LAYERS 4                  // Of the first page of each kind
+#define TEXTURE_PAGE_MAX_LAYERS 64
+#define TEXTURE_PAGE_MAX_SIZE   (64 * 1024 * 1024) // Bytes, pages of large textures have fewer layers
+
+struct TextureLayer
+{
+    u32 page;  // UINT32_MAX for textures that are not in a page
+    u32 layer;
+};
+
+// Pages bound to the texture units of a sequence of batches. A page keeps its unit until the
+// units run out, then the one bound the longest ago is replaced, so the TEXTURE_PAGE_UNITS pages
+// of a batch never replace each other
+struct TexturePageUnits
+{
+    u32 pages[TEXTURE_PAGE_UNITS]; // UINT32_MAX for the units bound to something else
+    u32 nextUnit;                  // Replaced next
+};
+
+/**
+ * Takes a free layer of a page of the format, size and level count, adding a page if they are
+ * all full, and returns a GL_TEXTURE_2D view of it, sampled trilinearly. Its contents are
+ * undefined until uploaded. With singleLayerPage, the page added has just that layer.
+ */
+GLuint CreateTextureLayer(GLenum format, u32 width, u32 height, u32 levelCount, bool singleLayerPage = false);
+
+/**
+ * Bytes that the pages grow by if CreateTextureLayer takes a layer of the format, size and level
+ * count: 0 while a page of that kind has a free layer, the size of the page added otherwise.
+ */
+u64 GetTextureLayerCost(GLenum format, u32 width, u32 height, u32 levelCount);
+
+/**
+ * Deletes the view and frees its layer, and the page once it has none in use. Handles that are
+ * not views of a page are just deleted.
+ */
+void DeleteTextureLayer(GLuint handle);
+
+/**
+ * Page and layer of a view.
+ */
+TextureLayer GetTextureLayer(GLuint handle);
+
+/**
+ * Forgets the pages of the units, for a sequence of batches that starts with other bindings.
+ */
+void ResetTexturePageUnits(TexturePageUnits& units);
+
+/**
+ * Returns the texture unit of a page, binding it to a unit first unless it already is there.
+ */
+u32 BindTexturePage(u32 page, TexturePageUnits& units);
+
+/**
+ * Bytes of the pages, their free layers included.
+ */
+u64 GetTexturePagesMemory();
+
+/**
+ * Deletes the pages. The views of their layers are left dangling.
+ */
+void ShutdownTexturePages();
+
+/**
+ * Pages with their layers in use and the memory they take.
+ */
+void GuiTexturePages();
@@ -0,0 +1,98 @@
+//
+// texture_registry.cpp : Implementation of the texture lookups declared in texture_registry.h.
+//
+
+#include "texture_registry.h"
+#include <imgui.h>
+#include <mutex>
+
+struct TextureContentKey
+{
+    u64          hash;
+    u64          size;
+    TextureUsage usage; // The same image cooks differently for each usage
+
+    bool operator==(const TextureContentKey& other) const
+    {
+        return hash == other.hash && size == other.size && usage == other.usage;
+    }
+};
+
+struct TextureContentKeyHasher
+{
+    size_t operator()(const TextureContentKey& key) const
+    {
+        return (size_t)(key.hash ^ ((u64)key.usage << 56));
+    }
+};
+
+struct TextureRegistry
+{
+    std::mutex                                                           mutex;
+    std::unordered_map<TextureContentKey, u32, TextureContentKeyHasher> textures; // First texture with the contents
+    std::unordered_map<u32, TextureContentKey>                           contents; // Of the textures that own their storage
+};
+
+static TextureRegistry GlobalTextureRegistry;
+
+u32 FindTexture(const App* app, const char* filepath)
+{
+    auto it = app->texturePathIndices.find(filepath);
+    return it != app->texturePathIndices.end() ? it->second : UINT32_MAX;
+}
+
+u32 AddTexture(App* app, const Texture& tex)
+{
+    u32 texIdx = (u32)app->textures.size();
+    app->textures.push_back(tex);
+    app->textures[texIdx].storageTexIdx = texIdx;
+    app->texturePathIndices[tex.filepath] = texIdx;
+    return texIdx;
+}
+
+u32 ShareTextureContent(u32 texIdx, TextureUsage usage, u64 contentHash, u64 contentSize, bool* contentChanged)
+{
+    TextureRegistry& registry = GlobalTextureRegistry;
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    TextureContentKey key = { contentHash, contentSize, usage };
+    auto it = registry.textures.find(key);
+    u32 storageTexIdx = it != registry.textures.end() ? it->second : texIdx;
+
+    // Textures that shared the previous contents of this one can't see the new ones
+    *contentChanged = false;
+    auto previous = registry.contents.find(texIdx);
+    if (previous != registry.contents.end() && !(previous->second == key))
+    {
+        registry.textures.erase(previous->second);
+        registry.contents.erase(previous);
+        *contentChanged = true;
+    }
+
+    if (storageTexIdx == texIdx)
+    {
+        registry.textures[key] = texIdx;
+        registry.contents[texIdx] = key;
+    }
+    return storageTexIdx;
+}
+
+void GuiTextureRegistry(const App* app)
+{
+    u32 sharedCount = 0;
+    u64 memorySize = 0;
+    u64 savedSize = 0;
+    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
+    {
+        const Texture& tex = app->textures[texIdx];
+        memorySize += tex.memorySize;
+        if (tex.storageTexIdx != texIdx)
+        {
+            sharedCount++;
+            savedSize += app->textures[tex.storageTexIdx].memorySize;
+        }
+    }
+
+    ImGui::Text("Textures: %u, %u of them share an identical one", (u32)app->textures.size(), sharedCount);
+    ImGui::Text("Memory: %.2f MB, %.2f MB saved by sharing", memorySize / (1024.0f * 1024.0f), savedSize / (1024.0f * 1024.0f));
+}
@@ -0,0 +1,34 @@
+//
+// texture_registry.h : Lookup of the textures of the app. Paths are found through a hash map
+// instead of comparing them with every loaded path, and image files are identified by a hash of
+// their bytes: a texture whose file has the same contents (and usage) as an earlier one is not
+// decoded nor uploaded, it binds the storage of that one instead.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Index of the texture of a path, or UINT32_MAX if it was never loaded.
+ */
+u32 FindTexture(const App* app, const char* filepath);
+
+/**
+ * Appends a texture and indexes its path. It owns its storage until it turns out to share it.
+ */
+u32 AddTexture(App* app, const Texture& tex);
+
+/**
+ * Registers the contents of the file of a texture, identified by its size and HashBytes of its
+ * bytes, unless an earlier texture has the same ones: returns the index of the texture whose
+ * storage it should use, which is its own if it has to be loaded. contentChanged tells whether it
+ * had other contents registered, in which case the textures that shared them must be loaded
+ * again. Thread safe, the workers check it before decoding.
+ */
+u32 ShareTextureContent(u32 texIdx, TextureUsage usage, u64 contentHash, u64 contentSize, bool* contentChanged);
+
+/**
+ * Texture count, memory taken and memory saved by sharing identical images.
+ */
+void GuiTextureRegistry(const App* app);
@@ -0,0 +1,228 @@
+//
+// texture_residency.cpp : Implementation of the texture residency declared in texture_residency.h.
+//
+
+#include "texture_residency.h"
+#include "texture_cache.h"
+#include "texture_streaming.h"
+#include "texture_pages.h"
+#include "profiler.h"
+#include <imgui.h>
+#include <algorithm>
+#include <math.h>
+
+struct TextureResidency
+{
+    std::vector<u32> candidates; // Textures whose levels can change this frame
+    u32              mipBias = 0; // Levels that the textures in use keep below the one they need, while those don't fit
+
+    u64              usedBytes = 0;
+    bool             overBudget = false; // Even the small levels don't fit
+    u32              evictions = 0;
+    u64              evictedBytes = 0;
+    u32              restores = 0;
+};
+
+static TextureResidency GlobalTextureResidency;
+
+void MarkTextureUsed(App* app, u32 texIdx, f32 projectedRadius)
+{
+    Texture& tex = app->textures[app->textures[texIdx].storageTexIdx];
+    if (tex.levelCount == 0)
+        return;
+
+    u32 mip = 0;
+    f32 texels = (f32)std::max(tex.width, tex.height);
+    f32 pixels = std::max(2.0f * projectedRadius, 1.0f);
+    if (pixels < texels)
+    {
+        i32 level = (i32)floorf(log2f(texels / pixels)) - TEXTURE_RESIDENCY_MIP_BIAS;
+        mip = std::min((u32)std::max(level, 0), tex.levelCount - 1);
+    }
+
+    // The passes of a frame may draw it at different sizes, the largest one counts
+    if (tex.lastUsedFrame != app->frame)
+        tex.requiredMip = mip;
+    else
+        tex.requiredMip = std::min(tex.requiredMip, mip);
+    tex.lastUsedFrame = app->frame;
+}
+
+// Largest level that is never evicted
+u32 GetTextureTailMip(const Texture& tex)
+{
+    u32 mip = 0;
+    while (mip + 1 < tex.levelCount && std::max(GetMipSize(tex.width, mip), GetMipSize(tex.height, mip)) > TEXTURE_RESIDENCY_TAIL_SIZE)
+        ++mip;
+    return mip;
+}
+
+bool IsTextureCold(const App* app, const Texture& tex)
+{
+    return app->frame - tex.lastUsedFrame > TEXTURE_RESIDENCY_COLD_FRAMES;
+}
+
+u64 GetTextureSizeFromMip(const Texture& tex, u32 firstLevel)
+{
+    return GetMipChainSize(tex.format, tex.width, tex.height, firstLevel, tex.levelCount);
+}
+
+// Largest level that a texture keeps: the small ones if it is cold, the one its draws need otherwise
+u32 GetTextureNeededMip(const App* app, const Texture& tex, u32 mipBias)
+{
+    u32 tailMip = GetTextureTailMip(tex);
+    return IsTextureCold(app, tex) ? tailMip : std::min(tex.requiredMip + mipBias, tailMip);
+}
+
+// Memory that the textures would take with the levels they need and nothing more
+u64 GetNeededTextureMemory(const App* app, u32 mipBias)
+{
+    u64 size = 0;
+    for (const Texture& tex : app->textures)
+    {
+        if (tex.levelCount == 0 || tex.handle == 0)
+            size += tex.memorySize;
+        else
+            size += GetTextureSizeFromMip(tex, GetTextureNeededMip(app, tex, mipBias));
+    }
+    return size;
+}
+
+// Bytes that the texture pages grow by if a texture gets the levels from firstLevel down
+u64 GetTextureLayerCostFromMip(const Texture& tex, u32 firstLevel)
+{
+    return GetTextureLayerCost(tex.format, GetMipSize(tex.width, firstLevel), GetMipSize(tex.height, firstLevel), tex.levelCount - firstLevel);
+}
+
+// Reallocates the storage of a texture from firstLevel down. Draws read the handle when binding,
+// so they switch to the new storage at once. The new storage takes a free layer or a page of its
+// own, so the pages only grow by the levels that stay, and shrink once the old page has no layer
+// in use
+void EvictTextureMips(Texture& tex, u32 firstLevel)
+{
+    u32 levelCount = tex.levelCount - firstLevel;
+    GLuint handle = CreateTextureLayer(tex.format, GetMipSize(tex.width, firstLevel), GetMipSize(tex.height, firstLevel), levelCount, true);
+
+    // Whole levels are copied, which compressed formats allow even for levels smaller than a block
+    for (u32 level = 0; level < levelCount; ++level)
+    {
+        glCopyImageSubData(tex.handle, GL_TEXTURE_2D, firstLevel - tex.residentMip + level, 0, 0, 0,
+                           handle, GL_TEXTURE_2D, level, 0, 0, 0,
+                           GetMipSize(tex.width, firstLevel + level), GetMipSize(tex.height, firstLevel + level), 1);
+    }
+
+    DeleteTextureLayer(tex.handle);
+    tex.handle = handle;
+    tex.residentMip = firstLevel;
+    tex.memorySize = GetTextureSizeFromMip(tex, firstLevel);
+}
+
+void UpdateTextureResidency(App* app)
+{
+    PROFILE_FUNCTION();
+    TextureResidency& tr = GlobalTextureResidency;
+    u64 budget = (u64)app->textureBudgetMB * 1024 * 1024;
+
+    // While the levels needed don't fit, the textures in use drop one more level each, and they
+    // only get it back once they would fit with it
+    while (tr.mipBias > 0 && GetNeededTextureMemory(app, tr.mipBias - 1) <= budget)
+        tr.mipBias--;
+    u64 neededSize = GetNeededTextureMemory(app, tr.mipBias);
+    while (tr.mipBias < COOKED_TEXTURE_MAX_LEVELS && neededSize > budget)
+        neededSize = GetNeededTextureMemory(app, ++tr.mipBias);
+    tr.overBudget = neededSize > budget;
+
+    // What the pages take, free layers included: they are only freed once they have no layer in
+    // use, and new layers may add a whole page
+    u64 used = GetTexturePagesMemory();
+    u64 wanted = 0; // By the textures that need levels back
+    tr.candidates.clear();
+    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
+    {
+        const Texture& tex = app->textures[texIdx];
+        if (tex.levelCount == 0 || tex.handle == 0)
+            continue;
+
+        // The levels on their way in count already, and the storage is left alone until they land
+        bool hasStorage;
+        u32 pendingMip = GetPendingTextureMip(texIdx, &hasStorage);
+        if (pendingMip != UINT32_MAX)
+        {
+            if (!hasStorage)
+                used += GetTextureLayerCostFromMip(tex, std::min(pendingMip, tex.levelCount - 1));
+            continue;
+        }
+
+        u32 neededMip = GetTextureNeededMip(app, tex, tr.mipBias);
+        if (neededMip < tex.residentMip)
+            wanted += GetTextureLayerCostFromMip(tex, neededMip);
+        tr.candidates.push_back(texIdx);
+    }
+
+    // Least recently drawn first
+    std::sort(tr.candidates.begin(), tr.candidates.end(), [app](u32 a, u32 b)
+    {
+        u32 frameA = app->textures[a].lastUsedFrame;
+        u32 frameB = app->textures[b].lastUsedFrame;
+        return frameA != frameB ? frameA < frameB : a < b;
+    });
+
+    // The levels not needed go while over the budget, or to make room for the ones needed back
+    u64 limit = budget > wanted ? budget - wanted : 0;
+    for (u32 i = 0; i < tr.candidates.size() && used > limit; ++i)
+    {
+        Texture& tex = app->textures[tr.candidates[i]];
+        u32 neededMip = GetTextureNeededMip(app, tex, tr.mipBias);
+        if (neededMip <= tex.residentMip)
+            continue;
+
+        u64 previousSize = tex.memorySize;
+        u64 previousMemory = GetTexturePagesMemory();
+        EvictTextureMips(tex, neededMip);
+        app->materialTexturesChanged = true;
+        used = used - previousMemory + GetTexturePagesMemory();
+        tr.evictions++;
+        tr.evictedBytes += previousSize - tex.memorySize;
+        LOG_MESSAGE(LOG_LEVEL_DEBUG, LOG_ASSETS, "Evicted the levels of texture %s above level %u", tex.filepath, neededMip);
+    }
+
+    // The textures drawn most recently get back the levels they need first, as long as they fit
+    u32 requests = 0;
+    for (u32 i = (u32)tr.candidates.size(); i-- > 0 && requests < TEXTURE_RESIDENCY_FRAME_REQUESTS;)
+    {
+        u32 texIdx = tr.candidates[i];
+        const Texture& tex = app->textures[texIdx];
+        u32 neededMip = GetTextureNeededMip(app, tex, tr.mipBias);
+        if (neededMip >= tex.residentMip)
+            continue;
+
+        u64 extraSize = GetTextureLayerCostFromMip(tex, neededMip);
+        if (used + extraSize > budget)
+            continue;
+
+        RequestTextureMips(app, texIdx, neededMip);
+        used += extraSize;
+        requests++;
+        tr.restores++;
+    }
+    tr.usedBytes = used;
+}
+
+void GuiTextureResidency(App* app)
+{
+    TextureResidency& tr = GlobalTextureResidency;
+
+    int budgetMB = (int)app->textureBudgetMB;
+    if (ImGui::DragInt("Budget (MB)", &budgetMB, 8.0f, 16, 65536))
+        app->textureBudgetMB = (u32)budgetMB;
+
+    u32 evictedCount = 0;
+    for (const Texture& tex : app->textures)
+        evictedCount += tex.levelCount > 0 && tex.residentMip > 0 ? 1 : 0;
+
+    ImGui::Text("In use: %.2f MB%s", tr.usedBytes / (1024.0f * 1024.0f), tr.overBudget ? ", over the budget" : "");
+    ImGui::Text("Levels dropped below the ones needed: %u", tr.mipBias);
+    ImGui::Text("Textures without their largest levels: %u", evictedCount);
+    ImGui::Text("Evictions: %u, %.2f MB", tr.evictions, tr.evictedBytes / (1024.0f * 1024.0f));
+    ImGui::Text("Streamed back in: %u", tr.restores);
+}
@@ -0,0 +1,42 @@
+//
+// texture_residency.h : Keeps the textures within a budget of GPU memory (App::textureBudgetMB).
+// Draws tell which textures they sample and the largest level they need, from the size of the
+// entity on the screen. The budget counts the texture pages (see texture_pages.h), free layers
+// included. While they take more than the budget, or to make room for levels needed again, the
+// least recently drawn textures lose the levels they don't need: their storage is reallocated
+// without them and the rest is copied over on the GPU. Cold textures, not drawn for
+// TEXTURE_RESIDENCY_COLD_FRAMES, keep only their small levels. Evicted levels needed again are
+// streamed back in (see texture_streaming.h) once they fit in the budget. If the levels needed
+// don't fit at all, every texture in use keeps one level less, and gets it back only once they
+// would all fit with it, so textures don't bounce between two levels every frame.
+//
+// Only the textures streamed from their files are managed. The engine ones and the images
+// embedded in glTF files, which can't be read again, stay resident.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define TEXTURE_RESIDENCY_COLD_FRAMES    120 // Frames without drawing a texture before it is cold
+#define TEXTURE_RESIDENCY_TAIL_SIZE      64  // Levels this size or smaller are never evicted
+#define TEXTURE_RESIDENCY_MIP_BIAS       1   // Levels kept above the one the screen size asks for, images may repeat over the entity
+#define TEXTURE_RESIDENCY_FRAME_REQUESTS 4   // Textures streamed back in per frame
+
+/**
+ * Records that a texture is drawn this frame on an entity whose bounding radius covers
+ * projectedRadius pixels (see GetProjectedMeshRadius). Assumes that the image spans the entity
+ * once, so about its projected diameter in texels is needed.
+ */
+void MarkTextureUsed(App* app, u32 texIdx, f32 projectedRadius);
+
+/**
+ * Evicts levels until the texture pages fit in the budget, or streams back the ones needed again
+ * if they fit. Call once a frame, after UpdateTextureStreaming, with the OpenGL context current.
+ */
+void UpdateTextureResidency(App* app);
+
+/**
+ * Budget, memory in use and evictions.
+ */
+void GuiTextureResidency(App* app);
@@ -0,0 +1,491 @@
+//
+// texture_streaming.cpp : Implementation of the texture streaming declared in texture_streaming.h.
+//
+
+#include "texture_streaming.h"
+#include "texture_compression.h"
+#include "texture_registry.h"
+#include "texture_pages.h"
+#include "buffer_management.h"
+#include "job_system.h"
+#include "profiler.h"
+#include <imgui.h>
+
+#define TEXTURE_STREAMING_CHUNK_ALIGNMENT 16
+#define TEXTURE_STREAMING_FLUSH_TIMEOUT   1000000000ull // Nanoseconds waited on a buffer when flushing
+
+struct TextureStreamRequest
+{
+    u32          texIdx;
+    const char*  filepath;   // Of the texture, in GlobalLevelArena
+    TextureUsage usage;
+    u32          firstLevel; // Largest level streamed, the ones above it stay evicted
+    bool         reload;     // The file changed
+    u64          requestTime;
+
+    // Written by the job until the counter reaches zero
+    TextureMips  mips;
+    u32          storageTexIdx;  // Another texture if the file is a copy of its image, then not prepared
+    bool         contentChanged; // The file no longer has the image that other textures share
+    JobCounter   counter;
+
+    bool         cancelled; // Replaced by a newer request for the same texture
+
+    GLuint       handle;    // Storage being filled, 0 until the first rows are copied
+    u32          level;     // Next level to copy, from the smallest one
+    u32          row;       // Next row of pixels, or of blocks, of that level
+    bool         copied;    // The whole chain is in a buffer
+};
+
+// Rows of a level copied to a buffer, uploaded once the buffer is unmapped
+struct TextureUploadChunk
+{
+    const TextureStreamRequest* request;
+    u32                         level;
+    u32                         y;
+    u32                         height;
+    u32                         offset;
+    u32                         size;
+};
+
+struct TextureUploadBuffer
+{
+    GLuint handle;
+    GLsync fence; // Signaled once the GPU has read the last uploads from it
+};
+
+struct TextureStreamer
+{
+    bool                               initialized = false;
+
+    TextureUploadBuffer                buffers[TEXTURE_STREAMING_BUFFER_COUNT];
+    u32                                nextBuffer = 0;
+
+    std::vector<TextureStreamRequest*> requests; // In the order they were made
+    std::vector<TextureUploadChunk>    chunks;
+
+    u32                                frameBytes = 0;
+    u64                                streamedBytes = 0;
+    u32                                streamedTextures = 0;
+};
+
+static TextureStreamer GlobalTextureStreamer;
+
+void InitTextureStreaming()
+{
+    TextureStreamer& ts = GlobalTextureStreamer;
+    if (ts.initialized)
+        return;
+
+    for (u32 i = 0; i < TEXTURE_STREAMING_BUFFER_COUNT; ++i)
+    {
+        glGenBuffers(1, &ts.buffers[i].handle);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts.buffers[i].handle);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_STREAMING_FRAME_BUDGET, NULL, GL_STREAM_DRAW);
+        ts.buffers[i].fence = 0;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    ts.nextBuffer = 0;
+    ts.initialized = true;
+}
+
+void DeleteTextureRequest(TextureStreamRequest* request)
+{
+    if (request->handle != 0)
+        DeleteTextureLayer(request->handle);
+    ReleaseTextureMips(request->mips);
+    delete request;
+}
+
+void ShutdownTextureStreaming()
+{
+    TextureStreamer& ts = GlobalTextureStreamer;
+    if (!ts.initialized)
+        return;
+
+    for (TextureStreamRequest* request : ts.requests)
+    {
+        WaitForCounter(&request->counter);
+        DeleteTextureRequest(request);
+    }
+    ts.requests.clear();
+
+    for (u32 i = 0; i < TEXTURE_STREAMING_BUFFER_COUNT; ++i)
+    {
+        if (ts.buffers[i].fence)
+            glDeleteSync(ts.buffers[i].fence);
+        glDeleteBuffers(1, &ts.buffers[i].handle);
+    }
+    ts.initialized = false;
+}
+
+void PrepareStreamedTexture(void* data)
+{
+    TextureStreamRequest* request = (TextureStreamRequest*)data;
+    FileView source = MapFile(request->filepath);
+    if (!source.data)
+    {
+        UnmapFile(source);
+        return;
+    }
+
+    // Files with the same bytes as an earlier one are neither decoded nor uploaded
+    u64 sourceHash = HashBytes(source.data, source.size);
+    request->storageTexIdx = ShareTextureContent(request->texIdx, request->usage, sourceHash, source.size, &request->contentChanged);
+    if (request->storageTexIdx != request->texIdx)
+    {
+        UnmapFile(source);
+        return;
+    }
+
+    if (PrepareTextureMips(request->mips, request->filepath, request->usage, source, sourceHash))
+        DecompressUnsupportedTextureMips(request->mips);
+}
+
+void QueueTextureRequest(u32 texIdx, const char* filepath, TextureUsage usage, u32 firstLevel, bool reload)
+{
+    TextureStreamer& ts = GlobalTextureStreamer;
+
+    // A newer request replaces the pending one, but is prepared after it, since both may cook
+    // the same file
+    JobCounter* dependency = NULL;
+    for (TextureStreamRequest* pending : ts.requests)
+    {
+        if (pending->texIdx == texIdx && !pending->cancelled)
+        {
+            pending->cancelled = true;
+            dependency = &pending->counter;
+        }
+    }
+
+    TextureStreamRequest* request = new TextureStreamRequest();
+    request->texIdx = texIdx;
+    request->filepath = filepath;
+    request->usage = usage;
+    request->firstLevel = firstLevel;
+    request->reload = reload;
+    request->requestTime = GetTimeNanoseconds();
+    request->storageTexIdx = texIdx;
+    ts.requests.push_back(request);
+
+    RunJob(PrepareStreamedTexture, request, &request->counter, dependency);
+}
+
+u32 RequestTexture2D(App* app, const char* filepath, TextureUsage usage)
+{
+    u32 texIdx = FindTexture(app, filepath);
+    if (texIdx != UINT32_MAX)
+        return texIdx;
+
+    Texture tex = {};
+    tex.filepath = MakeString(filepath, &GlobalLevelArena).str;
+    tex.usage = usage;
+    tex.state = TEXTURE_STATE_LOADING;
+    texIdx = AddTexture(app, tex);
+
+    QueueTextureRequest(texIdx, tex.filepath, usage, 0, false);
+    return texIdx;
+}
+
+void RequestTextureReload(App* app, u32 texIdx)
+{
+    const Texture& tex = app->textures[texIdx];
+    QueueTextureRequest(texIdx, tex.filepath, tex.usage, tex.residentMip, true);
+}
+
+void RequestTextureMips(App* app, u32 texIdx, u32 firstLevel)
+{
+    const Texture& tex = app->textures[texIdx];
+    QueueTextureRequest(texIdx, tex.filepath, tex.usage, firstLevel, false);
+}
+
+u32 GetPendingTextureMip(u32 texIdx, bool* hasStorage)
+{
+    for (const TextureStreamRequest* request : GlobalTextureStreamer.requests)
+    {
+        if (request->texIdx == texIdx && !request->cancelled)
+        {
+            *hasStorage = request->handle != 0;
+            return request->firstLevel;
+        }
+    }
+    *hasStorage = false;
+    return UINT32_MAX;
+}
+
+// Copies the next rows of the request that fit in the buffer. Returns true once the whole chain
+// has been copied
+bool CopyTextureRows(TextureStreamer& ts, TextureStreamRequest& request, u8* mapped, u32& used)
+{
+    const TextureMips& mips = request.mips;
+    u32 blockHeight = IsCompressedTextureFormat(mips.internalFormat) ? TEXTURE_BLOCK_SIZE : 1;
+    for (;;)
+    {
+        u32 width = GetMipSize(mips.width, request.level);
+        u32 height = GetMipSize(mips.height, request.level);
+        u32 rowCount = (height + blockHeight - 1) / blockHeight;
+        u32 rowSize = (u32)GetTextureLevelSize(mips.internalFormat, width, blockHeight);
+
+        u32 offset = Align(used, TEXTURE_STREAMING_CHUNK_ALIGNMENT);
+        u32 rows = offset < TEXTURE_STREAMING_FRAME_BUDGET
+            ? std::min(rowCount - request.row, (TEXTURE_STREAMING_FRAME_BUDGET - offset) / rowSize)
+            : 0;
+        if (rows == 0)
+            return false;
+
+        memcpy(mapped + offset, mips.levels[request.level] + (u64)request.row * rowSize, (u64)rows * rowSize);
+
+        TextureUploadChunk chunk;
+        chunk.request = &request;
+        chunk.level = request.level;
+        chunk.y = request.row * blockHeight;
+        chunk.height = std::min(rows * blockHeight, height - chunk.y);
+        chunk.offset = offset;
+        chunk.size = rows * rowSize;
+        ts.chunks.push_back(chunk);
+
+        used = offset + chunk.size;
+        request.row += rows;
+        if (request.row < rowCount)
+            return false;
+
+        request.row = 0;
+        if (request.level == request.firstLevel)
+            return true;
+        --request.level;
+    }
+}
+
+void UploadTextureChunk(const TextureUploadChunk& chunk)
+{
+    const TextureMips& mips = chunk.request->mips;
+    u32 width = GetMipSize(mips.width, chunk.level);
+    u32 level = chunk.level - chunk.request->firstLevel;
+    const void* offset = (const void*)(u64)chunk.offset;
+
+    glBindTexture(GL_TEXTURE_2D, chunk.request->handle);
+    if (IsCompressedTextureFormat(mips.internalFormat))
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, chunk.y, width, chunk.height, mips.internalFormat, chunk.size, offset);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, chunk.y, width, chunk.height, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+}
+
+// The textures that shared the previous image of a texture load their own files again
+void UnshareTexture(App* app, u32 texIdx)
+{
+    for (u32 i = 0; i < app->textures.size(); ++i)
+    {
+        Texture& tex = app->textures[i];
+        if (i != texIdx && tex.storageTexIdx == texIdx)
+        {
+            tex.storageTexIdx = i;
+            tex.state = TEXTURE_STATE_LOADING;
+            app->materialTexturesChanged = true;
+            RequestTextureReload(app, i);
+        }
+    }
+}
+
+void FinishSharedTextureRequest(App* app, const TextureStreamRequest& request)
+{
+    Texture& tex = app->textures[request.texIdx];
+    if (tex.handle != 0)
+        DeleteTextureLayer(tex.handle);
+    tex.handle = 0;
+    tex.memorySize = 0;
+    tex.levelCount = 0;
+    tex.residentMip = 0;
+    tex.storageTexIdx = request.storageTexIdx;
+    tex.state = TEXTURE_STATE_RESIDENT;
+    app->materialTexturesChanged = true;
+
+    LOG_MESSAGE(LOG_LEVEL_INFO, LOG_ASSETS, "Texture %s has the same image as %s, they share one texture", tex.filepath,
+                app->textures[request.storageTexIdx].filepath);
+}
+
+void FailTextureRequest(App* app, const TextureStreamRequest& request)
+{
+    LOG_MESSAGE(LOG_LEVEL_ERROR, LOG_ASSETS, "Could not open file %s", request.filepath);
+
+    // A texture that is reloaded keeps its current image
+    Texture& tex = app->textures[request.texIdx];
+    if (tex.handle == 0 && tex.storageTexIdx == request.texIdx)
+    {
+        tex.state = TEXTURE_STATE_MISSING;
+        app->materialTexturesChanged = true;
+    }
+}
+
+void FinishTextureRequest(App* app, TextureStreamRequest& request)
+{
+    TextureStreamer& ts = GlobalTextureStreamer;
+    Texture& tex = app->textures[request.texIdx];
+
+    // Draws read the handle when binding, so every material switches to the new one at once
+    bool replaced = tex.handle != 0;
+    if (replaced)
+        DeleteTextureLayer(tex.handle);
+    else
+        tex.lastUsedFrame = app->frame; // Not evicted before the frames that draw it say what they need
+    tex.handle = request.handle;
+    tex.memorySize = GetTextureMemorySize(request.mips, request.firstLevel);
+    tex.storageTexIdx = request.texIdx;
+    tex.state = TEXTURE_STATE_RESIDENT;
+    tex.format = request.mips.internalFormat;
+    tex.width = request.mips.width;
+    tex.height = request.mips.height;
+    tex.levelCount = request.mips.levelCount;
+    tex.residentMip = request.firstLevel;
+    request.handle = 0;
+    app->materialTexturesChanged = true;
+    ts.streamedTextures++;
+
+    f32 ms = (f32)((GetTimeNanoseconds() - request.requestTime) / 1000000.0);
+    if (request.reload)
+    {
+        LOG_MESSAGE(LOG_LEVEL_INFO, LOG_ASSETS, "Reloaded texture %s", tex.filepath);
+    }
+    else if (replaced)
+    {
+        LOG_MESSAGE(LOG_LEVEL_DEBUG, LOG_ASSETS, "Streamed texture %s back in from level %u in %.2f ms", tex.filepath, request.firstLevel, ms);
+    }
+    else
+    {
+        LOG_MESSAGE(LOG_LEVEL_DEBUG, LOG_ASSETS, "Streamed texture %s in %.2f ms", tex.filepath, ms);
+    }
+}
+
+void StreamTextures(App* app, bool wait)
+{
+    TextureStreamer& ts = GlobalTextureStreamer;
+    ts.frameBytes = 0;
+    if (ts.requests.empty())
+        return;
+
+    PROFILE_FUNCTION();
+
+    // The buffer is rewritten only once the GPU is done with it, the uploads of this frame wait
+    // for a later one otherwise
+    TextureUploadBuffer& buffer = ts.buffers[ts.nextBuffer];
+    if (buffer.fence)
+    {
+        GLenum status = glClientWaitSync(buffer.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? TEXTURE_STREAMING_FLUSH_TIMEOUT : 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+            return;
+        glDeleteSync(buffer.fence);
+        buffer.fence = 0;
+    }
+
+    u8* mapped = NULL;
+    u32 used = 0;
+    ts.chunks.clear();
+    for (u32 i = 0; i < ts.requests.size();)
+    {
+        TextureStreamRequest* request = ts.requests[i];
+        if (wait)
+            WaitForCounter(&request->counter);
+        if (request->counter.value > 0)
+        {
+            ++i;
+            continue;
+        }
+
+        if (request->contentChanged)
+        {
+            UnshareTexture(app, request->texIdx);
+            request->contentChanged = false;
+        }
+
+        // Requests that end without uploading anything
+        bool shared = request->storageTexIdx != request->texIdx;
+        bool failed = !shared && request->mips.levelCount == 0;
+        if (request->cancelled || shared || failed)
+        {
+            if (!request->cancelled && shared)
+                FinishSharedTextureRequest(app, *request);
+            if (!request->cancelled && failed)
+                FailTextureRequest(app, *request);
+            DeleteTextureRequest(request);
+            ts.requests.erase(ts.requests.begin() + i);
+            continue;
+        }
+
+        if (request->handle == 0)
+        {
+            // The file of a reloaded texture may have fewer levels now
+            request->firstLevel = std::min(request->firstLevel, request->mips.levelCount - 1);
+            request->handle = CreateTexture2DStorage(request->mips, request->firstLevel);
+            request->level = request->mips.levelCount - 1;
+            request->row = 0;
+        }
+
+        if (!mapped)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.handle);
+            mapped = (u8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, TEXTURE_STREAMING_FRAME_BUDGET,
+                                           GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (!mapped)
+                break;
+        }
+
+        request->copied = CopyTextureRows(ts, *request, mapped, used);
+        if (!request->copied)
+            break; // The buffer is full
+        ++i;
+    }
+
+    if (!mapped)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    // Sourcing the uploads from a buffer makes them asynchronous: the driver copies the rows to
+    // the textures while the GPU works through the frame
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    for (const TextureUploadChunk& chunk : ts.chunks)
+        UploadTextureChunk(chunk);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ts.nextBuffer = (ts.nextBuffer + 1) % TEXTURE_STREAMING_BUFFER_COUNT;
+    ts.frameBytes = used;
+    ts.streamedBytes += used;
+
+    for (u32 i = 0; i < ts.requests.size();)
+    {
+        TextureStreamRequest* request = ts.requests[i];
+        if (!request->copied)
+        {
+            ++i;
+            continue;
+        }
+
+        FinishTextureRequest(app, *request);
+        DeleteTextureRequest(request);
+        ts.requests.erase(ts.requests.begin() + i);
+    }
+}
+
+void UpdateTextureStreaming(App* app)
+{
+    StreamTextures(app, false);
+}
+
+void FlushTextureStreaming(App* app)
+{
+    PROFILE_FUNCTION();
+    while (!GlobalTextureStreamer.requests.empty())
+        StreamTextures(app, true);
+}
+
+void GuiTextureStreaming()
+{
+    TextureStreamer& ts = GlobalTextureStreamer;
+    ImGui::Text("Pending textures: %u", (u32)ts.requests.size());
+    ImGui::Text("Uploaded this frame: %.2f of %.2f MB", ts.frameBytes / (1024.0f * 1024.0f),
+                TEXTURE_STREAMING_FRAME_BUDGET / (1024.0f * 1024.0f));
+    ImGui::Text("Streamed: %u textures, %.2f MB", ts.streamedTextures, ts.streamedBytes / (1024.0f * 1024.0f));
+}
@@ -0,0 +1,60 @@
+//
+// texture_streaming.h : Asynchronous loading of the textures of models. Requesting a texture
+// adds it to the texture list right away, without a handle, and prepares its mips (see
+// texture_cache.h) on the job system. Once a frame the GL thread copies the prepared levels into
+// a ring of pixel buffer objects, up to a byte budget, and uploads them from there; a texture
+// gets its handle once its whole chain is in. Until then it is drawn with the white placeholder,
+// or the magenta one if its image can't be read (see GetTextureHandle).
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define TEXTURE_STREAMING_BUFFER_COUNT 3                 // Frames of uploads in flight
+#define TEXTURE_STREAMING_FRAME_BUDGET (8 * 1024 * 1024) // Bytes uploaded per frame, the size of each buffer
+
+/**
+ * Creates the pixel buffer objects. Must be called with the OpenGL context current.
+ */
+void InitTextureStreaming();
+
+/**
+ * Waits for the textures being prepared and drops the ones that are not resident yet.
+ */
+void ShutdownTextureStreaming();
+
+/**
+ * Returns the index of the texture of an image file, which is resident if it was already loaded
+ * and otherwise starts streaming in.
+ */
+u32 RequestTexture2D(App* app, const char* filepath, TextureUsage usage = TEXTURE_USAGE_COLOR);
+
+/**
+ * Streams in a new version of a texture. The current one is drawn until it is replaced.
+ */
+void RequestTextureReload(App* app, u32 texIdx);
+
+/**
+ * Streams a texture in again from firstLevel down, to bring back the levels evicted by the
+ * residency (see texture_residency.h). The current storage is drawn until it is replaced.
+ */
+void RequestTextureMips(App* app, u32 texIdx, u32 firstLevel);
+
+/**
+ * Largest level that the pending request of a texture streams in, UINT32_MAX if there is none.
+ * hasStorage tells if the request already took its layer of a texture page.
+ */
+u32 GetPendingTextureMip(u32 texIdx, bool* hasStorage);
+
+/**
+ * Uploads the prepared textures, without waiting for the GPU nor for the workers.
+ */
+void UpdateTextureStreaming(App* app);
+
+/**
+ * Waits until every requested texture is resident, for runs that must not see placeholders.
+ */
+void FlushTextureStreaming(App* app);
+
+void GuiTextureStreaming();
@@ -0,0 +1,235 @@
+//
+// vertex_compression.cpp : Implementation of the vertex compression declared in
+// vertex_compression.h.
+//
+// Compressed layout (20 bytes, 12 without texture coordinates):
+//   position   unorm16 x3 + padding      8 bytes, mapped back with Submesh::positionScale/Offset
+//   normal     snorm 10_10_10_2          4 bytes, w unused
+//   texCoord   half x2                   4 bytes (float x2 beyond VERTEX_HALF_TEXCOORD_LIMIT)
+//   tangent    snorm 10_10_10_2          4 bytes, w is the sign of the bitangent
+//
+// The shaders normalize the interpolated normals, so the normals and tangents are read as they
+// are, without decoding. The positions of all the submeshes of a mesh share one quantization
+// grid, so the edges between submeshes don't crack.
+//
+
+#include "vertex_compression.h"
+#include "profiler.h"
+#include "job_system.h"
+#include <glm/gtc/packing.hpp>
+
+#define COMPRESSED_POSITION_SIZE 8
+#define COMPRESSED_PACKED_SIZE   4
+
+struct VertexCompression
+{
+    Mesh*             mesh;
+    std::vector<vec3> boundsMin; // Of every submesh, then of the whole mesh in the first one
+    std::vector<vec3> boundsMax;
+};
+
+// Attributes of the float layout produced by the importers, NULL when missing
+const VertexBufferAttribute* FindFloatAttribute(const VertexBufferLayout& layout, u8 location)
+{
+    for (const VertexBufferAttribute& attribute : layout.attributes)
+        if (attribute.location == location && attribute.type == GL_FLOAT && attribute.stride == 0)
+            return &attribute;
+    return NULL;
+}
+
+bool IsSubmeshCompressible(const Submesh& submesh)
+{
+    const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+    for (const VertexBufferAttribute& attribute : layout.attributes)
+        if (attribute.type != GL_FLOAT || attribute.stride != 0)
+            return false;
+    return layout.stride > 0 && FindFloatAttribute(layout, 0) && FindFloatAttribute(layout, 1);
+}
+
+const f32* GetFloatAttribute(const Submesh& submesh, const VertexBufferAttribute* attribute, u32 vertex)
+{
+    return (const f32*)(submesh.vertices.data() + (size_t)vertex * submesh.vertexBufferLayout.stride + attribute->offset);
+}
+
+void ComputeSubmeshBoundsRange(void* data, u32 begin, u32 end)
+{
+    VertexCompression* compression = (VertexCompression*)data;
+    for (u32 i = begin; i < end; ++i)
+    {
+        const Submesh& submesh = compression->mesh->submeshes[i];
+        vec3 boundsMin = vec3(FLT_MAX);
+        vec3 boundsMax = vec3(-FLT_MAX);
+        if (IsSubmeshCompressible(submesh))
+        {
+            const VertexBufferAttribute* position = FindFloatAttribute(submesh.vertexBufferLayout, 0);
+            u32 vertexCount = (u32)(submesh.vertices.size() / submesh.vertexBufferLayout.stride);
+            for (u32 v = 0; v < vertexCount; ++v)
+            {
+                vec3 p = glm::make_vec3(GetFloatAttribute(submesh, position, v));
+                boundsMin = glm::min(boundsMin, p);
+                boundsMax = glm::max(boundsMax, p);
+            }
+        }
+        compression->boundsMin[i] = boundsMin;
+        compression->boundsMax[i] = boundsMax;
+    }
+}
+
+void CompressSubmeshRange(void* data, u32 begin, u32 end)
+{
+    VertexCompression* compression = (VertexCompression*)data;
+    vec3 boundsMin = compression->boundsMin[0];
+    vec3 extent = compression->boundsMax[0] - boundsMin;
+    vec3 invExtent = vec3(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f, extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+    for (u32 i = begin; i < end; ++i)
+    {
+        Submesh& submesh = compression->mesh->submeshes[i];
+        if (!IsSubmeshCompressible(submesh))
+            continue;
+
+        const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+        const VertexBufferAttribute* position = FindFloatAttribute(layout, 0);
+        const VertexBufferAttribute* normal = FindFloatAttribute(layout, 1);
+        const VertexBufferAttribute* texCoord = FindFloatAttribute(layout, 2);
+        const VertexBufferAttribute* tangent = FindFloatAttribute(layout, 3);
+        const VertexBufferAttribute* bitangent = FindFloatAttribute(layout, 4);
+        u32 vertexCount = (u32)(submesh.vertices.size() / layout.stride);
+
+        bool halfTexCoords = true;
+        for (u32 v = 0; texCoord && halfTexCoords && v < vertexCount; ++v)
+        {
+            const f32* uv = GetFloatAttribute(submesh, texCoord, v);
+            halfTexCoords = fabsf(uv[0]) <= VERTEX_HALF_TEXCOORD_LIMIT && fabsf(uv[1]) <= VERTEX_HALF_TEXCOORD_LIMIT;
+        }
+
+        VertexBufferLayout compressedLayout = {};
+        VertexBufferAttribute compressedPosition = { 0, 3, 0 };
+        compressedPosition.type = GL_UNSIGNED_SHORT;
+        compressedPosition.normalized = true;
+        compressedLayout.attributes.push_back(compressedPosition);
+        compressedLayout.stride = COMPRESSED_POSITION_SIZE;
+
+        VertexBufferAttribute compressedNormal = { 1, 4, compressedLayout.stride };
+        compressedNormal.type = GL_INT_2_10_10_10_REV;
+        compressedNormal.normalized = true;
+        compressedLayout.attributes.push_back(compressedNormal);
+        compressedLayout.stride += COMPRESSED_PACKED_SIZE;
+
+        u32 texCoordOffset = compressedLayout.stride;
+        if (texCoord)
+        {
+            VertexBufferAttribute compressedTexCoord = { 2, 2, compressedLayout.stride };
+            compressedTexCoord.type = halfTexCoords ? GL_HALF_FLOAT : GL_FLOAT;
+            compressedLayout.attributes.push_back(compressedTexCoord);
+            compressedLayout.stride += halfTexCoords ? COMPRESSED_PACKED_SIZE : 2 * sizeof(f32);
+        }
+
+        u32 tangentOffset = compressedLayout.stride;
+        if (tangent)
+        {
+            VertexBufferAttribute compressedTangent = { 3, 4, compressedLayout.stride };
+            compressedTangent.type = GL_INT_2_10_10_10_REV;
+            compressedTangent.normalized = true;
+            compressedLayout.attributes.push_back(compressedTangent);
+            compressedLayout.stride += COMPRESSED_PACKED_SIZE;
+        }
+
+        std::vector<u8> compressed((size_t)vertexCount * compressedLayout.stride);
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            u8* dst = compressed.data() + (size_t)v * compressedLayout.stride;
+
+            vec3 p = glm::make_vec3(GetFloatAttribute(submesh, position, v));
+            u64 packedPosition = glm::packUnorm4x16(vec4((p - boundsMin) * invExtent, 0.0f));
+            memcpy(dst, &packedPosition, sizeof(packedPosition));
+
+            vec3 n = glm::make_vec3(GetFloatAttribute(submesh, normal, v));
+            u32 packedNormal = glm::packSnorm3x10_1x2(vec4(n, 0.0f));
+            memcpy(dst + COMPRESSED_POSITION_SIZE, &packedNormal, sizeof(packedNormal));
+
+            if (texCoord)
+            {
+                const f32* uv = GetFloatAttribute(submesh, texCoord, v);
+                if (halfTexCoords)
+                {
+                    u32 packedTexCoord = glm::packHalf2x16(vec2(uv[0], uv[1]));
+                    memcpy(dst + texCoordOffset, &packedTexCoord, sizeof(packedTexCoord));
+                }
+                else
+                {
+                    memcpy(dst + texCoordOffset, uv, 2 * sizeof(f32));
+                }
+            }
+
+            if (tangent)
+            {
+                vec3 t = glm::make_vec3(GetFloatAttribute(submesh, tangent, v));
+                f32 sign = 1.0f;
+                if (bitangent && glm::dot(glm::cross(n, t), glm::make_vec3(GetFloatAttribute(submesh, bitangent, v))) < 0.0f)
+                    sign = -1.0f;
+                u32 packedTangent = glm::packSnorm3x10_1x2(vec4(t, sign));
+                memcpy(dst + tangentOffset, &packedTangent, sizeof(packedTangent));
+            }
+        }
+
+        submesh.vertices.swap(compressed);
+        submesh.vertexBufferLayout = compressedLayout;
+        submesh.positionScale = extent;
+        submesh.positionOffset = boundsMin;
+        submesh.indexType = vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    }
+}
+
+u64 CompressMeshVertices(Mesh& mesh)
+{
+    PROFILE_FUNCTION();
+    u32 submeshCount = (u32)mesh.submeshes.size();
+    if (submeshCount == 0)
+        return 0;
+
+    u64 originalSize = 0;
+    for (const Submesh& submesh : mesh.submeshes)
+        originalSize += submesh.vertices.size();
+
+    VertexCompression compression = {};
+    compression.mesh = &mesh;
+    compression.boundsMin.resize(submeshCount);
+    compression.boundsMax.resize(submeshCount);
+    ParallelFor(submeshCount, 1, ComputeSubmeshBoundsRange, &compression);
+    for (u32 i = 1; i < submeshCount; ++i)
+    {
+        compression.boundsMin[0] = glm::min(compression.boundsMin[0], compression.boundsMin[i]);
+        compression.boundsMax[0] = glm::max(compression.boundsMax[0], compression.boundsMax[i]);
+    }
+    ParallelFor(submeshCount, 1, CompressSubmeshRange, &compression);
+
+    u64 compressedSize = 0;
+    for (const Submesh& submesh : mesh.submeshes)
+        compressedSize += submesh.vertices.size();
+    return originalSize - compressedSize;
+}
+
+u32 GetIndexSize(GLenum indexType)
+{
+    switch (indexType)
+    {
+    case GL_UNSIGNED_BYTE: return 1;
+    case GL_UNSIGNED_SHORT: return 2;
+    default: return 4;
+    }
+}
+
+void PackSubmeshIndices(const Submesh& submesh, void* dst)
+{
+    if (submesh.indexType == GL_UNSIGNED_SHORT)
+    {
+        u16* indices = (u16*)dst;
+        for (u32 index : submesh.indices)
+            *indices++ = (u16)index;
+    }
+    else if (!submesh.indices.empty())
+    {
+        memcpy(dst, submesh.indices.data(), submesh.indices.size() * sizeof(u32));
+    }
+}
@@ -0,0 +1,29 @@
+//
+// vertex_compression.h : Compression of the imported vertices before they are uploaded. The
+// importers produce 32-bit float vertices (56 bytes with tangent space), which are packed into
+// 20 bytes: positions as unorm16 quantized against the bounds of the mesh, normals and tangents
+// as snorm 10_10_10_2, and texture coordinates as half floats. Submeshes with up to 65536
+// vertices are drawn with 16-bit indices.
+//
+
+#pragma once
+
+#include "engine.h"
+
+// Texture coordinates beyond this stay as floats, half floats lose too much precision there
+#define VERTEX_HALF_TEXCOORD_LIMIT 4.0f
+
+/**
+ * Replaces the float vertices of every submesh (in the layout of FillAssimpSubmesh) with the
+ * compressed ones, and sets their index types and the position dequantization. The bitangent
+ * is dropped: the tangent keeps its sign in w, so bitangent = w * cross(normal, tangent).
+ * Returns the bytes saved.
+ */
+u64 CompressMeshVertices(Mesh& mesh);
+
+u32 GetIndexSize(GLenum indexType);
+
+/**
+ * Writes the indices of the submesh with its index type, GetIndexSize(indexType) bytes each.
+ */
+void PackSubmeshIndices(const Submesh& submesh, void* dst);
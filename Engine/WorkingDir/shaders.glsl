@@ -45,10 +45,22 @@ layout(location = 2) in vec2 aTexCoord;
 //layout(location = 3) in vec3 aTangent;
 //layout(location = 4) in vec3 aBitangent;
 
-layout(binding = 1, std140) uniform LocalParams
+// Quantized positions are mapped back to model space with these (Submesh::positionScale/Offset)
+layout(location = 20) uniform vec3 uPositionScale;
+layout(location = 21) uniform vec3 uPositionOffset;
+
+// Entity and material of the draw, a record of the draw buffer per instance (see DrawScene)
+layout(location = 5) in uvec2 aDraw;
+
+struct EntityParams
+{
+	mat4 worldMatrix;
+	mat4 worldViewProjectionMatrix;
+};
+
+layout(binding = 5, std430) readonly buffer Entities
 {
-	mat4 uWorldMatrix;
-	mat4 uWorldViewProjectionMatrix;
+	EntityParams 	uEntities[];
 };
 
 layout(binding = 2, std140) uniform ClippingPlane
@@ -60,17 +72,23 @@ layout(binding = 2, std140) uniform ClippingPlane
 out vec2 vTexCoord;
 out vec3 vPosition;	// In worldspace
 out vec3 vNormal;	// In worldspace
+flat out uint vMaterialIndex;
 
 void main()
 {
+	vec3 position = aPosition * uPositionScale + uPositionOffset;
+	mat4 uWorldMatrix = uEntities[aDraw.x].worldMatrix;
+	mat4 uWorldViewProjectionMatrix = uEntities[aDraw.x].worldViewProjectionMatrix;
+	vMaterialIndex = aDraw.y;
+
 	vTexCoord = aTexCoord;
 
-	vPosition = vec3(uWorldMatrix * vec4(aPosition, 1.0));
+	vPosition = vec3(uWorldMatrix * vec4(position, 1.0));
 	vNormal   = vec3(uWorldMatrix * vec4(aNormal, 0.0));
 
-	vec4 clipDistanceDisplacement = vec4(0.0, 0.0, 0.0, length(camView * vec4(aPosition, 1.0)) / 100);
+	vec4 clipDistanceDisplacement = vec4(0.0, 0.0, 0.0, length(camView * vec4(position, 1.0)) / 100);
 	gl_ClipDistance[0] = dot(vec4(vPosition, 1.0), clippingPlane + clipDistanceDisplacement);
-	gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
+	gl_Position = uWorldViewProjectionMatrix * vec4(position, 1.0);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
@@ -78,8 +96,37 @@ void main()
 in vec2 vTexCoord;
 in vec3 vPosition;
 in vec3 vNormal;
+flat in uint vMaterialIndex;
 
-uniform sampler2D uTexture;
+// Materials live in a storage buffer indexed per draw, their textures in the layers of texture
+// pages (see texture_pages.h). The draws of a batch share the page of their albedo, bound to the
+// unit that DrawScene passes
+const uint TEXTURE_PAGE_UNITS = 16u;
+
+struct Material
+{
+	vec3  albedo;
+	float smoothness;
+	vec3  emissive;
+	uvec2 albedoTexture;	// Page and layer
+	uvec2 emissiveTexture;
+	uvec2 specularTexture;
+	uvec2 normalsTexture;
+	uvec2 bumpTexture;
+};
+
+layout(binding = 4, std430) readonly buffer Materials
+{
+	Material 		uMaterials[];
+};
+
+layout(location = 22) uniform uint uAlbedoPageUnit;
+layout(binding = 0) uniform sampler2DArray uTexturePages[TEXTURE_PAGE_UNITS];
+
+vec4 SampleMaterialTexture(uvec2 pageLayer, uint unit, vec2 texCoord)
+{
+	return texture(uTexturePages[unit], vec3(texCoord, float(pageLayer.y)));
+}
 
 layout(location = 0) out vec4 oColor;
 layout(location = 1) out vec4 oPosition;
@@ -99,7 +146,7 @@ float LinearizeDepth(float depth)
 void main()
 {
 	// Albedo Texture
-	oColor = texture(uTexture, vTexCoord);
+	oColor = SampleMaterialTexture(uMaterials[vMaterialIndex].albedoTexture, uAlbedoPageUnit, vTexCoord);
 	// Position texture
 	oPosition = vec4(vPosition, 1.0);
 	// Normal texture
@@ -116,7 +163,7 @@ void main()
 
 struct Light
 {
-    unsigned int type;
+    uint         type;
     vec3         color;
     vec3         direction;
     vec3         position;
@@ -134,8 +181,7 @@ layout(location = 1) in vec2 aTexCoord;
 layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 			uCameraPosition;
-	unsigned int 	uLightCount;
-	Light 			uLight[16];
+	uint 			uLightCount;
 };
 
 out vec2 vTexCoord;
@@ -159,8 +205,13 @@ layout(location = 0) out vec4 oFinal;
 layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 			uCameraPosition;
-	unsigned int 	uLightCount;
-	Light 			uLight[16];
+	uint 			uLightCount;
+};
+
+// Lights live in a storage buffer so the count is only limited by memory
+layout(binding = 3, std430) readonly buffer Lights
+{
+	Light 			uLight[];
 };
 
 vec3 ComputeDirectionalLight(vec3 lightDir, vec3 color, vec3 Normal)
@@ -230,11 +281,18 @@ void main()
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
 layout (location = 0) in vec3 aPosition;
+
+// Quantized positions are mapped back to model space with these (Submesh::positionScale/Offset)
+layout(location = 20) uniform vec3 uPositionScale;
+layout(location = 21) uniform vec3 uPositionOffset;
+
 uniform mat4 worldViewProjection;
 
 void main()
 {
-	gl_Position = worldViewProjection * vec4(aPosition, 1.0);
+	vec3 position = aPosition * uPositionScale + uPositionOffset;
+
+	gl_Position = worldViewProjection * vec4(position, 1.0);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
@@ -259,7 +317,7 @@ void main()
 
 struct Light
 {
-    unsigned int type;
+    uint         type;
     vec3         color;
     vec3         direction;
     vec3         position;
@@ -275,17 +333,28 @@ layout(location = 2) in vec2 aTexCoord;
 //layout(location = 3) in vec3 aTangent;
 //layout(location = 4) in vec3 aBitangent;
 
+// Quantized positions are mapped back to model space with these (Submesh::positionScale/Offset)
+layout(location = 20) uniform vec3 uPositionScale;
+layout(location = 21) uniform vec3 uPositionOffset;
+
 layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 			uCameraPosition;
-	unsigned int 	uLightCount;
-	Light 			uLight[16];
+	uint 			uLightCount;
+};
+
+// Entity and material of the draw, a record of the draw buffer per instance (see DrawScene)
+layout(location = 5) in uvec2 aDraw;
+
+struct EntityParams
+{
+	mat4 worldMatrix;
+	mat4 worldViewProjectionMatrix;
 };
 
-layout(binding = 1, std140) uniform LocalParams
+layout(binding = 5, std430) readonly buffer Entities
 {
-	mat4 uWorldMatrix;
-	mat4 uWorldViewProjectionMatrix;
+	EntityParams 	uEntities[];
 };
 
 layout(binding = 2, std140) uniform ClippingPlane
@@ -297,17 +366,23 @@ layout(binding = 2, std140) uniform ClippingPlane
 out vec2 vTexCoord;
 out vec3 vPosition;	// In worldspace
 out vec3 vNormal;	// In worldspace
+flat out uint vMaterialIndex;
 
 void main()
 {
+	vec3 position = aPosition * uPositionScale + uPositionOffset;
+	mat4 uWorldMatrix = uEntities[aDraw.x].worldMatrix;
+	mat4 uWorldViewProjectionMatrix = uEntities[aDraw.x].worldViewProjectionMatrix;
+	vMaterialIndex = aDraw.y;
+
 	vTexCoord = aTexCoord;
 
-	vPosition = vec3(uWorldMatrix * vec4(aPosition, 1.0));
+	vPosition = vec3(uWorldMatrix * vec4(position, 1.0));
 	vNormal   = vec3(uWorldMatrix * vec4(aNormal, 0.0));	
 
-	vec4 clipDistanceDisplacement = vec4(0.0, 0.0, 0.0, length(camView * vec4(aPosition, 1.0)) / 100);
+	vec4 clipDistanceDisplacement = vec4(0.0, 0.0, 0.0, length(camView * vec4(position, 1.0)) / 100);
 	gl_ClipDistance[0] = dot(vec4(vPosition, 1.0), clippingPlane + clipDistanceDisplacement);
-	gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
+	gl_Position = uWorldViewProjectionMatrix * vec4(position, 1.0);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
@@ -315,14 +390,48 @@ void main()
 in vec2 vTexCoord;
 in vec3 vPosition;
 in vec3 vNormal;
+flat in uint vMaterialIndex;
 
-uniform sampler2D uTexture;
+// Materials live in a storage buffer indexed per draw, their textures in the layers of texture
+// pages (see texture_pages.h). The draws of a batch share the page of their albedo, bound to the
+// unit that DrawScene passes
+const uint TEXTURE_PAGE_UNITS = 16u;
+
+struct Material
+{
+	vec3  albedo;
+	float smoothness;
+	vec3  emissive;
+	uvec2 albedoTexture;	// Page and layer
+	uvec2 emissiveTexture;
+	uvec2 specularTexture;
+	uvec2 normalsTexture;
+	uvec2 bumpTexture;
+};
+
+layout(binding = 4, std430) readonly buffer Materials
+{
+	Material 		uMaterials[];
+};
+
+layout(location = 22) uniform uint uAlbedoPageUnit;
+layout(binding = 0) uniform sampler2DArray uTexturePages[TEXTURE_PAGE_UNITS];
+
+vec4 SampleMaterialTexture(uvec2 pageLayer, uint unit, vec2 texCoord)
+{
+	return texture(uTexturePages[unit], vec3(texCoord, float(pageLayer.y)));
+}
 
 layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 			uCameraPosition;
-	unsigned int 	uLightCount;
-	Light 			uLight[16];
+	uint 			uLightCount;
+};
+
+// Lights live in a storage buffer so the count is only limited by memory
+layout(binding = 3, std430) readonly buffer Lights
+{
+	Light 			uLight[];
 };
 
 layout(location = 0) out vec4 oColor;
@@ -348,7 +457,7 @@ vec3 ComputePointLight(vec3 lightDir, Light light, vec3 Normal, float dist)
 void main()
 {
 	// finalColor = texture color
-	vec4 finalColor = texture(uTexture, vTexCoord);
+	vec4 finalColor = SampleMaterialTexture(uMaterials[vMaterialIndex].albedoTexture, uAlbedoPageUnit, vTexCoord);
 
 	// lightColor = the sum of all light, if there aren't any
 	vec3 lightColor = vec3(0.0f);
@@ -426,6 +535,10 @@ void main()
 layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec3 aNormal;
 
+// Quantized positions are mapped back to model space with these (Submesh::positionScale/Offset)
+layout(location = 20) uniform vec3 uPositionScale;
+layout(location = 21) uniform vec3 uPositionOffset;
+
 uniform mat4 projectionMatrix;
 uniform mat4 worldViewMatrix;
 uniform mat4 uWorldMatrix;
@@ -440,12 +553,14 @@ const float tiling = 2;
 
 void main(void)
 {
-	vPosition = vec3(uWorldMatrix * vec4(aPosition, 1.0));
+	vec3 position = aPosition * uPositionScale + uPositionOffset;
+
+	vPosition = vec3(uWorldMatrix * vec4(position, 1.0));
 	vNormal   = vec3(uWorldMatrix * vec4(aNormal, 0.0));
 
-	clipSpace = projectionMatrix * worldViewMatrix * vec4(aPosition, 1.0);
+	clipSpace = projectionMatrix * worldViewMatrix * vec4(position, 1.0);
 	gl_Position = clipSpace;
-	textureCoords = vec2(aPosition.x / 2.0 + 0.5, aPosition.z / 2.0 + 0.5);
+	textureCoords = vec2(position.x / 2.0 + 0.5, position.z / 2.0 + 0.5);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////